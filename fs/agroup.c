@@ -0,0 +1,481 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trace.h"
+#include "agroup.h"
+
+
+
+/* the threads get their group in order of arrival */
+static __thread int ag_thread_slot = -1;
+static int ag_next_slot = 0;
+
+
+
+static int ag_init( agroup_t *ag, unsigned char *bm, uint64_t first,
+                    uint64_t bits, uint32_t flags){
+    if( pthread_mutex_init( &ag->ag_mutex, NULL) != 0){
+        TRACE_ERR("mutex init has failed");
+        return( -1);
+    }
+
+    ag->ag_first = first;
+    ag->ag_bits = bits;
+    ag->ag_summary = bm_summary_alloc( bm + first / 8, bits);
+    if( ag->ag_summary == NULL){
+        goto exit0;
+    }
+
+    if( ( flags & AGMAP_EXTENTS) != 0){
+        ag->ag_falloc = falloc_alloc( ag->ag_summary);
+        if( ag->ag_falloc == NULL){
+            goto exit1;
+        }
+    }
+
+    ag->ag_free = bm_summary_free_bits( ag->ag_summary);
+    return( 0);
+
+exit1:
+    bm_summary_free( ag->ag_summary);
+    ag->ag_summary = NULL;
+exit0:
+    pthread_mutex_destroy( &ag->ag_mutex);
+    return( -1);
+}
+
+
+
+static void ag_destroy( agroup_t *ag){
+    falloc_free( ag->ag_falloc);
+    bm_summary_free( ag->ag_summary);
+    pthread_mutex_destroy( &ag->ag_mutex);
+}
+
+
+
+agmap_t *agmap_alloc( unsigned char *bm, uint64_t total_bits,
+                      uint64_t group_bits, uint32_t flags){
+    agmap_t *am;
+    uint64_t first;
+    int i;
+
+    if( total_bits == 0 || group_bits == 0 || ( group_bits % 64) != 0){
+        TRACE_ERR("Invalid allocation groups, bits=%lu, group=%lu",
+                  total_bits, group_bits);
+        return( NULL);
+    }
+
+    am = malloc( sizeof( agmap_t));
+    if( am == NULL){
+        TRACE_ERR("Error in malloc()");
+        return( NULL);
+    }
+
+    memset( (void *) am, 0, sizeof( agmap_t));
+    am->am_map = bm;
+    am->am_total_bits = total_bits;
+    am->am_group_bits = group_bits;
+    am->am_flags = flags;
+    am->am_groups_num = ( total_bits + group_bits - 1) / group_bits;
+    am->am_groups = calloc( am->am_groups_num, sizeof( agroup_t));
+    if( am->am_groups == NULL){
+        TRACE_ERR("Error in calloc()");
+        free( am);
+        return( NULL);
+    }
+
+    for( i = 0; i < am->am_groups_num; i++){
+        first = (uint64_t) i * group_bits;
+        if( ag_init( &am->am_groups[i], bm, first,
+                     min( group_bits, total_bits - first), flags) != 0){
+            TRACE_ERR("Could not build allocation group %d", i);
+            am->am_groups_num = i;
+            agmap_free( am);
+            return( NULL);
+        }
+    }
+
+    am->am_avail = agmap_free_bits( am);
+    return( am);
+}
+
+
+
+void agmap_free( agmap_t *am){
+    int i;
+
+    if( am == NULL){
+        return;
+    }
+
+    for( i = 0; i < am->am_groups_num; i++){
+        ag_destroy( &am->am_groups[i]);
+    }
+
+    free( am->am_groups);
+    free( am);
+}
+
+
+
+int agmap_group( agmap_t *am, uint64_t addr){
+    if( addr >= am->am_total_bits){
+        return( 0);
+    }
+
+    return( (int) ( addr / am->am_group_bits));
+}
+
+
+
+int agmap_thread_group( agmap_t *am){
+    if( ag_thread_slot < 0){
+        ag_thread_slot = __sync_fetch_and_add( &ag_next_slot, 1);
+    }
+
+    return( ag_thread_slot % am->am_groups_num);
+}
+
+
+
+/* fit len bits in the group as close as possible to the goal, searching
+ * outward in rings growing AG_NEAR_STEP times each time, the first fit
+ * after the goal or the last one before it. ag_mutex is held */
+static int ag_find_near( agroup_t *ag, uint64_t goal, uint64_t len,
+                         uint64_t *addr){
+    uint64_t w, lo, hi, fwd, back, end;
+    int f, b;
+
+    for( w = AG_NEAR_WINDOW; ; w *= AG_NEAR_STEP){
+        lo = ( goal > w) ? goal - w : 0;
+        hi = min( goal + w, ag->ag_bits);
+
+        f = bm_summary_find( ag->ag_summary, goal, hi - goal, len, &fwd);
+
+        /* a fit before the goal may still cross it */
+        end = min( goal + len - 1, ag->ag_bits);
+        b = ( goal > lo) ?
+            bm_summary_find_last( ag->ag_summary, lo, end - lo, len,
+                                  &back) : -1;
+
+        if( b == 0 && ( f != 0 || goal - back < fwd - goal)){
+            *addr = back;
+            return( 0);
+        }
+
+        if( f == 0){
+            *addr = fwd;
+            return( 0);
+        }
+
+        if( lo == 0 && hi == ag->ag_bits){
+            return( -1);
+        }
+    }
+}
+
+
+
+/* allocate in a group, goal is relative to the group or FALLOC_NO_GOAL.
+ * ag_mutex is held */
+static int ag_get( agroup_t *ag, uint64_t goal, uint64_t len,
+                   uint64_t *addr){
+    if( ag->ag_falloc != NULL){
+        return( falloc_get( ag->ag_falloc, goal, len, addr));
+    }
+
+    if( goal == FALLOC_NO_GOAL){
+        goal = 0;
+    }
+
+    if( ag_find_near( ag, goal, len, addr) != 0){
+        return( -1);
+    }
+
+    return( bm_summary_set_extent( ag->ag_summary, *addr, len, SETBIT));
+}
+
+
+
+/* the free bits not reserved, taken and given back without locks */
+static int am_avail_take( agmap_t *am, uint64_t len){
+    uint64_t avail = __atomic_load_n( &am->am_avail, __ATOMIC_RELAXED);
+
+    do{
+        if( avail < len){
+            return( -1);
+        }
+    }while( !__atomic_compare_exchange_n( &am->am_avail, &avail, avail - len,
+                                          0, __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+
+    return( 0);
+}
+
+
+
+static void am_avail_give( agmap_t *am, uint64_t len){
+    __atomic_fetch_add( &am->am_avail, len, __ATOMIC_RELAXED);
+}
+
+
+
+static int am_get( agmap_t *am, int group, uint64_t goal, uint64_t len,
+                   uint64_t *addr){
+    agroup_t *ag;
+    uint64_t rel_goal;
+    int i, g, step, rc;
+
+    *addr = 0;
+    if( len == 0 || len > am->am_group_bits){
+        return( -1);
+    }
+
+    if( goal != FALLOC_NO_GOAL && goal >= am->am_total_bits){
+        goal = FALLOC_NO_GOAL;
+    }
+
+    if( group < 0 || group >= am->am_groups_num){
+        group = ( goal != FALLOC_NO_GOAL) ? agmap_group( am, goal) :
+                                            agmap_thread_group( am);
+    }
+
+    /* the groups in order of distance to the first one, alternating the
+     * next and the previous ones */
+    for( i = 0; i < 2 * am->am_groups_num; i++){
+        step = ( i + 1) / 2;
+        g = ( i % 2) ? group + step : group - step;
+        if( g < 0 || g >= am->am_groups_num){
+            continue;
+        }
+
+        ag = &am->am_groups[g];
+        if( ag->ag_free < len){
+            continue;
+        }
+
+        /* a goal out of the group is taken to its closest edge, so the
+         * search keeps going outward */
+        rel_goal = FALLOC_NO_GOAL;
+        if( goal != FALLOC_NO_GOAL){
+            if( goal < ag->ag_first){
+                rel_goal = 0;
+            }else if( goal >= ag->ag_first + ag->ag_bits){
+                rel_goal = ag->ag_bits - 1;
+            }else{
+                rel_goal = goal - ag->ag_first;
+            }
+        }
+
+        pthread_mutex_lock( &ag->ag_mutex);
+        rc = ag_get( ag, rel_goal, len, addr);
+        if( rc == 0){
+            ag->ag_free -= len;
+        }
+        pthread_mutex_unlock( &ag->ag_mutex);
+
+        if( rc == 0){
+            *addr += ag->ag_first;
+            return( 0);
+        }
+    }
+
+    return( -1);
+}
+
+
+
+int agmap_get( agmap_t *am, int group, uint64_t goal, uint64_t len,
+               uint64_t *addr){
+    *addr = 0;
+    if( am_avail_take( am, len) != 0){
+        return( -1);
+    }
+
+    if( am_get( am, group, goal, len, addr) != 0){
+        am_avail_give( am, len);
+        return( -1);
+    }
+
+    return( 0);
+}
+
+
+
+int agmap_get_reserved( agmap_t *am, int group, uint64_t goal, uint64_t len,
+                        uint64_t *addr){
+    return( am_get( am, group, goal, len, addr));
+}
+
+
+
+int agmap_reserve( agmap_t *am, uint64_t len){
+    return( am_avail_take( am, len));
+}
+
+
+
+void agmap_unreserve( agmap_t *am, uint64_t len){
+    am_avail_give( am, len);
+}
+
+
+
+/* the group holding len bits from addr, NULL if they span groups */
+static agroup_t *ag_of_extent( agmap_t *am, uint64_t addr, uint64_t len){
+    agroup_t *ag;
+
+    if( len == 0 || addr + len > am->am_total_bits){
+        return( NULL);
+    }
+
+    ag = &am->am_groups[agmap_group( am, addr)];
+    if( addr + len > ag->ag_first + ag->ag_bits){
+        return( NULL);
+    }
+
+    return( ag);
+}
+
+
+
+static int am_put( agmap_t *am, uint64_t addr, uint64_t len, int reserved){
+    agroup_t *ag;
+    uint64_t count, rel;
+    int rc = 0;
+
+    ag = ag_of_extent( am, addr, len);
+    if( ag == NULL){
+        TRACE_ERR("Invalid extent, addr=%lu, len=%lu", addr, len);
+        return( -1);
+    }
+
+    rel = addr - ag->ag_first;
+    pthread_mutex_lock( &ag->ag_mutex);
+    if( ag->ag_falloc != NULL){
+        rc = falloc_put( ag->ag_falloc, rel, len);
+    }else{
+        bm_count( ag->ag_summary->bs_map, ag->ag_bits, rel, len, SETBIT,
+                  &count);
+        if( count != len){
+            TRACE_ERR("Extent is not in use, addr=%lu, len=%lu", addr, len);
+            rc = -1;
+        }else{
+            rc = bm_summary_set_extent( ag->ag_summary, rel, len, CLEARBIT);
+        }
+    }
+
+    if( rc == 0){
+        ag->ag_free += len;
+    }
+    pthread_mutex_unlock( &ag->ag_mutex);
+
+    if( rc == 0 && !reserved){
+        am_avail_give( am, len);
+    }
+
+    return( rc);
+}
+
+
+
+int agmap_put( agmap_t *am, uint64_t addr, uint64_t len){
+    return( am_put( am, addr, len, 0));
+}
+
+
+
+int agmap_put_reserved( agmap_t *am, uint64_t addr, uint64_t len){
+    return( am_put( am, addr, len, 1));
+}
+
+
+
+int agmap_take( agmap_t *am, uint64_t addr, uint64_t len){
+    agroup_t *ag;
+    uint64_t count, rel;
+    int rc = 0;
+
+    ag = ag_of_extent( am, addr, len);
+    if( ag == NULL || am_avail_take( am, len) != 0){
+        return( -1);
+    }
+
+    rel = addr - ag->ag_first;
+    pthread_mutex_lock( &ag->ag_mutex);
+    if( ag->ag_falloc != NULL){
+        rc = falloc_take( ag->ag_falloc, rel, len);
+    }else{
+        bm_count( ag->ag_summary->bs_map, ag->ag_bits, rel, len, CLEARBIT,
+                  &count);
+        rc = ( count != len) ? -1 :
+             bm_summary_set_extent( ag->ag_summary, rel, len, SETBIT);
+    }
+
+    if( rc == 0){
+        ag->ag_free -= len;
+    }
+    pthread_mutex_unlock( &ag->ag_mutex);
+
+    if( rc != 0){
+        am_avail_give( am, len);
+    }
+
+    return( rc);
+}
+
+
+
+int agmap_grow( agmap_t *am, uint64_t addr, uint64_t len, uint64_t grow,
+                int reserved){
+    agroup_t *ag;
+    uint64_t rel;
+    int rc;
+
+    /* the extent grows inside its group only */
+    ag = ag_of_extent( am, addr, len + grow);
+    if( ag == NULL || grow == 0){
+        return( -1);
+    }
+
+    if( !reserved && am_avail_take( am, grow) != 0){
+        return( -1);
+    }
+
+    rel = addr - ag->ag_first;
+    pthread_mutex_lock( &ag->ag_mutex);
+    rc = bm_extent_can_grow( ag->ag_summary->bs_map, ag->ag_bits, rel,
+                             len + grow);
+    if( rc == 0){
+        rc = ( ag->ag_falloc != NULL) ?
+             falloc_take( ag->ag_falloc, rel + len, grow) :
+             bm_summary_set_extent( ag->ag_summary, rel + len, grow, SETBIT);
+    }
+
+    if( rc == 0){
+        ag->ag_free -= grow;
+    }
+    pthread_mutex_unlock( &ag->ag_mutex);
+
+    if( rc != 0 && !reserved){
+        am_avail_give( am, grow);
+    }
+
+    return( rc == 0 ? 0 : -1);
+}
+
+
+
+uint64_t agmap_free_bits( agmap_t *am){
+    uint64_t free = 0;
+    int i;
+
+    for( i = 0; i < am->am_groups_num; i++){
+        free += am->am_groups[i].ag_free;
+    }
+
+    return( free);
+}
+
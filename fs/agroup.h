@@ -0,0 +1,107 @@
+#ifndef _AGROUP_H_
+#define _AGROUP_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include "map_summary.h"
+#include "falloc.h"
+
+
+/* allocation groups. A map is split in groups of contiguous bits, each
+ * one with its own lock, free counter and summary, and for the block map
+ * its own free extents index. A thread allocates in its own group, or in
+ * the group of a goal, so the threads rarely wait for each other and the
+ * related objects end up close on disk. The map itself is not changed,
+ * the groups only exist in memory. */
+#define AG_BLOCK_GROUP_BITS              ( 1ul << 18) /* blocks */
+#define AG_TABLE_GROUP_BITS              ( 1ul << 16) /* sinodes, slots */
+
+/* bit maps without extents index search outward from the goal, in rings
+ * of AG_NEAR_WINDOW bits, growing AG_NEAR_STEP times each round */
+#define AG_NEAR_WINDOW                   64
+#define AG_NEAR_STEP                     8
+
+/* any group, the caller has no preference */
+#define AG_ANY_GROUP                     -1
+
+
+typedef struct{
+    pthread_mutex_t ag_mutex;
+    uint64_t ag_first;            /* first bit of the group in the map */
+    uint64_t ag_bits;
+    uint64_t ag_free;             /* read without the lock as a hint */
+    bm_summary_t *ag_summary;     /* summary of the group bits only */
+    falloc_t *ag_falloc;          /* NULL without AGMAP_EXTENTS */
+}agroup_t;
+
+
+typedef struct{
+    unsigned char *am_map;
+    uint64_t am_total_bits;
+    uint64_t am_group_bits;
+    int am_groups_num;
+    agroup_t *am_groups;
+
+#define AGMAP_EXTENTS                    0x0001 /* index the free extents,
+                                                   for multi bit requests */
+    uint32_t am_flags;
+
+    /* free bits not reserved, the allocations without reservation only
+     * take from here. See agmap_reserve() */
+    uint64_t am_avail;
+}agmap_t;
+
+
+/* split the map bm, with total_bits bits, in groups of group_bits bits,
+ * a multiple of 64. The last group may be shorter */
+agmap_t *agmap_alloc( unsigned char *bm, uint64_t total_bits,
+                      uint64_t group_bits, uint32_t flags);
+void agmap_free( agmap_t *am);
+
+/* group of a bit, and the group of the calling thread */
+int agmap_group( agmap_t *am, uint64_t addr);
+int agmap_thread_group( agmap_t *am);
+
+/* allocate len contiguous bits and set them in the map, as close to goal
+ * as possible, if it is not FALLOC_NO_GOAL. The search starts in group,
+ * or with AG_ANY_GROUP in the group of goal, or in the thread group if
+ * there is no goal either, and goes outward to the groups around with
+ * enough free bits. A request never spans groups. Return 0 and set
+ * *addr, or -1 if there is no room */
+int agmap_get( agmap_t *am, int group, uint64_t goal, uint64_t len,
+               uint64_t *addr);
+
+/* the same, for bits reserved before with agmap_reserve(), the request
+ * takes them from the reservation */
+int agmap_get_reserved( agmap_t *am, int group, uint64_t goal, uint64_t len,
+                        uint64_t *addr);
+
+/* reserve len free bits, without choosing them yet, for a later
+ * agmap_get_reserved(). The other allocations can not take them, so the
+ * reserved bits are always there. Return -1 if there is no room.
+ * agmap_unreserve() gives back what was not used */
+int agmap_reserve( agmap_t *am, uint64_t len);
+void agmap_unreserve( agmap_t *am, uint64_t len);
+
+/* free len bits from addr, in use and in a single group */
+int agmap_put( agmap_t *am, uint64_t addr, uint64_t len);
+
+/* the same, the bits go back to the reservation they came from */
+int agmap_put_reserved( agmap_t *am, uint64_t addr, uint64_t len);
+
+/* take len free bits at addr, in a single group */
+int agmap_take( agmap_t *am, uint64_t addr, uint64_t len);
+
+/* grow in place the extent of len bits from addr, in use, with the grow
+ * bits right after it if they are free and in the same group. With
+ * reserved they come from a reservation. Return 0, or -1 if the extent
+ * can not grow */
+int agmap_grow( agmap_t *am, uint64_t addr, uint64_t len, uint64_t grow,
+                int reserved);
+
+/* free bits in all the groups, reserved or not */
+uint64_t agmap_free_bits( agmap_t *am);
+
+
+#endif
+
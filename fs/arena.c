@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trace.h"
+#include "arena.h"
+
+
+#define ARENA_ROUND(n)               ( ( (n) + ARENA_ALIGN - 1) &           \
+                                       ~( (size_t) ARENA_ALIGN - 1))
+
+
+
+arena_t *arena_alloc( size_t size){
+    arena_chunk_t *c;
+    arena_t *a;
+    size_t head;
+
+    /* the arena header at the start of the first chunk */
+    head = ARENA_ROUND( sizeof( arena_t));
+    size = ARENA_ROUND( size < ARENA_MIN_CHUNK ? ARENA_MIN_CHUNK : size);
+    c = malloc( sizeof( arena_chunk_t) + head + size);
+    if( c == NULL){
+        TRACE_ERR("Error in malloc()");
+        return( NULL);
+    }
+
+    c->ac_next = NULL;
+    c->ac_size = head + size;
+    c->ac_used = head;
+
+    a = (arena_t *) c->ac_data;
+    a->ar_chunk = c;
+    a->ar_chunks_num = 1;
+    a->ar_total = 0;
+    return( a);
+}
+
+
+
+void arena_free( arena_t *a){
+    arena_chunk_t *c, *next;
+
+    if( a == NULL){
+        return;
+    }
+
+    /* the first chunk, with the header, goes last */
+    for( c = a->ar_chunk; c != NULL; c = next){
+        next = c->ac_next;
+        free( c);
+    }
+}
+
+
+
+void *arena_malloc( arena_t *a, size_t size){
+    arena_chunk_t *c = a->ar_chunk;
+    size_t chunk;
+    void *p;
+
+    size = ARENA_ROUND( size == 0 ? 1 : size);
+    if( c->ac_used + size > c->ac_size){
+
+        /* twice the last chunk, or the request if bigger */
+        chunk = c->ac_size * 2;
+        if( chunk < size){
+            chunk = size;
+        }
+
+        c = malloc( sizeof( arena_chunk_t) + chunk);
+        if( c == NULL){
+            TRACE_ERR("Error in malloc()");
+            return( NULL);
+        }
+
+        c->ac_next = a->ar_chunk;
+        c->ac_size = chunk;
+        c->ac_used = 0;
+        a->ar_chunk = c;
+        a->ar_chunks_num++;
+    }
+
+    p = c->ac_data + c->ac_used;
+    c->ac_used += size;
+    a->ar_total += size;
+    return( p);
+}
+
+
+
+void *arena_memdup( arena_t *a, void *p, size_t n){
+    void *q;
+
+    q = arena_malloc( a, n);
+    if( q != NULL){
+        memcpy( q, p, n);
+    }
+    return( q);
+}
+
+
+
+char *arena_strndup( arena_t *a, char *s, size_t n){
+    char *q;
+
+    n = strnlen( s, n);
+    q = arena_malloc( a, n + 1);
+    if( q != NULL){
+        memcpy( q, s, n);
+        q[n] = 0;
+    }
+    return( q);
+}
+
@@ -0,0 +1,45 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/* bump arena. The memory is taken in chunks and given out in order, there
+ * is no free of single pieces, everything goes away with arena_free().
+ * The arena header lives in the first chunk, so an arena which never
+ * grows is a single malloc() and a single free(). */
+#define ARENA_ALIGN                      8
+#define ARENA_MIN_CHUNK                  1024
+
+
+typedef struct arena_chunk_s{
+    struct arena_chunk_s *ac_next;
+    size_t ac_size;               /* bytes for data in the chunk */
+    size_t ac_used;
+    char ac_data[];
+}arena_chunk_t;
+
+
+typedef struct{
+    arena_chunk_t *ar_chunk;      /* the current chunk, with the others
+                                     linked after it */
+    int ar_chunks_num;
+    size_t ar_total;              /* bytes given out */
+}arena_t;
+
+
+/* new arena with room for size bytes before it grows */
+arena_t *arena_alloc( size_t size);
+void arena_free( arena_t *a);
+
+/* size bytes aligned to ARENA_ALIGN, NULL without memory */
+void *arena_malloc( arena_t *a, size_t size);
+
+/* copy n bytes of p into the arena. The string version adds the zero */
+void *arena_memdup( arena_t *a, void *p, size_t n);
+char *arena_strndup( arena_t *a, char *s, size_t n);
+
+
+#endif
+
@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include "avl.h"
+
+
+
+static inline int avl_height( avl_node_t *n){
+    return( n == NULL ? 0 : n->av_height);
+}
+
+
+
+static inline void avl_fix_height( avl_node_t *n){
+    int l = avl_height( n->av_left), r = avl_height( n->av_right);
+
+    n->av_height = ( l > r ? l : r) + 1;
+}
+
+
+
+static avl_node_t *avl_rotate_right( avl_node_t *n){
+    avl_node_t *l = n->av_left;
+
+    n->av_left = l->av_right;
+    l->av_right = n;
+    avl_fix_height( n);
+    avl_fix_height( l);
+    return( l);
+}
+
+
+
+static avl_node_t *avl_rotate_left( avl_node_t *n){
+    avl_node_t *r = n->av_right;
+
+    n->av_right = r->av_left;
+    r->av_left = n;
+    avl_fix_height( n);
+    avl_fix_height( r);
+    return( r);
+}
+
+
+
+/* restore the balance of the subtree n after an insert or remove below
+ * it, return its new root */
+static avl_node_t *avl_balance( avl_node_t *n){
+    int bf;
+
+    avl_fix_height( n);
+    bf = avl_height( n->av_left) - avl_height( n->av_right);
+    if( bf > 1){
+        if( avl_height( n->av_left->av_left) <
+            avl_height( n->av_left->av_right)){
+            n->av_left = avl_rotate_left( n->av_left);
+        }
+        return( avl_rotate_right( n));
+    }
+
+    if( bf < -1){
+        if( avl_height( n->av_right->av_right) <
+            avl_height( n->av_right->av_left)){
+            n->av_right = avl_rotate_right( n->av_right);
+        }
+        return( avl_rotate_left( n));
+    }
+
+    return( n);
+}
+
+
+
+static avl_node_t *avl_insert_rec( avl_tree_t *t, avl_node_t *root,
+                                   avl_node_t *n){
+    if( root == NULL){
+        return( n);
+    }
+
+    if( t->at_cmp( n, root) < 0){
+        root->av_left = avl_insert_rec( t, root->av_left, n);
+    }else{
+        root->av_right = avl_insert_rec( t, root->av_right, n);
+    }
+
+    return( avl_balance( root));
+}
+
+
+
+/* unlink the lowest node of the subtree n, it is left in *min */
+static avl_node_t *avl_remove_min( avl_node_t *n, avl_node_t **min){
+    if( n->av_left == NULL){
+        *min = n;
+        return( n->av_right);
+    }
+
+    n->av_left = avl_remove_min( n->av_left, min);
+    return( avl_balance( n));
+}
+
+
+
+static avl_node_t *avl_remove_rec( avl_tree_t *t, avl_node_t *root,
+                                   avl_node_t *n){
+    avl_node_t *min, *right;
+    int c;
+
+    if( root == NULL){
+        return( NULL);
+    }
+
+    c = t->at_cmp( n, root);
+    if( c < 0){
+        root->av_left = avl_remove_rec( t, root->av_left, n);
+    }else if( c > 0){
+        root->av_right = avl_remove_rec( t, root->av_right, n);
+    }else{
+        if( root->av_right == NULL){
+            return( root->av_left);
+        }
+
+        right = avl_remove_min( root->av_right, &min);
+        min->av_left = root->av_left;
+        min->av_right = right;
+        root = min;
+    }
+
+    return( avl_balance( root));
+}
+
+
+
+void avl_init( avl_tree_t *t, avl_cmp_t cmp){
+    t->at_root = NULL;
+    t->at_cmp = cmp;
+    t->at_count = 0;
+}
+
+
+
+void avl_insert( avl_tree_t *t, avl_node_t *n){
+    n->av_left = n->av_right = NULL;
+    n->av_height = 1;
+    t->at_root = avl_insert_rec( t, t->at_root, n);
+    t->at_count++;
+}
+
+
+
+void avl_remove( avl_tree_t *t, avl_node_t *n){
+    t->at_root = avl_remove_rec( t, t->at_root, n);
+    t->at_count--;
+}
+
+
+
+avl_node_t *avl_find( avl_tree_t *t, avl_node_t *key){
+    avl_node_t *n = t->at_root;
+    int c;
+
+    while( n != NULL){
+        c = t->at_cmp( key, n);
+        if( c == 0){
+            return( n);
+        }
+        n = ( c < 0) ? n->av_left : n->av_right;
+    }
+
+    return( NULL);
+}
+
+
+
+avl_node_t *avl_ceil( avl_tree_t *t, avl_node_t *key){
+    avl_node_t *n = t->at_root, *found = NULL;
+    int c;
+
+    while( n != NULL){
+        c = t->at_cmp( key, n);
+        if( c == 0){
+            return( n);
+        }
+
+        if( c < 0){
+            found = n;
+            n = n->av_left;
+        }else{
+            n = n->av_right;
+        }
+    }
+
+    return( found);
+}
+
+
+
+avl_node_t *avl_floor( avl_tree_t *t, avl_node_t *key){
+    avl_node_t *n = t->at_root, *found = NULL;
+    int c;
+
+    while( n != NULL){
+        c = t->at_cmp( key, n);
+        if( c == 0){
+            return( n);
+        }
+
+        if( c > 0){
+            found = n;
+            n = n->av_right;
+        }else{
+            n = n->av_left;
+        }
+    }
+
+    return( found);
+}
+
+
+
+avl_node_t *avl_first( avl_tree_t *t){
+    avl_node_t *n = t->at_root;
+
+    if( n == NULL){
+        return( NULL);
+    }
+
+    while( n->av_left != NULL){
+        n = n->av_left;
+    }
+
+    return( n);
+}
+
+
+
+avl_node_t *avl_last( avl_tree_t *t){
+    avl_node_t *n = t->at_root;
+
+    if( n == NULL){
+        return( NULL);
+    }
+
+    while( n->av_right != NULL){
+        n = n->av_right;
+    }
+
+    return( n);
+}
+
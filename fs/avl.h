@@ -0,0 +1,47 @@
+#ifndef _AVL_H_
+#define _AVL_H_
+
+#include <stdint.h>
+
+
+/* intrusive AVL tree. The nodes are embedded in the caller structures,
+ * and the tree order is given by a compare function over two nodes, like
+ * strcmp(). Keys should be unique. Nothing is allocated here. */
+typedef struct avl_node_s{
+    struct avl_node_s *av_left;
+    struct avl_node_s *av_right;
+    int av_height;
+}avl_node_t;
+
+typedef int (*avl_cmp_t)( avl_node_t *a, avl_node_t *b);
+
+typedef struct{
+    avl_node_t *at_root;
+    avl_cmp_t at_cmp;
+    uint64_t at_count;
+}avl_tree_t;
+
+
+#define avl_entry(ptr, type, member) \
+    ((type *)((char *)(ptr)-(unsigned long)(&((type *)0)->member)))
+
+
+void avl_init( avl_tree_t *t, avl_cmp_t cmp);
+
+/* add the node n, its key should not be in the tree yet */
+void avl_insert( avl_tree_t *t, avl_node_t *n);
+
+/* remove the node n, which should be in the tree */
+void avl_remove( avl_tree_t *t, avl_node_t *n);
+
+/* lookups. key is a node, usually in the stack, with only the fields
+ * used by the compare function set. NULL if there is no such node */
+avl_node_t *avl_find( avl_tree_t *t, avl_node_t *key);
+avl_node_t *avl_ceil( avl_tree_t *t, avl_node_t *key);  /* first >= key */
+avl_node_t *avl_floor( avl_tree_t *t, avl_node_t *key); /* last <= key */
+avl_node_t *avl_first( avl_tree_t *t);
+avl_node_t *avl_last( avl_tree_t *t);
+
+
+#endif
+
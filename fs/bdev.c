@@ -0,0 +1,1159 @@
+#define _GNU_SOURCE /* fallocate() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <linux/falloc.h>
+#endif
+#include "trace.h"
+#include "kfs_mem.h"
+#include "eio.h"
+#include "bdev.h"
+
+
+
+/* file backend, buffered IO thru eio */
+
+static int bdev_file_read( bdev_t *bdev, char *buf, uint64_t addr,
+                           int num_blocks){
+    return( extent_read( bdev->bd_fd, buf, addr, num_blocks));
+}
+
+
+static int bdev_file_write( bdev_t *bdev, char *buf, uint64_t addr,
+                            int num_blocks){
+    return( extent_write( bdev->bd_fd, buf, addr, num_blocks));
+}
+
+
+static int bdev_file_readv( bdev_t *bdev, struct iovec *iov, int iovcnt,
+                            uint64_t addr){
+    return( extent_readv( bdev->bd_fd, iov, iovcnt, addr));
+}
+
+
+static int bdev_file_writev( bdev_t *bdev, struct iovec *iov, int iovcnt,
+                             uint64_t addr){
+    return( extent_writev( bdev->bd_fd, iov, iovcnt, addr));
+}
+
+
+static int bdev_file_flush( bdev_t *bdev){
+    if( fdatasync( bdev->bd_fd) != 0){
+        TRACE_ERRNO("fdatasync() failed");
+        return( -1);
+    }
+    return( 0);
+}
+
+
+static int bdev_file_discard( bdev_t *bdev, uint64_t addr, int num_blocks){
+    off_t offset = (off_t) KFS_BLOCKS_TO_BYTES( addr);
+    off_t len = (off_t) KFS_BLOCKS_TO_BYTES( num_blocks);
+    struct stat st;
+
+    if( fstat( bdev->bd_fd, &st) != 0){
+        TRACE_ERRNO("fstat() failed");
+        return( -1);
+    }
+
+#ifdef BLKDISCARD
+    if( S_ISBLK( st.st_mode)){
+        uint64_t range[2] = { (uint64_t) offset, (uint64_t) len};
+
+        if( ioctl( bdev->bd_fd, BLKDISCARD, range) != 0 &&
+            errno != EOPNOTSUPP){
+            TRACE_ERRNO("BLKDISCARD failed, addr=%lu", addr);
+            return( -1);
+        }
+        return( 0);
+    }
+#endif
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+    if( fallocate( bdev->bd_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                   offset, len) != 0 && errno != EOPNOTSUPP){
+        TRACE_ERRNO("fallocate() failed, addr=%lu", addr);
+        return( -1);
+    }
+#endif
+    return( 0);
+}
+
+
+static int bdev_file_size( bdev_t *bdev, uint64_t *size){
+    struct stat st;
+
+    if( fstat( bdev->bd_fd, &st) != 0){
+        TRACE_ERRNO("fstat() failed");
+        return( -1);
+    }
+
+#ifdef BLKGETSIZE64
+    if( S_ISBLK( st.st_mode)){
+        if( ioctl( bdev->bd_fd, BLKGETSIZE64, size) != 0){
+            TRACE_ERRNO("Could not get block device size");
+            return( -1);
+        }
+        return( 0);
+    }
+#endif
+
+    *size = (uint64_t) st.st_size;
+    return( 0);
+}
+
+
+static int bdev_file_close( bdev_t *bdev){
+    if( close( bdev->bd_fd) != 0){
+        TRACE_ERRNO("close() failed");
+        return( -1);
+    }
+    return( 0);
+}
+
+
+
+/* direct backend. O_DIRECT needs aligned buffers, the callers memory
+ * comes from malloc(), so unaligned buffers are bounced thru an aligned
+ * one */
+
+static int bdev_is_aligned( void *p){
+    return( ((uintptr_t) p % BDEV_DIRECT_ALIGN) == 0);
+}
+
+
+static char *bdev_bounce_alloc( size_t len){
+    void *p;
+
+    if( posix_memalign( &p, BDEV_DIRECT_ALIGN, len) != 0){
+        TRACE_ERR("posix_memalign() failed");
+        errno = ENOMEM;
+        return( NULL);
+    }
+    return( (char *) p);
+}
+
+
+static int bdev_direct_read( bdev_t *bdev, char *buf, uint64_t addr,
+                             int num_blocks){
+    size_t len = (size_t) KFS_BLOCKS_TO_BYTES( num_blocks);
+    char *p;
+    int rc;
+
+    if( bdev_is_aligned( buf)){
+        return( extent_read( bdev->bd_fd, buf, addr, num_blocks));
+    }
+
+    p = bdev_bounce_alloc( len);
+    if( p == NULL){
+        return( -1);
+    }
+
+    rc = extent_read( bdev->bd_fd, p, addr, num_blocks);
+    if( rc == 0){
+        memcpy( buf, p, len);
+    }
+    free( p);
+    return( rc);
+}
+
+
+static int bdev_direct_write( bdev_t *bdev, char *buf, uint64_t addr,
+                              int num_blocks){
+    size_t len = (size_t) KFS_BLOCKS_TO_BYTES( num_blocks);
+    char *p;
+    int rc;
+
+    if( bdev_is_aligned( buf)){
+        return( extent_write( bdev->bd_fd, buf, addr, num_blocks));
+    }
+
+    p = bdev_bounce_alloc( len);
+    if( p == NULL){
+        return( -1);
+    }
+
+    memcpy( p, buf, len);
+    rc = extent_write( bdev->bd_fd, p, addr, num_blocks);
+    free( p);
+    return( rc);
+}
+
+
+/* if every buffer is aligned, return 0 and the total length in len */
+static int bdev_iov_check( struct iovec *iov, int iovcnt, size_t *len){
+    int i, aligned = 1;
+
+    *len = 0;
+    for( i = 0; i < iovcnt; i++){
+        if( ! bdev_is_aligned( iov[i].iov_base) ||
+            ( iov[i].iov_len % BDEV_DIRECT_ALIGN) != 0){
+            aligned = 0;
+        }
+        *len += iov[i].iov_len;
+    }
+    return( aligned ? 0 : -1);
+}
+
+
+static int bdev_direct_readv( bdev_t *bdev, struct iovec *iov, int iovcnt,
+                              uint64_t addr){
+    size_t len, off;
+    char *p;
+    int i, rc;
+
+    if( bdev_iov_check( iov, iovcnt, &len) == 0){
+        return( extent_readv( bdev->bd_fd, iov, iovcnt, addr));
+    }
+
+    p = bdev_bounce_alloc( len);
+    if( p == NULL){
+        return( -1);
+    }
+
+    rc = extent_read( bdev->bd_fd, p, addr, KFS_BYTES_TO_BLOCKS( len));
+    if( rc == 0){
+        for( i = 0, off = 0; i < iovcnt; off += iov[i].iov_len, i++){
+            memcpy( iov[i].iov_base, p + off, iov[i].iov_len);
+        }
+    }
+    free( p);
+    return( rc);
+}
+
+
+static int bdev_direct_writev( bdev_t *bdev, struct iovec *iov, int iovcnt,
+                               uint64_t addr){
+    size_t len, off;
+    char *p;
+    int i, rc;
+
+    if( bdev_iov_check( iov, iovcnt, &len) == 0){
+        return( extent_writev( bdev->bd_fd, iov, iovcnt, addr));
+    }
+
+    p = bdev_bounce_alloc( len);
+    if( p == NULL){
+        return( -1);
+    }
+
+    for( i = 0, off = 0; i < iovcnt; off += iov[i].iov_len, i++){
+        memcpy( p + off, iov[i].iov_base, iov[i].iov_len);
+    }
+    rc = extent_write( bdev->bd_fd, p, addr, KFS_BYTES_TO_BLOCKS( len));
+    free( p);
+    return( rc);
+}
+
+
+
+/* ram backend */
+
+static void bdev_ram_delay( bdev_t *bdev){
+    struct timespec ts;
+
+    if( bdev->bd_latency_us == 0){
+        return;
+    }
+
+    ts.tv_sec = bdev->bd_latency_us / 1000000;
+    ts.tv_nsec = ( bdev->bd_latency_us % 1000000) * 1000;
+    while( nanosleep( &ts, &ts) != 0 && errno == EINTR){
+        ;
+    }
+}
+
+
+/* return the memory for len bytes starting in block addr, NULL if the
+ * range is out of the device */
+static char *bdev_ram_ptr( bdev_t *bdev, uint64_t addr, size_t len){
+    uint64_t offset = KFS_BLOCKS_TO_BYTES( addr);
+
+    if( offset > bdev->bd_size || len > bdev->bd_size - offset){
+        TRACE_ERR("out of range, addr=%lu, len=%zu", addr, len);
+        errno = EIO;
+        return( NULL);
+    }
+    return( bdev->bd_mem + offset);
+}
+
+
+static int bdev_ram_read( bdev_t *bdev, char *buf, uint64_t addr,
+                          int num_blocks){
+    size_t len = (size_t) KFS_BLOCKS_TO_BYTES( num_blocks);
+    char *p;
+
+    bdev_ram_delay( bdev);
+    p = bdev_ram_ptr( bdev, addr, len);
+    if( p == NULL){
+        return( -1);
+    }
+
+    memcpy( buf, p, len);
+    return( 0);
+}
+
+
+static int bdev_ram_write( bdev_t *bdev, char *buf, uint64_t addr,
+                           int num_blocks){
+    size_t len = (size_t) KFS_BLOCKS_TO_BYTES( num_blocks);
+    char *p;
+
+    bdev_ram_delay( bdev);
+    p = bdev_ram_ptr( bdev, addr, len);
+    if( p == NULL){
+        return( -1);
+    }
+
+    memcpy( p, buf, len);
+    return( 0);
+}
+
+
+static int bdev_ram_rw_vec( bdev_t *bdev, struct iovec *iov, int iovcnt,
+                            uint64_t addr, int write_flag){
+    size_t len, off;
+    char *p;
+    int i;
+
+    bdev_iov_check( iov, iovcnt, &len);
+
+    bdev_ram_delay( bdev);
+    p = bdev_ram_ptr( bdev, addr, len);
+    if( p == NULL){
+        return( -1);
+    }
+
+    for( i = 0, off = 0; i < iovcnt; off += iov[i].iov_len, i++){
+        if( write_flag){
+            memcpy( p + off, iov[i].iov_base, iov[i].iov_len);
+        }else{
+            memcpy( iov[i].iov_base, p + off, iov[i].iov_len);
+        }
+    }
+    return( 0);
+}
+
+
+static int bdev_ram_readv( bdev_t *bdev, struct iovec *iov, int iovcnt,
+                           uint64_t addr){
+    return( bdev_ram_rw_vec( bdev, iov, iovcnt, addr, 0));
+}
+
+
+static int bdev_ram_writev( bdev_t *bdev, struct iovec *iov, int iovcnt,
+                            uint64_t addr){
+    return( bdev_ram_rw_vec( bdev, iov, iovcnt, addr, 1));
+}
+
+
+static int bdev_ram_flush( bdev_t *bdev){
+    return( 0);
+}
+
+
+static int bdev_ram_discard( bdev_t *bdev, uint64_t addr, int num_blocks){
+    size_t len = (size_t) KFS_BLOCKS_TO_BYTES( num_blocks);
+    char *p;
+
+    p = bdev_ram_ptr( bdev, addr, len);
+    if( p == NULL){
+        return( -1);
+    }
+
+    memset( p, 0, len);
+    return( 0);
+}
+
+
+static int bdev_ram_size( bdev_t *bdev, uint64_t *size){
+    *size = bdev->bd_size;
+    return( 0);
+}
+
+
+static int bdev_ram_close( bdev_t *bdev){
+    free( bdev->bd_mem);
+    bdev->bd_mem = NULL;
+    return( 0);
+}
+
+
+
+/* stripe backend. A request is cut in chunks at the stripe unit
+ * boundaries. The chunks of a request falling in the same device are
+ * adjacent in that device, so each device gets a single vectored request,
+ * and those are served in parallel */
+
+typedef struct{
+    bdev_t *sj_dev;
+    struct iovec *sj_iov;
+    int sj_iovcnt;
+    uint64_t sj_addr;             /* first block in the device */
+    int sj_write;
+    int sj_rc;
+    int sj_errno;
+    int sj_done;                  /* set by the worker */
+    struct bdev_worker_s *sj_worker;   /* NULL if served inline */
+}bdev_stripe_job_t;
+
+
+/* every device has a worker started with the volume. It takes one job
+ * at a time, the callers wait for the slot to be free */
+typedef struct bdev_worker_s{
+    pthread_mutex_t sw_mutex;
+    pthread_cond_t sw_cond;
+    bdev_stripe_job_t *sw_job;    /* job being served, NULL if idle */
+    int sw_exit;
+    int sw_started;
+    pthread_t sw_thread;
+}bdev_worker_t;
+
+
+void bdev_stripe_map( bdev_t *bdev, uint64_t addr, int *dev,
+                      uint64_t *dev_addr){
+    uint64_t stripe;
+
+    if( bdev->bd_type != BDEV_STRIPE){
+        *dev = 0;
+        *dev_addr = addr;
+        return;
+    }
+
+    stripe = addr / bdev->bd_stripe_unit;
+    *dev = (int) ( stripe % (uint64_t) bdev->bd_devs_num);
+    *dev_addr = ( stripe / (uint64_t) bdev->bd_devs_num) * 
+                bdev->bd_stripe_unit + addr % bdev->bd_stripe_unit;
+}
+
+
+static void bdev_stripe_job_run( bdev_stripe_job_t *job){
+    if( job->sj_write){
+        job->sj_rc = bdev_writev( job->sj_dev, job->sj_iov, job->sj_iovcnt,
+                                  job->sj_addr);
+    }else{
+        job->sj_rc = bdev_readv( job->sj_dev, job->sj_iov, job->sj_iovcnt,
+                                 job->sj_addr);
+    }
+    job->sj_errno = errno;
+}
+
+
+static void *bdev_stripe_thread( void *arg){
+    bdev_worker_t *w = (bdev_worker_t *) arg;
+    bdev_stripe_job_t *job;
+
+    pthread_mutex_lock( &w->sw_mutex);
+    for(;;){
+        while( w->sw_job == NULL && !w->sw_exit){
+            pthread_cond_wait( &w->sw_cond, &w->sw_mutex);
+        }
+        if( w->sw_job == NULL){
+            break;
+        }
+
+        job = w->sw_job;
+        pthread_mutex_unlock( &w->sw_mutex);
+        bdev_stripe_job_run( job);
+        pthread_mutex_lock( &w->sw_mutex);
+
+        job->sj_done = 1;
+        w->sw_job = NULL;
+        pthread_cond_broadcast( &w->sw_cond);
+    }
+    pthread_mutex_unlock( &w->sw_mutex);
+    return( NULL);
+}
+
+
+/* hand the job to the worker of its device, or serve it here if there is
+ * no worker */
+static void bdev_stripe_job_post( bdev_t *bdev, int d, 
+                                  bdev_stripe_job_t *job){
+    bdev_worker_t *w = &bdev->bd_workers[d];
+
+    if( !w->sw_started){
+        bdev_stripe_job_run( job);
+        return;
+    }
+
+    pthread_mutex_lock( &w->sw_mutex);
+    while( w->sw_job != NULL){
+        pthread_cond_wait( &w->sw_cond, &w->sw_mutex);
+    }
+    w->sw_job = job;
+    job->sj_worker = w;
+    pthread_cond_broadcast( &w->sw_cond);
+    pthread_mutex_unlock( &w->sw_mutex);
+}
+
+
+static void bdev_stripe_job_wait( bdev_stripe_job_t *job){
+    bdev_worker_t *w = job->sj_worker;
+
+    if( w == NULL){
+        return;
+    }
+
+    pthread_mutex_lock( &w->sw_mutex);
+    while( !job->sj_done){
+        pthread_cond_wait( &w->sw_cond, &w->sw_mutex);
+    }
+    pthread_mutex_unlock( &w->sw_mutex);
+}
+
+
+static int bdev_stripe_rw_vec( bdev_t *bdev, struct iovec *iov, int iovcnt,
+                               uint64_t addr, int write_flag){
+    bdev_stripe_job_t jobs[BDEV_STRIPE_MAX_DEVS], *job, *first = NULL;
+    struct iovec *vecs;
+    size_t len, chunk, n, off = 0;
+    uint64_t dev_addr;
+    int i, d, max, cur = 0, rc = 0;
+
+    bdev_iov_check( iov, iovcnt, &len);
+    if( len == 0){
+        return( 0);
+    }
+
+    /* every chunk splits at most one of the callers iovecs, so a device
+     * never needs more than this */
+    max = iovcnt + (int) ( KFS_BYTES_TO_BLOCKS( len) / 
+                           bdev->bd_stripe_unit) + 2;
+    vecs = malloc( sizeof( struct iovec) * max * bdev->bd_devs_num);
+    if( vecs == NULL){
+        TRACE_ERR("Error in malloc()");
+        errno = ENOMEM;
+        return( -1);
+    }
+
+    memset( (void *) jobs, 0, sizeof( jobs));
+    for( i = 0; i < bdev->bd_devs_num; i++){
+        jobs[i].sj_dev = bdev->bd_devs[i];
+        jobs[i].sj_iov = vecs + i * max;
+        jobs[i].sj_write = write_flag;
+    }
+
+    while( len > 0){
+        bdev_stripe_map( bdev, addr, &d, &dev_addr);
+        job = &jobs[d];
+        if( job->sj_iovcnt == 0){
+            job->sj_addr = dev_addr;
+        }
+
+        chunk = (size_t) KFS_BLOCKS_TO_BYTES( bdev->bd_stripe_unit - 
+                                             addr % bdev->bd_stripe_unit);
+        if( chunk > len){
+            chunk = len;
+        }
+        addr += KFS_BYTES_TO_BLOCKS( chunk);
+        len -= chunk;
+
+        while( chunk > 0){
+            n = iov[cur].iov_len - off;
+            if( n > chunk){
+                n = chunk;
+            }
+            job->sj_iov[job->sj_iovcnt].iov_base = 
+                                          (char *) iov[cur].iov_base + off;
+            job->sj_iov[job->sj_iovcnt].iov_len = n;
+            job->sj_iovcnt++;
+
+            chunk -= n;
+            off += n;
+            if( off == iov[cur].iov_len){
+                cur++;
+                off = 0;
+            }
+        }
+    }
+
+    /* the first device is served here, the others by their workers. A
+     * request within a single device never leaves this thread */
+    for( i = 0; i < bdev->bd_devs_num; i++){
+        job = &jobs[i];
+        if( job->sj_iovcnt == 0){
+            continue;
+        }
+
+        if( first == NULL){
+            first = job;
+            continue;
+        }
+        bdev_stripe_job_post( bdev, i, job);
+    }
+
+    bdev_stripe_job_run( first);
+
+    for( i = 0; i < bdev->bd_devs_num; i++){
+        job = &jobs[i];
+        bdev_stripe_job_wait( job);
+
+        if( job->sj_iovcnt > 0 && job->sj_rc != 0){
+            TRACE_ERR("IO error in stripe device %d, addr=%lu", i, 
+                      job->sj_addr);
+            errno = job->sj_errno;
+            rc = -1;
+        }
+    }
+
+    free( vecs);
+    return( rc);
+}
+
+
+static int bdev_stripe_read( bdev_t *bdev, char *buf, uint64_t addr,
+                             int num_blocks){
+    struct iovec iov;
+
+    iov.iov_base = buf;
+    iov.iov_len = (size_t) KFS_BLOCKS_TO_BYTES( num_blocks);
+    return( bdev_stripe_rw_vec( bdev, &iov, 1, addr, 0));
+}
+
+
+static int bdev_stripe_write( bdev_t *bdev, char *buf, uint64_t addr,
+                              int num_blocks){
+    struct iovec iov;
+
+    iov.iov_base = buf;
+    iov.iov_len = (size_t) KFS_BLOCKS_TO_BYTES( num_blocks);
+    return( bdev_stripe_rw_vec( bdev, &iov, 1, addr, 1));
+}
+
+
+static int bdev_stripe_readv( bdev_t *bdev, struct iovec *iov, int iovcnt,
+                              uint64_t addr){
+    return( bdev_stripe_rw_vec( bdev, iov, iovcnt, addr, 0));
+}
+
+
+static int bdev_stripe_writev( bdev_t *bdev, struct iovec *iov, int iovcnt,
+                               uint64_t addr){
+    return( bdev_stripe_rw_vec( bdev, iov, iovcnt, addr, 1));
+}
+
+
+static int bdev_stripe_flush( bdev_t *bdev){
+    int i, rc = 0;
+
+    for( i = 0; i < bdev->bd_devs_num; i++){
+        if( bdev_flush( bdev->bd_devs[i]) != 0){
+            rc = -1;
+        }
+    }
+    return( rc);
+}
+
+
+static int bdev_stripe_discard( bdev_t *bdev, uint64_t addr, 
+                                int num_blocks){
+    uint64_t dev_addr;
+    int d, n;
+
+    while( num_blocks > 0){
+        bdev_stripe_map( bdev, addr, &d, &dev_addr);
+        n = (int) ( bdev->bd_stripe_unit - addr % bdev->bd_stripe_unit);
+        if( n > num_blocks){
+            n = num_blocks;
+        }
+
+        if( bdev_discard( bdev->bd_devs[d], dev_addr, n) != 0){
+            return( -1);
+        }
+        addr += n;
+        num_blocks -= n;
+    }
+    return( 0);
+}
+
+
+/* the smallest device rounded down to whole stripe units, times the
+ * number of devices */
+static int bdev_stripe_size( bdev_t *bdev, uint64_t *size){
+    uint64_t dev_size, min_blocks = UINT64_MAX;
+    int i;
+
+    for( i = 0; i < bdev->bd_devs_num; i++){
+        if( bdev_size( bdev->bd_devs[i], &dev_size) != 0){
+            return( -1);
+        }
+
+        dev_size = KFS_BYTES_TO_BLOCKS( dev_size);
+        if( dev_size < min_blocks){
+            min_blocks = dev_size;
+        }
+    }
+
+    min_blocks -= min_blocks % bdev->bd_stripe_unit;
+    *size = KFS_BLOCKS_TO_BYTES( min_blocks * (uint64_t) bdev->bd_devs_num);
+    return( 0);
+}
+
+
+static void bdev_stripe_workers_stop( bdev_t *bdev){
+    bdev_worker_t *w;
+    int i;
+
+    for( i = 0; i < bdev->bd_devs_num; i++){
+        w = &bdev->bd_workers[i];
+        if( !w->sw_started){
+            continue;
+        }
+
+        pthread_mutex_lock( &w->sw_mutex);
+        w->sw_exit = 1;
+        pthread_cond_broadcast( &w->sw_cond);
+        pthread_mutex_unlock( &w->sw_mutex);
+
+        pthread_join( w->sw_thread, NULL);
+        pthread_cond_destroy( &w->sw_cond);
+        pthread_mutex_destroy( &w->sw_mutex);
+        w->sw_started = 0;
+    }
+
+    free( bdev->bd_workers);
+    bdev->bd_workers = NULL;
+}
+
+
+static int bdev_stripe_close( bdev_t *bdev){
+    int i, rc = 0;
+
+    bdev_stripe_workers_stop( bdev);
+    for( i = 0; i < bdev->bd_devs_num; i++){
+        if( bdev_close( bdev->bd_devs[i]) != 0){
+            rc = -1;
+        }
+    }
+
+    free( bdev->bd_devs);
+    bdev->bd_devs = NULL;
+    return( rc);
+}
+
+
+static const bdev_ops_t bdev_stripe_ops = {
+    bdev_stripe_read, bdev_stripe_write,
+    bdev_stripe_readv, bdev_stripe_writev,
+    bdev_stripe_flush, bdev_stripe_discard,
+    bdev_stripe_size, bdev_stripe_close
+};
+
+
+
+static const bdev_ops_t bdev_ops[BDEV_TYPES_NUM] = {
+    { /* BDEV_FILE */
+        bdev_file_read, bdev_file_write,
+        bdev_file_readv, bdev_file_writev,
+        bdev_file_flush, bdev_file_discard,
+        bdev_file_size, bdev_file_close
+    },
+    { /* BDEV_DIRECT */
+        bdev_direct_read, bdev_direct_write,
+        bdev_direct_readv, bdev_direct_writev,
+        bdev_file_flush, bdev_file_discard,
+        bdev_file_size, bdev_file_close
+    },
+    { /* BDEV_RAM */
+        bdev_ram_read, bdev_ram_write,
+        bdev_ram_readv, bdev_ram_writev,
+        bdev_ram_flush, bdev_ram_discard,
+        bdev_ram_size, bdev_ram_close
+    }
+};
+
+static char *bdev_names[BDEV_TYPES_NUM] = { "file", "direct", "ram"};
+
+
+
+int bdev_type_from_str( char *str){
+    int i;
+
+    for( i = 0; i < BDEV_TYPES_NUM; i++){
+        if( strcmp( str, bdev_names[i]) == 0){
+            return( i);
+        }
+    }
+    return( -1);
+}
+
+
+
+bdev_t *bdev_open( char *fname, int type){
+    bdev_t *bdev;
+    int flags = O_RDWR;
+
+    if( type == BDEV_DIRECT){
+#ifdef O_DIRECT
+        flags |= O_DIRECT;
+#else
+        TRACE_ERR("O_DIRECT is not supported");
+        return( NULL);
+#endif
+    }else if( type != BDEV_FILE){
+        TRACE_ERR("invalid backend type %d", type);
+        return( NULL);
+    }
+
+    bdev = malloc( sizeof( bdev_t));
+    if( bdev == NULL){
+        TRACE_ERR("Error in malloc()");
+        return( NULL);
+    }
+
+    memset( (void *) bdev, 0, sizeof( bdev_t));
+    bdev->bd_fd = open( fname, flags);
+    if( bdev->bd_fd < 0){
+        TRACE_ERRNO("Could not open '%s'", fname);
+        free( bdev);
+        return( NULL);
+    }
+
+    bdev->bd_type = type;
+    bdev->bd_ops = &bdev_ops[type];
+    return( bdev);
+}
+
+
+
+bdev_t *bdev_open_ram( char *fname, uint64_t size, uint32_t latency_us){
+    uint64_t load;
+    bdev_t *bdev;
+    struct stat st;
+    int fd = -1;
+
+    if( fname != NULL){
+        fd = open( fname, O_RDONLY);
+        if( fd < 0 || fstat( fd, &st) != 0){
+            TRACE_ERRNO("Could not open '%s'", fname);
+            goto exit0;
+        }
+
+        if( size == 0){
+            size = (uint64_t) st.st_size;
+        }
+    }
+
+    /* whole blocks only */
+    size -= size % KFS_BLOCKSIZE;
+    if( size == 0){
+        TRACE_ERR("invalid ram device size");
+        goto exit0;
+    }
+
+    bdev = malloc( sizeof( bdev_t));
+    if( bdev == NULL){
+        TRACE_ERR("Error in malloc()");
+        goto exit0;
+    }
+
+    memset( (void *) bdev, 0, sizeof( bdev_t));
+    bdev->bd_mem = calloc( 1, size);
+    if( bdev->bd_mem == NULL){
+        TRACE_ERR("Could not allocate %lu bytes", size);
+        goto exit1;
+    }
+
+    if( fd >= 0){
+        /* load the whole blocks the file and the device have in common */
+        load = ( (uint64_t) st.st_size < size) ? (uint64_t) st.st_size : size;
+        load = KFS_BYTES_TO_BLOCKS( load);
+        if( load > 0 && extent_read( fd, bdev->bd_mem, 0, load) != 0){
+            TRACE_ERR("Could not load '%s'", fname);
+            goto exit2;
+        }
+        close( fd);
+    }
+
+    bdev->bd_fd = -1;
+    bdev->bd_type = BDEV_RAM;
+    bdev->bd_ops = &bdev_ops[BDEV_RAM];
+    bdev->bd_size = size;
+    bdev->bd_latency_us = latency_us;
+    return( bdev);
+
+exit2:
+    free( bdev->bd_mem);
+exit1:
+    free( bdev);
+exit0:
+    if( fd >= 0){
+        close( fd);
+    }
+    return( NULL);
+}
+
+
+
+bdev_t *bdev_stripe( bdev_t **devs, int num, uint32_t stripe_unit){
+    bdev_worker_t *w;
+    bdev_t *bdev;
+    int i;
+
+    if( num <= 0 || num > BDEV_STRIPE_MAX_DEVS || stripe_unit == 0){
+        TRACE_ERR("invalid stripe, %d devices, unit=%u", num, stripe_unit);
+        return( NULL);
+    }
+
+    bdev = malloc( sizeof( bdev_t));
+    if( bdev == NULL){
+        TRACE_ERR("Error in malloc()");
+        return( NULL);
+    }
+
+    memset( (void *) bdev, 0, sizeof( bdev_t));
+    bdev->bd_devs = malloc( sizeof( bdev_t *) * num);
+    if( bdev->bd_devs == NULL){
+        TRACE_ERR("Error in malloc()");
+        free( bdev);
+        return( NULL);
+    }
+
+    bdev->bd_workers = malloc( sizeof( bdev_worker_t) * num);
+    if( bdev->bd_workers == NULL){
+        TRACE_ERR("Error in malloc()");
+        free( bdev->bd_devs);
+        free( bdev);
+        return( NULL);
+    }
+
+    memcpy( bdev->bd_devs, devs, sizeof( bdev_t *) * num);
+    bdev->bd_devs_num = num;
+
+    /* a device without a worker is served by the caller, that is slower
+     * but still correct */
+    memset( (void *) bdev->bd_workers, 0, sizeof( bdev_worker_t) * num);
+    for( i = 0; i < num; i++){
+        w = &bdev->bd_workers[i];
+        pthread_mutex_init( &w->sw_mutex, NULL);
+        pthread_cond_init( &w->sw_cond, NULL);
+        if( pthread_create( &w->sw_thread, NULL, bdev_stripe_thread, 
+                            w) == 0){
+            w->sw_started = 1;
+        }else{
+            TRACE_ERR("Could not start the worker of device %d", i);
+            pthread_cond_destroy( &w->sw_cond);
+            pthread_mutex_destroy( &w->sw_mutex);
+        }
+    }
+    bdev->bd_stripe_unit = stripe_unit;
+    bdev->bd_fd = -1;
+    bdev->bd_type = BDEV_STRIPE;
+    bdev->bd_ops = &bdev_stripe_ops;
+    return( bdev);
+}
+
+
+
+bdev_t *bdev_open_stripe( char *fnames, int type, uint32_t stripe_unit,
+                          uint32_t latency_us){
+    bdev_t *devs[BDEV_STRIPE_MAX_DEVS], *bdev = NULL;
+    char *list, *name, *saveptr;
+    int i, num = 0;
+
+    list = strdup( fnames);
+    if( list == NULL){
+        TRACE_ERR("Error in strdup()");
+        return( NULL);
+    }
+
+    for( name = strtok_r( list, ",", &saveptr); name != NULL;
+         name = strtok_r( NULL, ",", &saveptr)){
+        if( num == BDEV_STRIPE_MAX_DEVS){
+            TRACE_ERR("Too many devices, max is %d", BDEV_STRIPE_MAX_DEVS);
+            goto exit0;
+        }
+
+        if( type == BDEV_RAM){
+            devs[num] = bdev_open_ram( name, 0, latency_us);
+        }else{
+            devs[num] = bdev_open( name, type);
+        }
+
+        if( devs[num] == NULL){
+            goto exit0;
+        }
+        num++;
+    }
+
+    if( num == 0){
+        TRACE_ERR("No devices in '%s'", fnames);
+    }else if( num == 1){
+        bdev = devs[0];
+        num = 0;
+    }else{
+        bdev = bdev_stripe( devs, num, stripe_unit);
+        if( bdev != NULL){
+            num = 0;
+        }
+    }
+
+exit0:
+    for( i = 0; i < num; i++){
+        bdev_close( devs[i]);
+    }
+    free( list);
+    return( bdev);
+}
+
+
+
+int bdev_close( bdev_t *bdev){
+    int rc;
+
+    rc = bdev->bd_ops->close( bdev);
+    free( bdev);
+    return( rc);
+}
+
+
+int bdev_read( bdev_t *bdev, char *buf, uint64_t addr, int num_blocks){
+    return( bdev->bd_ops->read( bdev, buf, addr, num_blocks));
+}
+
+
+int bdev_write( bdev_t *bdev, char *buf, uint64_t addr, int num_blocks){
+    return( bdev->bd_ops->write( bdev, buf, addr, num_blocks));
+}
+
+
+int bdev_readv( bdev_t *bdev, struct iovec *iov, int iovcnt, uint64_t addr){
+    return( bdev->bd_ops->readv( bdev, iov, iovcnt, addr));
+}
+
+
+int bdev_writev( bdev_t *bdev, struct iovec *iov, int iovcnt,
+                 uint64_t addr){
+    return( bdev->bd_ops->writev( bdev, iov, iovcnt, addr));
+}
+
+
+static int bdev_vec_cmp( const void *a, const void *b){
+    const bdev_vec_t *va = *(const bdev_vec_t **) a;
+    const bdev_vec_t *vb = *(const bdev_vec_t **) b;
+
+    if( va->bv_block_addr < vb->bv_block_addr){
+        return( -1);
+    }
+
+    if( va->bv_block_addr > vb->bv_block_addr){
+        return( 1);
+    }
+
+    return( 0);
+}
+
+
+static int bdev_rw_vec( bdev_t *bdev, bdev_vec_t *vec, int nvec,
+                        int write_flag){
+    bdev_vec_t **sorted = NULL, *vp;
+    struct iovec *iov = NULL;
+    uint64_t run_addr, next_addr;
+    int i, j, run_start, rc = -1;
+
+    if( nvec <= 0){
+        return( 0);
+    }
+
+    sorted = malloc( sizeof( bdev_vec_t *) * nvec);
+    iov = malloc( sizeof( struct iovec) * nvec);
+    if( sorted == NULL || iov == NULL){
+        TRACE_SYSERR( "malloc error");
+        goto exit0;
+    }
+
+    for( i = 0; i < nvec; i++){
+        sorted[i] = &vec[i];
+    }
+
+    qsort( sorted, nvec, sizeof( bdev_vec_t *), bdev_vec_cmp);
+
+#ifdef POSIX_FADV_WILLNEED
+    /* let the kernel start every run at once, the reads below then
+     * find most of the data already in flight */
+    if( ! write_flag && bdev->bd_type == BDEV_FILE){
+        for( i = 0; i < nvec; i++){
+            vp = sorted[i];
+            posix_fadvise( bdev->bd_fd,
+                           (off_t) KFS_BLOCKS_TO_BYTES( vp->bv_block_addr),
+                           (off_t) KFS_BLOCKS_TO_BYTES( vp->bv_num_blocks),
+                           POSIX_FADV_WILLNEED);
+        }
+    }
+#endif
+
+    for( i = 0; i < nvec; i = run_start){
+        run_start = i;
+        run_addr = next_addr = sorted[i]->bv_block_addr;
+        j = 0;
+
+        /* collect the adjacent descriptors into a single run */
+        while( run_start < nvec &&
+               sorted[run_start]->bv_block_addr == next_addr){
+            vp = sorted[run_start];
+            iov[j].iov_base = vp->bv_buf;
+            iov[j].iov_len = (size_t) KFS_BLOCKS_TO_BYTES( vp->bv_num_blocks);
+            next_addr += vp->bv_num_blocks;
+            run_start++;
+            j++;
+        }
+
+        if( write_flag){
+            rc = bdev_writev( bdev, iov, j, run_addr);
+        }else{
+            rc = bdev_readv( bdev, iov, j, run_addr);
+        }
+
+        if( rc != 0){
+            TRACE_ERR( "could not %s run at %lu, %d extents",
+                       write_flag ? "write" : "read", run_addr, j);
+            goto exit0;
+        }
+    }
+
+    rc = 0;
+
+exit0:
+    free( iov);
+    free( sorted);
+    return( rc);
+}
+
+
+int bdev_read_vec( bdev_t *bdev, bdev_vec_t *vec, int nvec){
+    return( bdev_rw_vec( bdev, vec, nvec, 0));
+}
+
+
+int bdev_write_vec( bdev_t *bdev, bdev_vec_t *vec, int nvec){
+    return( bdev_rw_vec( bdev, vec, nvec, 1));
+}
+
+
+int bdev_flush( bdev_t *bdev){
+    return( bdev->bd_ops->flush( bdev));
+}
+
+
+int bdev_discard( bdev_t *bdev, uint64_t addr, int num_blocks){
+    return( bdev->bd_ops->discard( bdev, addr, num_blocks));
+}
+
+
+int bdev_size( bdev_t *bdev, uint64_t *size){
+    return( bdev->bd_ops->size( bdev, size));
+}
+
@@ -0,0 +1,127 @@
+#ifndef _BDEV_H_
+#define _BDEV_H_
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+
+/* block device backends. All the IO in the page cache and the tools goes
+ * thru one of these, so the storage may be changed without touching the
+ * caches. */
+#define BDEV_FILE                        0 /* regular file or device,
+                                              buffered IO */
+#define BDEV_DIRECT                      1 /* same with O_DIRECT */
+#define BDEV_RAM                         2 /* memory, for benchmarks */
+#define BDEV_TYPES_NUM                   3
+
+/* striped volume, built on top of other backends with bdev_stripe() or
+ * bdev_open_stripe(), it has no name and bdev_open() can not create it */
+#define BDEV_STRIPE                      3
+#define BDEV_STRIPE_MAX_DEVS             16
+#define BDEV_STRIPE_UNIT_DEFAULT         16 /* blocks */
+
+/* O_DIRECT buffers, offsets and lengths should be aligned to this */
+#define BDEV_DIRECT_ALIGN                4096
+
+struct bdev_s;
+
+/* backend operations. Addresses and lengths are in blocks, all of them
+ * return 0 on success and -1 on error with errno set */
+typedef struct{
+    int (*read)( struct bdev_s *bdev, char *buf, uint64_t addr,
+                 int num_blocks);
+    int (*write)( struct bdev_s *bdev, char *buf, uint64_t addr,
+                  int num_blocks);
+    int (*readv)( struct bdev_s *bdev, struct iovec *iov, int iovcnt,
+                  uint64_t addr);
+    int (*writev)( struct bdev_s *bdev, struct iovec *iov, int iovcnt,
+                   uint64_t addr);
+    int (*flush)( struct bdev_s *bdev);
+    int (*discard)( struct bdev_s *bdev, uint64_t addr, int num_blocks);
+    int (*size)( struct bdev_s *bdev, uint64_t *size); /* in bytes */
+    int (*close)( struct bdev_s *bdev);
+}bdev_ops_t;
+
+
+typedef struct bdev_s{
+    const bdev_ops_t *bd_ops;
+    int bd_type;
+    int bd_fd;                    /* file and direct backends */
+
+    char *bd_mem;                 /* ram backend memory */
+    uint64_t bd_size;             /* ram backend size in bytes */
+    uint32_t bd_latency_us;       /* ram backend, delay per request */
+
+    /* stripe backend. The volume is split in chunks of bd_stripe_unit
+     * blocks, chunk n lives in device n % bd_devs_num */
+    struct bdev_s **bd_devs;
+    int bd_devs_num;
+    uint32_t bd_stripe_unit;
+    struct bdev_worker_s *bd_workers;  /* one per device */
+}bdev_t;
+
+
+/* open fname with the file or direct backend */
+bdev_t *bdev_open( char *fname, int type);
+
+/* create a ram backend of size bytes. If fname is not NULL, the memory is
+ * loaded with the file contents, and size may be 0 to take the file size.
+ * Writes are never stored back into the file. Every request sleeps
+ * latency_us microseconds, to emulate a device. */
+bdev_t *bdev_open_ram( char *fname, uint64_t size, uint32_t latency_us);
+
+/* build a striped volume over num opened backends, with a stripe unit of
+ * stripe_unit blocks. On success the devices belong to the new bdev_t and
+ * are closed with it. Requests spanning several devices are split and
+ * served in parallel by a worker thread per device, started here and
+ * stopped on close. Requests within one device are served inline. */
+bdev_t *bdev_stripe( bdev_t **devs, int num, uint32_t stripe_unit);
+
+/* open a comma separated list of files with the backend type and stripe
+ * them. A single file just opens it. latency_us is for the ram backend,
+ * see above. */
+bdev_t *bdev_open_stripe( char *fnames, int type, uint32_t stripe_unit,
+                          uint32_t latency_us);
+
+/* map a block of a striped volume to its device index and the block in
+ * that device. Other backends map everything to device 0 */
+void bdev_stripe_map( bdev_t *bdev, uint64_t addr, int *dev,
+                      uint64_t *dev_addr);
+
+/* backend type from its name, "file", "direct" or "ram". -1 if invalid */
+int bdev_type_from_str( char *str);
+
+/* close the backend and free the bdev_t */
+int bdev_close( bdev_t *bdev);
+
+int bdev_read( bdev_t *bdev, char *buf, uint64_t addr, int num_blocks);
+int bdev_write( bdev_t *bdev, char *buf, uint64_t addr, int num_blocks);
+
+/* the iov array is used as scratch and may be modified */
+int bdev_readv( bdev_t *bdev, struct iovec *iov, int iovcnt, uint64_t addr);
+int bdev_writev( bdev_t *bdev, struct iovec *iov, int iovcnt,
+                 uint64_t addr);
+
+/* scatter-gather descriptor, one extent in the device and its buffer */
+typedef struct{
+    uint64_t bv_block_addr;
+    int bv_num_blocks;
+    char *bv_buf;
+}bdev_vec_t;
+
+/* read or write nvec scattered extents in one call. The descriptors are
+ * sorted by address and the adjacent ones merged into a single readv or
+ * writev of the backend, so a striped volume still spreads them over its
+ * devices. The vec array itself is not modified */
+int bdev_read_vec( bdev_t *bdev, bdev_vec_t *vec, int nvec);
+int bdev_write_vec( bdev_t *bdev, bdev_vec_t *vec, int nvec);
+int bdev_flush( bdev_t *bdev);
+
+/* the blocks are not needed anymore, their contents are undefined after
+ * this call. Backends without support just return 0 */
+int bdev_discard( bdev_t *bdev, uint64_t addr, int num_blocks);
+int bdev_size( bdev_t *bdev, uint64_t *size);
+
+
+#endif
+
@@ -67,6 +67,11 @@ void *cache_thread( void *cache_p){
                     if( cache->ca_on_flush_callback != NULL){
                         arg_res = (void *) &rc;
                         arg_res = cache->ca_on_flush_callback( (void *) el);
+                        if( arg_res == CACHE_CB_BUSY){
+                            /* still dirty, no eviction before the flush */
+                            pthread_mutex_unlock( &el->ce_mutex);
+                            continue;
+                        }
                         if( rc != 0){
                             TRACE_ERR( "error in on_flush_callback, rc=%d",
                                        *((int *)arg_res) );
@@ -86,6 +91,11 @@ void *cache_thread( void *cache_p){
                     if( cache->ca_on_evict_callback != NULL){
                         arg_res = (void *) &rc; 
                         arg_res = cache->ca_on_evict_callback( ( void *) el );
+                        if( arg_res == CACHE_CB_BUSY){
+                            /* the evict flag stays for the next loop */
+                            pthread_mutex_unlock( &el->ce_mutex);
+                            continue;
+                        }
                         if( rc != 0){
                             TRACE_ERR("error in on_evict_callback, rc=%d",
                                       *((int *)arg_res) );
@@ -211,7 +221,8 @@ int cache_enable( cache_t *cache){
 }
 
 
-void cache_element_evict_by_idx( cache_t *cache, int subin){
+/* return 0 if the element was evicted, 1 if it is busy and stays */
+int cache_element_evict_by_idx( cache_t *cache, int subin){
 /* a cache mutex on is assumed!!! */
     int rc, *arg_res;
     cache_element_t *el;
@@ -228,6 +239,10 @@ void cache_element_evict_by_idx( cache_t *cache, int subin){
         if( cache->ca_on_flush_callback != NULL){
             arg_res = &rc;
             arg_res = (void *) cache->ca_on_flush_callback( (void *) el);
+            if( arg_res == CACHE_CB_BUSY){
+                pthread_mutex_unlock( &el->ce_mutex);
+                return( 1);
+            }
             if( rc != 0){
                 TRACE_ERR( "error in on_flush_callback, rc=%d",
                            *((int *)arg_res) );
@@ -245,6 +260,10 @@ void cache_element_evict_by_idx( cache_t *cache, int subin){
     if( cache->ca_on_evict_callback != NULL){
         arg_res = (void *) &rc; 
         arg_res = cache->ca_on_evict_callback( ( void *) el );
+        if( arg_res == CACHE_CB_BUSY){
+            pthread_mutex_unlock( &el->ce_mutex);
+            return( 1);
+        }
         if( rc != 0){
             TRACE_ERR( "error in on_evict_callback, rc=%d",
                        *((int *)arg_res) );
@@ -258,6 +277,7 @@ void cache_element_evict_by_idx( cache_t *cache, int subin){
 
     free( el);
     cache->ca_elements_ptr[subin] = NULL;
+    return( 0);
 }
 
 
@@ -272,7 +292,9 @@ void cache_element_evict( cache_t *cache, uint64_t key){
 
         if( el != NULL){
             if( el->ce_id == key){
-                cache_element_evict_by_idx( cache, i);
+                if( cache_element_evict_by_idx( cache, i) != 0){
+                    cache_element_mark_eviction( el);
+                }
                 break;
             }
         }
@@ -513,7 +535,24 @@ cache_element_t *cache_element_map( cache_t *cache, size_t byte_size){
             el = NULL;
             goto exit0;
         }
-        cache_element_evict_by_idx( cache, sub);
+
+        if( cache_element_evict_by_idx( cache, sub) != 0){
+            /* the LRU element is in use, take any other one that is not */
+            for( i = 0, sub = -1; i < cache->ca_elements_capacity; i++){
+                el = cache->ca_elements_ptr[i];
+                if( ( el->ce_flags & CACHE_EL_PIN) == 0 &&
+                    cache_element_evict_by_idx( cache, i) == 0){
+                    sub = i;
+                    break;
+                }
+            }
+
+            if( sub < 0){
+                TRACE_ERR("all cache elements are in use. Can not map data");
+                el = NULL;
+                goto exit0;
+            }
+        }
     }
 
     TRACE("clean pointer found sub=%d", sub);
@@ -643,6 +682,7 @@ int cache_element_wait_for_flags( cache_element_t *el,
 
         pthread_mutex_lock( &el->ce_mutex);
 
+        rc = 1;
         if( ( flags == 0 && el->ce_flags == 0) || 
             ( flags != 0 && ( ( el->ce_flags & flags) == flags)) ){
             rc = 0;
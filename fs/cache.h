@@ -90,10 +90,18 @@
                                            CACHE_LOOP_DONE to zero when 
                                            acknowledgement */
 
+/* on_flush and on_evict return this when the element is in use and can
+ * not be written or freed now. It stays dirty or resident, and the
+ * cache thread tries it again in the next loop */
+#define CACHE_CB_BUSY          ((void *) 1)
+
 #define CACHE(x)               ((cache_t *)(x))
 #define CACHE_EL(x)            ((cache_element_t *)(x))
 
-#define CACHE_EL_ADD_COUNT(x)  ((CACHE_EL(x))->ce_access_count++)
+/* elements may be looked up in parallel under shared locks */
+#define CACHE_EL_ADD_COUNT(x)  __atomic_fetch_add(                          \
+                                   &(CACHE_EL(x))->ce_access_count, 1,      \
+                                   __ATOMIC_RELAXED)
 #define IS_CACHE_ACTIVE(x)     (((CACHE(x))->ca_flags & CACHE_ACTIVE)?1:0)
 
 /* each element in cache.
@@ -194,7 +202,7 @@ int cache_element_pin( cache_element_t *ce);
 
 /* if not pinned, any element may be removed in a sync or when a cache 
  * eviction is needed. */ 
-int cache_element_un_pin( cache_element_t *ce);
+int cache_element_mark_unpin( cache_element_t *ce);
 
 /* wait for conditions but in the cache element, not the cache data 
  * structure*/
@@ -202,7 +210,8 @@ int cache_element_wait_for_flags( cache_element_t *ce,
                                   uint32_t flags, 
                                   int timeout_secs);
 
-/* explicit eviction of a cache element */
+/* explicit eviction of a cache element, if it is busy it is marked for
+ * eviction in the next thread loop */
 void cache_element_evict( cache_t *cache, uint64_t key);
 #endif
 
@@ -0,0 +1,320 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trace.h"
+#include "kfs_mem.h"
+#include "dalloc.h"
+
+
+
+void dalloc_init( dalloc_t *da, agmap_t *am, pgcache_t *pgcache,
+                  uint64_t goal){
+    memset( (void *) da, 0, sizeof( dalloc_t));
+    da->da_map = am;
+    da->da_pgcache = pgcache;
+    da->da_goal = goal;
+    prealloc_init( &da->da_prealloc, am, DALLOC_MAX_EXTENT_BLOCKS);
+}
+
+
+
+void dalloc_destroy( dalloc_t *da){
+    if( da->da_reserved > 0){
+        agmap_unreserve( da->da_map, da->da_reserved);
+    }
+
+    prealloc_trim( &da->da_prealloc);
+    free( da->da_buf);
+    da->da_buf = NULL;
+    da->da_len = da->da_capacity = da->da_reserved = 0;
+    da->da_flags = 0;
+}
+
+
+
+int dalloc_write( dalloc_t *da, uint64_t offset, void *buf, uint64_t len){
+    uint64_t end, blocks, capacity;
+    unsigned char *p;
+
+    /* the partial block kept by the last flush is on disk already, a write
+     * somewhere else drops it and starts a new range */
+    if( !( da->da_flags & DALLOC_DIRTY) &&
+        ( offset < da->da_offset || offset > da->da_offset + da->da_len)){
+        da->da_len = 0;
+        da->da_flags &= ~DALLOC_PARTIAL;
+    }
+
+    /* a new range */
+    if( da->da_len == 0 && offset != da->da_offset){
+        if( ( offset & ( KFS_BLOCKSIZE - 1)) != 0){
+            TRACE_ERR("Dirty range out of a block boundary, offset=%lu",
+                      offset);
+            return( -1);
+        }
+        da->da_offset = offset;
+    }
+
+    if( offset < da->da_offset || offset > da->da_offset + da->da_len){
+        return( 1);
+    }
+
+    end = offset - da->da_offset + len;
+    if( end > da->da_len){
+        /* a partial first block is allocated already */
+        blocks = KFS_BYTES_TO_BLOCKS( end + KFS_BLOCKSIZE - 1);
+        if( da->da_flags & DALLOC_PARTIAL){
+            blocks--;
+        }
+
+        if( blocks > da->da_reserved){
+            if( agmap_reserve( da->da_map, blocks - da->da_reserved) != 0){
+                TRACE_ERR("No room for %lu blocks",
+                          blocks - da->da_reserved);
+                return( -1);
+            }
+            da->da_reserved = blocks;
+        }
+
+        if( end > da->da_capacity){
+            capacity = ( da->da_capacity == 0) ? KFS_BLOCKSIZE :
+                                                 da->da_capacity;
+            while( capacity < end){
+                capacity *= 2;
+            }
+
+            p = realloc( da->da_buf, capacity);
+            if( p == NULL){
+                TRACE_ERR("Error in realloc()");
+                return( -1);
+            }
+            da->da_buf = p;
+            da->da_capacity = capacity;
+        }
+    }
+
+    memcpy( da->da_buf + ( offset - da->da_offset), buf, len);
+    if( end > da->da_len){
+        da->da_len = end;
+    }
+    da->da_flags |= DALLOC_DIRTY;
+
+    return( 0);
+}
+
+
+
+/* copy len bytes of the range into the blocks of an extent thru the page
+ * cache, the rest of the last block is zeroed */
+static int dalloc_write_out( dalloc_t *da, uint64_t addr, int blocks,
+                             unsigned char *p, uint64_t len){
+    pgcache_element_t *el;
+    int rc;
+
+    /* blocks freed before may still be cached */
+    el = pgcache_element_map_zero( da->da_pgcache, addr, blocks);
+    if( el == NULL){
+        el = pgcache_element_map( da->da_pgcache, addr, blocks);
+        if( el == NULL){
+            TRACE_ERR("Could not map extent, addr=%lu", addr);
+            return( -1);
+        }
+    }
+
+    pgcache_element_write_lock( el);
+    memcpy( el->pe_mem_ptr, p, len);
+    memset( (unsigned char *) el->pe_mem_ptr + len, 0,
+            KFS_BLOCKS_TO_BYTES( blocks) - len);
+    pgcache_element_unlock( el);
+
+    rc = PGCACHE_EL_MARK_DIRTY( el);
+    return( rc);
+}
+
+
+
+/* give back the blocks of the extents from the n-th one, the partial
+ * first block of the range stays allocated */
+static void dalloc_put_extents( dalloc_t *da, kfs_extent_t *ex, int n,
+                                int ex_num){
+    uint64_t addr, len;
+
+    for( ; n < ex_num; n++){
+        addr = ex[n].ee_block_addr;
+        len = ex[n].ee_block_size;
+        if( n == 0 && ( da->da_flags & DALLOC_PARTIAL)){
+            addr++;
+            len--;
+        }
+
+        if( len > 0){
+            agmap_put_reserved( da->da_map, addr, len);
+        }
+    }
+}
+
+
+
+/* the partial block of the last flush, written again thru the element
+ * holding it, so the page cache has a single copy of the block. The
+ * element is read back if it was evicted */
+static int dalloc_write_partial( dalloc_t *da, unsigned char *p, 
+                                 uint64_t len){
+    pgcache_element_t *el;
+    unsigned char *b;
+    int rc;
+
+    el = pgcache_element_map( da->da_pgcache, da->da_el_addr, 
+                              da->da_el_blocks);
+    if( el == NULL){
+        TRACE_ERR("Could not map extent, addr=%lu", da->da_el_addr);
+        return( -1);
+    }
+
+    pgcache_element_write_lock( el);
+    b = (unsigned char *) el->pe_mem_ptr + 
+        KFS_BLOCKS_TO_BYTES( da->da_block_addr - da->da_el_addr);
+    memcpy( b, p, len);
+    memset( b + len, 0, KFS_BLOCKSIZE - len);
+    pgcache_element_unlock( el);
+
+    rc = PGCACHE_EL_MARK_DIRTY( el);
+    return( rc);
+}
+
+
+
+int dalloc_flush( dalloc_t *da, kfs_extent_t *ex, int ex_max){
+    uint64_t blocks, done, want, addr, goal, bytes, first = 0;
+    uint64_t el_addr;
+    int n = 0, i, size, el_blocks;
+
+    if( !( da->da_flags & DALLOC_DIRTY)){
+        return( 0);
+    }
+
+    blocks = KFS_BYTES_TO_BLOCKS( da->da_len + KFS_BLOCKSIZE - 1);
+    goal = da->da_goal;
+
+    /* the partial block of the last flush is rewritten where it is, the
+     * extent grows after it */
+    if( da->da_flags & DALLOC_PARTIAL){
+        memset( (void *) &ex[0], 0, sizeof( kfs_extent_t));
+        ex[0].ee_block_addr = da->da_block_addr;
+        ex[0].ee_block_size = 1;
+        ex[0].ee_log_addr = (uint32_t) KFS_BYTES_TO_BLOCKS( da->da_offset);
+        ex[0].ee_log_size = 1;
+        goal = da->da_block_addr + 1;
+        first = 1;
+        n = 1;
+    }
+
+    /* the biggest extents we can get, all at once if there is room */
+    for( done = first; done < blocks; done += want){
+        want = min( blocks - done, (uint64_t) DALLOC_MAX_EXTENT_BLOCKS);
+        want = min( want, da->da_map->am_group_bits);
+        while( want > 0 &&
+               prealloc_get( &da->da_prealloc, goal, want, 1, &addr) != 0){
+            want /= 2;
+        }
+
+        /* right after the partial block */
+        if( want > 0 && n == 1 && first && addr == goal &&
+            ex[0].ee_block_size + want <= DALLOC_MAX_EXTENT_BLOCKS){
+            ex[0].ee_block_size += (uint16_t) want;
+            ex[0].ee_log_size += (uint16_t) want;
+            goal = addr + want;
+            continue;
+        }
+
+        if( want == 0 || n == ex_max){
+            if( want > 0){
+                agmap_put_reserved( da->da_map, addr, want);
+            }
+            TRACE_ERR("Dirty range does not fit, blocks=%lu, extents=%d",
+                      blocks, n);
+            goto exit0;
+        }
+
+        memset( (void *) &ex[n], 0, sizeof( kfs_extent_t));
+        ex[n].ee_block_addr = addr;
+        ex[n].ee_block_size = (uint16_t) want;
+        ex[n].ee_log_addr = (uint32_t) ( KFS_BYTES_TO_BLOCKS( da->da_offset) +
+                                         done);
+        ex[n].ee_log_size = (uint16_t) want;
+        n++;
+        goal = addr + want;
+    }
+
+    el_addr = da->da_el_addr;
+    el_blocks = da->da_el_blocks;
+    for( i = 0, done = 0; i < n; i++){
+        addr = ex[i].ee_block_addr;
+        size = ex[i].ee_block_size;
+        if( i == 0 && first){
+            bytes = min( (uint64_t) KFS_BLOCKSIZE, da->da_len);
+            if( dalloc_write_partial( da, da->da_buf, bytes) != 0){
+                goto exit1;
+            }
+            done = bytes;
+            addr++;
+            if( --size == 0){
+                continue;
+            }
+        }
+
+        bytes = min( KFS_BLOCKS_TO_BYTES( size), da->da_len - done);
+        if( dalloc_write_out( da, addr, size, da->da_buf + done, 
+                              bytes) != 0){
+            goto exit1;
+        }
+        el_addr = addr;
+        el_blocks = size;
+        done += bytes;
+    }
+
+    da->da_reserved -= blocks - first;
+    da->da_goal = goal;
+    da->da_flags &= ~( DALLOC_DIRTY | DALLOC_PARTIAL);
+
+    /* a partial last block stays in the range, the next appends go on
+     * after the data and the next flush writes it again */
+    bytes = da->da_len & ( KFS_BLOCKSIZE - 1);
+    if( bytes != 0){
+        da->da_block_addr = ex[n - 1].ee_block_addr +
+                            ex[n - 1].ee_block_size - 1;
+        da->da_el_addr = el_addr;
+        da->da_el_blocks = el_blocks;
+        da->da_flags |= DALLOC_PARTIAL;
+        memmove( da->da_buf, da->da_buf + da->da_len - bytes, bytes);
+    }
+    da->da_offset += da->da_len - bytes;
+    da->da_len = bytes;
+    return( n);
+
+exit1:
+    if( i > 0){
+        /* the extents written are dirty in the page cache, they are kept
+         * and returned, the rest of the range stays dirty. The extents
+         * before i are whole, done is at a block boundary */
+        prealloc_trim( &da->da_prealloc);
+        da->da_prealloc.pa_len = 0;
+        dalloc_put_extents( da, ex, i, n);
+
+        da->da_reserved -= KFS_BYTES_TO_BLOCKS( done) - first;
+        da->da_offset += done;
+        da->da_len -= done;
+        da->da_flags &= ~DALLOC_PARTIAL;
+        memmove( da->da_buf, da->da_buf + done, da->da_len);
+        da->da_goal = ex[i - 1].ee_block_addr + ex[i - 1].ee_block_size;
+        return( i);
+    }
+
+exit0:
+    /* the blocks go back to the reservation, the range is still dirty.
+     * The last extent is not known anymore, the next flush starts a new
+     * one */
+    prealloc_trim( &da->da_prealloc);
+    da->da_prealloc.pa_len = 0;
+    dalloc_put_extents( da, ex, 0, n);
+    return( -1);
+}
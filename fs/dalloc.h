@@ -0,0 +1,87 @@
+#ifndef _DALLOC_H_
+#define _DALLOC_H_
+
+#include <stdint.h>
+#include "kfs_mem.h"
+#include "kfs_disk.h"
+#include "agroup.h"
+#include "prealloc.h"
+#include "page_cache.h"
+
+
+/* delayed allocation. New data of an object stays in memory, with its
+ * blocks reserved in the block map but not chosen yet, until it is
+ * flushed. Then a single contiguous extent is taken for the whole dirty
+ * range when possible, so an object growing by small appends ends up in
+ * a few big extents instead of one per write.
+ *
+ * The dirty range is contiguous and starts at a block boundary of the
+ * object. The writes go inside it or right after its end. A flush ending
+ * in a partial block keeps that block in the range, allocated already, so
+ * the next small append goes on right after the data and the next flush
+ * rewrites the block in place.
+ *
+ * The extents are taken with a speculative tail after them, see
+ * prealloc.h, so the next flushes grow the same extent in place. */
+
+/* longest extent given by a flush, an extent size on disk is 16 bits */
+#define DALLOC_MAX_EXTENT_BLOCKS         UINT16_MAX
+
+typedef struct{
+    agmap_t *da_map;              /* block map, not owned */
+    pgcache_t *da_pgcache;        /* the flush writes thru it, not owned */
+    uint64_t da_goal;             /* block to allocate near */
+
+    uint64_t da_offset;           /* bytes, start of the range in the object */
+    uint64_t da_len;              /* bytes in the range */
+    uint64_t da_capacity;
+    unsigned char *da_buf;
+
+    uint64_t da_reserved;         /* blocks reserved in da_map */
+    uint64_t da_block_addr;       /* first block of the range if partial */
+    uint64_t da_el_addr;          /* page cache element it was written */
+    int da_el_blocks;             /* thru, rewritten thru it too */
+
+#define DALLOC_DIRTY                     0x0001 /* written since the last
+                                                   flush */
+#define DALLOC_PARTIAL                   0x0002 /* the first block of the
+                                                   range is the partial
+                                                   last block of the last
+                                                   flush, at da_block_addr */
+    uint32_t da_flags;
+    prealloc_t da_prealloc;       /* last extent and its tail */
+}dalloc_t;
+
+
+/* empty dirty range for an object, its extents are allocated near goal
+ * if it is not FALLOC_NO_GOAL */
+void dalloc_init( dalloc_t *da, agmap_t *am, pgcache_t *pgcache,
+                  uint64_t goal);
+
+/* drop the data not flushed and its reservation, and give back the tail
+ * of the last extent. Call it on close or eviction of the object */
+void dalloc_destroy( dalloc_t *da);
+
+/* copy len bytes at offset of the object into the dirty range and reserve
+ * the blocks for them. Return 0, 1 if offset is out of the range, the
+ * caller should flush it first, or -1 if there is no room in the map or a
+ * new range would not start at a block boundary */
+int dalloc_write( dalloc_t *da, uint64_t offset, void *buf, uint64_t len);
+
+/* allocate the blocks for the whole dirty range, as few extents as
+ * possible, and write it thru the page cache. The extents are set in ex,
+ * with ee_log_addr the block of the object. The first one may follow the
+ * last extent of the previous flush, grown in place, the caller may merge
+ * both. If the previous flush ended in a partial block, the first extent
+ * starts at that block, rewritten in place, and overlaps the last one by
+ * that block. The range is clean after this, the next one starts at the
+ * first block after it, or at its last block if that one is partial.
+ * Return the number of extents, or -1 if more than ex_max are needed or
+ * on error, the range stays dirty then. If the write fails after some
+ * extents went to the page cache, only those are returned and the range
+ * left after them stays dirty */
+int dalloc_flush( dalloc_t *da, kfs_extent_t *ex, int ex_max);
+
+
+#endif
+
@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include "trace.h"
@@ -66,38 +67,345 @@ value_t dict_value_new( unsigned int data_type, void *data, int len){
 
 
 void dict_init( dict_t *d){
-    d->n_elems = 0;
+    memset( d->inline_dict, 0, sizeof( d->inline_dict));
+    d->inline_str_used = 0;
+    d->n_elems = DICT_INLINE_ELEMS;
     d->used_elems = 0;
-    d->dict = NULL;
+    d->deleted_elems = 0;
+    d->dict = d->inline_dict;
+    d->index = NULL;
+    d->index_slots = 0;
+    d->index_used = 0;
+    d->flags = 0;
+    d->arena = NULL;
 }
 
-dict_t dict_new(){
-    dict_t d;
+void dict_init_sorted( dict_t *d){
+    dict_init( d);
+    d->flags = DICT_SORTED;
+}
+
+int dict_init_arena( dict_t *d, size_t size, uint32_t flags){
+    dict_init( d);
+    d->arena = arena_alloc( size);
+    if( d->arena == NULL){
+        return( -1);
+    }
 
-    dict_init( &d);
-    return(d);
+    d->flags = ( flags & DICT_SORTED) | DICT_ARENA;
+    return( 0);
 }
 
 
-int dict_add_entry( dict_t *d, char *key, value_t value){
+
+/* memory for the dict arrays, from the arena in arena dicts */
+static void *dict_mem_calloc( dict_t *d, size_t n, size_t size){
+    void *p;
+
+    if( ( d->flags & DICT_ARENA) == 0){
+        return( calloc( n, size));
+    }
+
+    p = arena_malloc( d->arena, n * size);
+    if( p != NULL){
+        memset( p, 0, n * size);
+    }
+    return( p);
+}
+
+static void dict_mem_free( dict_t *d, void *p){
+    if( ( d->flags & DICT_ARENA) == 0 && p != ( void *) d->inline_dict){
+        free( p);
+    }
+}
+
+
+
+/* the values with data in value.s */
+static int dict_value_has_data( value_t *v){
+    return( v->value.s != NULL &&
+            ( (v->data_type == DICT_BLOB   ) ||
+              (v->data_type == DICT_EXTENT ) ||
+              (v->data_type == DICT_STRING ) ) );
+}
+
+
+
+/* the data of the value came from malloc() */
+static int dict_value_owned( dict_t *d, value_t *v){
+    return( ( d->flags & DICT_ARENA) == 0 && dict_value_has_data( v) &&
+            ( v->value.s < d->inline_str ||
+              v->value.s >= d->inline_str + DICT_INLINE_STRLEN));
+}
+
+
+
+/* n bytes for a string of d, NULL if they do not fit in inline_str */
+static char *dict_str_inline( dict_t *d, size_t n){
+    char *p;
+
+    if( d->flags & DICT_ARENA ||
+        d->inline_str_used + n > DICT_INLINE_STRLEN){
+        return( NULL);
+    }
+
+    p = d->inline_str + d->inline_str_used;
+    d->inline_str_used += n;
+    return( p);
+}
+
+
+
+/* put the data of a value in the memory of d, its arena or the heap. With
+ * owned the old copy came from malloc() and it is freed */
+static int dict_value_copy( dict_t *d, value_t *v, int owned){
+    size_t n;
+    char *p;
+
+    if( !dict_value_has_data( v)){
+        return( 0);
+    }
+
+    /* strings keep their zero */
+    n = v->data_len + ( v->data_type == DICT_STRING);
+    if( n == 0){
+        if( owned){
+            free( v->value.s);
+        }
+        v->value.s = NULL;
+        return( 0);
+    }
+
+    if( d->flags & DICT_ARENA){
+        p = arena_malloc( d->arena, n);
+    }else{
+        p = ( v->data_type == DICT_STRING) ? dict_str_inline( d, n) : NULL;
+        if( p == NULL){
+            p = malloc( n);
+        }
+    }
+
+    if( p == NULL){
+        TRACE_ERR("could not reserve memory");
+        return( -1);
+    }
+
+    /* the strings may come without their zero */
+    if( v->data_type == DICT_STRING){
+        memcpy( p, v->value.s, n - 1);
+        p[n - 1] = 0;
+    }else{
+        memcpy( p, v->value.s, n);
+    }
+
+    if( owned){
+        free( v->value.s);
+    }
+    v->value.s = p;
+    return( 0);
+}
+
+/* hash of the whole key for the index, hash_b79() only takes the first
+ * characters */
+static uint64_t dict_key_hash( char *key){
+    return( xxh64( key, strnlen( key, DICT_KEY_LEN), 0));
+}
+
+
+
+static void dict_index_insert( dict_t *d, uint64_t h, uint32_t sub){
+    uint32_t i, mask = d->index_slots - 1;
+
+    i = (uint32_t) h & mask;
+    while( d->index[i] != 0 && d->index[i] != DICT_INDEX_DELETED){
+        i = ( i + 1) & mask;
+    }
+
+    if( d->index[i] == 0){
+        d->index_used++;
+    }
+    d->index[i] = ( ( h >> 32) << 32) | ( sub + 1);
+}
+
+
+
+/* slot of key in the index, -1 if it is not there */
+static int64_t dict_index_find( dict_t *d, char *key, uint64_t h){
+    uint32_t i, sub, mask = d->index_slots - 1;
+    uint64_t slot;
+
+    i = (uint32_t) h & mask;
+    while( ( slot = d->index[i]) != 0){
+        if( slot != DICT_INDEX_DELETED && ( slot >> 32) == ( h >> 32)){
+            sub = (uint32_t) slot - 1;
+            if( strncmp( key, d->dict[sub].key, DICT_KEY_LEN) == 0){
+                return( i);
+            }
+        }
+        i = ( i + 1) & mask;
+    }
+
+    return( -1);
+}
+
+
+
+/* build the index again for the entries, with room to grow. Without
+ * memory the dict keeps working with linear searches */
+static int dict_index_build( dict_t *d){
+    const void *keys[DICT_HASH_BATCH];
+    size_t lens[DICT_HASH_BATCH];
+    uint64_t h[DICT_HASH_BATCH];
+    uint32_t subs[DICT_HASH_BATCH];
+    uint32_t i, j, n = 0, slots = DICT_INDEX_MIN_SLOTS;
+
+    while( slots < 4 * dict_num_entries( d)){
+        slots *= 2;
+    }
+
+    dict_mem_free( d, d->index);
+    d->index = dict_mem_calloc( d, slots, sizeof( uint64_t));
+    d->index_used = 0;
+    if( d->index == NULL){
+        TRACE_ERR("could not reserve memory for the index");
+        d->index_slots = 0;
+        return( -1);
+    }
+    d->index_slots = slots;
+
+    /* the keys are hashed in batches, the same as dict_key_hash() */
+    for( i = 0; i < d->used_elems; i++){
+        if( d->dict[i].value.data_type == DICT_DELETED){
+            continue;
+        }
+
+        keys[n] = d->dict[i].key;
+        lens[n] = strnlen( d->dict[i].key, DICT_KEY_LEN);
+        subs[n++] = i;
+        if( n == DICT_HASH_BATCH){
+            xxh64_batch( keys, lens, 0, h, n);
+            for( j = 0; j < n; j++){
+                dict_index_insert( d, h[j], subs[j]);
+            }
+            n = 0;
+        }
+    }
+
+    xxh64_batch( keys, lens, 0, h, n);
+    for( j = 0; j < n; j++){
+        dict_index_insert( d, h[j], subs[j]);
+    }
+
+    return( 0);
+}
+
+
+
+/* squeeze the holes out, keeping the order */
+static void dict_compact( dict_t *d){
+    uint32_t i, n = 0;
+
+    for( i = 0; i < d->used_elems; i++){
+        if( d->dict[i].value.data_type == DICT_DELETED){
+            continue;
+        }
+
+        if( n != i){
+            d->dict[n] = d->dict[i];
+        }
+        n++;
+    }
+
+    memset( &d->dict[n], 0, ( d->used_elems - n) * sizeof( dict_entry_t));
+    d->used_elems = n;
+    d->deleted_elems = 0;
+
+    if( d->index != NULL){
+        dict_index_build( d);
+    }
+}
+
+
+
+/* order of the sorted dicts */
+static int dict_key_cmp( uint64_t h1, char *k1, uint64_t h2, char *k2){
+    if( h1 != h2){
+        return( h1 < h2 ? -1 : 1);
+    }
+
+    return( strncmp( k1, k2, DICT_KEY_LEN));
+}
+
+
+
+/* first entry of a sorted dict not lower than h and key */
+static uint32_t dict_lower_bound( dict_t *d, uint64_t h, char *key){
+    uint32_t lo = 0, hi = d->used_elems, mid;
+
+    while( lo < hi){
+        mid = lo + ( hi - lo) / 2;
+        if( dict_key_cmp( d->dict[mid].hash_key, d->dict[mid].key, h,
+                          key) < 0){
+            lo = mid + 1;
+        }else{
+            hi = mid;
+        }
+    }
+
+    return( lo);
+}
+
+
+
+static void dict_value_free( dict_t *d, value_t *v){
+    if( dict_value_owned( d, v)){
+        free( v->value.s);
+    }
+}
+
+
+
+uint32_t dict_num_entries( dict_t *d){
+    return( d->used_elems - d->deleted_elems);
+}
+
+
+
+/* add an entry, its value is in the memory of the dict already */
+static int dict_insert( dict_t *d, char *key, value_t value){
     dict_entry_t dentry; 
     void *p = NULL;
     int nbuflen = 0;
+    uint32_t sub;
 
     strncpy( dentry.key, key, DICT_KEY_LEN);
     dentry.value = value;
 
     dentry.hash_key = hash_b79( dentry.key);
 
-    /* if nothing in the dict, calculate a new buf length */ 
-    if( d->dict == NULL){
-        nbuflen = sizeof( dict_entry_t ) * DICT_DEFAULT_NUM_ELEMS;
-    }else if( (d->used_elems + 1) >= d->n_elems){
-        /* if we need extra storage, also calculate a new buf length */
+    /* if we need extra storage, calculate a new buf length */
+    if( d->used_elems >= d->n_elems){
         nbuflen = sizeof( dict_entry_t ) * d->n_elems * 2;
     }       
 
-    if( nbuflen > 0){
+    /* out of the inline entries, or out of the arena ones. The old array
+     * stays in the arena */
+    if( nbuflen > 0 &&
+        ( ( d->flags & DICT_ARENA) || d->dict == d->inline_dict)){
+        p = ( d->flags & DICT_ARENA) ? arena_malloc( d->arena, nbuflen) :
+                                       malloc( nbuflen);
+        if( p == NULL){
+            return( -1);
+        }
+        if( d->used_elems > 0){
+            memcpy( p, d->dict, d->used_elems * sizeof( dict_entry_t));
+        }
+        d->dict = p;
+        d->n_elems = nbuflen / sizeof( dict_entry_t);
+        memset( &d->dict[d->used_elems], 0,
+                ( d->n_elems - d->used_elems) * sizeof( dict_entry_t));
+        p = NULL;
+    }else if( nbuflen > 0){
         /* if extra memory is required, alloc and clean the new memory */
         d->dict = realloc( d->dict, nbuflen);
         if( p != NULL){
@@ -112,17 +420,100 @@ int dict_add_entry( dict_t *d, char *key, value_t value){
 
     }
 
+    /* sorted, in its place */
+    if( d->flags & DICT_SORTED){
+        sub = dict_lower_bound( d, dentry.hash_key, dentry.key);
+        memmove( &d->dict[sub + 1], &d->dict[sub],
+                 ( d->used_elems - sub) * sizeof( dict_entry_t));
+        memcpy( &d->dict[sub], &dentry, sizeof( dict_entry_t));
+        d->used_elems++;
+        return( 0);
+    }
+
     memcpy( &d->dict[d->used_elems], &dentry, sizeof( dict_entry_t));
     d->used_elems++;
 
+    if( d->index != NULL){
+        if( ( d->index_used + 1) * 2 > d->index_slots){
+            dict_index_build( d);
+        }else{
+            dict_index_insert( d, dict_key_hash( dentry.key),
+                               d->used_elems - 1);
+        }
+    }else if( dict_num_entries( d) > DICT_INDEX_MIN_ELEMS){
+        dict_index_build( d);
+    }
+
     return(0);
 }
 
+int dict_add_entry( dict_t *d, char *key, value_t value){
+    /* arena dicts keep a copy */
+    if( ( d->flags & DICT_ARENA) && dict_value_copy( d, &value, 1) != 0){
+        return( -1);
+    }
+
+    return( dict_insert( d, key, value));
+}
+
+int dict_add_value( dict_t *d, char *key, unsigned int data_type, void *data,
+                    int len){
+    value_t v;
+
+    if( data_type != DICT_STRING && data_type != DICT_BLOB &&
+        data_type != DICT_EXTENT){
+        return( dict_add_entry( d, key, dict_value_new( data_type, data,
+                                                        len)));
+    }
+
+    memset( &v, 0, sizeof( v));
+    v.data_type = data_type;
+    v.value.s = ( char *) data;
+    v.data_len = ( uint32_t) len;
+    if( data_type == DICT_STRING){
+        v.data_len = strnlen( ( char *) data,
+                              ( len > 0 && len < DICT_MAX_STRLEN) ?
+                              len : DICT_MAX_STRLEN);
+    }
+
+    /* data stays with the caller */
+    if( dict_value_copy( d, &v, 0) != 0){
+        return( -1);
+    }
+
+    return( dict_insert( d, key, v));
+}
+
 dict_entry_t *dict_search_entry( dict_t *d, char *key, int *sub){
+    int64_t slot;
+    uint64_t h;
     int i;
 
+    if( d->flags & DICT_SORTED){
+        h = hash_b79( key);
+        i = dict_lower_bound( d, h, key);
+        if( i == d->used_elems ||
+            dict_key_cmp( d->dict[i].hash_key, d->dict[i].key, h, key) != 0){
+            return( NULL);
+        }
+
+        *sub = i;
+        return( &d->dict[i]);
+    }
+
+    if( d->index != NULL){
+        slot = dict_index_find( d, key, dict_key_hash( key));
+        if( slot < 0){
+            return( NULL);
+        }
+
+        *sub = (uint32_t) d->index[slot] - 1;
+        return( &d->dict[*sub]);
+    }
+
     for( i = 0; i < d->used_elems; i++){
-        if( strncmp( key, d->dict[i].key, DICT_KEY_LEN) == 0){
+        if( d->dict[i].value.data_type != DICT_DELETED &&
+            strncmp( key, d->dict[i].key, DICT_KEY_LEN) == 0){
             *sub = i;
             return( &d->dict[i]);
         }
@@ -137,9 +528,10 @@ dict_entry_t *dict_search_entry( dict_t *d, char *key, int *sub){
 
 int dict_remove_entry( dict_t *d, char *key){
     dict_entry_t *o;
+    int64_t slot;
     int sub;
 
-    if( d->used_elems == 0){
+    if( dict_num_entries( d) == 0){
         return( -1);
     }
 
@@ -147,20 +539,40 @@ int dict_remove_entry( dict_t *d, char *key){
     if( o == NULL){
         return( -1);
     }
+    dict_value_free( d, &o->value);
+
+    if( d->index != NULL){
+        slot = dict_index_find( d, key, dict_key_hash( key));
+        d->index[slot] = DICT_INDEX_DELETED;
+    }
+
+    /* sorted dicts have no holes */
+    if( d->flags & DICT_SORTED){
+        memmove( &d->dict[sub], &d->dict[sub + 1],
+                 ( d->used_elems - sub - 1) * sizeof( dict_entry_t));
+        d->used_elems--;
+        memset( &d->dict[d->used_elems], 0, sizeof( dict_entry_t));
+        return( 0);
+    }
 
-    if( (d->used_elems - 1) != sub){
-        memcpy( &d->dict[sub], 
-                &d->dict[sub+1], 
-                sizeof( dict_entry_t) * ( d->used_elems - sub - 1));
+    /* the last entry just goes away, any other leaves a hole so the
+     * entries after it keep their place */
+    memset( o, 0, sizeof( dict_entry_t));
+    if( (d->used_elems - 1) == sub){
+        d->used_elems--;
+    }else{
+        o->value.data_type = DICT_DELETED;
+        d->deleted_elems++;
+        if( d->deleted_elems * 2 > d->used_elems){
+            dict_compact( d);
+        }
     }
-    d->used_elems--;
     return( 0);
 }
 
 int dict_update_entry( dict_t *d, char *key, value_t new_value){
     dict_entry_t *o;
     int sub;
-    value_t v;
 
     if( d->used_elems == 0){
         return( -1);
@@ -170,53 +582,76 @@ int dict_update_entry( dict_t *d, char *key, value_t new_value){
     if( o == NULL){
         return( -1);
     }
-    v = o->value;
-    if( v.value.s != NULL && 
-        ( (v.data_type == DICT_BLOB   ) || 
-          (v.data_type == DICT_EXTENT ) ||
-          (v.data_type == DICT_STRING ) ) ){
-        free( v.value.s);
+    if( ( d->flags & DICT_ARENA) && dict_value_copy( d, &new_value, 1) != 0){
+        return( -1);
     }
- 
+
+    dict_value_free( d, &o->value);
     o->value = new_value;
     return(0);
 }
 
 void dict_clean( dict_t *d){
     int i;
-    value_t v;
 
-    if( d->n_elems == 0 && d->dict == NULL){
+    /* a single free for arena dicts */
+    if( d->flags & DICT_ARENA){
+        arena_free( d->arena);
+        dict_init( d);
         return;
     }
 
     /* free the dynamic memory of blobs, strings and extents */
     for( i = 0; i < d->used_elems; i++){
-        v = d->dict[i].value;
-        if( v.value.s != NULL && 
-            ( (v.data_type == DICT_BLOB   ) || 
-              (v.data_type == DICT_EXTENT ) ||
-              (v.data_type == DICT_STRING ) ) ){
-            free( v.value.s);
-        }
+        dict_value_free( d, &d->dict[i].value);
     }
 
-    free( d->dict);
+    dict_mem_free( d, d->dict);
+    free( d->index);
     dict_init( d);
 }
 
 
+
+void dict_move( dict_t *dst, dict_t *src){
+    uint32_t i;
+    value_t *v;
+
+    memcpy( dst, src, sizeof( dict_t));
+    if( src->dict == src->inline_dict){
+        dst->dict = dst->inline_dict;
+    }
+
+    /* the strings inline point into src */
+    for( i = 0; i < dst->used_elems; i++){
+        v = &dst->dict[i].value;
+        if( ( src->flags & DICT_ARENA) == 0 && dict_value_has_data( v) &&
+            v->value.s >= src->inline_str &&
+            v->value.s < src->inline_str + DICT_INLINE_STRLEN){
+            v->value.s = dst->inline_str + ( v->value.s - src->inline_str);
+        }
+    }
+
+    dict_init( src);
+    src->flags = dst->flags & DICT_SORTED;
+}
+
+
 void dict_display( dict_t *d){
-    int i;
+    int i, n;
     value_t v;
 
     printf("[");
-    for( i = 0; i < d->used_elems; i++){
-        if( i != 0){
+    for( i = 0, n = 0; i < d->used_elems; i++){
+        v = d->dict[i].value;
+        if( v.data_type == DICT_DELETED){
+            continue;
+        }
+
+        if( n++ != 0){
             printf(",");
         }
         printf(" %s:", d->dict[i].key);
-        v = d->dict[i].value;
         switch( v.data_type){
             case DICT_INT: 
                 printf("%d ", v.value.i); 
@@ -244,3 +679,122 @@ void dict_display( dict_t *d){
     printf("]\n");
 }
 
+
+
+int dict_range( dict_t *d, dict_iter_t *it, char *from, char *to){
+    if( ( d->flags & DICT_SORTED) == 0){
+        return( -1);
+    }
+
+    memset( (void *) it, 0, sizeof( dict_iter_t));
+    it->it_dict = d;
+    it->it_sub = ( from != NULL) ?
+                 dict_lower_bound( d, hash_b79( from), from) : 0;
+    it->it_end = ( to != NULL) ?
+                 dict_lower_bound( d, hash_b79( to), to) : d->used_elems;
+    return( 0);
+}
+
+
+
+int dict_prefix( dict_t *d, dict_iter_t *it, char *prefix){
+    uint64_t lo, hi;
+
+    if( ( d->flags & DICT_SORTED) == 0){
+        return( -1);
+    }
+
+    /* the keys in the hash range of the prefix, the ones with other
+     * prefixes in it are skipped while iterating */
+    hash_b79_prefix( prefix, &lo, &hi);
+    memset( (void *) it, 0, sizeof( dict_iter_t));
+    it->it_dict = d;
+    it->it_sub = dict_lower_bound( d, lo, "");
+    it->it_end = dict_lower_bound( d, hi + 1, "");
+    strncpy( it->it_prefix, prefix, DICT_KEY_LEN);
+    it->it_prefix_len = strnlen( prefix, DICT_KEY_LEN);
+    return( 0);
+}
+
+
+
+dict_entry_t *dict_iter_next( dict_iter_t *it){
+    dict_entry_t *e;
+
+    while( it->it_sub < it->it_end){
+        e = &it->it_dict->dict[it->it_sub++];
+        if( it->it_prefix_len == 0 ||
+            strncmp( e->key, it->it_prefix, it->it_prefix_len) == 0){
+            return( e);
+        }
+    }
+
+    return( NULL);
+}
+
+
+
+int dict_merge( dict_t *d, dict_t *src){
+    dict_entry_t *m, *a, *b;
+    uint32_t i = 0, j = 0, n = 0, capacity;
+    int cmp;
+
+    if( ( d->flags & src->flags & DICT_SORTED) == 0){
+        TRACE_ERR("only sorted dicts can be merged");
+        return( -1);
+    }
+
+    capacity = d->used_elems + src->used_elems;
+    if( capacity < DICT_DEFAULT_NUM_ELEMS){
+        capacity = DICT_DEFAULT_NUM_ELEMS;
+    }
+    m = dict_mem_calloc( d, capacity, sizeof( dict_entry_t));
+    if( m == NULL){
+        TRACE_ERR("could not reserve memory");
+        return( -1);
+    }
+
+    while( i < d->used_elems || j < src->used_elems){
+        a = ( i < d->used_elems) ? &d->dict[i] : NULL;
+        b = ( j < src->used_elems) ? &src->dict[j] : NULL;
+        cmp = ( a == NULL) ? 1 : ( b == NULL) ? -1 :
+              dict_key_cmp( a->hash_key, a->key, b->hash_key, b->key);
+
+        if( cmp < 0){
+            m[n++] = *a;
+            i++;
+            continue;
+        }
+
+        /* the same key, the one of src stays */
+        if( cmp == 0){
+            dict_value_free( d, &a->value);
+            i++;
+        }
+
+        /* the data of src goes away with its arena or its dict_t */
+        m[n] = *b;
+        if( dict_value_has_data( &b->value) &&
+            ( ( d->flags & DICT_ARENA) || !dict_value_owned( src, &b->value)) &&
+            dict_value_copy( d, &m[n].value,
+                             dict_value_owned( src, &b->value)) != 0){
+            m[n].value.value.s = NULL;
+        }
+        n++;
+        j++;
+    }
+
+    dict_mem_free( d, d->dict);
+    d->dict = m;
+    d->n_elems = capacity;
+    d->used_elems = n;
+
+    if( src->flags & DICT_ARENA){
+        arena_free( src->arena);
+    }else{
+        dict_mem_free( src, src->dict);
+        free( src->index);
+    }
+    dict_init_sorted( src);
+    return( 0);
+}
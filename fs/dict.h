@@ -2,6 +2,7 @@
 #define _DICT_H_
 
 #include <stdint.h>
+#include "arena.h"
 
 
 #define DICT_MIN_STRING_LEN                        8
@@ -29,6 +30,8 @@ typedef struct{
 #define DICT_EXTENT                                7
 
 #define DICT_NUM_TYPES                             8
+#define DICT_DELETED                               0xff /* a hole left by
+                                                          a removed entry */
 
 #define DICT_MAX_STRLEN                            250
 
@@ -49,23 +52,122 @@ typedef struct{
 }dict_entry_t;
 
 
+/* dicts with more than DICT_INDEX_MIN_ELEMS entries get a hash index, open
+ * addressing with linear probing over a hash of the whole key. A slot
+ * holds the upper 32 bits of the hash and the entry subscript + 1, 0 if
+ * it is empty, so most probes end without any string compare. The index
+ * is at most half full counting the deleted slots.
+ *
+ * The entries keep the insertion order. A removed entry leaves a hole
+ * with data type DICT_DELETED, the holes are squeezed out when they are
+ * half of the entries. */
+#define DICT_INDEX_MIN_ELEMS                       16
+#define DICT_INDEX_MIN_SLOTS                       64
+#define DICT_INDEX_DELETED                         UINT64_MAX
+#define DICT_HASH_BATCH                            16 /* keys hashed at once
+                                                         by the rebuilds */
+
+/* small dicts. The first DICT_INLINE_ELEMS entries live in the dict_t
+ * itself, dict points to inline_dict until it grows, and the strings
+ * added with dict_add_value() are taken from inline_str while they fit.
+ * A dict with a few keys takes no memory from the heap then. As dict may
+ * point into the dict_t, a dict_t should not be copied, dict_move() hands
+ * one over */
+#define DICT_INLINE_ELEMS                          4
+#define DICT_INLINE_STRLEN                         64
+
 typedef struct{
     uint32_t n_elems;
-    uint32_t used_elems;
+    uint32_t used_elems;          /* entries, holes included */
+    uint32_t deleted_elems;       /* holes */
     dict_entry_t *dict;
+
+    uint64_t *index;              /* NULL if there is no index */
+    uint32_t index_slots;         /* power of 2 */
+    uint32_t index_used;          /* slots not empty, deleted included */
+
+#define DICT_SORTED                                0x0001 /* entries sorted
+                                                             by hash_key,
+                                                             then by key */
+#define DICT_ARENA                                 0x0002 /* all the memory
+                                                             in arena */
+    uint32_t flags;
+    arena_t *arena;
+
+    /* the first entries and short strings, see DICT_INLINE_ELEMS */
+    uint32_t inline_str_used;
+    char inline_str[DICT_INLINE_STRLEN];
+    dict_entry_t inline_dict[DICT_INLINE_ELEMS];
 }dict_t; 
 
 
+/* arena dicts. The entries, the index and the data of the values live in
+ * an arena owned by the dict, see arena.h. The values added are copied
+ * into it, dict_add_value() builds them there without any malloc(), and
+ * dict_clean() releases everything at once. Entries removed or updated
+ * leave their memory in the arena until then. Meant for the dicts of the
+ * slots, loaded and evicted all the time */
+#define DICT_ARENA_DEFAULT_SIZE                    4096
+
+
+/* sorted dicts. The entries are kept in order of hash_b79() of the key,
+ * which follows the order of the first 10 characters, and of the whole
+ * key after it. The searches are binary, there is no hash index and no
+ * holes, and the keys can be walked by range or by prefix with an
+ * iterator */
+typedef struct{
+    dict_t *it_dict;
+    uint32_t it_sub;              /* next entry */
+    uint32_t it_end;              /* first entry out of the range */
+    char it_prefix[DICT_KEY_LEN]; /* the keys should start with it */
+    int it_prefix_len;            /* 0 for any key */
+}dict_iter_t;
+
+
 value_t dict_value_new( unsigned int data_type, void *data, int len);
-dict_t dict_new();
 void dict_init( dict_t *d);
 int dict_add_entry( dict_t *d, char *key, value_t value);
 int dict_remove_entry( dict_t *d, char *key);
 dict_entry_t *dict_search_entry( dict_t *d, char *key, int *sub);
+uint32_t dict_num_entries( dict_t *d);
 int dict_update_entry( dict_t *d, char *key, value_t new_value);
 void dict_clean( dict_t *d);
 void dict_display( dict_t *d);
 
+/* move the entries of src to dst, src is left empty */
+void dict_move( dict_t *dst, dict_t *src);
+
+/* empty sorted dict */
+void dict_init_sorted( dict_t *d);
+
+/* empty arena dict with room for size bytes before the arena grows, flags
+ * may have DICT_SORTED too */
+int dict_init_arena( dict_t *d, size_t size, uint32_t flags);
+
+/* add a value of data_type built from data and len, like dict_value_new(),
+ * but the data of strings, blobs and extents is copied and stays with the
+ * caller. The copy goes directly to the arena of arena dicts, or to
+ * inline_str for short strings, without any malloc(). Strings stop at len
+ * bytes too if it is not 0, they may come without the zero */
+int dict_add_value( dict_t *d, char *key, unsigned int data_type, void *data,
+                    int len);
+
+/* iterate the keys of a sorted dict from from, included, to to, not
+ * included. Any of them may be NULL for no limit. Return -1 if the dict
+ * is not sorted */
+int dict_range( dict_t *d, dict_iter_t *it, char *from, char *to);
+
+/* iterate the keys of a sorted dict starting with prefix */
+int dict_prefix( dict_t *d, dict_iter_t *it, char *prefix);
+
+/* next entry of the iteration, NULL at the end */
+dict_entry_t *dict_iter_next( dict_iter_t *it);
+
+/* move the entries of the sorted dict src into the sorted dict d, in a
+ * single pass. The entries of src replace the ones of d with the same key.
+ * src is left empty */
+int dict_merge( dict_t *d, dict_t *src);
+
 int dict_get_type_id( char *dt);
 char *dict_get_type_name( int dt);
 
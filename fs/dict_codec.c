@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trace.h"
+#include "dict_codec.h"
+
+
+
+int dict_varint_put( unsigned char *p, uint64_t v){
+    int n = 0;
+
+    while( v >= 0x80){
+        p[n++] = ( unsigned char) ( v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = ( unsigned char) v;
+    return( n);
+}
+
+
+
+int dict_varint_get( unsigned char *p, uint32_t len, uint64_t *v){
+    uint32_t n;
+    int shift = 0;
+
+    *v = 0;
+    for( n = 0; n < len && n < KFS_VARINT_MAX_LEN; n++, shift += 7){
+        *v |= ( uint64_t) ( p[n] & 0x7f) << shift;
+        if( ( p[n] & 0x80) == 0){
+            return( n + 1);
+        }
+    }
+
+    return( -1);
+}
+
+
+
+int dict_varint_len( uint64_t v){
+    int n = 1;
+
+    while( v >= 0x80){
+        v >>= 7;
+        n++;
+    }
+    return( n);
+}
+
+
+
+int dict_keys_find( dict_keys_t *keys, char *key, uint32_t len){
+    uint32_t i;
+
+    if( keys == NULL){
+        return( -1);
+    }
+
+    /* the tables have a few dozens of keys */
+    for( i = 0; i < keys->dk_num; i++){
+        if( strncmp( keys->dk_keys[i], key, len) == 0 &&
+            keys->dk_keys[i][len] == 0){
+            return( i);
+        }
+    }
+
+    return( -1);
+}
+
+
+
+/* bytes of the value of v, and its varint in *num for the numbers */
+static int dc_value_len( value_t *v, uint64_t *num){
+    *num = 0;
+    switch( v->data_type){
+        case DICT_INT:
+            /* zigzag, the small negative numbers stay small */
+            *num = ( ( uint32_t) v->value.i << 1) ^
+                   ( uint32_t) ( v->value.i >> 31);
+            return( dict_varint_len( *num));
+        case DICT_UINT:
+            *num = v->value.ui;
+            return( dict_varint_len( *num));
+        case DICT_BOOLEAN:
+            return( 1);
+        case DICT_FLOAT:
+            return( sizeof( double));
+        case DICT_STRING:
+        case DICT_BLOB:
+        case DICT_EXTENT:
+            return( dict_varint_len( v->data_len) + v->data_len);
+        case DICT_NULL:
+            return( 0);
+    }
+
+    return( -1);
+}
+
+
+
+int dict_encode_compact( dict_t *d, dict_keys_t *keys, unsigned char *buf,
+                         uint32_t len){
+    dict_entry_t *e;
+    uint64_t kh, num;
+    uint32_t i, off = 0, klen;
+    int id, vlen;
+
+    for( i = 0; i < d->used_elems; i++){
+        e = &d->dict[i];
+        if( e->value.data_type == DICT_DELETED){
+            continue;
+        }
+
+        /* a zero key would end the records */
+        klen = strnlen( e->key, DICT_KEY_LEN);
+        if( klen == 0){
+            TRACE_ERR("Empty keys can not be encoded");
+            return( -1);
+        }
+
+        id = dict_keys_find( keys, e->key, klen);
+        kh = ( id >= 0) ? ( ( uint64_t) id << 1) | KFS_SLOT_KEY_INTERNED :
+                          ( uint64_t) klen << 1;
+
+        vlen = dc_value_len( &e->value, &num);
+        if( vlen < 0){
+            TRACE_ERR("Unknown data type %u", e->value.data_type);
+            return( -1);
+        }
+
+        if( off + dict_varint_len( kh) + ( id >= 0 ? 0 : klen) + 1 + vlen >
+            len){
+            return( -1);
+        }
+
+        off += dict_varint_put( buf + off, kh);
+        if( id < 0){
+            memcpy( buf + off, e->key, klen);
+            off += klen;
+        }
+        buf[off++] = e->value.data_type;
+
+        switch( e->value.data_type){
+            case DICT_INT:
+            case DICT_UINT:
+                off += dict_varint_put( buf + off, num);
+                break;
+            case DICT_BOOLEAN:
+                buf[off++] = ( e->value.value.b != 0);
+                break;
+            case DICT_FLOAT:
+                memcpy( buf + off, &e->value.value.f, sizeof( double));
+                off += sizeof( double);
+                break;
+            case DICT_STRING:
+            case DICT_BLOB:
+            case DICT_EXTENT:
+                off += dict_varint_put( buf + off, e->value.data_len);
+                if( e->value.data_len > 0){
+                    memcpy( buf + off, e->value.value.s, e->value.data_len);
+                    off += e->value.data_len;
+                }
+                break;
+        }
+    }
+
+    return( off);
+}
+
@@ -0,0 +1,42 @@
+#ifndef _DICT_CODEC_H_
+#define _DICT_CODEC_H_
+
+#include <stdint.h>
+#include "dict.h"
+#include "kfs_disk.h"
+
+
+/* compact encoding of the slot dicts, see the compact records in
+ * kfs_disk.h. The common keys are written as a small id of a shared keys
+ * table instead of the whole key. The table is an array of keys, the id is
+ * the position, so new keys should only be added at the end of it. */
+typedef struct{
+    char **dk_keys;
+    uint32_t dk_num;
+}dict_keys_t;
+
+
+/* write v in p, return the bytes used */
+int dict_varint_put( unsigned char *p, uint64_t v);
+
+/* read a varint of at most len bytes from p into *v, return the bytes
+ * used or -1 if it does not end in them */
+int dict_varint_get( unsigned char *p, uint32_t len, uint64_t *v);
+
+/* bytes of v as a varint */
+int dict_varint_len( uint64_t v);
+
+/* id of the key of len bytes in keys, -1 if it is not there or keys is
+ * NULL */
+int dict_keys_find( dict_keys_t *keys, char *key, uint32_t len);
+
+/* encode the entries of d as compact records in buf, with the keys of
+ * keys interned if it is not NULL. Return the bytes used, or -1 if they do
+ * not fit in len. A zero byte after them ends the records, the free space
+ * of a slot is zeroed already */
+int dict_encode_compact( dict_t *d, dict_keys_t *keys, unsigned char *buf,
+                         uint32_t len);
+
+
+#endif
+
@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trace.h"
+#include "hash.h"
+#include "dict_view.h"
+
+
+
+void dict_view_init( dict_view_t *v, void *buf, uint32_t len){
+    v->dv_buf = ( unsigned char *) buf;
+    v->dv_len = len;
+    v->dv_flags = 0;
+    v->dv_keys = NULL;
+}
+
+
+
+void dict_view_init_compact( dict_view_t *v, void *buf, uint32_t len,
+                             dict_keys_t *keys){
+    dict_view_init( v, buf, len);
+    v->dv_flags = DICT_VIEW_COMPACT;
+    v->dv_keys = keys;
+}
+
+
+
+uint32_t dict_view_hash( char *key){
+    return( xxh32( key, strnlen( key, DICT_KEY_LEN), 0));
+}
+
+
+
+/* the record at off, NULL at the end of the records. *bad is set if the
+ * record does not fit in the buffer or its fields do not fit in it */
+static kfs_slot_data_t *dv_record( dict_view_t *v, uint32_t off, int *bad){
+    kfs_slot_data_t *r;
+
+    *bad = 0;
+    if( off + sizeof( kfs_slot_data_t) > v->dv_len){
+        return( NULL);
+    }
+
+    /* a zero record is the free space after the last one */
+    r = ( kfs_slot_data_t *) ( v->dv_buf + off);
+    if( r->rec_len == 0){
+        return( NULL);
+    }
+
+    if( r->rec_len < sizeof( kfs_slot_data_t) || r->rec_len > v->dv_len - off ||
+        r->key_len == 0 || r->key_len >= DICT_KEY_LEN ||
+        sizeof( kfs_slot_data_t) + r->key_len + 1 + r->value_len >
+        r->rec_len || r->kv_data[r->key_len] != 0){
+        TRACE_ERR("Bad slot record at offset %u", off);
+        *bad = 1;
+        return( NULL);
+    }
+
+    return( r);
+}
+
+
+
+static void dv_entry( kfs_slot_data_t *r, dict_view_entry_t *e){
+    e->ve_key = r->kv_data;
+    e->ve_key_len = r->key_len;
+    e->ve_type = r->value_type;
+    e->ve_flags = 0;
+    e->ve_len = r->value_len;
+    e->ve_data = r->kv_data + r->key_len + 1;
+}
+
+
+
+/* the compact record at off into e, with the id of its key in *key_id or
+ * -1. Return its length, 0 at the end of the records or -1 if it is
+ * broken */
+static int dv_compact( dict_view_t *v, uint32_t off, dict_view_entry_t *e,
+                       int *key_id){
+    unsigned char *p = v->dv_buf + off;
+    uint32_t left = v->dv_len - off, n;
+    uint64_t kh, len;
+    int rc;
+
+    /* a zero key is the free space after the last one */
+    if( off >= v->dv_len || *p == 0){
+        return( 0);
+    }
+
+    rc = dict_varint_get( p, left, &kh);
+    if( rc < 0){
+        goto exit1;
+    }
+    n = rc;
+
+    *key_id = -1;
+    if( kh & KFS_SLOT_KEY_INTERNED){
+        if( v->dv_keys == NULL || ( kh >> 1) >= v->dv_keys->dk_num){
+            goto exit1;
+        }
+        *key_id = kh >> 1;
+        e->ve_key = v->dv_keys->dk_keys[*key_id];
+        e->ve_key_len = strnlen( e->ve_key, DICT_KEY_LEN);
+        if( e->ve_key_len == 0 || e->ve_key_len >= DICT_KEY_LEN){
+            goto exit1;
+        }
+    }else{
+        if( ( kh >> 1) == 0 || ( kh >> 1) >= DICT_KEY_LEN ||
+            n + ( kh >> 1) >= left){
+            goto exit1;
+        }
+        e->ve_key = ( char *) p + n;
+        e->ve_key_len = kh >> 1;
+        n += e->ve_key_len;
+    }
+
+    if( n >= left){
+        goto exit1;
+    }
+    e->ve_type = p[n++];
+    e->ve_flags = 0;
+    e->ve_data = p + n;
+
+    switch( e->ve_type){
+        case DICT_INT:
+        case DICT_UINT:
+            rc = dict_varint_get( p + n, left - n, &len);
+            e->ve_flags = DICT_VIEW_VARINT;
+            len = rc;
+            break;
+        case DICT_BOOLEAN:
+            len = 1;
+            break;
+        case DICT_FLOAT:
+            len = sizeof( double);
+            break;
+        case DICT_STRING:
+        case DICT_BLOB:
+        case DICT_EXTENT:
+            rc = dict_varint_get( p + n, left - n, &len);
+            n += ( rc > 0) ? rc : 0;
+            e->ve_data = p + n;
+            break;
+        case DICT_NULL:
+            len = 0;
+            break;
+        default:
+            goto exit1;
+    }
+
+    if( rc < 0 || len > left - n){
+        goto exit1;
+    }
+
+    e->ve_len = len;
+    return( n + len);
+
+exit1:
+    TRACE_ERR("Bad compact slot record at offset %u", off);
+    return( -1);
+}
+
+
+
+/* dict_view_find() of compact records */
+static int dv_compact_find( dict_view_t *v, char *key, dict_view_entry_t *e){
+    uint32_t off;
+    size_t len;
+    int rc, id, key_id;
+
+    len = strnlen( key, DICT_KEY_LEN);
+    id = dict_keys_find( v->dv_keys, key, len);
+    for( off = 0; ( rc = dv_compact( v, off, e, &key_id)) > 0; off += rc){
+        if( key_id >= 0 ? key_id == id :
+            ( e->ve_key_len == len && memcmp( e->ve_key, key, len) == 0)){
+            return( 0);
+        }
+    }
+
+    return( rc < 0 ? -1 : 1);
+}
+
+
+
+int dict_view_find( dict_view_t *v, char *key, dict_view_entry_t *e){
+    kfs_slot_data_t *r;
+    uint32_t off, h;
+    size_t len;
+    int bad;
+
+    if( v->dv_flags & DICT_VIEW_COMPACT){
+        return( dv_compact_find( v, key, e));
+    }
+
+    len = strnlen( key, DICT_KEY_LEN);
+    h = xxh32( key, len, 0);
+    for( off = 0; ( r = dv_record( v, off, &bad)) != NULL;
+         off += r->rec_len){
+        if( r->hash_k != h || r->key_len != len ||
+            memcmp( r->kv_data, key, len) != 0){
+            continue;
+        }
+
+        dv_entry( r, e);
+        return( 0);
+    }
+
+    return( bad ? -1 : 1);
+}
+
+
+
+void dict_view_iter_init( dict_view_t *v, dict_view_iter_t *it){
+    it->vi_view = v;
+    it->vi_off = 0;
+}
+
+
+
+int dict_view_next( dict_view_iter_t *it, dict_view_entry_t *e){
+    kfs_slot_data_t *r;
+    int bad, rc, key_id;
+
+    if( it->vi_view->dv_flags & DICT_VIEW_COMPACT){
+        rc = dv_compact( it->vi_view, it->vi_off, e, &key_id);
+        if( rc <= 0){
+            return( rc);
+        }
+        it->vi_off += rc;
+        return( 1);
+    }
+
+    r = dv_record( it->vi_view, it->vi_off, &bad);
+    if( r == NULL){
+        return( bad ? -1 : 0);
+    }
+
+    dv_entry( r, e);
+    it->vi_off += r->rec_len;
+    return( 1);
+}
+
+
+
+int dict_view_value( dict_view_entry_t *e, value_t *value){
+    uint64_t num;
+
+    memset( value, 0, sizeof( value_t));
+    value->data_type = e->ve_type;
+    value->data_len = e->ve_len;
+
+    if( e->ve_flags & DICT_VIEW_VARINT){
+        dict_varint_get( e->ve_data, e->ve_len, &num);
+        value->data_len = 0;
+        if( e->ve_type == DICT_INT){
+            /* zigzag */
+            value->value.i = ( int) ( ( num >> 1) ^ -( num & 1));
+        }else{
+            value->value.ui = num;
+        }
+        return( 0);
+    }
+
+    switch( e->ve_type){
+        case DICT_STRING:
+        case DICT_BLOB:
+        case DICT_EXTENT:
+            value->value.s = ( char *) e->ve_data;
+            break;
+        case DICT_INT:
+        case DICT_UINT:
+        case DICT_FLOAT:
+        case DICT_BOOLEAN:
+            /* numbers are not aligned in the record */
+            memcpy( &value->value, e->ve_data,
+                    e->ve_len < sizeof( value_u) ? e->ve_len :
+                    sizeof( value_u));
+            break;
+        case DICT_NULL:
+            break;
+        default:
+            TRACE_ERR("Unknown data type %u", e->ve_type);
+            return( -1);
+    }
+
+    return( 0);
+}
+
@@ -0,0 +1,80 @@
+#ifndef _DICT_VIEW_H_
+#define _DICT_VIEW_H_
+
+#include <stdint.h>
+#include "dict.h"
+#include "kfs_disk.h"
+#include "dict_codec.h"
+
+
+/* read only views of the kfs_slot_data_t records of a slot, straight over
+ * the buffer of the page cache. Nothing is copied or allocated, the keys
+ * and the values returned point into the buffer, so they are valid while
+ * the page is. The searches reject the records by their hash_k first and
+ * only compare the keys when it matches.
+ *
+ * hash_k is dict_view_hash() of the key, the writers of the records should
+ * set it with it.
+ *
+ * The views of compact records, see kfs_disk.h, work the same way. There
+ * is no hash there, the keys are rejected by their length or their id in
+ * the shared keys table. */
+typedef struct{
+    unsigned char *dv_buf;        /* not owned */
+    uint32_t dv_len;
+
+#define DICT_VIEW_COMPACT                          0x0001
+    uint32_t dv_flags;
+    dict_keys_t *dv_keys;         /* shared keys of compact records */
+}dict_view_t;
+
+
+/* a record of the view */
+typedef struct{
+    char *ve_key;                 /* in the buffer, zero terminated only in
+                                     kfs_slot_data_t records */
+    uint8_t ve_key_len;
+    uint8_t ve_type;              /* DICT_INT, DICT_STRING... */
+
+#define DICT_VIEW_VARINT                           0x01 /* the number in
+                                                           ve_data is a
+                                                           varint */
+    uint8_t ve_flags;
+    uint32_t ve_len;
+    void *ve_data;                /* in the buffer, not aligned */
+}dict_view_entry_t;
+
+
+typedef struct{
+    dict_view_t *vi_view;
+    uint32_t vi_off;              /* next record */
+}dict_view_iter_t;
+
+
+/* view over len bytes of records in buf */
+void dict_view_init( dict_view_t *v, void *buf, uint32_t len);
+
+/* view over len bytes of compact records, keys may be NULL if they were
+ * encoded without a shared keys table */
+void dict_view_init_compact( dict_view_t *v, void *buf, uint32_t len,
+                             dict_keys_t *keys);
+
+/* hash_k of a key */
+uint32_t dict_view_hash( char *key);
+
+/* look for key. Return 0 and fill e, 1 if it is not there or -1 if a
+ * record is broken */
+int dict_view_find( dict_view_t *v, char *key, dict_view_entry_t *e);
+
+/* walk the records in order. dict_view_next() returns 1 and fills e, 0
+ * at the end or -1 if a record is broken */
+void dict_view_iter_init( dict_view_t *v, dict_view_iter_t *it);
+int dict_view_next( dict_view_iter_t *it, dict_view_entry_t *e);
+
+/* the value of an entry. Strings and blobs point into the buffer, strings
+ * are not zero terminated there, data_len has their length */
+int dict_view_value( dict_view_entry_t *e, value_t *value);
+
+
+#endif
+
@@ -1,4 +1,8 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdint.h>
 #include <time.h>
@@ -6,10 +10,35 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <ctype.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
 #include "kfs_mem.h"
 #include "eio.h"
 
+#ifndef IOV_MAX
+#define IOV_MAX                                 1024
+#endif
+
+
+uint32_t kfs_blocksize = KFS_BLOCKSIZE_DEFAULT;
+uint32_t kfs_block_shift = 13;  /* log2( KFS_BLOCKSIZE_DEFAULT) */
+
+
+int kfs_set_blocksize( uint32_t blocksize){
+    if( blocksize < KFS_BLOCKSIZE_MIN || blocksize > KFS_BLOCKSIZE_MAX ||
+        ( blocksize & ( blocksize - 1)) != 0){
+        TRACE_ERR( "Unsupported block size %u", blocksize);
+        return( -1);
+    }
+
+    kfs_blocksize = blocksize;
+    kfs_block_shift = (uint32_t) __builtin_ctz( blocksize);
+    return( 0);
+}
+
 
 
 int get_bd_size( char *fname, uint64_t *size){
@@ -21,7 +50,11 @@ int get_bd_size( char *fname, uint64_t *size){
         TRACE_ERR("Could not open block device \n");
         return( -1);
     }
-    ioctl( fd, BLKGETSIZE64, size);
+    if( ioctl( fd, BLKGETSIZE64, size) != 0){
+        TRACE_ERRNO("Could not get block device size");
+        close( fd);
+        return( -1);
+    }
     close(fd);
     return( 0);
 #else
@@ -46,44 +79,184 @@ int create_file( char *fname){
 char *extent_alloc( int n){
     char *extent;
 
-    extent = malloc( KFS_BLOCKSIZE * n);
+    extent = malloc( KFS_BLOCKS_TO_BYTES( n));
     if( extent == NULL){
         TRACE_SYSERR( "malloc error");
         return( NULL);
     }
 
     /* Fill the whole file with zeroes */
-    memset( extent, 0, (KFS_BLOCKSIZE * n) );
+    memset( extent, 0, KFS_BLOCKS_TO_BYTES( n));
     return( extent);
 }
 
+
+/* All the IO is positional, so threads sharing the same fd never step on
+ * each other's file offset. pread()/pwrite() may transfer less than asked,
+ * or be interrupted by a signal, so loop until the whole length is done.
+ * Hitting the end of file before that is an error. */
+static int eio_pread_full( int fd, void *buf, size_t len, off_t offset){
+    char *p = (char *) buf;
+    ssize_t rc;
+
+    while( len > 0){
+        rc = pread( fd, p, len, offset);
+        if( rc < 0){
+            if( errno == EINTR){
+                continue;
+            }
+            TRACE_ERRNO( "pread() failed, offset=%ld", (long) offset);
+            return( -1);
+        }
+
+        if( rc == 0){
+            TRACE_ERR( "short read, offset=%ld, missing=%zu", 
+                       (long) offset, len);
+            errno = EIO;
+            return( -1);
+        }
+
+        p += rc;
+        len -= rc;
+        offset += rc;
+    }
+    return( 0);
+}
+
+
+static int eio_pwrite_full( int fd, void *buf, size_t len, off_t offset){
+    char *p = (char *) buf;
+    ssize_t rc;
+
+    while( len > 0){
+        rc = pwrite( fd, p, len, offset);
+        if( rc < 0){
+            if( errno == EINTR){
+                continue;
+            }
+            TRACE_ERRNO( "pwrite() failed, offset=%ld", (long) offset);
+            return( -1);
+        }
+
+        if( rc == 0){
+            TRACE_ERR( "short write, offset=%ld, missing=%zu", 
+                       (long) offset, len);
+            errno = ENOSPC;
+            return( -1);
+        }
+
+        p += rc;
+        len -= rc;
+        offset += rc;
+    }
+    return( 0);
+}
+
+
+/* skip the iovec entries already transferred after a short preadv() or
+ * pwritev(). Return the number of entries still pending */
+static int eio_iov_advance( struct iovec **iov, int iovcnt, size_t done){
+    struct iovec *v = *iov;
+
+    while( iovcnt > 0 && done >= v->iov_len){
+        done -= v->iov_len;
+        v++;
+        iovcnt--;
+    }
+
+    if( iovcnt > 0){
+        v->iov_base = (char *) v->iov_base + done;
+        v->iov_len -= done;
+    }
+
+    *iov = v;
+    return( iovcnt);
+}
+
+
+static int eio_prw_vec_full( int fd, 
+                             struct iovec *iov, 
+                             int iovcnt, 
+                             off_t offset, 
+                             int write_flag){
+    ssize_t rc;
+    int cnt;
+
+    /* drop empty trailing entries, so we never loop on a zero transfer */
+    iovcnt = eio_iov_advance( &iov, iovcnt, 0);
+
+    while( iovcnt > 0){
+        cnt = ( iovcnt > IOV_MAX) ? IOV_MAX : iovcnt;
+        if( write_flag){
+            rc = pwritev( fd, iov, cnt, offset);
+        }else{
+            rc = preadv( fd, iov, cnt, offset);
+        }
+
+        if( rc < 0){
+            if( errno == EINTR){
+                continue;
+            }
+            TRACE_ERRNO( "%s() failed, offset=%ld", 
+                         write_flag ? "pwritev" : "preadv", (long) offset);
+            return( -1);
+        }
+
+        if( rc == 0){
+            TRACE_ERR( "short %s, offset=%ld", 
+                       write_flag ? "write" : "read", (long) offset);
+            errno = write_flag ? ENOSPC : EIO;
+            return( -1);
+        }
+
+        offset += rc;
+        iovcnt = eio_iov_advance( &iov, iovcnt, (size_t) rc);
+    }
+    return( 0);
+}
+
+
+int superblock_read( int fd, char *buf){
+    return( eio_pread_full( fd, buf, KFS_BLOCKSIZE_MIN, 0));
+}
+
+
 int block_read( int fd, char *page, uint64_t addr){
-    lseek( fd, addr * KFS_BLOCKSIZE, SEEK_SET);
-    read( fd, page, KFS_BLOCKSIZE );
-    return(0);
+    return( eio_pread_full( fd, page, KFS_BLOCKSIZE, 
+                            KFS_BLOCKS_TO_BYTES( addr)));
 }
 
 
 int block_write( int fd, char *page, uint64_t addr){
-    lseek( fd, addr * KFS_BLOCKSIZE, SEEK_SET);
-    write( fd, page, KFS_BLOCKSIZE);
-
-    return(0);
+    return( eio_pwrite_full( fd, page, KFS_BLOCKSIZE, 
+                             KFS_BLOCKS_TO_BYTES( addr)));
 }
 
 
 int extent_read( int fd, char *extent, uint64_t addr, int block_num){
-    lseek( fd, addr * KFS_BLOCKSIZE, SEEK_SET);
-    read( fd, extent, KFS_BLOCKSIZE * block_num );
-    return(0);
+    return( eio_pread_full( fd, 
+                            extent, 
+                            (size_t) KFS_BLOCKS_TO_BYTES( block_num), 
+                            KFS_BLOCKS_TO_BYTES( addr)));
 }
 
 
 int extent_write( int fd, char *extent, uint64_t addr, int block_num){
-    lseek( fd, addr * KFS_BLOCKSIZE, SEEK_SET);
-    write( fd, extent, KFS_BLOCKSIZE * block_num );
+    return( eio_pwrite_full( fd, 
+                             extent, 
+                             (size_t) KFS_BLOCKS_TO_BYTES( block_num), 
+                             KFS_BLOCKS_TO_BYTES( addr)));
+}
 
-    return(0);
+
+int extent_readv( int fd, struct iovec *iov, int iovcnt, uint64_t addr){
+    return( eio_prw_vec_full( fd, iov, iovcnt, 
+                              KFS_BLOCKS_TO_BYTES( addr), 0));
 }
 
 
+int extent_writev( int fd, struct iovec *iov, int iovcnt, uint64_t addr){
+    return( eio_prw_vec_full( fd, iov, iovcnt, 
+                              KFS_BLOCKS_TO_BYTES( addr), 1));
+}
+
@@ -1,16 +1,29 @@
 #ifndef _EIO_H_
 #define _EIO_H_
 #include <stdint.h>
+#include <sys/uio.h>
+
+/* All the block and extent calls are positional and thread safe, they 
+ * transfer the whole length or fail. Return 0 on success, -1 on error 
+ * with errno set. */
 
 int get_bd_size( char *fname, uint64_t *size);
-uint64_t get_bd_size( char *fname);
+
+/* read the first KFS_BLOCKSIZE_MIN bytes of the device, where the 
+ * superblock lives. Works before the block size is known */
+int superblock_read( int fd, char *buf);
 int create_file( char *fname);
 char *extent_alloc( int n);
+#define pages_alloc(n)                          extent_alloc(n)
 int block_read( int fd, char *page, uint64_t addr);
 int block_write( int fd, char *page, uint64_t addr);
 int extent_read( int fd, char *extent, uint64_t addr, int block_num);
 int extent_write( int fd, char *extent, uint64_t addr, int block_num);
 
+/* read or write contiguous blocks starting in addr into/from several
+ * buffers. The iov array is used as scratch and may be modified */
+int extent_readv( int fd, struct iovec *iov, int iovcnt, uint64_t addr);
+int extent_writev( int fd, struct iovec *iov, int iovcnt, uint64_t addr);
 
-#endif
 
+#endif
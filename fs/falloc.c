@@ -0,0 +1,352 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trace.h"
+#include "falloc.h"
+
+
+
+#define FE_BY_ADDR(n)        avl_entry( n, free_extent_t, fe_by_addr)
+#define FE_BY_SIZE(n)        avl_entry( n, free_extent_t, fe_by_size)
+
+
+
+static int fe_cmp_addr( avl_node_t *a, avl_node_t *b){
+    free_extent_t *x = FE_BY_ADDR( a), *y = FE_BY_ADDR( b);
+
+    if( x->fe_addr != y->fe_addr){
+        return( x->fe_addr < y->fe_addr ? -1 : 1);
+    }
+
+    return( 0);
+}
+
+
+
+static int fe_cmp_size( avl_node_t *a, avl_node_t *b){
+    free_extent_t *x = FE_BY_SIZE( a), *y = FE_BY_SIZE( b);
+
+    if( x->fe_len != y->fe_len){
+        return( x->fe_len < y->fe_len ? -1 : 1);
+    }
+
+    return( fe_cmp_addr( &x->fe_by_addr, &y->fe_by_addr));
+}
+
+
+
+static free_extent_t *fe_new( uint64_t addr, uint64_t len){
+    free_extent_t *fe;
+
+    fe = malloc( sizeof( free_extent_t));
+    if( fe == NULL){
+        TRACE_ERR("Error in malloc()");
+        return( NULL);
+    }
+
+    memset( (void *) fe, 0, sizeof( free_extent_t));
+    fe->fe_addr = addr;
+    fe->fe_len = len;
+    return( fe);
+}
+
+
+
+static void fe_link( falloc_t *fa, free_extent_t *fe){
+    avl_insert( &fa->fa_by_addr, &fe->fe_by_addr);
+    avl_insert( &fa->fa_by_size, &fe->fe_by_size);
+    fa->fa_free += fe->fe_len;
+}
+
+
+
+static void fe_unlink( falloc_t *fa, free_extent_t *fe){
+    avl_remove( &fa->fa_by_addr, &fe->fe_by_addr);
+    avl_remove( &fa->fa_by_size, &fe->fe_by_size);
+    fa->fa_free -= fe->fe_len;
+}
+
+
+
+/* the first free extent starting at addr or after it */
+static free_extent_t *fe_next( falloc_t *fa, uint64_t addr){
+    free_extent_t key;
+    avl_node_t *n;
+
+    key.fe_addr = addr;
+    n = avl_ceil( &fa->fa_by_addr, &key.fe_by_addr);
+    return( n == NULL ? NULL : FE_BY_ADDR( n));
+}
+
+
+
+/* the last free extent starting at addr or before it */
+static free_extent_t *fe_prev( falloc_t *fa, uint64_t addr){
+    free_extent_t key;
+    avl_node_t *n;
+
+    key.fe_addr = addr;
+    n = avl_floor( &fa->fa_by_addr, &key.fe_by_addr);
+    return( n == NULL ? NULL : FE_BY_ADDR( n));
+}
+
+
+
+/* cut len bits at addr out of the free extent fe, which holds them, and
+ * set them in the map */
+static int fe_carve( falloc_t *fa, free_extent_t *fe, uint64_t addr,
+                     uint64_t len){
+    free_extent_t *tail = NULL;
+    uint64_t end = fe->fe_addr + fe->fe_len;
+
+    /* taken from the middle, the extent is split in two */
+    if( addr > fe->fe_addr && addr + len < end){
+        tail = fe_new( addr + len, end - addr - len);
+        if( tail == NULL){
+            return( -1);
+        }
+    }
+
+    fe_unlink( fa, fe);
+    if( addr > fe->fe_addr){
+        fe->fe_len = addr - fe->fe_addr;
+        fe_link( fa, fe);
+    }else if( addr + len < end){
+        fe->fe_addr = addr + len;
+        fe->fe_len = end - addr - len;
+        fe_link( fa, fe);
+    }else{
+        free( fe);
+    }
+
+    if( tail != NULL){
+        fe_link( fa, tail);
+    }
+
+    if( bm_summary_set_extent( fa->fa_map, addr, len, SETBIT) != 0){
+        TRACE_ERR("Could not set the extent in the map, addr=%lu, len=%lu",
+                  addr, len);
+        return( -1);
+    }
+
+    return( 0);
+}
+
+
+
+falloc_t *falloc_alloc( bm_summary_t *bms){
+    falloc_t *fa;
+    free_extent_t *fe;
+    uint64_t pos = 0, count, total = bms->bs_total_bits;
+
+    fa = malloc( sizeof( falloc_t));
+    if( fa == NULL){
+        TRACE_ERR("Error in malloc()");
+        return( NULL);
+    }
+
+    memset( (void *) fa, 0, sizeof( falloc_t));
+    fa->fa_map = bms;
+    avl_init( &fa->fa_by_addr, fe_cmp_addr);
+    avl_init( &fa->fa_by_size, fe_cmp_size);
+
+    /* walk the map, the used runs and the free runs one after another */
+    while( pos < total){
+        bm_count( bms->bs_map, total, pos, total - pos, SETBIT, &count);
+        pos += count;
+        if( pos >= total){
+            break;
+        }
+
+        bm_count( bms->bs_map, total, pos, total - pos, CLEARBIT, &count);
+        fe = fe_new( pos, count);
+        if( fe == NULL){
+            falloc_free( fa);
+            return( NULL);
+        }
+        fe_link( fa, fe);
+        pos += count;
+    }
+
+    return( fa);
+}
+
+
+
+void falloc_free( falloc_t *fa){
+    avl_node_t *n;
+    free_extent_t *fe;
+
+    if( fa == NULL){
+        return;
+    }
+
+    while( ( n = avl_first( &fa->fa_by_addr)) != NULL){
+        fe = FE_BY_ADDR( n);
+        fe_unlink( fa, fe);
+        free( fe);
+    }
+
+    free( fa);
+}
+
+
+
+int falloc_get( falloc_t *fa, uint64_t goal, uint64_t len, uint64_t *addr){
+    free_extent_t *fe, *back = NULL, *fwd = NULL, key;
+    avl_node_t *n;
+    int i;
+
+    *addr = 0;
+    if( len == 0){
+        return( -1);
+    }
+
+    if( goal != FALLOC_NO_GOAL){
+        /* right at the goal */
+        fe = fe_prev( fa, goal);
+        if( fe != NULL && goal < fe->fe_addr + fe->fe_len &&
+            fe->fe_addr + fe->fe_len - goal >= len){
+            *addr = goal;
+            return( fe_carve( fa, fe, goal, len));
+        }
+
+        /* or outward, the closest fit before the goal, taken from the end
+         * of its extent, and the closest after it, from the start */
+        for( i = 0; fe != NULL && i < FALLOC_NEAR_SCAN; i++){
+            if( fe->fe_len >= len){
+                back = fe;
+                break;
+            }
+            fe = ( fe->fe_addr > 0) ? fe_prev( fa, fe->fe_addr - 1) : NULL;
+        }
+
+        fe = fe_next( fa, goal + 1);
+        for( i = 0; fe != NULL && i < FALLOC_NEAR_SCAN; i++){
+            if( fe->fe_len >= len){
+                fwd = fe;
+                break;
+            }
+            fe = fe_next( fa, fe->fe_addr + 1);
+        }
+
+        if( back != NULL && ( fwd == NULL || goal + len - 
+            ( back->fe_addr + back->fe_len) < fwd->fe_addr - goal)){
+            *addr = back->fe_addr + back->fe_len - len;
+            return( fe_carve( fa, back, *addr, len));
+        }
+
+        if( fwd != NULL){
+            *addr = fwd->fe_addr;
+            return( fe_carve( fa, fwd, fwd->fe_addr, len));
+        }
+    }
+
+    /* best fit, the smallest extent with room, the lowest address if
+     * there are several */
+    key.fe_len = len;
+    key.fe_addr = 0;
+    n = avl_ceil( &fa->fa_by_size, &key.fe_by_size);
+    if( n == NULL){
+        return( -1);
+    }
+
+    fe = FE_BY_SIZE( n);
+    *addr = fe->fe_addr;
+    return( fe_carve( fa, fe, fe->fe_addr, len));
+}
+
+
+
+int falloc_put( falloc_t *fa, uint64_t addr, uint64_t len){
+    free_extent_t *prev, *next;
+    uint64_t count;
+
+    if( len == 0 || addr + len > fa->fa_map->bs_total_bits){
+        TRACE_ERR("Invalid extent, addr=%lu, len=%lu", addr, len);
+        return( -1);
+    }
+
+    /* it should be all in use */
+    bm_count( fa->fa_map->bs_map, fa->fa_map->bs_total_bits, addr, len,
+              SETBIT, &count);
+    if( count != len){
+        TRACE_ERR("Extent is not in use, addr=%lu, len=%lu", addr, len);
+        return( -1);
+    }
+
+    prev = fe_prev( fa, addr);
+    if( prev != NULL && prev->fe_addr + prev->fe_len != addr){
+        prev = NULL;
+    }
+
+    next = fe_next( fa, addr);
+    if( next != NULL && next->fe_addr != addr + len){
+        next = NULL;
+    }
+
+    /* merge with the free extents around, if any */
+    if( prev != NULL && next != NULL){
+        fe_unlink( fa, next);
+        fe_unlink( fa, prev);
+        prev->fe_len += len + next->fe_len;
+        fe_link( fa, prev);
+        free( next);
+    }else if( prev != NULL){
+        fe_unlink( fa, prev);
+        prev->fe_len += len;
+        fe_link( fa, prev);
+    }else if( next != NULL){
+        fe_unlink( fa, next);
+        next->fe_addr = addr;
+        next->fe_len += len;
+        fe_link( fa, next);
+    }else{
+        next = fe_new( addr, len);
+        if( next == NULL){
+            return( -1);
+        }
+        fe_link( fa, next);
+    }
+
+    if( bm_summary_set_extent( fa->fa_map, addr, len, CLEARBIT) != 0){
+        TRACE_ERR("Could not clear the extent in the map, addr=%lu, len=%lu",
+                  addr, len);
+        return( -1);
+    }
+
+    return( 0);
+}
+
+
+
+int falloc_take( falloc_t *fa, uint64_t addr, uint64_t len){
+    free_extent_t *fe;
+
+    if( len == 0){
+        return( -1);
+    }
+
+    fe = fe_prev( fa, addr);
+    if( fe == NULL || addr + len > fe->fe_addr + fe->fe_len){
+        return( -1);
+    }
+
+    return( fe_carve( fa, fe, addr, len));
+}
+
+
+
+uint64_t falloc_extents( falloc_t *fa){
+    return( fa->fa_by_addr.at_count);
+}
+
+
+
+uint64_t falloc_max_extent( falloc_t *fa){
+    avl_node_t *n;
+
+    n = avl_last( &fa->fa_by_size);
+    return( n == NULL ? 0 : FE_BY_SIZE( n)->fe_len);
+}
+
@@ -0,0 +1,62 @@
+#ifndef _FALLOC_H_
+#define _FALLOC_H_
+
+#include <stdint.h>
+#include "avl.h"
+#include "map_summary.h"
+
+
+/* free extents allocator. The free space of a map is indexed in memory
+ * as extents, in two trees, one by address and one by size. The map is
+ * still the only thing on disk, every allocation and free is set in it
+ * thru its summary, the index is built again from the map when needed */
+
+/* how many extents at each side of the goal are checked for a goal near
+ * allocation before falling back to best fit */
+#define FALLOC_NEAR_SCAN                 32
+
+typedef struct{
+    avl_node_t fe_by_addr;
+    avl_node_t fe_by_size;
+    uint64_t fe_addr;
+    uint64_t fe_len;
+}free_extent_t;
+
+
+typedef struct{
+    bm_summary_t *fa_map;
+    avl_tree_t fa_by_addr;        /* by fe_addr */
+    avl_tree_t fa_by_size;        /* by fe_len, then fe_addr */
+    uint64_t fa_free;             /* free bits in the index */
+}falloc_t;
+
+
+/* create the index of the free bits in the summarized map bms */
+falloc_t *falloc_alloc( bm_summary_t *bms);
+void falloc_free( falloc_t *fa);
+
+/* allocate len contiguous bits, and set them in the map. With goal set
+ * to FALLOC_NO_GOAL the smallest free extent with room is taken, best
+ * fit. Otherwise the bits are taken at the goal if they are free, or as
+ * close as possible to it, at the end of an extent before the goal or
+ * at the start of one after it. Return 0 and set *addr, or -1 if there
+ * is no room */
+#define FALLOC_NO_GOAL                   UINT64_MAX
+int falloc_get( falloc_t *fa, uint64_t goal, uint64_t len, uint64_t *addr);
+
+/* free len bits from addr, clear them in the map and merge them with the
+ * free extents around. They should be in use. Return 0, or -1 if some
+ * of them are free already */
+int falloc_put( falloc_t *fa, uint64_t addr, uint64_t len);
+
+/* take len bits at addr, wherever they are in a free extent. Used to
+ * grow an extent in place. Return 0, or -1 if any of them is not free */
+int falloc_take( falloc_t *fa, uint64_t addr, uint64_t len);
+
+/* number of free extents and the longest one */
+uint64_t falloc_extents( falloc_t *fa);
+uint64_t falloc_max_extent( falloc_t *fa);
+
+
+#endif
+
@@ -20,43 +20,95 @@ void gc_debug_display( gc_node_t *node){
             (uintptr_t) node, 
             (uintptr_t) node->data);
     printf("Size=%d\n", node->size);
+#ifdef DEBUG
     printf("reservation log: '%s', \n", node->d_str);
+#endif
 
     dumphex( (void *) node, sizeof( gc_node_t) + node->size);
 }
 
 
-void *gc_malloc( gc_list_t *ll, size_t size){
-    size_t total = size + sizeof( gc_node_t);
+/* size class of size bytes, GC_LARGE if it is too big for them */
+static uint16_t gc_class( size_t size){
+    uint16_t c = 0;
+
+    if( size > GC_MAX_CLASS_SIZE){
+        return( GC_LARGE);
+    }
+
+    while( ( (size_t) GC_MIN_CLASS_SIZE << c) < size){
+        c++;
+    }
+    return( c);
+}
 
+
+void *gc_malloc( gc_list_t *ll, size_t size){
     list_t *l = LIST( ll);
-    gc_node_t *node = malloc( total);
+    gc_node_t *node;
+    uint16_t c;
+
+    /* a node of the class freed before, or a new one from the arena */
+    c = gc_class( size);
+    if( c == GC_LARGE){
+        node = malloc( sizeof( gc_node_t) + size);
+        if( node == NULL)
+            return NULL;
+        ll->large++;
+    }else if( !list_empty( &ll->free_nodes[c])){
+        node = ( gc_node_t *) ll->free_nodes[c].next;
+        list_del( LIST( node));
+    }else{
+        if( ll->arena == NULL){
+            ll->arena = arena_alloc( GC_ARENA_SIZE);
+            if( ll->arena == NULL)
+                return NULL;
+        }
 
-    if( node == NULL)
-        return NULL;
+        node = arena_malloc( ll->arena, sizeof( gc_node_t) +
+                                        ( GC_MIN_CLASS_SIZE << c));
+        if( node == NULL)
+            return NULL;
+    }
 
-    memset( (void *) node, 'X', total);
+#ifdef DEBUG
+    memset( (void *) node, 'X', sizeof( gc_node_t) + size);
+    strcpy( node->d_str, "-------");
+#endif
     node->size = size;
     node->mark = 0;
-    strcpy( node->d_str, "-------");
+    node->sclass = c;
 
     list_add( LIST( node), l);
 
     return( (void *) node->data);
 }
 
-void gc_free( void *p){
+void gc_free( gc_list_t *ll, void *p){
     gc_node_t *node = container_of( p, gc_node_t, data);
+
     list_del( LIST( node));
-    free( node);
+    if( node->sclass == GC_LARGE){
+        ll->large--;
+        free( node);
+        return;
+    }
+
+    list_add( LIST( node), &ll->free_nodes[node->sclass]);
 }
 
 
 int gc_list_init( gc_list_t *ll){
     list_t *l = LIST( ll);
+    int i;
 
 
     INIT_LIST_HEAD( LIST( l));
+    for( i = 0; i < GC_CLASSES; i++){
+        INIT_LIST_HEAD( &ll->free_nodes[i]);
+    }
+    ll->arena = NULL;
+    ll->large = 0;
 
     return( 0);
 }
@@ -66,24 +118,37 @@ void gc_list_destroy( gc_list_t *ll){
     list_t *l = LIST( ll);
 
 
-    list_for_each_safe( i, tmp, l){
-        free( i);
+    /* only the big nodes are freed one by one */
+    if( ll->large > 0){
+        list_for_each_safe( i, tmp, l){
+            if( ((gc_node_t *)i)->sclass == GC_LARGE){
+                free( i);
+            }
+        }
     }
 
+    arena_free( ll->arena);
     gc_list_init( ll);
 }
 
 void *gc_realloc( gc_list_t *ll, void *ptr, size_t size){
     gc_node_t *node = container_of( ptr, gc_node_t, data);
-    gc_node_t *mem; 
+    void *mem; 
+
+    /* there is room in its class */
+    if( node->sclass != GC_LARGE &&
+        size <= ( (size_t) GC_MIN_CLASS_SIZE << node->sclass)){
+        node->size = size;
+        return ptr;
+    }
 
-    mem = realloc( (void *) node, size);
+    mem = gc_malloc( ll, size);
 
     if( mem == NULL)
         return NULL;
 
-    mem->size = size;
-    mem->mark = 0;
+    memcpy( mem, ptr, node->size < size ? node->size : size);
+    gc_free( ll, ptr);
 
     return mem;
 }
@@ -136,7 +201,7 @@ int gc_dump_list( gc_list_t *ll){
 
     list_for_each_safe( i, tmp, l){
         printf("Node no.-%d\r\n", j++);
-        gc_debug_display( (gc_list_t *)i);
+        gc_debug_display( (gc_node_t *)i);
     }
 
     printf("-----------GC LIST DUMP END\r\n");
@@ -144,7 +209,12 @@ int gc_dump_list( gc_list_t *ll){
 }
 
 void *gc_calloc( gc_list_t *ll, size_t nelements, size_t elementSize){
-    return gc_malloc( ll, nelements * elementSize);
+    void *p;
+
+    p = gc_malloc( ll, nelements * elementSize);
+    if( p != NULL)
+        memset( p, 0, nelements * elementSize);
+    return p;
 }
 
 
@@ -157,24 +227,25 @@ void gc_mark( void *ptr){
 }
 
 void gc_node_set_trace( void *n, char *str){
+#ifdef DEBUG
     gc_node_t *node;
 
     node = (gc_node_t *) container_of( n, gc_node_t, data);
-    strncpy( node->d_str, str, MAX_DBG_STR_LEN);
+    strncpy( node->d_str, str, MAX_DBG_STR_LEN - 1);
+    node->d_str[MAX_DBG_STR_LEN - 1] = 0;
+#endif
 }
 
 void gc_sweep(gc_list_t *ll){
     list_t *i, *tmp;
     list_t *l = LIST( ll);
     gc_node_t *n;
-    void *p;
 
 
     list_for_each_safe( i, tmp, l){
-        p = i;
-        n = container_of( p, gc_node_t, data);
+        n = (gc_node_t *) i;
         if( n->mark == 1){
-            gc_free( (void *) n->data);
+            gc_free( ll, (void *) n->data);
         }
     }
 }
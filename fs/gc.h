@@ -3,7 +3,9 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "list.h"
+#include "arena.h"
 
 
 /**
@@ -17,24 +19,50 @@
 	const typeof( ((type *)0)->member ) *__mptr = (ptr);	\
 	(type *)( (char *)__mptr - offsetof(type,member) );})
 
+/* the nodes of a list are carved from an arena, see arena.h, in size
+ * classes of powers of 2 from GC_MIN_CLASS_SIZE to GC_MAX_CLASS_SIZE. The
+ * nodes freed go to a free list of their class and are given again by the
+ * next requests of the class, without any malloc(). The bigger nodes are
+ * malloc()ed one by one. gc_list_destroy() releases the arena in a single
+ * free() when there are no big nodes, so a request can take its memory
+ * from a list and drop it all at once.
+ *
+ * With DEBUG the nodes are filled with 'X' and carry a trace string, see
+ * gc_node_set_trace() */
+#define GC_MIN_CLASS_SHIFT                         4
+#define GC_MIN_CLASS_SIZE                          ( 1 << GC_MIN_CLASS_SHIFT)
+#define GC_CLASSES                                 8
+#define GC_MAX_CLASS_SIZE                          ( GC_MIN_CLASS_SIZE << \
+                                                     ( GC_CLASSES - 1))
+#define GC_ARENA_SIZE                              16384
+
 typedef struct{
     list_t list;
     uint32_t size;
-    uint32_t mark;
+    uint16_t mark;
+#define GC_LARGE                                   0xffff /* malloc()ed */
+    uint16_t sclass;
+#ifdef DEBUG
 #define MAX_DBG_STR_LEN                            48
     char d_str[MAX_DBG_STR_LEN];
+#endif
     char data[];
 }gc_node_t;
 
 
 
-typedef gc_node_t gc_list_t;
+typedef struct{
+    list_t list;                  /* nodes in use */
+    list_t free_nodes[GC_CLASSES];
+    arena_t *arena;
+    uint32_t large;               /* GC_LARGE nodes in use */
+}gc_list_t;
 
 int     gc_list_init( gc_list_t *ll);
 void    gc_list_destroy( gc_list_t *ll);
 size_t  gc_list_total_mem( gc_list_t *ll);
 void   *gc_malloc( gc_list_t *ll, size_t size);
-void    gc_free( void *p);
+void    gc_free( gc_list_t *ll, void *p);
 void   *gc_realloc( gc_list_t *ll, void *ptr, size_t size);
 char   *gc_strdup( gc_list_t *ll, char *p);
 char   *gc_strncat( gc_list_t *ll, char *p, char *q);
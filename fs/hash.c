@@ -2,6 +2,11 @@
 #include <stdio.h>
 #include <stdlib.h> 
 #include <ctype.h> 
+#if defined( USER_SPACE) && defined( __x86_64__) && defined( __GNUC__)
+#include <immintrin.h>
+#define HASH_AVX2
+#define HASH_AVX2_FN                     __attribute__(( target( "avx2")))
+#endif
 
 
 /* In order to encode words in a 64-bits "hash", we need to encode the ascii 
@@ -52,6 +57,29 @@ hb79_r_t hb79_r[]={
     { 0,    0,     0}};
 
 
+/* ascii_2_mx79() of every byte, hash_b79() looks the codes up here instead
+ * of walking the ranges above for every character */
+static const uint8_t hb79_table[256] = {
+     0,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+     2,  3,  4,  4,  4,  4,  4,  4,  5,  6,  7,  7,  7,  8,  9, 10,
+    11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 21, 21, 21, 21, 21,
+    21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36,
+    37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 48, 48, 49, 49,
+    49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64,
+    65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 76, 77, 77, 78,
+    78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78,
+    78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78,
+    78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78,
+    78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78,
+    78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78,
+    78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78,
+    78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78,
+    78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78, 78,
+};
+
+
+/* the code of a character walking hb79_r, the reference for hb79_table */
 int ascii_2_mx79( int c){
     int cc, i, liminf, limsup=0;
 
@@ -77,26 +105,41 @@ int ascii_2_mx79( int c){
  * This hash is interesting because it works well for create 64-bit numbers
  * which can be used to sort words. */
 uint64_t hash_b79(char *s){
-    int l, i, c, cc; 
-    uint64_t h;
-    l = strlen( s);
-    h = 0;
-
-    for( i = 0; i < 10; i++){
-        if( i < l){
-            c = s[i];
-            cc = ascii_2_mx79( c);
-        }else{
-            cc = 0;
-        } 
-        h *= 79;
-        h += cc;
+    unsigned char *p = ( unsigned char *) s;
+    uint64_t h = 0;
+    int i;
+
+    /* the code of the zero is 0 too, the words shorter than 10 chars are
+     * padded with it */
+    for( i = 0; i < 10 && p[i] != 0; i++){
+        h = h * 79 + hb79_table[p[i]];
     } 
+    for( ; i < 10; i++){
+        h *= 79;
+    }
 
     return( h);
 }
 
 
+/* every word starting with prefix has a hash_b79() between lo and hi, the
+ * prefix followed by the lowest and the highest codes. Words with other
+ * prefixes may fall in between if their characters share codes with the
+ * prefix ones */
+void hash_b79_prefix( char *prefix, uint64_t *lo, uint64_t *hi){
+    int l, i, cc;
+
+    l = strlen( prefix);
+    *lo = *hi = 0;
+
+    for( i = 0; i < 10; i++){
+        cc = ( i < l) ? hb79_table[( unsigned char) prefix[i]] : 0;
+        *lo = *lo * 79 + cc;
+        *hi = *hi * 79 + ( ( i < l) ? cc : 78);
+    }
+}
+
+
 /* took this from linux kernel. I know, I am a pirate :( */
 
 /*-*************************************
@@ -146,6 +189,9 @@ static uint64_t xxh64_merge_round(uint64_t acc, uint64_t val){
 }
 
 
+static uint64_t xxh64_tail(uint64_t h64, const uint8_t *p,
+                           const uint8_t *b_end);
+
 /* 64-bit unique hash for a bunch of bytes */
 uint64_t xxh64(const void *input, const size_t len, const uint64_t seed){
     const uint8_t *p = (const uint8_t *)input;
@@ -182,7 +228,13 @@ uint64_t xxh64(const void *input, const size_t len, const uint64_t seed){
     }
 
     h64 += (uint64_t)len;
+    return xxh64_tail(h64, p, b_end);
+}
 
+
+/* the bytes after the 32 bytes stripes and the final mix */
+static uint64_t xxh64_tail(uint64_t h64, const uint8_t *p,
+                           const uint8_t *b_end){
     while (p + 8 <= b_end) {
         const uint64_t k1 = xxh64_round(0, get_unaligned_le64(p));
 
@@ -273,3 +325,353 @@ uint32_t xxh32(const void *input, const size_t len, const uint32_t seed)
 	return h32;
 }
 
+
+
+#ifdef HASH_AVX2
+
+/* multi-lane versions of the hashes above, lane i hashes the input
+ * lanes[i]. Every lane runs the same steps than the scalar code, a lane
+ * whose input has no bytes left for a step keeps its value. Only the
+ * inputs shorter than a stripe go here, the names and the keys. They are
+ * built for AVX2 whatever the CFLAGS, and only called if the CPU has it */
+
+#define HB79_LANES                       4
+#define XXH64_LANES                      4
+#define XXH32_LANES                      8
+
+#define xxh_rotl32_v(x, r)   _mm256_or_si256( _mm256_slli_epi32( x, r), \
+                                              _mm256_srli_epi32( x, 32 - r))
+#define xxh_rotl64_v(x, r)   _mm256_or_si256( _mm256_slli_epi64( x, r), \
+                                              _mm256_srli_epi64( x, 64 - r))
+
+
+/* the low 64 bits of a * b in every lane, AVX2 has no 64 bits mullo */
+static inline HASH_AVX2_FN __m256i xxh_mul64_v( __m256i a, __m256i b){
+    __m256i lo, t;
+
+    lo = _mm256_mul_epu32( a, b);
+    t = _mm256_add_epi64( _mm256_mul_epu32( _mm256_srli_epi64( a, 32), b),
+                          _mm256_mul_epu32( a, _mm256_srli_epi64( b, 32)));
+    return( _mm256_add_epi64( lo, _mm256_slli_epi64( t, 32)));
+}
+
+
+static HASH_AVX2_FN void hash_b79_lanes( char **s, uint64_t *h, const int *lanes){
+    uint64_t c[HB79_LANES] __attribute__(( aligned( 32)));
+    const unsigned char *p[HB79_LANES];
+    int done[HB79_LANES];
+    __m256i v = _mm256_setzero_si256();
+    int i, k;
+
+    for( i = 0; i < HB79_LANES; i++){
+        p[i] = ( const unsigned char *) s[lanes[i]];
+        done[i] = 0;
+    }
+
+    /* h * 79 is h * 64 + h * 16 - h, after the terminator the code is 0 */
+    for( k = 0; k < 10; k++){
+        for( i = 0; i < HB79_LANES; i++){
+            if( !done[i] && p[i][k] == 0){
+                done[i] = 1;
+            }
+            c[i] = done[i] ? 0 : hb79_table[p[i][k]];
+        }
+
+        v = _mm256_sub_epi64( _mm256_add_epi64( _mm256_slli_epi64( v, 6),
+                                                _mm256_slli_epi64( v, 4)), v);
+        v = _mm256_add_epi64( v, _mm256_load_si256( (const __m256i *) c));
+    }
+
+    _mm256_store_si256( (__m256i *) c, v);
+    for( i = 0; i < HB79_LANES; i++){
+        h[lanes[i]] = c[i];
+    }
+}
+
+
+static HASH_AVX2_FN void xxh64_lanes( const void **input, const size_t *len, 
+                         uint64_t seed, uint64_t *h, const int *lanes){
+    uint64_t w[XXH64_LANES] __attribute__(( aligned( 32)));
+    const uint8_t *p[XXH64_LANES];
+    size_t l[XXH64_LANES], off[XXH64_LANES];
+    __m256i h64, k1, v, lenv, rem, act;
+    int i, k;
+
+    for( i = 0; i < XXH64_LANES; i++){
+        p[i] = ( const uint8_t *) input[lanes[i]];
+        l[i] = len[lanes[i]];
+        w[i] = l[i];
+    }
+
+    lenv = _mm256_load_si256( (const __m256i *) w);
+    h64 = _mm256_add_epi64( _mm256_set1_epi64x( seed + PRIME64_5), lenv);
+
+    /* up to three 8 bytes words */
+    for( k = 0; k < 3; k++){
+        for( i = 0; i < XXH64_LANES; i++){
+            w[i] = ( l[i] >= 8 * k + 8) ? get_unaligned_le64( p[i] + 8 * k)
+                                        : 0;
+        }
+        act = _mm256_cmpgt_epi64( lenv, _mm256_set1_epi64x( 8 * k + 7));
+
+        k1 = _mm256_load_si256( (const __m256i *) w);
+        k1 = xxh_mul64_v( k1, _mm256_set1_epi64x( PRIME64_2));
+        k1 = xxh_mul64_v( xxh_rotl64_v( k1, 31), 
+                          _mm256_set1_epi64x( PRIME64_1));
+        v = _mm256_xor_si256( h64, k1);
+        v = xxh_mul64_v( xxh_rotl64_v( v, 27), _mm256_set1_epi64x( PRIME64_1));
+        v = _mm256_add_epi64( v, _mm256_set1_epi64x( PRIME64_4));
+        h64 = _mm256_blendv_epi8( h64, v, act);
+    }
+
+    /* a 4 bytes word */
+    for( i = 0; i < XXH64_LANES; i++){
+        off[i] = l[i] & ~( size_t) 7;
+        w[i] = ( l[i] - off[i] >= 4) ? get_unaligned_le32( p[i] + off[i]) : 0;
+        off[i] += ( l[i] - off[i] >= 4) ? 4 : 0;
+    }
+    rem = _mm256_and_si256( lenv, _mm256_set1_epi64x( 7));
+    act = _mm256_cmpgt_epi64( rem, _mm256_set1_epi64x( 3));
+    v = xxh_mul64_v( _mm256_load_si256( (const __m256i *) w), 
+                     _mm256_set1_epi64x( PRIME64_1));
+    v = _mm256_xor_si256( h64, v);
+    v = xxh_mul64_v( xxh_rotl64_v( v, 23), _mm256_set1_epi64x( PRIME64_2));
+    v = _mm256_add_epi64( v, _mm256_set1_epi64x( PRIME64_3));
+    h64 = _mm256_blendv_epi8( h64, v, act);
+
+    /* up to three bytes */
+    rem = _mm256_and_si256( lenv, _mm256_set1_epi64x( 3));
+    for( k = 0; k < 3; k++){
+        for( i = 0; i < XXH64_LANES; i++){
+            w[i] = ( off[i] + k < l[i]) ? p[i][off[i] + k] : 0;
+        }
+        act = _mm256_cmpgt_epi64( rem, _mm256_set1_epi64x( k));
+
+        v = xxh_mul64_v( _mm256_load_si256( (const __m256i *) w), 
+                         _mm256_set1_epi64x( PRIME64_5));
+        v = _mm256_xor_si256( h64, v);
+        v = xxh_mul64_v( xxh_rotl64_v( v, 11), _mm256_set1_epi64x( PRIME64_1));
+        h64 = _mm256_blendv_epi8( h64, v, act);
+    }
+
+    h64 = _mm256_xor_si256( h64, _mm256_srli_epi64( h64, 33));
+    h64 = xxh_mul64_v( h64, _mm256_set1_epi64x( PRIME64_2));
+    h64 = _mm256_xor_si256( h64, _mm256_srli_epi64( h64, 29));
+    h64 = xxh_mul64_v( h64, _mm256_set1_epi64x( PRIME64_3));
+    h64 = _mm256_xor_si256( h64, _mm256_srli_epi64( h64, 32));
+
+    _mm256_store_si256( (__m256i *) w, h64);
+    for( i = 0; i < XXH64_LANES; i++){
+        h[lanes[i]] = w[i];
+    }
+}
+
+
+static HASH_AVX2_FN void xxh32_lanes( const void **input, const size_t *len, 
+                         uint32_t seed, uint32_t *h, const int *lanes){
+    uint32_t w[XXH32_LANES] __attribute__(( aligned( 32)));
+    const uint8_t *p[XXH32_LANES];
+    size_t l[XXH32_LANES];
+    __m256i h32, v, lenv, rem, act;
+    int i, k;
+
+    for( i = 0; i < XXH32_LANES; i++){
+        p[i] = ( const uint8_t *) input[lanes[i]];
+        l[i] = len[lanes[i]];
+        w[i] = ( uint32_t) l[i];
+    }
+
+    lenv = _mm256_load_si256( (const __m256i *) w);
+    h32 = _mm256_add_epi32( _mm256_set1_epi32( seed + PRIME32_5), lenv);
+
+    /* up to three 4 bytes words */
+    for( k = 0; k < 3; k++){
+        for( i = 0; i < XXH32_LANES; i++){
+            w[i] = ( l[i] >= 4 * k + 4) ? get_unaligned_le32( p[i] + 4 * k)
+                                        : 0;
+        }
+        act = _mm256_cmpgt_epi32( lenv, _mm256_set1_epi32( 4 * k + 3));
+
+        v = _mm256_mullo_epi32( _mm256_load_si256( (const __m256i *) w),
+                                _mm256_set1_epi32( PRIME32_3));
+        v = _mm256_add_epi32( h32, v);
+        v = _mm256_mullo_epi32( xxh_rotl32_v( v, 17), 
+                                _mm256_set1_epi32( PRIME32_4));
+        h32 = _mm256_blendv_epi8( h32, v, act);
+    }
+
+    /* up to three bytes */
+    rem = _mm256_and_si256( lenv, _mm256_set1_epi32( 3));
+    for( k = 0; k < 3; k++){
+        for( i = 0; i < XXH32_LANES; i++){
+            w[i] = ( ( l[i] & 3) > ( size_t) k) ? p[i][( l[i] & ~3) + k] : 0;
+        }
+        act = _mm256_cmpgt_epi32( rem, _mm256_set1_epi32( k));
+
+        v = _mm256_mullo_epi32( _mm256_load_si256( (const __m256i *) w),
+                                _mm256_set1_epi32( PRIME32_5));
+        v = _mm256_add_epi32( h32, v);
+        v = _mm256_mullo_epi32( xxh_rotl32_v( v, 11), 
+                                _mm256_set1_epi32( PRIME32_1));
+        h32 = _mm256_blendv_epi8( h32, v, act);
+    }
+
+    h32 = _mm256_xor_si256( h32, _mm256_srli_epi32( h32, 15));
+    h32 = _mm256_mullo_epi32( h32, _mm256_set1_epi32( PRIME32_2));
+    h32 = _mm256_xor_si256( h32, _mm256_srli_epi32( h32, 13));
+    h32 = _mm256_mullo_epi32( h32, _mm256_set1_epi32( PRIME32_3));
+    h32 = _mm256_xor_si256( h32, _mm256_srli_epi32( h32, 16));
+
+    _mm256_store_si256( (__m256i *) w, h32);
+    for( i = 0; i < XXH32_LANES; i++){
+        h[lanes[i]] = w[i];
+    }
+}
+
+
+
+/* the short inputs are grouped in lanes, the left overs and the long ones
+ * go one by one */
+static void hash_b79_batch_lanes( char **s, uint64_t *h, int n){
+    int lanes[HB79_LANES], i, j;
+
+    for( i = 0; i + HB79_LANES <= n; i += HB79_LANES){
+        for( j = 0; j < HB79_LANES; j++){
+            lanes[j] = i + j;
+        }
+        hash_b79_lanes( s, h, lanes);
+    }
+
+    for( ; i < n; i++){
+        h[i] = hash_b79( s[i]);
+    }
+}
+
+
+static void xxh64_batch_lanes( const void **input, const size_t *len, 
+                               uint64_t seed, uint64_t *h, int n){
+    int lanes[XXH64_LANES], i, m = 0;
+    const uint8_t *p;
+
+    for( i = 0; i < n; i++){
+        if( len[i] >= 32){
+            h[i] = xxh64( input[i], len[i], seed);
+            continue;
+        }
+
+        lanes[m++] = i;
+        if( m == XXH64_LANES){
+            xxh64_lanes( input, len, seed, h, lanes);
+            m = 0;
+        }
+    }
+
+    while( m > 0){
+        i = lanes[--m];
+        p = ( const uint8_t *) input[i];
+        h[i] = xxh64_tail( seed + PRIME64_5 + len[i], p, p + len[i]);
+    }
+}
+
+
+static void xxh32_batch_lanes( const void **input, const size_t *len, 
+                               uint32_t seed, uint32_t *h, int n){
+    int lanes[XXH32_LANES], i, m = 0;
+
+    for( i = 0; i < n; i++){
+        if( len[i] >= 16){
+            h[i] = xxh32( input[i], len[i], seed);
+            continue;
+        }
+
+        lanes[m++] = i;
+        if( m == XXH32_LANES){
+            xxh32_lanes( input, len, seed, h, lanes);
+            m = 0;
+        }
+    }
+
+    while( m > 0){
+        i = lanes[--m];
+        h[i] = xxh32( input[i], len[i], seed);
+    }
+}
+
+#endif
+
+
+
+/* checked once, the batches take the lanes only if the CPU runs AVX2 */
+int hash_batch_avx2(){
+#ifdef HASH_AVX2
+    static int avx2 = -1;
+
+    if( avx2 < 0){
+        __builtin_cpu_init();
+        avx2 = __builtin_cpu_supports( "avx2") ? 1 : 0;
+    }
+    return( avx2);
+#else
+    return( 0);
+#endif
+}
+
+
+
+void hash_b79_batch( char **s, uint64_t *h, int n){
+    int i;
+
+#ifdef HASH_AVX2
+    if( hash_batch_avx2()){
+        hash_b79_batch_lanes( s, h, n);
+        return;
+    }
+#endif
+
+    for( i = 0; i < n; i++){
+        h[i] = hash_b79( s[i]);
+    }
+}
+
+
+
+void xxh64_batch( const void **input, const size_t *len, uint64_t seed,
+                  uint64_t *h, int n){
+    const uint8_t *p;
+    int i;
+
+#ifdef HASH_AVX2
+    if( hash_batch_avx2()){
+        xxh64_batch_lanes( input, len, seed, h, n);
+        return;
+    }
+#endif
+
+    /* names and keys are shorter than a stripe most of the time, they go
+     * straight to the tail. The hashes are independent, so the compiler
+     * can overlap their multiplications */
+    for( i = 0; i < n; i++){
+        p = ( const uint8_t *) input[i];
+        h[i] = ( len[i] < 32) ?
+               xxh64_tail( seed + PRIME64_5 + len[i], p, p + len[i]) :
+               xxh64( p, len[i], seed);
+    }
+}
+
+
+
+void xxh32_batch( const void **input, const size_t *len, uint32_t seed,
+                  uint32_t *h, int n){
+    int i;
+
+#ifdef HASH_AVX2
+    if( hash_batch_avx2()){
+        xxh32_batch_lanes( input, len, seed, h, n);
+        return;
+    }
+#endif
+
+    for( i = 0; i < n; i++){
+        h[i] = xxh32( input[i], len[i], seed);
+    }
+}
@@ -16,8 +16,28 @@
 /* Function that create a "hash" of 10 chars words with low 
  * collisions. */
 uint64_t hash_b79(char *s);
+
+/* the code of a character for hash_b79() */
+int ascii_2_mx79( int c);
+
+/* range of hash_b79() for the words starting with prefix */
+void hash_b79_prefix( char *prefix, uint64_t *lo, uint64_t *hi);
 uint64_t xxh64(const void *input, const size_t len, const uint64_t seed);
 uint32_t xxh32(const void *input, const size_t len, const uint32_t seed);
 
+/* the hashes of n words or buffers at once, h[i] is the hash of the i-th
+ * one. The same values than one by one, for the bulk imports of edges and
+ * the rebuilds of the dict indexes. In user space, on a CPU with AVX2, the
+ * words and the buffers shorter than a stripe are hashed several at a
+ * time */
+void hash_b79_batch( char **s, uint64_t *h, int n);
+void xxh64_batch( const void **input, const size_t *len, uint64_t seed,
+                  uint64_t *h, int n);
+void xxh32_batch( const void **input, const size_t *len, uint32_t seed,
+                  uint32_t *h, int n);
+
+/* 1 if the batches above run on AVX2 lanes, checked at run time */
+int hash_batch_avx2();
+
 
 #endif
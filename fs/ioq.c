@@ -0,0 +1,334 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/uio.h>
+#include "trace.h"
+#include "list.h"
+#include "kfs_mem.h"
+#include "bdev.h"
+#include "ioq.h"
+
+
+
+static const uint64_t ioq_deadline_ms[IOQ_PRIO_NUM] = {
+    IOQ_DEADLINE_META_MS,
+    IOQ_DEADLINE_WRITEBACK_MS,
+    IOQ_DEADLINE_PREFETCH_MS
+};
+
+
+
+static uint64_t ioq_now_ns( void){
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts);
+    return( (uint64_t) ts.tv_sec * 1000000000ul + (uint64_t) ts.tv_nsec);
+}
+
+
+
+/* do the IO for a batch of adjacent requests, all with the same
+ * operation. No lock is held here */
+static int ioq_do_io( ioq_t *ioq, ioq_request_t **batch, int n){
+    struct iovec iov[IOQ_MAX_MERGE];
+    int i;
+
+    for( i = 0; i < n; i++){
+        iov[i].iov_base = batch[i]->iq_buf;
+        iov[i].iov_len = (size_t) KFS_BLOCKS_TO_BYTES( batch[i]->iq_num_blocks);
+    }
+
+    if( batch[0]->iq_op == IOQ_OP_WRITE){
+        return( bdev_writev( ioq->io_bdev, iov, n, batch[0]->iq_block_addr));
+    }
+
+    return( bdev_readv( ioq->io_bdev, iov, n, batch[0]->iq_block_addr));
+}
+
+
+
+/* choose the next request to serve. Expired requests go first, the one
+ * with the oldest deadline. Otherwise the highest priority queue is served
+ * in elevator order, the first request after the head position, wrapping
+ * around to the lowest address. io_mutex is held */
+static ioq_request_t *ioq_pick( ioq_t *ioq){
+    ioq_request_t *req, *expired = NULL;
+    list_t *pos;
+    uint64_t now;
+    int prio;
+
+    now = ioq_now_ns();
+    for( prio = 0; prio < IOQ_PRIO_NUM; prio++){
+        list_for_each( pos, &ioq->io_queues[prio]){
+            req = (ioq_request_t *) pos;
+            if( req->iq_deadline_ns <= now &&
+                ( expired == NULL ||
+                  req->iq_deadline_ns < expired->iq_deadline_ns)){
+                expired = req;
+            }
+        }
+    }
+
+    if( expired != NULL){
+        return( expired);
+    }
+
+    for( prio = 0; prio < IOQ_PRIO_NUM; prio++){
+        if( list_empty( &ioq->io_queues[prio])){
+            continue;
+        }
+
+        list_for_each( pos, &ioq->io_queues[prio]){
+            req = (ioq_request_t *) pos;
+            if( req->iq_block_addr >= ioq->io_head_addr){
+                return( req);
+            }
+        }
+
+        return( (ioq_request_t *) ioq->io_queues[prio].next);
+    }
+
+    return( NULL);
+}
+
+
+
+/* dispatcher thread, serves the requests in batches of adjacent blocks.
+ * On exit the queues are drained first. */
+static void *ioq_thread( void *arg){
+    ioq_t *ioq = (ioq_t *) arg;
+    ioq_request_t *batch[IOQ_MAX_MERGE];
+    ioq_request_t *req, *next;
+    list_t *head;
+    uint64_t end;
+    int i, n, rc;
+
+    pthread_mutex_lock( &ioq->io_mutex);
+    for( ;;){
+        if( ioq->io_pending == 0){
+            if( (ioq->io_flags & IOQ_EXIT) != 0){
+                break;
+            }
+            pthread_cond_wait( &ioq->io_cond, &ioq->io_mutex);
+            continue;
+        }
+
+        req = ioq_pick( ioq);
+        head = &ioq->io_queues[req->iq_prio];
+
+        /* merge the adjacent requests following this one. The queue is
+         * sorted, so they are right behind it */
+        n = 0;
+        batch[n++] = req;
+        end = req->iq_block_addr + req->iq_num_blocks;
+        while( n < IOQ_MAX_MERGE && req->iq_list.next != head){
+            next = (ioq_request_t *) req->iq_list.next;
+            if( next->iq_op != req->iq_op || next->iq_block_addr != end){
+                break;
+            }
+            batch[n++] = next;
+            end += next->iq_num_blocks;
+            req = next;
+        }
+
+        for( i = 0; i < n; i++){
+            list_del( &batch[i]->iq_list);
+            batch[i]->iq_flags &= ~IOQ_REQ_QUEUED;
+        }
+        ioq->io_pending -= n;
+        ioq->io_head_addr = end;
+        pthread_mutex_unlock( &ioq->io_mutex);
+
+        rc = ioq_do_io( ioq, batch, n);
+        if( rc != 0){
+            TRACE_ERR("IO error, addr=%lu, %d requests",
+                      batch[0]->iq_block_addr, n);
+        }
+
+        pthread_mutex_lock( &ioq->io_mutex);
+        for( i = 0; i < n; i++){
+            batch[i]->iq_rc = rc;
+            batch[i]->iq_flags |= IOQ_REQ_DONE;
+        }
+        pthread_cond_broadcast( &ioq->io_done_cond);
+    }
+    pthread_mutex_unlock( &ioq->io_mutex);
+
+    pthread_exit( NULL);
+}
+
+
+
+ioq_t *ioq_alloc( bdev_t *bdev){
+    ioq_t *ioq;
+    int i;
+
+    ioq = malloc( sizeof( ioq_t));
+    if( ioq == NULL){
+        TRACE_ERR("Error in malloc()");
+        return( NULL);
+    }
+
+    memset( (void *) ioq, 0, sizeof( ioq_t));
+    for( i = 0; i < IOQ_PRIO_NUM; i++){
+        INIT_LIST_HEAD( &ioq->io_queues[i]);
+    }
+
+    if( pthread_mutex_init( &ioq->io_mutex, NULL) != 0){
+        TRACE_ERR("mutex init has failed");
+        goto exit0;
+    }
+
+    if( pthread_cond_init( &ioq->io_cond, NULL) != 0){
+        TRACE_ERR("cond init has failed");
+        goto exit1;
+    }
+
+    if( pthread_cond_init( &ioq->io_done_cond, NULL) != 0){
+        TRACE_ERR("cond init has failed");
+        goto exit2;
+    }
+
+    ioq->io_bdev = bdev;
+    return( ioq);
+
+exit2:
+    pthread_cond_destroy( &ioq->io_cond);
+exit1:
+    pthread_mutex_destroy( &ioq->io_mutex);
+exit0:
+    free( ioq);
+    return( NULL);
+}
+
+
+
+int ioq_start( ioq_t *ioq){
+    int rc;
+
+    rc = pthread_create( &ioq->io_thread, NULL, ioq_thread, ioq);
+    if( rc != 0){
+        TRACE_ERR("pthread_create() failed for IO dispatcher");
+        return( -1);
+    }
+
+    pthread_mutex_lock( &ioq->io_mutex);
+    ioq->io_flags |= IOQ_ACTIVE;
+    pthread_mutex_unlock( &ioq->io_mutex);
+    return( 0);
+}
+
+
+
+int ioq_destroy( ioq_t *ioq){
+    if( (ioq->io_flags & IOQ_ACTIVE) != 0){
+        pthread_mutex_lock( &ioq->io_mutex);
+        ioq->io_flags |= IOQ_EXIT;
+        pthread_cond_signal( &ioq->io_cond);
+        pthread_mutex_unlock( &ioq->io_mutex);
+
+        pthread_join( ioq->io_thread, NULL);
+    }
+
+    pthread_cond_destroy( &ioq->io_done_cond);
+    pthread_cond_destroy( &ioq->io_cond);
+    pthread_mutex_destroy( &ioq->io_mutex);
+    free( ioq);
+    return( 0);
+}
+
+
+
+int ioq_submit( ioq_t *ioq, ioq_request_t *req){
+    ioq_request_t *el;
+    list_t *pos;
+
+    if( req->iq_prio < 0 || req->iq_prio >= IOQ_PRIO_NUM ||
+        req->iq_num_blocks <= 0){
+        TRACE_ERR("invalid IO request");
+        return( -1);
+    }
+
+    req->iq_flags = 0;
+    req->iq_rc = 0;
+
+    pthread_mutex_lock( &ioq->io_mutex);
+    if( (ioq->io_flags & IOQ_ACTIVE) == 0 ||
+        (ioq->io_flags & IOQ_EXIT) != 0){
+        pthread_mutex_unlock( &ioq->io_mutex);
+
+        /* no dispatcher, serve it here */
+        req->iq_rc = ioq_do_io( ioq, &req, 1);
+        req->iq_flags |= IOQ_REQ_DONE;
+        return( 0);
+    }
+
+    req->iq_deadline_ns = ioq_now_ns() +
+                          ioq_deadline_ms[req->iq_prio] * 1000000ul;
+
+    /* insert sorted by block address, after the requests with the same
+     * address so they are served in arrival order */
+    list_for_each( pos, &ioq->io_queues[req->iq_prio]){
+        el = (ioq_request_t *) pos;
+        if( el->iq_block_addr > req->iq_block_addr){
+            break;
+        }
+    }
+    list_add_tail( &req->iq_list, pos);
+    req->iq_flags |= IOQ_REQ_QUEUED;
+    ioq->io_pending++;
+
+    pthread_cond_signal( &ioq->io_cond);
+    pthread_mutex_unlock( &ioq->io_mutex);
+    return( 0);
+}
+
+
+
+int ioq_wait( ioq_t *ioq, ioq_request_t *req){
+    pthread_mutex_lock( &ioq->io_mutex);
+    while( (req->iq_flags & IOQ_REQ_DONE) == 0){
+        pthread_cond_wait( &ioq->io_done_cond, &ioq->io_mutex);
+    }
+    pthread_mutex_unlock( &ioq->io_mutex);
+
+    return( req->iq_rc);
+}
+
+
+
+static int ioq_rw( ioq_t *ioq, int op, char *buf, uint64_t addr,
+                   int num_blocks, int prio){
+    ioq_request_t req;
+
+    memset( (void *) &req, 0, sizeof( ioq_request_t));
+    req.iq_block_addr = addr;
+    req.iq_num_blocks = num_blocks;
+    req.iq_buf = buf;
+    req.iq_op = op;
+    req.iq_prio = prio;
+
+    if( ioq_submit( ioq, &req) != 0){
+        return( -1);
+    }
+
+    return( ioq_wait( ioq, &req));
+}
+
+
+
+int ioq_read( ioq_t *ioq, char *buf, uint64_t addr, int num_blocks,
+              int prio){
+    return( ioq_rw( ioq, IOQ_OP_READ, buf, addr, num_blocks, prio));
+}
+
+
+
+int ioq_write( ioq_t *ioq, char *buf, uint64_t addr, int num_blocks,
+               int prio){
+    return( ioq_rw( ioq, IOQ_OP_WRITE, buf, addr, num_blocks, prio));
+}
+
@@ -0,0 +1,93 @@
+#ifndef _IOQ_H_
+#define _IOQ_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include "list.h"
+#include "bdev.h"
+
+
+/* request priorities, lower value is served first. A request waiting
+ * longer than the deadline of its class is served before any other, so
+ * background IO is delayed but never starved. */
+#define IOQ_PRIO_META                    0 /* foreground reads and writes */
+#define IOQ_PRIO_WRITEBACK               1 /* cache flusher */
+#define IOQ_PRIO_PREFETCH                2 /* prefetch worker */
+#define IOQ_PRIO_NUM                     3
+
+/* deadlines in milliseconds, by priority */
+#define IOQ_DEADLINE_META_MS             50
+#define IOQ_DEADLINE_WRITEBACK_MS        500
+#define IOQ_DEADLINE_PREFETCH_MS         1000
+
+/* max number of adjacent requests merged in a single dispatch */
+#define IOQ_MAX_MERGE                    32
+
+#define IOQ_OP_READ                      0
+#define IOQ_OP_WRITE                     1
+
+
+/* an IO request. The memory belongs to the submitter, and it should stay
+ * valid until ioq_wait() returns */
+typedef struct{
+    list_t iq_list;               /* keep this first */
+    uint64_t iq_block_addr;
+    int iq_num_blocks;
+    char *iq_buf;
+    int iq_op;
+    int iq_prio;
+    uint64_t iq_deadline_ns;      /* monotonic clock */
+
+#define IOQ_REQ_QUEUED                   0x0001
+#define IOQ_REQ_DONE                     0x0002
+    uint32_t iq_flags;
+    int iq_rc;                    /* 0 on success, -1 on IO error */
+}ioq_request_t;
+
+
+typedef struct{
+    bdev_t *io_bdev;
+
+    /* one queue per priority, each one sorted by block address */
+    list_t io_queues[IOQ_PRIO_NUM];
+    int io_pending;
+
+    /* elevator position, the block after the last dispatched request */
+    uint64_t io_head_addr;
+
+#define IOQ_ACTIVE                       0x0001 /* dispatcher running */
+#define IOQ_EXIT                         0x0002 /* dispatcher should
+                                                   finish */
+    uint32_t io_flags;
+    pthread_mutex_t io_mutex;
+    pthread_cond_t io_cond;       /* wakes up the dispatcher */
+    pthread_cond_t io_done_cond;  /* wakes up the submitters */
+    pthread_t io_thread;
+}ioq_t;
+
+
+/* create and init an IO queue for the block device backend bdev */
+ioq_t *ioq_alloc( bdev_t *bdev);
+
+/* start the dispatcher thread */
+int ioq_start( ioq_t *ioq);
+
+/* serve the pending requests, stop the dispatcher and free everything */
+int ioq_destroy( ioq_t *ioq);
+
+/* queue a request and return without waiting for it. If the dispatcher
+ * is not running, the request is served right away in the caller. */
+int ioq_submit( ioq_t *ioq, ioq_request_t *req);
+
+/* wait for a submitted request to complete, return its result */
+int ioq_wait( ioq_t *ioq, ioq_request_t *req);
+
+/* synchronous helpers, submit and wait */
+int ioq_read( ioq_t *ioq, char *buf, uint64_t addr, int num_blocks,
+              int prio);
+int ioq_write( ioq_t *ioq, char *buf, uint64_t addr, int num_blocks,
+               int prio);
+
+
+#endif
+
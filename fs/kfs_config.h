@@ -3,6 +3,7 @@
 #include "kfs_mem.h"
 
 #define KFS_FILENAME_LEN                           128
+#define KFS_STRIPE_FILES_LEN                       1024
 typedef struct{
     char kfs_file[KFS_FILENAME_LEN];
     char pid_file[KFS_FILENAME_LEN];
@@ -15,6 +16,12 @@ typedef struct{
     int max_clients;
     int root_super_inode;
     int sock_buffer_size; 
+    int bdev_backend;    /* BDEV_FILE, BDEV_DIRECT or BDEV_RAM */
+    int bdev_latency_us; /* BDEV_RAM only, delay per request */
+
+    /* comma separated list of the devices after kfs_file in a striped
+     * volume, empty for a single device */
+    char kfs_stripe_files[KFS_STRIPE_FILES_LEN];
 }kfs_config_t; 
 
 int kfs_config_read( char *filename, kfs_config_t *conf);
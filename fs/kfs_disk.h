@@ -271,6 +271,23 @@ typedef struct{
 
 }kfs_slot_data_t;
 
+
+/* compact records, for the slots with SLOT_COMPACT in their flags. There
+ * is no hash, no padding and no fixed width field, one after the other:
+ *
+ *   varint key       (key id << 1) | 1 for a key of the shared keys table,
+ *                    see dict_keys_t, or key length << 1 followed by the
+ *                    key, without the zero. 0 ends the records
+ *   uint8 type       value data type
+ *   value            DICT_INT zigzag varint, DICT_UINT varint, DICT_BOOLEAN
+ *                    a byte, DICT_FLOAT 8 bytes, DICT_STRING, DICT_BLOB and
+ *                    DICT_EXTENT varint length followed by the data
+ *
+ * The varints are LEB128, 7 bits per byte with the high bit set in all
+ * but the last one */
+#define KFS_SLOT_KEY_INTERNED                      0x01
+#define KFS_VARINT_MAX_LEN                         10
+
 /* enough for slots. Now on to the real file system stuff. */ 
 
 /* Edges are represented also in an extent.
@@ -332,6 +349,7 @@ typedef struct{
 #define KFS_SB_SLOTS_NUM_FIXED                     0x0002
 #define KFS_SB_AUTO_DEFRAG                         0x0004
 #define KFS_IS_MOUNTED                             0x0008
+#define KFS_SB_LAZY_TABLES                         0x0010
 
 
     uint32_t sb_flags;
@@ -353,6 +371,18 @@ typedef struct{
     
     /* block dev */
     int dev;
+
+    /* striping. Blocks are spread in chunks of sb_stripe_unit blocks over
+     * sb_stripe_devs devices, round robin. The block map covers the whole
+     * striped volume. 0 devices means a single device volume */
+    uint32_t sb_stripe_devs;
+    uint32_t sb_stripe_unit;
+
+    /* with KFS_SB_LAZY_TABLES, the number of blocks of the super inodes
+     * and slots tables written so far. The blocks after them were never
+     * written and hold default entries */
+    uint64_t sb_si_table_hwm;
+    uint64_t sb_slot_table_hwm;
 }kfs_superblock_t;
 
 #endif
@@ -14,21 +14,31 @@
 
 
 int main( int argc, char **argv){
-    char *filename;
+    char *filename, *stripe_files = NULL;
+    bdev_t *bdev;
     int rc;
 
-    if( argc != 2 ){
+    if( argc != 2 && argc != 3){
         printf("ERROR: Incorrect arguments number\n");
         printf("Usage: \n");
-        printf("    kfs_info <filename>\n");
-        printf("\nkfs_info displays kfs filesystem information\n");
+        printf("    kfs_info <filename> [file,...]\n");
+        printf("\nkfs_info displays kfs filesystem information. A striped\n");
+        printf("volume needs the rest of its files, in order\n");
         printf("---------------------------------------------------------\n");
         return( -1);
     }
     
     filename = argv[1];
+    if( argc == 3){
+        stripe_files = argv[2];
+    }
 
-    rc = kfs_verify( filename, 1, 1);
+    bdev = kfs_bdev_open( filename, stripe_files, BDEV_FILE, 0);
+    if( bdev == NULL){
+        return( -1);
+    }
+
+    rc = kfs_verify( bdev, 1, 1);
+    bdev_close( bdev);
     return( rc);
 }
-
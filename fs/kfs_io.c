@@ -10,6 +10,7 @@
 #include "kfs.h"
 #include "kfs_io.h"
 #include "utils.h"
+#include "bdev.h"
 
 int kfs_config_read( char *filename, kfs_config_t *conf){
     char *s, buff[KFS_FILENAME_LEN];
@@ -74,6 +75,26 @@ int kfs_config_read( char *filename, kfs_config_t *conf){
             conf->root_super_inode = atoi( value);
         }else if ( strcmp( key, "max_clients")==0){
             conf->max_clients = atoi( value);
+        }else if ( strcmp( key, "bdev_backend")==0){
+            conf->bdev_backend = bdev_type_from_str( value);
+            if( conf->bdev_backend < 0){
+                printf("%s/%s: Invalid backend, use file, direct or ram\n",
+                       key, value);
+                return( -1);
+            }
+        }else if ( strcmp( key, "bdev_latency_us")==0){
+            conf->bdev_latency_us = atoi( value);
+        }else if ( strcmp( key, "kfs_stripe_file")==0){
+            /* one line per device, in stripe order */
+            if( strlen( conf->kfs_stripe_files) + strlen( value) + 2 > 
+                KFS_STRIPE_FILES_LEN){
+                printf("%s/%s: Too many stripe files\n", key, value);
+                return( -1);
+            }
+            if( conf->kfs_stripe_files[0] != '\0'){
+                strcat( conf->kfs_stripe_files, ",");
+            }
+            strcat( conf->kfs_stripe_files, value);
         }else{
             printf("%s/%s: Unknown name/value pair!\n", key, value);
             return( -1);
@@ -98,6 +119,9 @@ void kfs_config_display( kfs_config_t *conf){
     printf("    threads_pool=%d\n", conf->threads_pool);
     printf("    sock_buffer_size=%d\n", conf->sock_buffer_size);
     printf("    root_super_inode=%d\n", conf->root_super_inode);
+    printf("    bdev_backend=%d\n", conf->bdev_backend);
+    printf("    bdev_latency_us=%d\n", conf->bdev_latency_us);
+    printf("    kfs_stripe_files='%s'\n", conf->kfs_stripe_files);
 }
 
 
@@ -17,7 +17,27 @@
 #include "trace.h"
 #include "dict.h"
 
-#define KFS_BLOCKSIZE                             8192
+/* the block size is chosen by kfs_mkfs and stored in the superblock. It
+ * should be set with kfs_set_blocksize() before doing any IO, kfs_verify()
+ * does it from sb_blocksize. Supported sizes are the powers of two in
+ * [KFS_BLOCKSIZE_MIN, KFS_BLOCKSIZE_MAX], so blocks and bytes are 
+ * converted with shifts. */
+#define KFS_BLOCKSIZE_MIN                         8192
+#define KFS_BLOCKSIZE_MAX                         65536
+#define KFS_BLOCKSIZE_DEFAULT                     KFS_BLOCKSIZE_MIN
+
+extern uint32_t kfs_blocksize;
+extern uint32_t kfs_block_shift;
+
+#define KFS_BLOCKSIZE                             (kfs_blocksize)
+#define KFS_BLOCK_SHIFT                           (kfs_block_shift)
+#define KFS_BLOCKS_TO_BYTES(n)                    ((uint64_t)(n) <<        \
+                                                   kfs_block_shift)
+#define KFS_BYTES_TO_BLOCKS(n)                    ((uint64_t)(n) >>        \
+                                                   kfs_block_shift)
+
+/* set the block size for all the layers, return -1 if not supported */
+int kfs_set_blocksize( uint32_t blocksize);
 
 
 /* this structure maps an extent or segment of an extent in the memory */
@@ -57,6 +77,7 @@ typedef struct{
 #define SLOT_IN_USE              0x0100
 #define SLOT_LOCK                0x0200
 #define SLOT_UPDATE              0x1000
+#define SLOT_COMPACT             0x2000 /* compact records, see kfs_disk.h */
     uint16_t slot_flags;
     dict_t slot_d;
     extent_t slot_extent;
@@ -144,6 +165,11 @@ typedef struct{
     uint64_t in_use;
     extent_t bitmap_extent; 
     extent_t table_extent;
+    uint64_t hwm; /* table blocks initialized on disk, see kfs_table.h */
+
+    /* while mounted, the bitmap extent mapped in the page cache and its
+     * allocation groups, an agmap_t */
+    void *map_page;
     void *cache;
 }table_t;
 
@@ -168,15 +194,17 @@ typedef struct{
     /* slots capacity, used, cache and extents */
     slot_table_t sb_slot_table;
 
-    /* bit map capacity in blocks, taken and extents. Cache is not used. */
+    /* bit map capacity in blocks, taken and extents. Its allocation groups
+     * index the free extents */
     blockmap_t sb_blockmap;
 
     time_t sb_c_time, sb_m_time, sb_a_time; 
 
     uint64_t sb_flags;
 
-    /* block dev */
+    /* block dev, sb_bdev is -1 if the backend has no file descriptor */
     int sb_bdev;
+    void *sb_bdev_backend; /* bdev_t */
 }sb_t;
 
 
@@ -10,10 +10,13 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <ctype.h>
+#include <pthread.h>
 #include "kfs.h"
 #include "map.h"
 #include "kfs_config.h"
 #include "eio.h"
+#include "bdev.h"
+#include "kfs_table.h"
 
 #define CMD_KFS                                    0x000001
 #define CMD_META                                   0x000002
@@ -31,6 +34,10 @@
 #define OPT_K                                      0x002000
 #define OPT_X_ITEMS                                0x004000
 #define OPT_X_BLOCKS                               0x008000
+#define OPT_B                                      0x010000
+#define OPT_Z                                      0x020000
+#define OPT_T                                      0x040000
+#define OPT_U                                      0x080000
 
 #define MKFS_CREATE_FILE                           0x100000
 #define MKFS_IS_BLOCKDEVICE                        0x200000
@@ -39,7 +46,6 @@
 #define MKFS_DEFAULT_PERCENTAGE                    10
 
 
-uint64_t blocks_per_block = KFS_BLOCKSIZE * 8;
 typedef struct{
     char file_name[240];
     char conf_file[240];
@@ -53,6 +59,10 @@ typedef struct{
     uint64_t slots_num;
     uint64_t size;
     int percentage;
+    int backend;    /* BDEV_FILE or BDEV_DIRECT */
+    char stripe_files[1024]; /* devices after file_name, comma separated */
+    int stripe_devs;         /* file_name included, 0 if not striped */
+    uint32_t stripe_unit;    /* in blocks */
     int flags;
 }options_t;
 
@@ -77,6 +87,24 @@ typedef struct{
 
 char *pages[]={ NULL, NULL};
 
+/* tables and maps are built in memory and written out at the end, each
+ * region from its own thread, with writes of up to MKFS_WRITE_CHUNK */
+#define MKFS_MAX_REGIONS                           8
+#define MKFS_WRITE_CHUNK                           ( 4 * _1M)
+
+typedef struct{
+    char *rg_buf;                 /* freed once written */
+    uint64_t rg_block_addr;
+    uint64_t rg_num_blocks;
+    bdev_t *rg_bdev;
+    int rg_rc;
+    int rg_started;
+    pthread_t rg_thread;
+}mkfs_region_t;
+
+mkfs_region_t regions[MKFS_MAX_REGIONS];
+int regions_num = 0;
+
 options_t options;
 blocks_calc_t blocks_calc;
 
@@ -139,6 +167,30 @@ uint64_t validate_size( char *str_size){
 }
 
 
+/* block size in bytes, or with a K suffix. Return 0 if not valid */
+uint32_t validate_blocksize( char *str_size){
+    int l = strlen( str_size);
+    uint64_t n;
+    char *ptr;
+
+    if( l == 0 || ! isdigit( (int) str_size[0])){
+        return( 0);
+    }
+
+    n = strtoul( str_size, &ptr, 10);
+    if( toupper( (int) *ptr) == 'K'){
+        n *= 1024;
+        ptr++;
+    }
+
+    if( *ptr != '\0' || n > UINT32_MAX){
+        return( 0);
+    }
+
+    return( (uint32_t) n);
+}
+
+
 uint64_t validate_num( char *str_size){
     int i;
     int l = strlen( str_size);
@@ -155,7 +207,87 @@ uint64_t validate_num( char *str_size){
     return( uint);
 }
 
-int build_superblock( int fd){
+/* queue buf to be written in num_blocks blocks from addr, the buffer
+ * belongs to the region from now on */
+int region_add( char *buf, uint64_t addr, uint64_t num_blocks){
+    mkfs_region_t *rg;
+
+    if( regions_num == MKFS_MAX_REGIONS){
+        TRACE_ERR( "Too many regions");
+        return( -1);
+    }
+
+    rg = &regions[regions_num++];
+    memset( (void *) rg, 0, sizeof( mkfs_region_t));
+    rg->rg_buf = buf;
+    rg->rg_block_addr = addr;
+    rg->rg_num_blocks = num_blocks;
+    return( 0);
+}
+
+
+void *region_write( void *arg){
+    mkfs_region_t *rg = (mkfs_region_t *) arg;
+    uint64_t chunk, done = 0;
+
+    chunk = KFS_BYTES_TO_BLOCKS( MKFS_WRITE_CHUNK);
+    while( done < rg->rg_num_blocks){
+        if( chunk > rg->rg_num_blocks - done){
+            chunk = rg->rg_num_blocks - done;
+        }
+
+        rg->rg_rc = bdev_write( rg->rg_bdev, 
+                                rg->rg_buf + KFS_BLOCKS_TO_BYTES( done),
+                                rg->rg_block_addr + done, (int) chunk);
+        if( rg->rg_rc != 0){
+            TRACE_ERR( "Could not write blocks [%lu-%lu]", 
+                       rg->rg_block_addr + done, 
+                       rg->rg_block_addr + done + chunk - 1);
+            break;
+        }
+        done += chunk;
+    }
+
+    return( NULL);
+}
+
+
+/* write all the queued regions in parallel and flush */
+int regions_write( bdev_t *bdev){
+    mkfs_region_t *rg;
+    int i, rc = 0;
+
+    for( i = 0; i < regions_num; i++){
+        rg = &regions[i];
+        rg->rg_bdev = bdev;
+        if( pthread_create( &rg->rg_thread, NULL, region_write, rg) == 0){
+            rg->rg_started = 1;
+        }else{
+            region_write( rg);
+        }
+    }
+
+    for( i = 0; i < regions_num; i++){
+        rg = &regions[i];
+        if( rg->rg_started){
+            pthread_join( rg->rg_thread, NULL);
+        }
+
+        if( rg->rg_rc != 0){
+            rc = -1;
+        }
+        free( rg->rg_buf);
+    }
+    regions_num = 0;
+
+    if( bdev_flush( bdev) != 0){
+        rc = -1;
+    }
+    return( rc);
+}
+
+
+int build_superblock( bdev_t *bdev){
     time_t current_time;
     kfs_extent_t extent;
     kfs_superblock_t *sb = (kfs_superblock_t *) pages[PG_SB]; 
@@ -184,6 +316,17 @@ int build_superblock( int fd){
     sb->sb_flags = 0x0000;
     sb->sb_blocksize = KFS_BLOCKSIZE;
     sb->sb_root_super_inode = 0;
+
+    /* the tables are initialized lazily, just their first block is
+     * written */
+    sb->sb_flags |= KFS_SB_LAZY_TABLES;
+    sb->sb_si_table_hwm = 1;
+    sb->sb_slot_table_hwm = 1;
+
+    if( options.flags & OPT_T){
+        sb->sb_stripe_devs = options.stripe_devs;
+        sb->sb_stripe_unit = options.stripe_unit;
+    }
    
 
     sb->sb_c_time = current_time; 
@@ -235,7 +378,7 @@ int build_superblock( int fd){
     p += 512; 
     strcpy( p, secret);
     PRINTV("    -Write Superblock in block: [0]")
-    rc = block_write( fd, (void *) sb, 0);
+    rc = bdev_write( bdev, (void *) sb, 0, 1);
     if( rc != 0){
         TRACE_ERR( "Could not write\n");
         exit(-1);
@@ -245,7 +388,7 @@ int build_superblock( int fd){
 }
 
 
-int build_map( int fd){
+int build_map( bdev_t *bdev){
     kfs_extent_header_t *ex_header = NULL;
     char *p, *bitmap;
     blocks_calc_t *bc = &blocks_calc;
@@ -271,12 +414,12 @@ int build_map( int fd){
     return(rc);
 }
 
-int build_sinodes( int fd){
+int build_sinodes( bdev_t *bdev){
     time_t current_time;
     kfs_extent_header_t *ex_header = NULL;
     kfs_sinode_t *sino;
-    uint64_t i, block_num, sino_num;
-    char *p, *slp;
+    uint64_t sino_num;
+    char *p;
     unsigned char *bitmap;
     blocks_calc_t *bc = &blocks_calc;
     uint64_t sinode_map_block, slot_map_block, fs_map_block, liminf, limsup;
@@ -297,62 +440,37 @@ int build_sinodes( int fd){
 
     current_time = time( NULL);
 
-    /* fill in the first block of the sinodes table */
-    ex_header->eh_magic = KFS_SINODE_TABLE_MAGIC;
+    /* only the first block of the table is written, the other ones hold
+     * default entries until they are written, see kfs_table.h */
+    kfs_table_block_init( p, KFS_SINODE_TABLE_MAGIC, 0, bc->out_sinodes_num);
     ex_header->eh_entries_in_use = 1;
-    ex_header->eh_entries_capacity = bc->out_sinodes_num;
-    ex_header->eh_flags = KFS_ENTRIES_ROOT|KFS_ENTRIES_LEAF;
-    i = sizeof( kfs_extent_header_t);
 
     /* fill in the first inode */
-    sino_num = 0;
-    slp = p + sizeof( kfs_extent_header_t);
-
-    sino = ( kfs_sinode_t *) slp;
+    sino = ( kfs_sinode_t *) ( p + sizeof( kfs_extent_header_t));
     sino->si_a_time = current_time;
     sino->si_c_time = current_time;
     sino->si_m_time = current_time;
     sino->si_slot_id = 0xfffffffe;
-    sino->si_id = sino_num++;
 
-    /* fill in the other inodes */
-    for( i = 1; i < bc->out_sinodes_per_block; i++){
-        sino->si_id = sino_num++;
-        sino++;
+    liminf = 1;
+    if( region_add( p, liminf, 1) != 0){
+        free( p);
+        return( -1);
     }
-
-    /* write the first block of the extent with the sinodes table */
-    liminf = block_num = 1;
-    block_write( fd, p, block_num++);
     limsup = liminf + bc->out_sinodes_table_in_blocks;
+    sino_num = bc->out_sinodes_num;
 
-    /* write out the remaining blocks of the table */
-    for( ; block_num < limsup; block_num++){
-        memset( (void *) p, 0, KFS_BLOCKSIZE);
- 
-        i = 0;
-        sino = ( kfs_sinode_t *) p;
-
-        for( i = 0; i < bc->out_sinodes_per_block; i++){
-            sino->si_id = sino_num++;
-            sino++;
-        }
-
-        block_write( fd, p, block_num);
-    }
-
-
-    PRINTV("    -Written SuperInodes table blocks: [%lu-%lu]",
+    PRINTV("    -SuperInodes table blocks: [%lu-%lu], written: [%lu]",
                 liminf,
-                limsup - 1); 
-    PRINTV("    -Written SuperInodes num: [%lu, %lx]", sino_num, sino_num); 
-    free( p);
+                limsup - 1,
+                liminf); 
+    PRINTV("    -SuperInodes num: [%lu, %lx]", sino_num, sino_num); 
 
 
     /* now on to the super inodes map */
     PRINTV("    -Building super inodes map");
 
-    slp = p = pages_alloc( bc->out_sinodes_bitmap_blocks_num);
+    p = pages_alloc( bc->out_sinodes_bitmap_blocks_num);
 
 
     /* fill in the super inodes map */
@@ -367,16 +485,15 @@ int build_sinodes( int fd){
 
     bm_set_bit( ( unsigned char *) bitmap, bc->out_sinodes_num, 0, 1);
     liminf = sinode_map_block;
-    for( i = 0; i < bc->out_sinodes_bitmap_blocks_num; i++){
-        block_write( fd, slp, sinode_map_block + i);
-        slp += KFS_BLOCKSIZE;
+    if( region_add( p, sinode_map_block, 
+                    bc->out_sinodes_bitmap_blocks_num) != 0){
+        free( p);
+        return( -1);
     }
-    limsup = sinode_map_block + i - 1;
+    limsup = sinode_map_block + bc->out_sinodes_bitmap_blocks_num - 1;
     PRINTV("    -Writing SuperInodes blocks map: [%lu-%lu]", 
                 liminf, 
-                limsup - 1);
-    
-    free( p);
+                limsup);
 
     /* update the file system block map */
     p = pages[PG_MAP];
@@ -403,11 +520,10 @@ int build_sinodes( int fd){
 }
 
 
-int build_slots( int fd){
+int build_slots( bdev_t *bdev){
     kfs_extent_header_t *ex_header = NULL;
-    kfs_slot_t *slot;
-    uint64_t block_num, i, slot_num;
-    char *p, *slp;
+    uint64_t block_num, slot_num;
+    char *p;
     unsigned char *bitmap;
     blocks_calc_t *bc = &blocks_calc;
     uint64_t slot_map_block, fs_map_block, liminf, limsup;
@@ -422,54 +538,31 @@ int build_slots( int fd){
     slot_map_block = fs_map_block - bc->out_slots_bitmap_blocks_num;
 
 
-    slp = p = pages_alloc( 1);
-    ex_header = (kfs_extent_header_t *) p;
-
-    /* fill in the first block of the slots table */
-    ex_header->eh_magic = KFS_SLOTS_TABLE_MAGIC;
-    ex_header->eh_entries_in_use = 0;
-    ex_header->eh_entries_capacity = bc->out_slots_num;
-    ex_header->eh_flags = KFS_ENTRIES_ROOT|KFS_ENTRIES_LEAF;
+    p = pages_alloc( 1);
 
-    /* fill in the slots */
-    slot_num = 0;
-    slot = ( kfs_slot_t *) slp + sizeof( kfs_extent_header_t);
-    for( i = 0; i < bc->out_slots_per_block; i++){
-        slot->slot_id = slot_num++;
-       slot++;
-    }
+    /* first block of the slots table, the other ones hold default entries
+     * until they are written */
+    kfs_table_block_init( p, KFS_SLOTS_TABLE_MAGIC, 0, bc->out_slots_num);
 
-    /* write the first block of the extent with the slots table */
     block_num = bc->out_sinodes_table_in_blocks + 1;
     liminf = block_num;
-    block_write( fd, slp, block_num++);
-    limsup = liminf + bc->out_slots_table_in_blocks;
-
-    /* write out the remaining blocks of the table */
-    for( ; block_num < limsup; block_num++){
-        memset( (void *) slp, 0, KFS_BLOCKSIZE);
- 
-        i = 0;
-        slot = ( kfs_slot_t *) p;
-
-        for( i = 0; i < bc->out_slots_per_block; i++){
-            slot->slot_id = slot_num++;
-            slot++;
-        }
-
-        block_write( fd, p, block_num);
+    if( region_add( p, block_num, 1) != 0){
+        free( p);
+        return( -1);
     }
+    limsup = liminf + bc->out_slots_table_in_blocks;
+    slot_num = bc->out_slots_num;
 
-    free( p);
-    PRINTV("    -Written last slot num: [%lu, %lx]", slot_num, slot_num); 
-    PRINTV("    -Writing slots table blocks: [%lu-%lu]", 
+    PRINTV("    -Slots num: [%lu, %lx]", slot_num, slot_num); 
+    PRINTV("    -Slots table blocks: [%lu-%lu], written: [%lu]", 
                 liminf, 
-                limsup);
+                limsup - 1,
+                liminf);
  
     /* now on to the super inodes map */
     PRINTV("    -Building slots map");
 
-    slp = p = pages_alloc( bc->out_slots_bitmap_blocks_num);
+    p = pages_alloc( bc->out_slots_bitmap_blocks_num);
 
 
     /* fill in the super inodes map */
@@ -482,16 +575,15 @@ int build_slots( int fd){
     ex_header->eh_flags = KFS_ENTRIES_ROOT|KFS_ENTRIES_LEAF;
     bitmap = (unsigned char *) p + sizeof( kfs_extent_header_t);
     liminf = slot_map_block;
-    for( i = 0; i < bc->out_slots_bitmap_blocks_num; i++){
-        block_write( fd, slp, slot_map_block + i);
-        slp += KFS_BLOCKSIZE;
+    if( region_add( p, slot_map_block, 
+                    bc->out_slots_bitmap_blocks_num) != 0){
+        free( p);
+        return( -1);
     }
-    limsup = slot_map_block + i - 1;
+    limsup = slot_map_block + bc->out_slots_bitmap_blocks_num - 1;
     PRINTV("    -Writing Slots blocks map: [%lu-%lu]", 
                 liminf, 
                 limsup);
- 
-    free( p);
 
     /* update the file system block map */
     p = pages[PG_MAP];
@@ -519,9 +611,9 @@ int build_slots( int fd){
 }
 
 
-int write_map(int fd){
+int write_map( bdev_t *bdev){
     char *p = pages[PG_MAP];
-    uint64_t i, block_num, fs_map_block, liminf, limsup; 
+    uint64_t block_num, fs_map_block, liminf, limsup; 
     blocks_calc_t *bc = &blocks_calc;
     kfs_extent_header_t *ex_header = (kfs_extent_header_t *) p;
     unsigned char *bitmap = (unsigned char *) p + 
@@ -542,31 +634,84 @@ int write_map(int fd){
     ex_header->eh_entries_in_use += block_num;
  
     liminf = fs_map_block;
-    for( i = 0; i < block_num; i++){
-        block_write( fd, p, fs_map_block++);
-        p += KFS_BLOCKSIZE;
+    limsup = fs_map_block + block_num - 1;
+    if( region_add( p, fs_map_block, block_num) != 0){
+        return( -1);
     }
-
-    limsup = fs_map_block - 1;
+    pages[PG_MAP] = NULL;
 
     PRINTV("    -Writing KFS block map: [%lu-%lu]", 
                  liminf, 
                  limsup);
 
+    /* everything built so far goes out now, in parallel */
+    return( regions_write( bdev));
+}
 
 
-    fsync( fd);
-    free( pages[PG_MAP]);
+/* create the stripe files not there yet, they grow with the writes */
+int create_stripe_files(){
+    char list[sizeof( options.stripe_files)];
+    char *name, *saveptr;
+    struct stat st;
 
-    return(0);
+    strcpy( list, options.stripe_files);
+    for( name = strtok_r( list, ",", &saveptr); name != NULL;
+         name = strtok_r( NULL, ",", &saveptr)){
+        if( stat( name, &st) == 0){
+            continue;
+        }
+
+        PRINTV("    -Creating stripe file '%s'", name);
+        if( create_file( name) != 0){
+            return( -1);
+        }
+    }
+
+    return( 0);
+}
+
+
+/* size the regular files for the volume. They are not filled, so they
+ * stay sparse, the unused blocks are never written. Block devices keep
+ * their old contents */
+int size_files(){
+    char list[sizeof( options.file_name) + sizeof( options.stripe_files)];
+    char *name, *saveptr;
+    struct stat st;
+    uint64_t size;
+
+    size = KFS_BLOCKS_TO_BYTES( blocks_calc.in_file_size_in_blocks);
+    if( options.flags & OPT_T){
+        size /= options.stripe_devs;
+        snprintf( list, sizeof( list), "%s,%s", options.file_name,
+                  options.stripe_files);
+    }else{
+        strcpy( list, options.file_name);
+    }
+
+    for( name = strtok_r( list, ",", &saveptr); name != NULL;
+         name = strtok_r( NULL, ",", &saveptr)){
+        if( stat( name, &st) != 0 || ! S_ISREG( st.st_mode)){
+            continue;
+        }
+
+        PRINTV("    -Sizing '%s' to %lu bytes", name, size);
+        if( truncate( name, (off_t) size) != 0){
+            TRACE_ERRNO( "Could not size '%s'", name);
+            return( -1);
+        }
+    }
+
+    return( 0);
 }
 
 
 int build_filesystem_in_file(){
-    int fd, rc = 0;
-    uint64_t i;
+    char names[sizeof( options.file_name) + sizeof( options.stripe_files)];
+    bdev_t *bdev;
+    int rc = 0;
     char *page;
-    blocks_calc_t *bc = &blocks_calc;
     
     PRINTV("-Creating file");
     if( options.flags & MKFS_CREATE_FILE){
@@ -576,59 +721,70 @@ int build_filesystem_in_file(){
         }
     }
 
+    if( options.flags & OPT_T){
+        rc = create_stripe_files();
+        if( rc != 0){
+            return( rc);
+        }
+    }
+
+    rc = size_files();
+    if( rc != 0){
+        return( rc);
+    }
+
     PRINTV("-Writing file");
-    fd = open( options.file_name, O_RDWR );
-    if( fd < 0){
+    if( options.flags & OPT_T){
+        /* all the writes below go thru the stripe, so the block map and
+         * tables are spread over the devices too */
+        snprintf( names, sizeof( names), "%s,%s", options.file_name,
+                  options.stripe_files);
+        bdev = bdev_open_stripe( names, options.backend, 
+                                 options.stripe_unit, 0);
+    }else{
+        bdev = bdev_open( options.file_name, options.backend);
+    }
+    if( bdev == NULL){
         TRACE_ERR( "Could not open file '%s'\n", options.file_name);
         return( -1);
     }
 
     page = pages_alloc( 1);
     if( page == NULL){
-        close( fd);
+        bdev_close( bdev);
         exit(-1);
     }
 
-
-    lseek( fd, 0, SEEK_SET);
-    for( i = 0; i < bc->in_file_size_in_blocks; i++){
-        write( fd, page, KFS_BLOCKSIZE);
-        //lseek( fd, 0, SEEK_END);
-    }
-    fsync( fd);
-
-
-
     pages[PG_SB] = page;
-    rc = build_superblock( fd);
+    rc = build_superblock( bdev);
     if( rc < 0){
         return( rc);
     }
 
 
-    rc = build_map( fd);
+    rc = build_map( bdev);
     if( rc < 0){
         return( rc);
     }
 
 
-    rc = build_sinodes( fd); 
+    rc = build_sinodes( bdev); 
     if( rc < 0){
         return( rc);
     }
 
 
-    rc = build_slots( fd); 
+    rc = build_slots( bdev); 
     if( rc < 0){
         return( rc);
     }
 
-    rc = write_map( fd);
+    rc = write_map( bdev);
     if( rc < 0){
         return( rc);
     }
 
-    close( fd);
+    bdev_close( bdev);
 
     return( rc);
 }
@@ -647,8 +803,8 @@ int blocks_results_display(){
     printf("    Percentage=%d\n", bc->in_percentage);
     printf("OUT:\n");
     printf("    TotalBlocksRequired=%lu\n", bc->out_total_blocks_required);
-    printf("    TotalDiskRequiredInMB=%lu\n",  /* 128 blocks per Mbyte */
-           bc->out_total_blocks_required / 128);
+    printf("    TotalDiskRequiredInMB=%lu\n",
+           KFS_BLOCKS_TO_BYTES( bc->out_total_blocks_required) / _1M);
     printf("    BitmapSizeInBlocks=%lu\n", bc->out_bitmap_size_in_blocks);
     printf("    InodesNum=%lu\n", bc->out_sinodes_num);
     printf("    SlotsNum=%lu\n", bc->out_slots_num);
@@ -684,7 +840,7 @@ int compute_values(){
     memset( ( void *) bc, 0, sizeof( blocks_calc_t));
 
     /* fill in sizes */
-    bc->in_file_size_in_blocks = options.size / KFS_BLOCKSIZE;
+    bc->in_file_size_in_blocks = KFS_BYTES_TO_BLOCKS( options.size);
     bc->in_file_size_in_mbytes = options.size / _1M;
 
 
@@ -693,9 +849,8 @@ int compute_values(){
         bc->in_slots_num = options.slots_num;
     }
     
-    if( options.flags & OPT_P){
-        bc->in_percentage = options.percentage;
-    }
+    /* parse_opts() sets the default when there is no -p */
+    bc->in_percentage = options.percentage;
  
     /* do first real computations */
     slots_per_block = (KFS_BLOCKSIZE - sizeof( kfs_extent_header_t)) / 
@@ -820,7 +975,8 @@ int compute_values(){
         bc->in_file_size_in_blocks = (uint64_t) ((float) n * 
                                         ( 100.0 / (float) bc->in_percentage));
 
-        bc->in_file_size_in_mbytes = bc->in_file_size_in_blocks / 128;
+        bc->in_file_size_in_mbytes = 
+            KFS_BLOCKS_TO_BYTES( bc->in_file_size_in_blocks) / _1M;
     }
 
     /* now fill in the bitmap size in blocks and finish calculations */
@@ -842,13 +998,12 @@ int parse_opts( int argc, char **argv){
     struct stat st;
     int rc;
     int need_file = 1;
-    options_t options;
     char **help = ( char **) &help_mkfs;
     char *command;
     char **passed_opts;
 
     flags = 0;
-    char opc[] = "f:d:i:s:p:k:w:m:xvh";
+    char opc[] = "f:d:i:s:p:k:w:m:b:z:t:u:xvh";
     memset( (void *) &options, 0, sizeof( options_t));
 
     if( argc <= 1){
@@ -915,6 +1070,42 @@ int parse_opts( int argc, char **argv){
                 flags |= OPT_M;
                 strcpy( options.metadata_file, optarg);
                 break;
+            case 'b':
+                flags |= OPT_B;
+                options.backend = bdev_type_from_str( optarg);
+                if( options.backend != BDEV_FILE && 
+                    options.backend != BDEV_DIRECT){
+                    TRACE_ERR( "Invalid backend '%s'", optarg);
+                    display_help( help);
+                    exit( EXIT_FAILURE);
+                }
+                break;
+            case 'z':
+                flags |= OPT_Z;
+                if( kfs_set_blocksize( validate_blocksize( optarg)) != 0){
+                    TRACE_ERR( "Invalid block size '%s', use 8K, 16K, "
+                               "32K or 64K", optarg);
+                    display_help( help);
+                    exit( EXIT_FAILURE);
+                }
+                break;
+            case 't':
+                flags |= OPT_T;
+                if( strlen( optarg) >= sizeof( options.stripe_files)){
+                    TRACE_ERR( "Stripe files list too long");
+                    exit( EXIT_FAILURE);
+                }
+                strcpy( options.stripe_files, optarg);
+                break;
+            case 'u':
+                flags |= OPT_U;
+                options.stripe_unit = (uint32_t) validate_num( optarg);
+                if( options.stripe_unit == 0){
+                    TRACE_ERR( "Invalid stripe unit '%s'", optarg);
+                    display_help( help);
+                    exit( EXIT_FAILURE);
+                }
+                break;
             case 'x':
                 if( strncmp( optarg, "blocks", 6) == 0){
                     flags |= OPT_X_BLOCKS;
@@ -1088,7 +1279,10 @@ int parse_opts( int argc, char **argv){
             }
 
             if( S_ISBLK(st.st_mode)){
-                options.size = (uint64_t) get_bd_size( options.file_name);
+                if( get_bd_size( options.file_name, &options.size) != 0){
+                    TRACE_ERR( "Could not get the block device size");
+                    return( -1);
+                }
                 options.flags |= MKFS_IS_BLOCKDEVICE;
             }
    
@@ -1096,6 +1290,64 @@ int parse_opts( int argc, char **argv){
         }
     }
 
+    /* striped volume, the -f file is the first device. With -d the size
+     * is the whole volume size, otherwise every device should exist and
+     * the smallest one is used. The size is rounded down to whole rows of
+     * stripe units */
+    if( options.flags & OPT_T){
+        char list[sizeof( options.stripe_files)];
+        char *name, *saveptr;
+        uint64_t dev_size, row;
+
+        if( ( options.flags & OPT_U) == 0){
+            options.stripe_unit = BDEV_STRIPE_UNIT_DEFAULT;
+        }
+
+        options.stripe_devs = 1;
+        dev_size = options.size;
+        strcpy( list, options.stripe_files);
+        for( name = strtok_r( list, ",", &saveptr); name != NULL;
+             name = strtok_r( NULL, ",", &saveptr)){
+            options.stripe_devs++;
+            if( options.flags & OPT_D){
+                continue;
+            }
+
+            if( stat( name, &st) != 0){
+                TRACE_ERR( "Stripe file '%s' does not exist, -d is "
+                           "required", name);
+                return( -1);
+            }
+
+            if( S_ISBLK(st.st_mode)){
+                if( get_bd_size( name, &row) != 0){
+                    TRACE_ERR( "Could not get the block device size");
+                    return( -1);
+                }
+            }else{
+                row = (uint64_t) st.st_size;
+            }
+
+            if( row < dev_size){
+                dev_size = row;
+            }
+        }
+
+        if( options.stripe_devs > BDEV_STRIPE_MAX_DEVS){
+            TRACE_ERR( "Too many stripe devices, max is %d", 
+                       BDEV_STRIPE_MAX_DEVS);
+            return( -1);
+        }
+
+        if( ( options.flags & OPT_D) == 0){
+            options.size = dev_size * options.stripe_devs;
+        }
+
+        row = KFS_BLOCKS_TO_BYTES( (uint64_t) options.stripe_unit * 
+                                   options.stripe_devs);
+        options.size -= options.size % row;
+    }
+
     if( ( options.flags & MKFS_CREATE_FILE) && 
         ( (options.flags & OPT_D) == 0)){
         TRACE_ERR( "We need to create a file but argument -d is missing.");
@@ -1119,7 +1371,6 @@ int parse_opts( int argc, char **argv){
         printf("    Flags=<0x%x>\n", options.flags);
     }
 
-    exit(0);
     return(0);
 }
 
@@ -1,13 +1,13 @@
 #include "kfs.h"
 #include "eio.h"
 #include "page_cache.h"
+#include "kfs_table.h"
+#include "dict_view.h"
 
 #include "slots.h"
 
 int kfs_slot_reserve( uint64_t *slot_id ){
     char *p;
-    unsigned char *bitmap;
-    uint64_t slotmap_blocks_num, slotmap_block, total_slots;
     uint64_t slot_block, slots_per_block, slot_offset; 
     kfs_extent_header_t *ex_header;
     int rc;
@@ -26,88 +26,26 @@ int kfs_slot_reserve( uint64_t *slot_id ){
         return( -1);
     }
 
-    slotmap_block = sb->sb_slot_table.bitmap_extent.ex_block_addr;
-    slotmap_blocks_num = sb->sb_slot_table.bitmap_extent.ex_block_size;
-
-    /* alloc blocks */
-    p = pages_alloc( slotmap_blocks_num);
-    if( p == NULL){
-        TRACE_ERR("Memory for SlotMap could not be reserved");
-        return( -1);
-    }
-
-    /* read extent */
-    rc = extent_read( sb->sb_bdev, p, slotmap_block, slotmap_blocks_num);
-    if( rc == 0){
-        TRACE_ERR("Could not read all, rc=%d", rc);
-        return( -1);
-    }
-
-    ex_header = (kfs_extent_header_t *) p;
-
-    /* verify this is a slot map block */
-    if( ex_header->eh_magic != KFS_SLOTS_BITMAP_MAGIC){
-        TRACE_ERR("Not a slot map block");
-        return( -1);
-    }
-
-    /* double check the map has enough room for an extra slot, but
-     * now we check in the map extent */
-    if( ex_header->eh_entries_in_use > ex_header->eh_entries_capacity ){
-        TRACE_ERR("No more slots available");
-        return( -1);
-    }
-
-    total_slots = sb->sb_slot_table.capacity; 
-/*    ex_header->eh_entries_in_use = 0;
-    ex_header->eh_entries_capacity = bc->out_slots_num;
-    ex_header->eh_flags = KFS_ENTRIES_ROOT|KFS_ENTRIES_LEAF;*/
- 
-    bitmap = (unsigned char *) p + sizeof( kfs_extent_header_t);
-    rc = bm_find( bitmap, 
-                  total_slots, 
-                  0,
-                  total_slots,
-                  1,
-                  slot_id);
-
-
+    /* take a free slot id from the slot map, its allocation groups keep
+     * the map in the page cache and update its header */
+    rc = kfs_slot_id_alloc( FALLOC_NO_GOAL, slot_id);
     if( rc != 0){
         TRACE_ERR("A slot could not be found in the map");
         return( -1);
     }
 
-    /* mark the slot as busy */
-    rc = bm_set_bit( bitmap, total_slots, *slot_id, 1);
-
-    /* update superblock data */
-    sb->sb_slot_table.in_use++;
-
-    /* update slot map header */
-    ex_header->eh_entries_in_use = sb->sb_slot_table.in_use;
-
-    /* write extent */
-    rc = extent_write( sb->sb_bdev, p, slotmap_block, slotmap_blocks_num);
-    if( rc == 0){
-        TRACE_ERR("Could not write, rc=%d", rc);
-        return( -1);
-    }
-
-    free( p);
-
 
     /* next, update slot and mark it as used */
-    slots_per_block = (KFS_BLOCKSIZE - sizeof( kfs_extent_header_t)) / 
-                      sizeof( kfs_slot_t);
+    slots_per_block = KFS_SLOTS_PER_BLOCK;
 
     
     slot_offset = 0;
-    slot_block = ( *slot_id * slots_per_block);
+    slot_block = ( *slot_id / slots_per_block);
     if( slot_block == 0){
-        slot_offset = sizeof( kfs_extent_t);
+        slot_offset = sizeof( kfs_extent_header_t);
     }
 
-    if( slot_block > sb->sb_si_table.table_extent.ex_block_size){
+    if( slot_block >= sb->sb_slot_table.table_extent.ex_block_size){
         TRACE_ERR( "slot block is outside the slots table. ");
         TRACE_ERR( "slot=[%lu, 0x%lx], slot_block=[%lu, 0x%lx]", 
                    *slot_id, *slot_id,
@@ -115,8 +53,6 @@ int kfs_slot_reserve( uint64_t *slot_id ){
         return( -1);
     }
 
-    slot_block += sb->sb_si_table.table_extent.ex_block_addr;
-
     p = pages_alloc( 1);
     if( p == NULL){
         TRACE_ERR("Memory for SlotMap could not be reserved");
@@ -124,14 +60,15 @@ int kfs_slot_reserve( uint64_t *slot_id ){
     }
 
 
-    rc = block_read( sb->sb_bdev, p, slot_block);
-    if( rc == 0){
+    rc = kfs_table_block_read( sb->sb_bdev_backend, &sb->sb_slot_table, 
+                               KFS_SLOTS_TABLE_MAGIC, slot_block, p);
+    if( rc != 0){
         TRACE_ERR("Could not read page, rc=%d", rc);
         return( -1);
     }
 
-    kslot = ( kfs_slot_t *) p + (( *slot_id % KFS_BLOCKSIZE) + slot_offset);
-    if( kslot->slot_id == *slot_id){
+    kslot = ( kfs_slot_t *) ( p + slot_offset) + *slot_id % slots_per_block;
+    if( kslot->slot_id != *slot_id){
         TRACE_ERR("Could not find slot. ");
         TRACE_ERR("slot_id=[%lu, 0x%lx], got: [%lu, 0x%lx]",
                   *slot_id, *slot_id,
@@ -143,16 +80,17 @@ int kfs_slot_reserve( uint64_t *slot_id ){
 
     kslot->slot_flags |= SLOT_IN_USE;
 
-    rc = block_write( sb->sb_bdev, p, slot_block);
-    if( rc == 0){
+    rc = kfs_table_block_write( sb->sb_bdev_backend, &sb->sb_slot_table, 
+                                KFS_SLOTS_TABLE_MAGIC, slot_block, p);
+    if( rc != 0){
         TRACE_ERR("Could not write page, rc=%d", rc);
         return( -1);
     }
 
     /* and update the slot index */
-    rc = block_read( sb->sb_bdev, p, 
-                     sb->sb_si_table.table_extent.ex_block_addr);
-    if( rc == 0){
+    rc = kfs_table_block_read( sb->sb_bdev_backend, &sb->sb_slot_table, 
+                               KFS_SLOTS_TABLE_MAGIC, 0, p);
+    if( rc != 0){
         TRACE_ERR("Could not read page, rc=%d", rc);
         return( -1);
     }
@@ -167,9 +105,9 @@ int kfs_slot_reserve( uint64_t *slot_id ){
 
     ex_header->eh_entries_in_use = sb->sb_slot_table.in_use;
     /* and update the slot index */
-    rc = block_write( sb->sb_bdev, p, 
-                      sb->sb_si_table.table_extent.ex_block_addr);
-    if( rc == 0){
+    rc = kfs_table_block_write( sb->sb_bdev_backend, &sb->sb_slot_table, 
+                                KFS_SLOTS_TABLE_MAGIC, 0, p);
+    if( rc != 0){
         TRACE_ERR("Could not write page, rc=%d", rc);
         return( -1);
     }
@@ -180,8 +118,6 @@ int kfs_slot_reserve( uint64_t *slot_id ){
 
 int kfs_slot_remove(uint64_t slot_id){
     char *p;
-    unsigned char *bitmap;
-    uint64_t slotmap_blocks_num, slotmap_block, total_slots;
     uint64_t slot_block, slots_per_block, slot_offset; 
     kfs_extent_header_t *ex_header;
     int rc;
@@ -202,69 +138,25 @@ int kfs_slot_remove(uint64_t slot_id){
         return( -1);
     }
 
-    slotmap_block = sb->sb_slot_table.bitmap_extent.ex_block_addr;
-    slotmap_blocks_num = sb->sb_slot_table.bitmap_extent.ex_block_size;
-
-    /* alloc blocks */
-    p = pages_alloc( slotmap_blocks_num);
-    if( p == NULL){
-        TRACE_ERR("Memory for SlotMap could not be reserved");
-        return( -1);
-    }
-
-    /* read extent */
-    rc = extent_read( sb->sb_bdev, p, slotmap_block, slotmap_blocks_num);
-    if( rc == 0){
-        TRACE_ERR("Could not read all, rc=%d", rc);
-        return( -1);
-    }
-
-    ex_header = (kfs_extent_header_t *) p;
-
-    /* verify this is a slot map block */
-    if( ex_header->eh_magic != KFS_SLOTS_BITMAP_MAGIC){
-        TRACE_ERR("Not a slot map block");
-        return( -1);
-    }
-
-    total_slots = sb->sb_slot_table.capacity; 
-/*    ex_header->eh_entries_in_use = 0;
-    ex_header->eh_entries_capacity = bc->out_slots_num;
-    ex_header->eh_flags = KFS_ENTRIES_ROOT|KFS_ENTRIES_LEAF;*/
- 
-    bitmap = (unsigned char *) p + sizeof( kfs_extent_header_t);
-
-    /* clean the slot  */
-    rc = bm_set_bit( bitmap, total_slots, slot_id, 0);
-
-    /* update superblock data */
-    sb->sb_slot_table.in_use--;
-
-    /* update slot map header */
-    ex_header->eh_entries_in_use = sb->sb_slot_table.in_use;
-
-    /* write extent */
-    rc = extent_write( sb->sb_bdev, p, slotmap_block, slotmap_blocks_num);
-    if( rc == 0){
-        TRACE_ERR("Could not write, rc=%d", rc);
+    /* give the slot id back to the slot map */
+    rc = kfs_slot_id_free( slot_id);
+    if( rc != 0){
+        TRACE_ERR("Could not free the slot in the map");
         return( -1);
     }
 
-    free( p);
-
 
     /* next, update slot and mark it as used */
-    slots_per_block = (KFS_BLOCKSIZE - sizeof( kfs_extent_header_t)) / 
-                      sizeof( kfs_slot_t);
+    slots_per_block = KFS_SLOTS_PER_BLOCK;
 
     
     slot_offset = 0;
-    slot_block = ( slot_id * slots_per_block);
+    slot_block = ( slot_id / slots_per_block);
     if( slot_block == 0){
-        slot_offset = sizeof( kfs_extent_t);
+        slot_offset = sizeof( kfs_extent_header_t);
     }
 
-    if( slot_block > sb->sb_si_table.table_extent.ex_block_size){
+    if( slot_block >= sb->sb_slot_table.table_extent.ex_block_size){
         TRACE_ERR( "slot block is outside the slots table. ");
         TRACE_ERR( "slot=[%lu, 0x%lx], slot_block=[%lu, 0x%lx]", 
                    slot_id, slot_id,
@@ -272,8 +164,6 @@ int kfs_slot_remove(uint64_t slot_id){
         return( -1);
     }
 
-    slot_block += sb->sb_si_table.table_extent.ex_block_addr;
-
     p = pages_alloc( 1);
     if( p == NULL){
         TRACE_ERR("Memory for SlotMap could not be reserved");
@@ -281,14 +171,15 @@ int kfs_slot_remove(uint64_t slot_id){
     }
 
 
-    rc = block_read( sb->sb_bdev, p, slot_block);
-    if( rc == 0){
+    rc = kfs_table_block_read( sb->sb_bdev_backend, &sb->sb_slot_table, 
+                               KFS_SLOTS_TABLE_MAGIC, slot_block, p);
+    if( rc != 0){
         TRACE_ERR("Could not read page, rc=%d", rc);
         return( -1);
     }
 
-    kslot = ( kfs_slot_t *) p + (( slot_id % KFS_BLOCKSIZE) + slot_offset);
-    if( kslot->slot_id == slot_id){
+    kslot = ( kfs_slot_t *) ( p + slot_offset) + slot_id % slots_per_block;
+    if( kslot->slot_id != slot_id){
         TRACE_ERR("Could not find slot.");
         TRACE_ERR("slot_id=[%lu, 0x%lx], got: [%lu, 0x%lx]",
                    slot_id, slot_id,
@@ -300,16 +191,17 @@ int kfs_slot_remove(uint64_t slot_id){
 
     kslot->slot_flags = 0;
 
-    rc = block_write( sb->sb_bdev, p, slot_block);
-    if( rc == 0){
+    rc = kfs_table_block_write( sb->sb_bdev_backend, &sb->sb_slot_table, 
+                                KFS_SLOTS_TABLE_MAGIC, slot_block, p);
+    if( rc != 0){
         TRACE_ERR("Could not write page, rc=%d", rc);
         return( -1);
     }
 
     /* and update the slot index */
-    rc = block_read( sb->sb_bdev, p, 
-                     sb->sb_si_table.table_extent.ex_block_addr);
-    if( rc == 0){
+    rc = kfs_table_block_read( sb->sb_bdev_backend, &sb->sb_slot_table, 
+                               KFS_SLOTS_TABLE_MAGIC, 0, p);
+    if( rc != 0){
         TRACE_ERR("Could not read page, rc=%d", rc);
         return( -1);
     }
@@ -324,9 +216,9 @@ int kfs_slot_remove(uint64_t slot_id){
 
     ex_header->eh_entries_in_use = sb->sb_slot_table.in_use;
     /* and update the slot index */
-    rc = block_write( sb->sb_bdev, p, 
-                      sb->sb_si_table.table_extent.ex_block_addr);
-    if( rc == 0){
+    rc = kfs_table_block_write( sb->sb_bdev_backend, &sb->sb_slot_table, 
+                                KFS_SLOTS_TABLE_MAGIC, 0, p);
+    if( rc != 0){
         TRACE_ERR("Could not write page, rc=%d", rc);
         return( -1);
     }
@@ -337,3 +229,85 @@ int kfs_slot_remove(uint64_t slot_id){
 }
 
 
+
+int kfs_slot_dict_load( unsigned char *p, uint32_t len, uint16_t flags,
+                        dict_keys_t *keys, dict_t *d){
+    dict_view_t v;
+    dict_view_iter_t it;
+    dict_view_entry_t e;
+    value_t value;
+    char key[DICT_KEY_LEN + 1];
+    uint32_t n = 0;
+    void *data;
+    int rc;
+
+    /* count the records first, the arena takes all of them at once */
+    if( flags & SLOT_COMPACT){
+        dict_view_init_compact( &v, p, len, keys);
+    }else{
+        dict_view_init( &v, p, len);
+    }
+    dict_view_iter_init( &v, &it);
+    while( ( rc = dict_view_next( &it, &e)) == 1){
+        n++;
+    }
+    if( rc != 0){
+        return( -1);
+    }
+
+    /* the small ones fit in the dict_t */
+    rc = 0;
+    if( n <= DICT_INLINE_ELEMS){
+        dict_init( d);
+    }else{
+        rc = dict_init_arena( d, len + n * ( 2 * sizeof( dict_entry_t) +
+                                             4 * sizeof( uint64_t)), 0);
+    }
+    if( rc != 0){
+        TRACE_ERR("Could not create the slot dict");
+        return( -1);
+    }
+
+    dict_view_iter_init( &v, &it);
+    while( dict_view_next( &it, &e) == 1){
+        if( dict_view_value( &e, &value) != 0){
+            goto exit1;
+        }
+
+        /* the numbers come aligned in value, the rest from the page */
+        data = &value.value;
+        if( value.data_type == DICT_STRING || value.data_type == DICT_BLOB ||
+            value.data_type == DICT_EXTENT){
+            data = ( e.ve_len > 0) ? e.ve_data : "";
+        }
+
+        /* the compact keys have no zero */
+        memcpy( key, e.ve_key, e.ve_key_len);
+        key[e.ve_key_len] = 0;
+
+        rc = dict_add_value( d, key, value.data_type, data, e.ve_len);
+        if( rc != 0){
+            TRACE_ERR("Could not add key %s", key);
+            goto exit1;
+        }
+    }
+
+    return( 0);
+
+exit1:
+    dict_clean( d);
+    return( -1);
+}
+
+
+
+int slot_destroy( slot_t *slot){
+    if( slot == NULL){
+        return( -1);
+    }
+
+    /* the arena of the dict goes away in a single free */
+    dict_clean( &slot->slot_d);
+    free( slot);
+    return( 0);
+}
@@ -27,7 +27,7 @@ int slot_set_owner( slot_t *s,
                     uint64_t inode, 
                     uint16_t edge, 
                     uint16_t flags);
-int slot_set_dict( slot_t *s, dict_t d); /* write key-values into slot */
+int slot_set_dict( slot_t *s, dict_t *d); /* write key-values into slot */
 int slot_dump( slot_t *slot); /* dump slot */
 int slot_close( slot_t *slot); /* close slot */
 int slot_evict( uint64_t slot_id); /* evict a slot from storage*/
@@ -10,6 +10,9 @@
 #include "kfs.h"
 #include "eio.h"
 #include "page_cache.h"
+#include "bdev.h"
+#include "kfs_table.h"
+#include "agroup.h"
 
 
 
@@ -36,6 +39,16 @@ void kfsex_2_ex( extent_t *ex, kfs_extent_t *kex){
     ex->ex_log_addr = kex->ee_log_addr;
 }
 
+/* the high water mark of a table. Volumes made without lazy tables have
+ * all their table blocks written */
+static uint64_t kfs_table_hwm( kfs_superblock_t *kfs_sb, kfs_table_t *t,
+                               uint64_t hwm){
+    if( ( kfs_sb->sb_flags & KFS_SB_LAZY_TABLES) == 0){
+        return( t->table_extent.ee_block_size);
+    }
+    return( hwm);
+}
+
 
 /*
 void kfs_sb_statfs(){
@@ -52,77 +65,144 @@ void kfs_sb_statfs(){
 
 */
 
-/* open a kfs_filesystem */ 
-int kfs_open( kfs_config_t *config){
-    int rc, fd; 
+/* read the stripe layout from the superblock in the first device */
+static int kfs_stripe_layout( char *filename, uint32_t *devs, 
+                              uint32_t *unit){
+    kfs_superblock_t *sb;
+    char *p;
+    int fd, rc = -1;
 
-    rc = kfs_verify( config->kfs_file, 0, 0);
-    if( rc < 0){
-        TRACE_ERR("Verification failed, abort");
-        return( rc);
+    p = malloc( KFS_BLOCKSIZE_MIN);
+    if( p == NULL){
+        TRACE_ERR("Could not reserve memory.");
+        return( -1);
     }
 
-    fd = open( config->kfs_file, O_RDWR );
+    fd = open( filename, O_RDONLY);
     if( fd < 0){
-        TRACE_ERR( "ERROR: Could not open file '%s'\n", config->kfs_file);
+        TRACE_ERR("Could not open '%s'", filename);
+        goto exit0;
+    }
+
+    if( superblock_read( fd, p) == 0){
+        sb = (kfs_superblock_t *) p;
+        *devs = sb->sb_stripe_devs;
+        *unit = sb->sb_stripe_unit;
+        rc = 0;
     }
+    close( fd);
 
-    return( fd);
+exit0:
+    free( p);
+    return( rc);
+}
+
+bdev_t *kfs_bdev_open( char *filename, char *stripe_files, int type,
+                       uint32_t latency_us){
+    char names[KFS_FILENAME_LEN + KFS_STRIPE_FILES_LEN + 2];
+    uint32_t devs, unit, n;
+    bdev_t *bdev;
+    char *p;
+
+    if( kfs_stripe_layout( filename, &devs, &unit) != 0){
+        TRACE_ERR("Could not read the stripe layout, abort");
+        return( NULL);
+    }
+
+    n = 1;
+    if( stripe_files != NULL && stripe_files[0] != '\0'){
+        for( n = 2, p = stripe_files; *p != '\0'; p++){
+            if( *p == ','){
+                n++;
+            }
+        }
+    }
+
+    if( ( devs > 1 && n != devs) || ( devs <= 1 && n > 1)){
+        TRACE_ERR("The volume has %u devices, %u given", 
+                  devs > 1 ? devs : 1, n);
+        return( NULL);
+    }
+
+    if( devs > 1){
+        snprintf( names, sizeof( names), "%s,%s", filename, stripe_files);
+        bdev = bdev_open_stripe( names, type, unit, latency_us);
+    }else if( type == BDEV_RAM){
+        bdev = bdev_open_ram( filename, 0, latency_us);
+    }else{
+        bdev = bdev_open( filename, type);
+    }
+
+    if( bdev == NULL){
+        TRACE_ERR( "ERROR: Could not open file '%s'\n", filename);
+    }
+
+    return( bdev);
+}
+
+/* open a kfs_filesystem with the configured block device backend, and
+ * verify it thru that backend, so striped volumes are read right */ 
+bdev_t *kfs_open( kfs_config_t *config){
+    bdev_t *bdev;
+
+    bdev = kfs_bdev_open( config->kfs_file, config->kfs_stripe_files,
+                          config->bdev_backend, config->bdev_latency_us);
+    if( bdev == NULL){
+        return( NULL);
+    }
+
+    if( kfs_verify( bdev, 0, 0) < 0){
+        TRACE_ERR("Verification failed, abort");
+        bdev_close( bdev);
+        return( NULL);
+    }
+
+    return( bdev);
 }
 
 /* verify the kfs superblock is valid */
-int kfs_verify( char *filename, int verbose, int extra_verification){
+int kfs_verify( bdev_t *bdev, int verbose, int extra_verification){
     char buff[256];
     uint64_t size, addr, last_ino, sipp, slpp;
-    struct stat st;
-    int rc, fd;
     char *p, *pex;
     kfs_superblock_t *sb;
     kfs_extent_t *e;
     kfs_extent_header_t *eh;
     kfs_sinode_t *si;
     kfs_slot_t *slot;
+    table_t t;
     time_t ctime, atime, mtime;
 
-    rc = stat( filename, &st);
-    if( rc != 0){
-        TRACE_ERR("File does not exist");
+    if( bdev_size( bdev, &size) != 0){
+        TRACE_ERR( "Could not get the volume size. Exit.");
         return( -1);
     }
 
-    if( (! S_ISREG(st.st_mode)) && (! S_ISBLK(st.st_mode))){
-        TRACE_ERR( "File is not a regular file nor a block device. Exit. ");
-        return( -1);
-    }  
-
-    if( S_ISREG(st.st_mode)){
-        size = (uint64_t) st.st_size;
-    }else if( S_ISBLK(st.st_mode)){
-        size = (uint64_t) get_bd_size( filename);
-    }
-     
-
+    /* the block size is not known yet, any block size holds the whole
+     * superblock in block 0, also in the first stripe of a volume */
     p = malloc( KFS_BLOCKSIZE);
     if( p == NULL){
         TRACE_ERR("Could not reserve memory. Exit.");
         return( -1);
     }
 
-
-    fd = open( filename, O_RDONLY);
-    if( fd < 0){
-        TRACE_ERR("Could not open block device.");
+    if( bdev_read( bdev, p, 0, 1) != 0){
+        TRACE_ERR("Could not read the superblock. Abort.");
         return( -1);
     }
 
-    block_read( fd, p, 0);
-
     sb = (kfs_superblock_t *) p;
 
     if( sb->sb_magic != KFS_MAGIC){
         TRACE_ERR("Not a KFS file system. Abort.");
         return( -1);
     }
+
+    /* from now on, all the layers use the file system block size */
+    if( kfs_set_blocksize( (uint32_t) sb->sb_blocksize) != 0){
+        TRACE_ERR("Invalid block size %lu. Abort.", sb->sb_blocksize);
+        return( -1);
+    }
     ctime = sb->sb_c_time;
     atime = sb->sb_a_time;
     mtime = sb->sb_m_time;
@@ -133,6 +213,10 @@ int kfs_verify( char *filename, int verbose, int extra_verification){
         printf("KFS Magic: 0x%lx\n", sb->sb_magic);
         printf("KFS Flags: 0x%x\n", sb->sb_flags);
         printf("KFS Blocksize: %lu\n", sb->sb_blocksize);
+        if( sb->sb_stripe_devs > 1){
+            printf("KFS Stripe: %u devices, %u blocks unit\n", 
+                   sb->sb_stripe_devs, sb->sb_stripe_unit);
+        }
         printf("KFS root super inode: %lu\n", sb->sb_root_super_inode);
 
         strftime(buff, 20, "%Y-%m-%d %H:%M:%S", localtime(&ctime));
@@ -206,7 +290,6 @@ int kfs_verify( char *filename, int verbose, int extra_verification){
     }
 
     if( extra_verification == 0){
-        close( fd);
         free(p);
 
         return(0);
@@ -225,7 +308,10 @@ int kfs_verify( char *filename, int verbose, int extra_verification){
     } 
    
 
-    block_read( fd, pex, addr);
+    if( bdev_read( bdev, pex, addr, 1) != 0){
+        TRACE_ERR("Could not read block %lu. Abort.", addr);
+        return( -1);
+    }
     eh = (kfs_extent_header_t *) pex;
 
     if( eh->eh_magic != KFS_SINODE_TABLE_MAGIC){
@@ -248,9 +334,18 @@ int kfs_verify( char *filename, int verbose, int extra_verification){
                 addr);
     }
 
-    block_read( fd, pex, addr);
+    /* the last block is usually past the high water mark */
+    memset( (void *) &t, 0, sizeof( table_t));
+    t.capacity = sb->sb_si_table.capacity;
+    kfsex_2_ex( &t.table_extent, &sb->sb_si_table.table_extent);
+    t.hwm = kfs_table_hwm( sb, &sb->sb_si_table, sb->sb_si_table_hwm);
+    if( kfs_table_block_read( bdev, &t, KFS_SINODE_TABLE_MAGIC, 
+                              t.table_extent.ex_block_size - 1, pex) != 0){
+        TRACE_ERR("Could not read block %lu. Abort.", addr);
+        return( -1);
+    }
 
-    sipp = (KFS_BLOCKSIZE / sizeof( kfs_sinode_t));
+    sipp = KFS_SINODES_PER_BLOCK;
 
     /* get last inode */
     si = ( kfs_sinode_t *) pex;
@@ -274,7 +369,10 @@ int kfs_verify( char *filename, int verbose, int extra_verification){
     if( verbose){
         printf("-Reading Slot Table Extent in: %lu\n", addr); 
     }
-    block_read( fd, pex, addr);
+    if( bdev_read( bdev, pex, addr, 1) != 0){
+        TRACE_ERR("Could not read block %lu. Abort.", addr);
+        return( -1);
+    }
     eh = (kfs_extent_header_t *) pex;
 
     
@@ -296,9 +394,17 @@ int kfs_verify( char *filename, int verbose, int extra_verification){
     if( verbose){
         printf("     Verifying last block of slot extent in: %lu\n", addr); 
     }
-    block_read( fd, pex, addr);
+    memset( (void *) &t, 0, sizeof( table_t));
+    t.capacity = sb->sb_slot_table.capacity;
+    kfsex_2_ex( &t.table_extent, &sb->sb_slot_table.table_extent);
+    t.hwm = kfs_table_hwm( sb, &sb->sb_slot_table, sb->sb_slot_table_hwm);
+    if( kfs_table_block_read( bdev, &t, KFS_SLOTS_TABLE_MAGIC, 
+                              t.table_extent.ex_block_size - 1, pex) != 0){
+        TRACE_ERR("Could not read block %lu. Abort.", addr);
+        return( -1);
+    }
 
-    slpp = (KFS_BLOCKSIZE / sizeof( kfs_slot_t));
+    slpp = KFS_SLOTS_PER_BLOCK;
 
     /* get last inode */
     slot = ( kfs_slot_t *) pex;
@@ -326,7 +432,10 @@ int kfs_verify( char *filename, int verbose, int extra_verification){
         printf("-Reading Super Inode Table Map Extent in: %lu\n", addr); 
     }
 
-    block_read( fd, pex, addr);
+    if( bdev_read( bdev, pex, addr, 1) != 0){
+        TRACE_ERR("Could not read block %lu. Abort.", addr);
+        return( -1);
+    }
     eh = (kfs_extent_header_t *) pex;
   
     if( eh->eh_magic != KFS_SINODE_BITMAP_MAGIC){
@@ -348,7 +457,10 @@ int kfs_verify( char *filename, int verbose, int extra_verification){
     if( verbose){ 
         printf("-Reading Slot Table Map Extent in: %lu\n", addr); 
     }
-    block_read( fd, pex, addr);
+    if( bdev_read( bdev, pex, addr, 1) != 0){
+        TRACE_ERR("Could not read block %lu. Abort.", addr);
+        return( -1);
+    }
     eh = (kfs_extent_header_t *) pex;
   
     if( eh->eh_magic != KFS_SLOTS_BITMAP_MAGIC){
@@ -369,7 +481,10 @@ int kfs_verify( char *filename, int verbose, int extra_verification){
     if( verbose){
         printf("-Reading KFS BlockMap Extent in: %lu\n", addr); 
     }
-    block_read( fd, pex, addr);
+    if( bdev_read( bdev, pex, addr, 1) != 0){
+        TRACE_ERR("Could not read block %lu. Abort.", addr);
+        return( -1);
+    }
     eh = (kfs_extent_header_t *) pex;
   
     if( eh->eh_magic != KFS_BLOCKMAP_MAGIC){
@@ -387,7 +502,6 @@ int kfs_verify( char *filename, int verbose, int extra_verification){
     free( pex);
 
 
-    close( fd);
     free(p);
     return(0);
 }
@@ -413,6 +527,8 @@ void kfssb_to_sb( sb_t *sb, kfs_superblock_t *kfs_sb){
     kex = &kfs_sb->sb_si_table.bitmap_extent;
     ex = &sb->sb_si_table.bitmap_extent;
     kfsex_2_ex( ex, kex);
+    sb->sb_si_table.hwm = kfs_table_hwm( kfs_sb, &kfs_sb->sb_si_table,
+                                         kfs_sb->sb_si_table_hwm);
 
     sb->sb_slot_table.capacity = kfs_sb->sb_slot_table.capacity;
     sb->sb_slot_table.in_use = kfs_sb->sb_slot_table.in_use;
@@ -422,6 +538,8 @@ void kfssb_to_sb( sb_t *sb, kfs_superblock_t *kfs_sb){
     kex = &kfs_sb->sb_slot_table.bitmap_extent;
     ex = &sb->sb_slot_table.bitmap_extent;
     kfsex_2_ex( ex, kex);
+    sb->sb_slot_table.hwm = kfs_table_hwm( kfs_sb, &kfs_sb->sb_slot_table,
+                                           kfs_sb->sb_slot_table_hwm);
 
 
     sb->sb_blockmap.capacity = kfs_sb->sb_blockmap.capacity;
@@ -435,25 +553,266 @@ void kfssb_to_sb( sb_t *sb, kfs_superblock_t *kfs_sb){
 
 }
 
+static void kfs_maps_free( sb_t *sb);
+
+/* map the bitmap of the table t thru the page cache, it stays there while
+ * mounted, and split it in allocation groups of group_bits bits. The map
+ * covers total_bits, but never more bits than its extent can hold */
+static int kfs_map_load( pgcache_t *pgcache, table_t *t, uint64_t total_bits,
+                         uint64_t group_bits, uint32_t flags){
+    pgcache_element_t *el;
+    extent_t *ex = &t->bitmap_extent;
+    uint64_t map_bits;
+    agmap_t *am;
+
+    map_bits = ( KFS_BLOCKS_TO_BYTES( ex->ex_block_size) - 
+                 sizeof( kfs_extent_header_t)) * 8;
+    if( total_bits > map_bits){
+        total_bits = map_bits;
+    }
+
+    el = pgcache_element_map_sync( pgcache, ex->ex_block_addr, 
+                                   ex->ex_block_size);
+    if( el == NULL){
+        TRACE_ERR("Issues in pgcache_element_map_sync()");
+        return( -1);
+    }
+
+    /* the groups point into the element memory, it can not be evicted
+     * until kfs_maps_free() */
+    if( cache_element_pin( CACHE_EL( el)) != 0){
+        TRACE_ERR("Could not pin the map");
+        return( -1);
+    }
+
+    am = agmap_alloc( (unsigned char *) el->pe_mem_ptr + 
+                      sizeof( kfs_extent_header_t), 
+                      total_bits, group_bits, flags);
+    if( am == NULL){
+        TRACE_ERR("Could not build the allocation groups");
+        cache_element_mark_unpin( CACHE_EL( el));
+        return( -1);
+    }
+
+    t->map_page = (void *) el;
+    t->cache = (void *) am;
+    return( 0);
+}
+
+
+
+/* load the block map, with the free extents of the volume, and the super
+ * inodes and slots maps */
+static int kfs_maps_load( sb_t *sb, pgcache_t *pgcache, bdev_t *bdev){
+    uint64_t size;
+
+    if( bdev_size( bdev, &size) != 0){
+        TRACE_ERR("Could not get the volume size");
+        return( -1);
+    }
+
+    if( kfs_map_load( pgcache, &sb->sb_blockmap, KFS_BYTES_TO_BLOCKS( size),
+                      AG_BLOCK_GROUP_BITS, AGMAP_EXTENTS) != 0 ||
+        kfs_map_load( pgcache, &sb->sb_si_table, sb->sb_si_table.capacity,
+                      AG_TABLE_GROUP_BITS, 0) != 0 ||
+        kfs_map_load( pgcache, &sb->sb_slot_table, 
+                      sb->sb_slot_table.capacity, AG_TABLE_GROUP_BITS, 
+                      0) != 0){
+        kfs_maps_free( sb);
+        return( -1);
+    }
+
+    return( 0);
+}
+
+
+
+/* drop the groups of the table t, its map is written out and may be
+ * evicted after this */
+static void kfs_map_free( table_t *t){
+    pgcache_element_t *el = (pgcache_element_t *) t->map_page;
+
+    agmap_free( (agmap_t *) t->cache);
+    t->cache = NULL;
+    if( el == NULL){
+        return;
+    }
+
+    if( pgcache_element_sync( el) != 0){
+        TRACE_ERR("Could not write the map out");
+    }
+    cache_element_mark_unpin( CACHE_EL( el));
+    t->map_page = NULL;
+}
+
+
+
+static void kfs_maps_free( sb_t *sb){
+    kfs_map_free( &sb->sb_blockmap);
+    kfs_map_free( &sb->sb_si_table);
+    kfs_map_free( &sb->sb_slot_table);
+}
+
+
+
+/* the map of the table t was changed, count the entries in use and queue
+ * it for writing */
+static int kfs_map_dirty( table_t *t){
+    pgcache_element_t *el = (pgcache_element_t *) t->map_page;
+    agmap_t *am = (agmap_t *) t->cache;
+    kfs_extent_header_t *ex_header;
+    int rc;
+
+    t->in_use = am->am_total_bits - agmap_free_bits( am);
+    ex_header = (kfs_extent_header_t *) el->pe_mem_ptr;
+    ex_header->eh_entries_in_use = t->in_use;
+
+    rc = PGCACHE_EL_MARK_DIRTY( el);
+    if( rc != 0){
+        TRACE_ERR("Issues in pgcache_element_mark_dirty()");
+    }
+
+    return( rc);
+}
+
+
+
+/* allocate len entries in the map of the table t, in group or near the
+ * goal */
+static int kfs_map_get( table_t *t, int group, uint64_t goal, uint64_t len,
+                        uint64_t *addr){
+    if( kfs_active() != 0){
+        TRACE_ERR("Superblock is not active");
+        return( -1);
+    }
+
+    if( agmap_get( (agmap_t *) t->cache, group, goal, len, addr) != 0){
+        TRACE_ERR("No room for %lu entries", len);
+        return( -1);
+    }
+
+    return( kfs_map_dirty( t));
+}
+
+
+
+static int kfs_map_put( table_t *t, uint64_t addr, uint64_t len){
+    if( kfs_active() != 0){
+        TRACE_ERR("Superblock is not active");
+        return( -1);
+    }
+
+    if( agmap_put( (agmap_t *) t->cache, addr, len) != 0){
+        TRACE_ERR("Could not free %lu entries at %lu", len, addr);
+        return( -1);
+    }
+
+    return( kfs_map_dirty( t));
+}
+
+
+
+int kfs_blocks_alloc( uint64_t goal, uint64_t num_blocks, uint64_t *addr){
+    return( kfs_map_get( &__sb.sb_blockmap, AG_ANY_GROUP, goal, num_blocks,
+                         addr));
+}
+
+
+
+int kfs_blocks_free( uint64_t addr, uint64_t num_blocks){
+    return( kfs_map_put( &__sb.sb_blockmap, addr, num_blocks));
+}
+
+
+
+void kfs_data_init( dalloc_t *da, uint64_t goal){
+    dalloc_init( da, (agmap_t *) __sb.sb_blockmap.cache,
+                 (pgcache_t *) __sb.sb_page_cache, goal);
+}
+
+
+
+int kfs_data_flush( dalloc_t *da, kfs_extent_t *ex, int ex_max){
+    int n;
+
+    n = dalloc_flush( da, ex, ex_max);
+    if( n <= 0){
+        return( n);
+    }
+
+    if( kfs_map_dirty( &__sb.sb_blockmap) != 0){
+        return( -1);
+    }
+
+    return( n);
+}
+
+
+
+int kfs_data_close( dalloc_t *da){
+    dalloc_destroy( da);
+    return( kfs_map_dirty( &__sb.sb_blockmap));
+}
+
+
+
+uint64_t kfs_sinode_block( uint64_t sinode_id){
+    si_table_t *t = &__sb.sb_si_table;
+
+    if( sinode_id >= t->capacity){
+        return( FALLOC_NO_GOAL);
+    }
+
+    return( t->table_extent.ex_block_addr +
+            sinode_id / KFS_SINODES_PER_BLOCK);
+}
+
+
+
+int kfs_sinode_id_alloc( uint64_t parent, uint64_t *sinode_id){
+    return( kfs_map_get( &__sb.sb_si_table, AG_ANY_GROUP, parent, 1,
+                         sinode_id));
+}
+
+
+
+int kfs_sinode_id_free( uint64_t sinode_id){
+    return( kfs_map_put( &__sb.sb_si_table, sinode_id, 1));
+}
+
+
+
+int kfs_slot_id_alloc( uint64_t goal, uint64_t *slot_id){
+    return( kfs_map_get( &__sb.sb_slot_table, AG_ANY_GROUP, goal, 1, 
+                         slot_id));
+}
+
+
+
+int kfs_slot_id_free( uint64_t slot_id){
+    return( kfs_map_put( &__sb.sb_slot_table, slot_id, 1));
+}
+
 /* to mount the super block implies to create a page cache for deal with
  * it. So, once the super block is mounted, all the IO should be done thru
  * the page cache */
 int kfs_mount( kfs_config_t *config){
-    int rc = 0, fd;
+    int rc = 0;
+    bdev_t *bdev;
     pgcache_t *pgcache;
     pgcache_element_t *el;
     kfs_superblock_t *kfs_sb;
     sb_t *sb = &__sb;
     time_t now;
 
-    fd = kfs_open( config);
-    if( fd < 0){
+    bdev = kfs_open( config);
+    if( bdev == NULL){
         TRACE_ERR("kfs_open() failed! abort.");
         rc = -1;
-        goto exit1; 
+        goto exitOK; 
     }
 
-    pgcache = pgcache_alloc( fd, config->cache_page_len);
+    pgcache = pgcache_alloc( bdev, config->cache_page_len);
     if( pgcache == NULL){
         TRACE_ERR("Issues in kfs_pgcache_alloc()");
         rc = -1;
@@ -475,10 +834,18 @@ int kfs_mount( kfs_config_t *config){
         goto exit0;
     }
 
+    /* kept in sb_superblock_page while mounted */
+    rc = cache_element_pin( CACHE_EL( el));
+    if( rc != 0){
+        TRACE_ERR("Could not pin the superblock");
+        goto exit0;
+    }
+
     kfs_sb = (kfs_superblock_t *) el->pe_mem_ptr;
     kfssb_to_sb( sb, kfs_sb);
 
-    sb->sb_bdev = fd;
+    sb->sb_bdev = bdev->bd_fd;
+    sb->sb_bdev_backend = (void *) bdev;
     sb->sb_page_cache = (void *) pgcache; 
     sb->sb_superblock_page = (void *) el;
     sb->sb_flags = kfs_sb->sb_flags |= KFS_IS_MOUNTED;
@@ -498,6 +865,12 @@ int kfs_mount( kfs_config_t *config){
         TRACE_ERR("Superblock is not active");
         goto exit0;
     }
+
+    rc = kfs_maps_load( sb, pgcache, bdev);
+    if( rc != 0){
+        TRACE_ERR("Could not load the maps");
+        goto exit0;
+    }
  
     goto exitOK;
 
@@ -505,7 +878,7 @@ exit0:
     pgcache_destroy( pgcache);
 
 exit1:
-    close( fd);
+    bdev_close( bdev);
 exitOK:
 
     return( rc);
@@ -647,14 +1020,19 @@ int kfs_umount(){
  
     sb->sb_flags = sb->sb_flags &~ KFS_IS_MOUNTED;
 
+    kfs_maps_free( sb);
+
     kfs_sb = ( kfs_superblock_t *) el->pe_mem_ptr;
     sb_to_kfssb( kfs_sb, sb);
-
-    
-    TRACE("ok2");
+    if( pgcache_element_sync( el) != 0){
+        TRACE_ERR("could not sync the superblock");
+        rc = -1;
+    }
+    cache_element_mark_unpin( CACHE_EL( el));
 
     pgcache_destroy( pgcache);
-    close( sb->sb_bdev);
+    bdev_flush( (bdev_t *) sb->sb_bdev_backend);
+    bdev_close( (bdev_t *) sb->sb_bdev_backend);
     memset( &__sb, 0, sizeof( sb_t ));
     TRACE("end rc=%d", rc);
     return(rc);
@@ -684,6 +1062,7 @@ void sb_to_kfssb( kfs_superblock_t *ksb, sb_t *sb){
     kex = &ksb->sb_si_table.bitmap_extent;
     ex = &sb->sb_si_table.bitmap_extent;
     ex_2_kfsex( kex, ex);
+    ksb->sb_si_table_hwm = sb->sb_si_table.hwm;
 
     ksb->sb_slot_table.capacity = sb->sb_slot_table.capacity;
     ksb->sb_slot_table.in_use = sb->sb_slot_table.in_use;
@@ -693,6 +1072,7 @@ void sb_to_kfssb( kfs_superblock_t *ksb, sb_t *sb){
     kex = &ksb->sb_slot_table.bitmap_extent;
     ex = &sb->sb_slot_table.bitmap_extent;
     ex_2_kfsex( kex, ex);
+    ksb->sb_slot_table_hwm = sb->sb_slot_table.hwm;
 
 
     ksb->sb_blockmap.capacity = sb->sb_blockmap.capacity;
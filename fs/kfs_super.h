@@ -17,17 +17,53 @@
 #include "trace.h"
 #include "dict.h"
 #include "kfs_mem.h"
+#include "falloc.h"
+#include "dalloc.h"
+#include "bdev.h"
 
 
+extern sb_t __sb;
 #define kfs_get_sb()                     ( &__sb)
 
-int kfs_verify( char *filename, int verbose, int extra_verification);
+/* open the volume in filename with the backend type. If its superblock
+ * says it is striped, filename and the comma separated files in
+ * stripe_files are opened together. latency_us is for the ram backend.
+ * kfs_verify() reads the volume thru it */
+bdev_t *kfs_bdev_open( char *filename, char *stripe_files, int type,
+                       uint32_t latency_us);
+int kfs_verify( bdev_t *bdev, int verbose, int extra_verification);
 int kfs_mount( kfs_config_t *config);
 int kfs_active();
 void kfs_superblock_display();
 int kfs_umount();
 int kfs_superblock_update();
 
+/* data blocks, taken from and given back to the block map. goal is the
+ * block to allocate near, or FALLOC_NO_GOAL for the best fit */
+int kfs_blocks_alloc( uint64_t goal, uint64_t num_blocks, uint64_t *addr);
+int kfs_blocks_free( uint64_t addr, uint64_t num_blocks);
+
+/* new data of an object, its blocks are reserved in the block map and
+ * allocated at once when it is flushed, see dalloc.h. goal as above.
+ * kfs_data_flush() is dalloc_flush() updating the block map on disk too,
+ * and kfs_data_close() the same for dalloc_destroy(), on close or eviction
+ * of the object, so the preallocated tail is trimmed */
+void kfs_data_init( dalloc_t *da, uint64_t goal);
+int kfs_data_flush( dalloc_t *da, kfs_extent_t *ex, int ex_max);
+int kfs_data_close( dalloc_t *da);
+
+/* block of the sinode table holding a super inode, a goal for its data
+ * blocks. FALLOC_NO_GOAL if the id is out of the table */
+uint64_t kfs_sinode_block( uint64_t sinode_id);
+
+/* super inode and slot ids from their maps. A new super inode goes as
+ * close as possible to its parent, FALLOC_NO_GOAL if it has none, so
+ * neighbors share table blocks */
+int kfs_sinode_id_alloc( uint64_t parent, uint64_t *sinode_id);
+int kfs_sinode_id_free( uint64_t sinode_id);
+int kfs_slot_id_alloc( uint64_t goal, uint64_t *slot_id);
+int kfs_slot_id_free( uint64_t slot_id);
+
 
 
 /* super block operations */
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trace.h"
+#include "kfs_mem.h"
+#include "kfs_disk.h"
+#include "bdev.h"
+#include "kfs_table.h"
+
+
+
+int kfs_table_block_init( char *p, uint32_t magic, uint64_t idx, 
+                          uint64_t capacity){
+    kfs_extent_header_t *eh;
+    kfs_sinode_t *si;
+    kfs_slot_t *slot;
+    uint64_t i, id;
+    char *entries = p;
+
+    memset( (void *) p, 0, KFS_BLOCKSIZE);
+    if( idx == 0){
+        eh = (kfs_extent_header_t *) p;
+        eh->eh_magic = magic;
+        eh->eh_entries_in_use = 0;
+        eh->eh_entries_capacity = (uint32_t) capacity;
+        eh->eh_flags = KFS_ENTRIES_ROOT|KFS_ENTRIES_LEAF;
+        entries += sizeof( kfs_extent_header_t);
+    }
+
+    if( magic == KFS_SINODE_TABLE_MAGIC){
+        si = (kfs_sinode_t *) entries;
+        id = idx * KFS_SINODES_PER_BLOCK;
+        for( i = 0; i < KFS_SINODES_PER_BLOCK; i++){
+            si[i].si_id = id++;
+        }
+    }else if( magic == KFS_SLOTS_TABLE_MAGIC){
+        slot = (kfs_slot_t *) entries;
+        id = idx * KFS_SLOTS_PER_BLOCK;
+        for( i = 0; i < KFS_SLOTS_PER_BLOCK; i++){
+            slot[i].slot_id = id++;
+        }
+    }else{
+        TRACE_ERR("Unknown table magic 0x%x", magic);
+        return( -1);
+    }
+
+    return( 0);
+}
+
+
+
+int kfs_table_block_read( bdev_t *bdev, table_t *t, uint32_t magic,
+                          uint64_t idx, char *p){
+    if( idx >= t->table_extent.ex_block_size){
+        TRACE_ERR("Block %lu is outside the table", idx);
+        return( -1);
+    }
+
+    if( idx >= t->hwm){
+        return( kfs_table_block_init( p, magic, idx, t->capacity));
+    }
+
+    return( bdev_read( bdev, p, t->table_extent.ex_block_addr + idx, 1));
+}
+
+
+
+int kfs_table_block_write( bdev_t *bdev, table_t *t, uint32_t magic,
+                           uint64_t idx, char *p){
+    uint64_t i;
+    char *q;
+
+    if( idx >= t->table_extent.ex_block_size){
+        TRACE_ERR("Block %lu is outside the table", idx);
+        return( -1);
+    }
+
+    /* blocks never written could hold anything on a block device, so
+     * the gap up to this one gets its default entries first */
+    if( idx > t->hwm){
+        q = malloc( KFS_BLOCKSIZE);
+        if( q == NULL){
+            TRACE_ERR("Error in malloc()");
+            return( -1);
+        }
+
+        for( i = t->hwm; i < idx; i++){
+            if( kfs_table_block_init( q, magic, i, t->capacity) != 0 ||
+                bdev_write( bdev, q, t->table_extent.ex_block_addr + i,
+                            1) != 0){
+                TRACE_ERR("Could not initialize table block %lu", i);
+                free( q);
+                return( -1);
+            }
+            t->hwm = i + 1;
+        }
+        free( q);
+    }
+
+    if( bdev_write( bdev, p, t->table_extent.ex_block_addr + idx, 1) != 0){
+        return( -1);
+    }
+
+    if( idx >= t->hwm){
+        t->hwm = idx + 1;
+    }
+    return( 0);
+}
+
@@ -0,0 +1,46 @@
+#ifndef _KFS_TABLE_H_
+#define _KFS_TABLE_H_
+
+#include <stdint.h>
+#include "kfs_mem.h"
+#include "kfs_disk.h"
+#include "bdev.h"
+
+
+/* super inodes and slots tables. Every block of a table holds the same
+ * number of entries, the first block starts with the extent header and
+ * the entries follow it. Entries are numbered in sequence.
+ *
+ * Tables are initialized lazily. Only the blocks below the table high
+ * water mark (table_t hwm) were ever written, the blocks after it hold
+ * default entries, zeroed but with their IDs. kfs_mkfs just writes the
+ * first block of each table. */
+
+#define KFS_SINODES_PER_BLOCK    ( ( KFS_BLOCKSIZE -                        \
+                                     sizeof( kfs_extent_header_t)) /        \
+                                   sizeof( kfs_sinode_t))
+#define KFS_SLOTS_PER_BLOCK      ( ( KFS_BLOCKSIZE -                        \
+                                     sizeof( kfs_extent_header_t)) /        \
+                                   sizeof( kfs_slot_t))
+
+
+/* fill p with block idx of a table with default entries. magic is
+ * KFS_SINODE_TABLE_MAGIC or KFS_SLOTS_TABLE_MAGIC. The first block gets
+ * the extent header too */
+int kfs_table_block_init( char *p, uint32_t magic, uint64_t idx, 
+                          uint64_t capacity);
+
+/* read block idx of a table. Blocks past the high water mark are built
+ * in memory, without IO */
+int kfs_table_block_read( bdev_t *bdev, table_t *t, uint32_t magic,
+                          uint64_t idx, char *p);
+
+/* write block idx of a table. If it is past the high water mark, the
+ * blocks in between are initialized first and the mark is moved. The
+ * caller should store the new mark in the superblock */
+int kfs_table_block_write( bdev_t *bdev, table_t *t, uint32_t magic,
+                           uint64_t idx, char *p);
+
+
+#endif
+
@@ -1,4 +1,7 @@
 #include "map.h"
+#if defined( __AVX2__) && defined( USER_SPACE)
+#include <immintrin.h>
+#endif
 #ifndef USER_SPACE
 extern unsigned int trace_level;
 extern unsigned int trace_mask;
@@ -12,15 +15,18 @@ unsigned char byte_set_bits( int start,
                              char byte,
                              int clear_or_set){
     int to = start + numbits; /* which bit to stop */
-    uint8_t mask = 0x00; 
+    uint8_t mask;
 
     if( to > 8){
         to = 8;
     }
 
-    do{
-        mask |= (0x01 << start++); 
-    }while( start < to);
+    /* at least the start bit is updated */
+    if( to <= start){
+        to = start + 1;
+    }
+
+    mask = (uint8_t) ( ( 0xffu << start) & ( 0xffu >> ( 8 - to)));
 
     /* if  turn the bits on */
     if( clear_or_set == SETBIT){
@@ -48,32 +54,26 @@ int byte_get_bit( unsigned char byte, int bit){
  * the number of contiguous bits */
 int byte_count_bits( int start, int numbits, char byte, int clear_or_set){
     int to = start + numbits; /* which bit to stop */
-    uint8_t mask = 0x00;
-    int count = 0;
+    unsigned int bits = (uint8_t) byte;
+    int count;
 
     if( to > 8){
         to = 8;
     }
 
-    /* turn on the required bits in the mask */
-    do{
-        mask = 0x01 << start;
-        if( mask & byte){
-            if( clear_or_set == SETBIT){
-                count++;
-            }else{
-                return( count);
-            }
-        }else{
-            if( clear_or_set != SETBIT){
-                count++;
-            }else{
-                return( count);
-            }
-        }
-        start++;
-    }while( start < to);
-    return( count);
+    /* at least the start bit is checked */
+    if( to <= start){
+        to = start + 1;
+    }
+
+    /* look for 1s, then the first 0 ends the count */
+    if( clear_or_set != SETBIT){
+        bits = ~bits;
+    }
+    bits = ( bits & 0xffu) >> start;
+    count = __builtin_ctz( ~bits);
+
+    return( min( count, to - start));
 }
 
 
@@ -281,7 +281,7 @@ int bm_set_extent( unsigned char *bm,
      * the bitmap. */
     extra_bits_to_mark = pending_bits % 8;
 
-    if( extra_bits_to_mark > 1){
+    if( extra_bits_to_mark >= 1){
         byte = bm[location_in_map];
 	byte = byte_set_bits( 0, extra_bits_to_mark, byte, clear_or_set);
         bm[location_in_map] = byte;
@@ -293,6 +293,77 @@ int bm_set_extent( unsigned char *bm,
     return(-2);
 }
 
+/* the maps are searched and counted 64 bits at a time. Bit n of the map
+ * is bit n % 8 of byte n / 8, so on little endian machines a word loaded
+ * from the map has its bits in the same order. */
+
+static inline uint64_t bm_load64( const unsigned char *p){
+    uint64_t w;
+
+    memcpy( &w, p, sizeof( w));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64( w);
+#endif
+    return( w);
+}
+
+
+/* mask with the lower n bits set, n from 1 to 64 */
+static inline uint64_t bm_mask( uint64_t n){
+    return( n >= 64 ? ~0ull : ( 1ull << n) - 1);
+}
+
+
+/* get n bits, up to 64, from the map starting in bit pos, in the lower
+ * bits of the result. Only the bytes holding those bits are read. */
+static uint64_t bm_get_word( const unsigned char *bm, uint64_t pos, 
+                             uint64_t n){
+    unsigned char buf[16] = { 0};
+    uint64_t w, nbytes;
+    int shift = pos & 0x07;
+
+    if( shift == 0 && n == 64){
+        return( bm_load64( &bm[pos / 8]));
+    }
+
+    nbytes = ( shift + n + 7) / 8;
+    memcpy( buf, &bm[pos / 8], nbytes);
+    w = bm_load64( buf) >> shift;
+    if( shift != 0){
+        w |= (uint64_t) buf[8] << ( 64 - shift);
+    }
+
+    return( w & bm_mask( n));
+}
+
+
+/* skip the fully used parts of the map, starting in pos, which should be
+ * 64 bits aligned. Return the first position, before end, where some bit
+ * may be clear. */
+static uint64_t bm_skip_ones( const unsigned char *bm, uint64_t pos, 
+                              uint64_t end){
+#if defined( __AVX2__) && defined( USER_SPACE)
+    const __m256i ones = _mm256_set1_epi8( -1);
+    __m256i v;
+
+    /* 256 bits at a time */
+    while( pos + 256 <= end){
+        v = _mm256_loadu_si256( (const __m256i *) &bm[pos / 8]);
+        if( ! _mm256_testc_si256( v, ones)){
+            break;
+        }
+        pos += 256;
+    }
+#endif
+
+    while( pos + 64 <= end && bm_load64( &bm[pos / 8]) == ~0ull){
+        pos += 64;
+    }
+
+    return( pos);
+}
+
+
 /* count how many contiguous 0 or 1 do we have in the bitmap pointed by
  * bm, which has a size of total_bits bits. The count starts in
  * bit_address, until num_bits_to_count bits is reached.
@@ -308,85 +379,41 @@ int bm_count( unsigned char *bm,
                    int clear_or_set, 
                    uint64_t *count_result){
 
-    uint64_t location_in_map;
-    uint8_t byte;
+    uint64_t pos, end, n, w, mask;
     uint64_t bits_count = 0; 
-    int64_t pending_bits = num_bits_to_count;
-    int expected_bits = 0;
-    int aligned_to_byte;
 
     *count_result = 0;
 
-
     if( (bit_address >= total_bits) ||
         (bit_address + num_bits_to_count) > total_bits) {
         return( -1);
     }
- 
-    bits_count = 0;
-    location_in_map = bit_address / 8;
-
-    /* get if the bit address is byte aligned */
-    aligned_to_byte = bit_address & 0x07;
-
-    /* bit not aligned to byte start */ 
-    if( aligned_to_byte != 0){
-        /* process first byte */
-        byte = bm[location_in_map++];
 
-
-        if( (aligned_to_byte + num_bits_to_count) >= 8){
-            expected_bits = 8 - aligned_to_byte;
-        }else{
-            expected_bits = num_bits_to_count;
+    pos = bit_address;
+    end = bit_address + num_bits_to_count;
+    while( pos < end){
+        /* the first word goes up to the next word boundary, so the
+         * following ones are aligned */
+        n = min( 64 - ( pos & 63), end - pos);
+        mask = bm_mask( n);
+
+        /* the bits we are counting are 1s in w */
+        w = bm_get_word( bm, pos, n);
+        if( clear_or_set != SETBIT){
+            w = ~w & mask;
         }
 
-        bits_count = byte_count_bits( (int) aligned_to_byte, 
-                                      (int) expected_bits, 
-                                      byte, 
-                                      clear_or_set);
-
-
-        pending_bits -= expected_bits;
-
-        if( pending_bits <= 0 || bits_count < expected_bits){
-            *count_result = bits_count;
-            return( 0);
+        if( w != mask){
+            bits_count += __builtin_ctzll( ~w);
+            break;
         }
-    }
-
-
-    while( bits_count < num_bits_to_count){
-        byte = bm[location_in_map++];
-
-        if( byte != 0xff && byte != 0x00 ){
-            bits_count += byte_count_bits( (int) 0,
-                                           pending_bits,
-                                           byte,
-                                           clear_or_set);
-
-            *count_result = bits_count;
 
-            return(0);
-        }else{
-            if( ( clear_or_set == 1 && byte == 0xff) ||
-                ( clear_or_set == 0 && byte == 0x00)){
-
-
-                if( pending_bits <= 8){
-                    *count_result = num_bits_to_count;
-                    return( 0);
-                }
-                bits_count += 8;
-                pending_bits -= 8;
-            }else{
-                *count_result = bits_count;
-                return( 0);
-            }
-        }
+        bits_count += n;
+        pos += n;
     }
 
-    return( -2);
+    *count_result = bits_count;
+    return( 0);
 }
 
 /* find a gap of contiguous zeroed bits in the bitmap pointed by
@@ -404,19 +431,15 @@ int bm_find( unsigned char *bm,
              uint64_t gap_size,
              uint64_t *found_address){
 
-    uint64_t location_in_map = bit_address / 8;
-    uint64_t bit_offset, updated_gap_size; 
-    uint8_t byte; 
-    int rc, bit_count; 
-    int aligned_to_byte = bit_address & 0x07;
-    int may_have_a_large_gap = 0;
+    uint64_t pos, end, n, w, x, off, len;
+    uint64_t gap_start = 0, gap_len = 0;
 
+    *found_address = 0;
 
     if( ( bit_address >= total_bits) || 
         ( gap_size == 0)                 || 
         ( count == 0)                    ||
         ( gap_size > count)){ 
-        *found_address = 0;
         return( -1);
     }
 
@@ -424,56 +447,65 @@ int bm_find( unsigned char *bm,
         count = total_bits - bit_address;
     }
 
-    updated_gap_size = gap_size;
- 
-    do{
-        byte = bm[location_in_map];
-        rc = byte_find_gap( aligned_to_byte, 
-                            updated_gap_size, 
-                            byte, 
-                            &bit_count);
-                            
-        if( ( 8 - aligned_to_byte) > count){
-            count = 0;
-        }else{
-            count -= ( 8 - aligned_to_byte);
+    pos = bit_address;
+    end = bit_address + count;
+    while( pos < end){
+        /* out of a gap, jump over the used words */
+        if( gap_len == 0 && ( pos & 63) == 0){
+            pos = bm_skip_ones( bm, pos, end);
+            if( pos >= end){
+                break;
+            }
         }
 
-        if( rc >= 0){
-            if( may_have_a_large_gap == 0){
-                bit_offset = rc;
-                *found_address = (location_in_map * 8) + bit_offset;
-                return(0);
-            }else{
-                updated_gap_size -= bit_count;
-                if( updated_gap_size == 0){
-                    return(0);
-                } 
-            }
+        n = min( 64 - ( pos & 63), end - pos);
 
-        }else if( rc == -1){
-            if( (gap_size > count) || ( count == 0)){
-                *found_address = 0;
-                return( -1);
+        /* free bits are 1s in w */
+        w = ~bm_get_word( bm, pos, n) & bm_mask( n);
+        if( w == bm_mask( n)){
+            if( gap_len == 0){
+                gap_start = pos;
             }
+            gap_len += n;
+            if( gap_len >= gap_size){
+                *found_address = gap_start;
+                return( 0);
+            }
+            pos += n;
+            continue;
+        }
 
-            updated_gap_size = gap_size; 
-            may_have_a_large_gap = 0;
+        /* walk the runs of free bits in this word */
+        off = 0;
+        while( off < n){
+            x = w >> off;
+            if( x == 0){
+                gap_len = 0;
+                break;
+            }
 
-        }else if( rc == -2){
-            if( may_have_a_large_gap == 0){
-                may_have_a_large_gap = 1;
-                *found_address = ((location_in_map + 1) * 8) - bit_count;
+            if( ( x & 1) == 0){
+                gap_len = 0;
+                off += __builtin_ctzll( x);
+                continue;
             }
-            updated_gap_size -= bit_count;
 
+            len = min( (uint64_t) __builtin_ctzll( ~x), n - off);
+            if( gap_len == 0){
+                gap_start = pos + off;
+            }
+            gap_len += len;
+            if( gap_len >= gap_size){
+                *found_address = gap_start;
+                return( 0);
+            }
+            off += len;
         }
-        aligned_to_byte = 0;
-        location_in_map++;
-    }while( 1);
 
-    /* should not happen */
-    return( -2); 
+        pos += n;
+    }
+
+    return( -1);
 }
 
 
@@ -22,6 +22,15 @@
 })
 #endif
 
+#ifndef max
+#define max(a,b)             \
+({                           \
+    __typeof__ (a) _a = (a); \
+    __typeof__ (b) _b = (b); \
+    _a > _b ? _a : _b;       \
+})
+#endif
+
 /* set or clear numbits bits in the byte passed as argument, starting in 
  * the start bit. Will return the byte updated.
  */
@@ -0,0 +1,568 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trace.h"
+#include "map_summary.h"
+
+
+
+/* mask with the lower n bits set, n from 1 to 64 */
+static inline uint64_t bms_mask( uint64_t n){
+    return( n >= 64 ? ~0ull : ( 1ull << n) - 1);
+}
+
+
+
+/* free bits of the word w of the map, as 1s. The bits past the end of the
+ * map are not free */
+static uint64_t bms_word_free( bm_summary_t *s, uint64_t w){
+    uint64_t pos = w * BMS_WORD_BITS, n, bits = 0;
+
+    n = min( (uint64_t) BMS_WORD_BITS, s->bs_total_bits - pos);
+    memcpy( &bits, &s->bs_map[pos / 8], ( n + 7) / 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    bits = __builtin_bswap64( bits);
+#endif
+    return( ~bits & bms_mask( n));
+}
+
+
+
+/* counters of a single word, from its free bits */
+static void bms_word_sum( uint64_t f, bm_run_sum_t *r){
+    uint64_t x, len, longest = 0;
+
+    if( f == ~0ull){
+        r->rs_free = r->rs_head = r->rs_tail = r->rs_max = BMS_WORD_BITS;
+        return;
+    }
+
+    r->rs_free = __builtin_popcountll( f);
+    r->rs_head = __builtin_ctzll( ~f);
+    r->rs_tail = __builtin_clzll( ~f);
+
+    x = f;
+    while( x != 0){
+        x >>= __builtin_ctzll( x);
+        len = __builtin_ctzll( ~x);
+        if( len > longest){
+            longest = len;
+        }
+        x >>= len;
+    }
+    r->rs_max = longest;
+}
+
+
+
+/* counters of a group from the counters of its n parts, each one of span
+ * bits. A run may cross the parts, so it is their tail plus any number of
+ * fully free parts plus the head of the next one */
+static void bms_combine( bm_run_sum_t *dst, bm_run_sum_t *r, uint64_t n,
+                         uint64_t span){
+    uint64_t i, run = 0, longest = 0, free = 0, head = 0;
+    int in_head = 1;
+
+    for( i = 0; i < n; i++){
+        free += r[i].rs_free;
+        if( in_head){
+            head += r[i].rs_head;
+            in_head = ( r[i].rs_free == span);
+        }
+
+        longest = max( longest, r[i].rs_max);
+        longest = max( longest, run + r[i].rs_head);
+        run = ( r[i].rs_free == span) ? run + span : r[i].rs_tail;
+    }
+
+    dst->rs_free = free;
+    dst->rs_head = head;
+    dst->rs_tail = run;
+    dst->rs_max = longest;
+}
+
+
+
+/* build the first level entry g from the map words */
+static void bms_group_build( bm_summary_t *s, uint64_t g){
+    bm_run_sum_t r[BMS_FANOUT];
+    uint64_t i, w, f;
+
+    for( i = 0; i < BMS_FANOUT; i++){
+        w = g * BMS_FANOUT + i;
+        f = ( w < s->bs_words_num) ? bms_word_free( s, w) : 0;
+        bms_word_sum( f, &r[i]);
+
+        if( w >= s->bs_words_num){
+            continue;
+        }
+
+        if( f != 0){
+            s->bs_words[w / 64] |= 1ull << ( w % 64);
+        }else{
+            s->bs_words[w / 64] &= ~( 1ull << ( w % 64));
+        }
+    }
+
+    bms_combine( &s->bs_levels[0][g], r, BMS_FANOUT, BMS_WORD_BITS);
+}
+
+
+
+/* build the entry e of level l, l > 0, from the level below */
+static void bms_entry_build( bm_summary_t *s, int l, uint64_t e){
+    uint64_t first, n;
+
+    first = e * BMS_FANOUT;
+    n = min( (uint64_t) BMS_FANOUT, s->bs_entries[l - 1] - first);
+    bms_combine( &s->bs_levels[l][e], &s->bs_levels[l - 1][first], n,
+                 s->bs_span[l - 1]);
+
+    /* the missing parts are past the end of the map */
+    if( n < BMS_FANOUT){
+        s->bs_levels[l][e].rs_tail = 0;
+    }
+}
+
+
+
+bm_summary_t *bm_summary_alloc( unsigned char *bm, uint64_t total_bits){
+    bm_summary_t *s;
+    uint64_t entries, span;
+    int l;
+
+    if( bm == NULL || total_bits == 0){
+        TRACE_ERR("Invalid map");
+        return( NULL);
+    }
+
+    s = malloc( sizeof( bm_summary_t));
+    if( s == NULL){
+        TRACE_ERR("Error in malloc()");
+        return( NULL);
+    }
+
+    memset( (void *) s, 0, sizeof( bm_summary_t));
+    s->bs_map = bm;
+    s->bs_total_bits = total_bits;
+    s->bs_words_num = ( total_bits + BMS_WORD_BITS - 1) / BMS_WORD_BITS;
+    s->bs_words = calloc( ( s->bs_words_num + 63) / 64, sizeof( uint64_t));
+    if( s->bs_words == NULL){
+        TRACE_ERR("Error in calloc()");
+        goto exit0;
+    }
+
+    span = BMS_GROUP_BITS;
+    entries = ( total_bits + span - 1) / span;
+    for( l = 0; l < BMS_MAX_LEVELS; l++){
+        s->bs_levels[l] = calloc( entries, sizeof( bm_run_sum_t));
+        if( s->bs_levels[l] == NULL){
+            TRACE_ERR("Error in calloc()");
+            goto exit0;
+        }
+
+        s->bs_entries[l] = entries;
+        s->bs_span[l] = span;
+        s->bs_levels_num++;
+        if( entries <= BMS_FANOUT){
+            break;
+        }
+
+        span *= BMS_FANOUT;
+        entries = ( entries + BMS_FANOUT - 1) / BMS_FANOUT;
+    }
+
+    bm_summary_rebuild( s);
+    return( s);
+
+exit0:
+    bm_summary_free( s);
+    return( NULL);
+}
+
+
+
+void bm_summary_free( bm_summary_t *s){
+    int l;
+
+    if( s == NULL){
+        return;
+    }
+
+    for( l = 0; l < s->bs_levels_num; l++){
+        free( s->bs_levels[l]);
+    }
+
+    free( s->bs_words);
+    free( s);
+}
+
+
+
+void bm_summary_rebuild( bm_summary_t *s){
+    bm_summary_update( s, 0, s->bs_total_bits);
+}
+
+
+
+void bm_summary_update( bm_summary_t *s,
+                        uint64_t bit_address,
+                        uint64_t num_bits){
+    uint64_t first, last, e;
+    int l;
+
+    if( num_bits == 0 || bit_address >= s->bs_total_bits){
+        return;
+    }
+
+    if( bit_address + num_bits > s->bs_total_bits){
+        num_bits = s->bs_total_bits - bit_address;
+    }
+
+    first = bit_address / BMS_GROUP_BITS;
+    last = ( bit_address + num_bits - 1) / BMS_GROUP_BITS;
+    for( e = first; e <= last; e++){
+        bms_group_build( s, e);
+    }
+
+    for( l = 1; l < s->bs_levels_num; l++){
+        first /= BMS_FANOUT;
+        last /= BMS_FANOUT;
+        for( e = first; e <= last; e++){
+            bms_entry_build( s, l, e);
+        }
+    }
+}
+
+
+
+int bm_summary_set_bit( bm_summary_t *s,
+                        uint64_t bit_address,
+                        int clear_or_set){
+    int rc;
+
+    rc = bm_set_bit( s->bs_map, s->bs_total_bits, bit_address,
+                     clear_or_set);
+    bm_summary_update( s, bit_address, 1);
+    return( rc);
+}
+
+
+
+int bm_summary_set_extent( bm_summary_t *s,
+                           uint64_t bit_address,
+                           uint64_t num_bits_to_set,
+                           int clear_or_set){
+    int rc;
+
+    rc = bm_set_extent( s->bs_map, s->bs_total_bits, bit_address,
+                        num_bits_to_set, clear_or_set);
+
+    /* on errors part of the extent may be changed anyway */
+    bm_summary_update( s, bit_address, num_bits_to_set);
+    return( rc);
+}
+
+
+
+/* look for the gap in the words first to last - 1, the bits out of
+ * [start, end) are taken as used. carry is the free run ending right
+ * before the first word, it is updated */
+static int bms_scan_words( bm_summary_t *s, uint64_t first, uint64_t last,
+                           uint64_t start, uint64_t end, uint64_t gap,
+                           uint64_t *carry, uint64_t *found){
+    uint64_t w, pos, f, x, off, len;
+
+    for( w = first; w < last; w++){
+        pos = w * BMS_WORD_BITS;
+        if( ( s->bs_words[w / 64] & ( 1ull << ( w % 64))) == 0){
+            *carry = 0;
+            continue;
+        }
+
+        f = bms_word_free( s, w);
+        if( pos < start){
+            f &= ~bms_mask( start - pos);
+        }
+        if( pos + BMS_WORD_BITS > end){
+            f &= bms_mask( end - pos);
+        }
+
+        if( f == ~0ull){
+            *carry += BMS_WORD_BITS;
+            if( *carry >= gap){
+                *found = pos + BMS_WORD_BITS - *carry;
+                return( 0);
+            }
+            continue;
+        }
+
+        off = __builtin_ctzll( ~f);
+        if( *carry + off >= gap){
+            *found = pos - *carry;
+            return( 0);
+        }
+
+        /* the runs inside the word */
+        while( off < BMS_WORD_BITS){
+            x = f >> off;
+            if( x == 0){
+                break;
+            }
+
+            off += __builtin_ctzll( x);
+            x = f >> off;
+            len = __builtin_ctzll( ~x);
+            if( len >= gap){
+                *found = pos + off;
+                return( 0);
+            }
+            off += len;
+        }
+
+        *carry = __builtin_clzll( ~f);
+    }
+
+    return( -1);
+}
+
+
+
+/* look for the gap in the entries first to last - 1 of level l. Entries
+ * fully inside [start, end) are skipped by their counters, the others
+ * are searched in the level below */
+static int bms_scan( bm_summary_t *s, int l, uint64_t first, uint64_t last,
+                     uint64_t start, uint64_t end, uint64_t gap,
+                     uint64_t *carry, uint64_t *found){
+    uint64_t e, pos, span, cspan, cfirst, clast;
+    bm_run_sum_t *r;
+
+    span = s->bs_span[l];
+    for( e = first; e < last; e++){
+        r = &s->bs_levels[l][e];
+        pos = e * span;
+        if( pos >= start && pos + span <= end){
+            if( *carry + r->rs_head >= gap){
+                *found = pos - *carry;
+                return( 0);
+            }
+
+            if( r->rs_max < gap){
+                *carry = ( r->rs_free == span) ? *carry + span : r->rs_tail;
+                continue;
+            }
+        }
+
+        /* the gap starts here, or the entry is cut by start or end */
+        cspan = ( l == 0) ? BMS_WORD_BITS : s->bs_span[l - 1];
+        cfirst = max( pos, start) / cspan;
+        clast = ( min( pos + span, end) - 1) / cspan + 1;
+        if( l == 0){
+            if( bms_scan_words( s, cfirst, clast, start, end, gap, carry,
+                                found) == 0){
+                return( 0);
+            }
+        }else if( bms_scan( s, l - 1, cfirst, clast, start, end, gap,
+                            carry, found) == 0){
+            return( 0);
+        }
+    }
+
+    return( -1);
+}
+
+
+
+int bm_summary_find( bm_summary_t *s,
+                     uint64_t start,
+                     uint64_t count,
+                     uint64_t gap_size,
+                     uint64_t *found_address){
+    uint64_t end, span, carry = 0;
+    int top;
+
+    *found_address = 0;
+
+    if( ( start >= s->bs_total_bits) ||
+        ( gap_size == 0)             ||
+        ( count == 0)                ||
+        ( gap_size > count)){
+        return( -1);
+    }
+
+    if( ( start + count) > s->bs_total_bits){
+        count = s->bs_total_bits - start;
+    }
+
+    end = start + count;
+    top = s->bs_levels_num - 1;
+    span = s->bs_span[top];
+    return( bms_scan( s, top, start / span, ( end - 1) / span + 1, start,
+                      end, gap_size, &carry, found_address));
+}
+
+
+
+/* same than bms_scan_words() from the last word to the first one, for the
+ * last gap. carry is the free run starting right after the last word */
+static int bms_rscan_words( bm_summary_t *s, uint64_t first, uint64_t last,
+                            uint64_t start, uint64_t end, uint64_t gap,
+                            uint64_t *carry, uint64_t *found){
+    uint64_t w, pos, f, x, off, len, tail;
+    int fit;
+
+    for( w = last; w-- > first; ){
+        pos = w * BMS_WORD_BITS;
+        if( ( s->bs_words[w / 64] & ( 1ull << ( w % 64))) == 0){
+            *carry = 0;
+            continue;
+        }
+
+        f = bms_word_free( s, w);
+        if( pos < start){
+            f &= ~bms_mask( start - pos);
+        }
+        if( pos + BMS_WORD_BITS > end){
+            f &= bms_mask( end - pos);
+        }
+
+        if( f == ~0ull){
+            *carry += BMS_WORD_BITS;
+            if( *carry >= gap){
+                *found = pos + *carry - gap;
+                return( 0);
+            }
+            continue;
+        }
+
+        tail = __builtin_clzll( ~f);
+        if( *carry + tail >= gap){
+            *found = pos + BMS_WORD_BITS + *carry - gap;
+            return( 0);
+        }
+
+        /* the last run inside the word with room */
+        fit = 0;
+        off = 0;
+        while( off < BMS_WORD_BITS){
+            x = f >> off;
+            if( x == 0){
+                break;
+            }
+
+            off += __builtin_ctzll( x);
+            x = f >> off;
+            len = __builtin_ctzll( ~x);
+            if( len >= gap){
+                *found = pos + off + len - gap;
+                fit = 1;
+            }
+            off += len;
+        }
+
+        if( fit){
+            return( 0);
+        }
+
+        *carry = __builtin_ctzll( ~f);
+    }
+
+    return( -1);
+}
+
+
+
+/* same than bms_scan() from the last entry to the first one */
+static int bms_rscan( bm_summary_t *s, int l, uint64_t first, uint64_t last,
+                      uint64_t start, uint64_t end, uint64_t gap,
+                      uint64_t *carry, uint64_t *found){
+    uint64_t e, pos, span, cspan, cfirst, clast;
+    bm_run_sum_t *r;
+
+    span = s->bs_span[l];
+    for( e = last; e-- > first; ){
+        r = &s->bs_levels[l][e];
+        pos = e * span;
+        if( pos >= start && pos + span <= end){
+            if( *carry + r->rs_tail >= gap){
+                *found = pos + span + *carry - gap;
+                return( 0);
+            }
+
+            if( r->rs_max < gap){
+                *carry = ( r->rs_free == span) ? *carry + span : r->rs_head;
+                continue;
+            }
+        }
+
+        cspan = ( l == 0) ? BMS_WORD_BITS : s->bs_span[l - 1];
+        cfirst = max( pos, start) / cspan;
+        clast = ( min( pos + span, end) - 1) / cspan + 1;
+        if( l == 0){
+            if( bms_rscan_words( s, cfirst, clast, start, end, gap, carry,
+                                 found) == 0){
+                return( 0);
+            }
+        }else if( bms_rscan( s, l - 1, cfirst, clast, start, end, gap,
+                             carry, found) == 0){
+            return( 0);
+        }
+    }
+
+    return( -1);
+}
+
+
+
+int bm_summary_find_last( bm_summary_t *s,
+                          uint64_t start,
+                          uint64_t count,
+                          uint64_t gap_size,
+                          uint64_t *found_address){
+    uint64_t end, span, carry = 0;
+    int top;
+
+    *found_address = 0;
+
+    if( ( start >= s->bs_total_bits) ||
+        ( gap_size == 0)             ||
+        ( count == 0)                ||
+        ( gap_size > count)){
+        return( -1);
+    }
+
+    if( ( start + count) > s->bs_total_bits){
+        count = s->bs_total_bits - start;
+    }
+
+    end = start + count;
+    top = s->bs_levels_num - 1;
+    span = s->bs_span[top];
+    return( bms_rscan( s, top, start / span, ( end - 1) / span + 1, start,
+                       end, gap_size, &carry, found_address));
+}
+
+
+
+uint64_t bm_summary_free_bits( bm_summary_t *s){
+    uint64_t e, free = 0;
+    int top = s->bs_levels_num - 1;
+
+    for( e = 0; e < s->bs_entries[top]; e++){
+        free += s->bs_levels[top][e].rs_free;
+    }
+
+    return( free);
+}
+
+
+
+uint64_t bm_summary_max_gap( bm_summary_t *s){
+    bm_run_sum_t r;
+    int top = s->bs_levels_num - 1;
+
+    bms_combine( &r, s->bs_levels[top], s->bs_entries[top],
+                 s->bs_span[top]);
+    return( r.rs_max);
+}
+
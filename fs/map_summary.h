@@ -0,0 +1,98 @@
+#ifndef _MAP_SUMMARY_H_
+#define _MAP_SUMMARY_H_
+
+#include <stdint.h>
+#include "map.h"
+
+
+/* in memory summary of a bitmap, to find free runs without walking the
+ * whole map. It is never stored, it is built from the map at mount time
+ * and kept updated by the bm_summary_set_*() calls, so every change to a
+ * summarized map should go thru them.
+ *
+ * The lower level is a bit per 64 bits word of the map, set if the word
+ * has any free bit. Over it there are levels of counters, the first one
+ * has an entry per group of 4096 bits, each next level an entry per 64
+ * entries of the level below, up to a top level with at most 64 entries.
+ * The bits past the end of the map are taken as used. */
+#define BMS_WORD_BITS                    64
+#define BMS_GROUP_BITS                   4096
+#define BMS_FANOUT                       64
+#define BMS_MAX_LEVELS                   4
+
+
+/* free bits of a group, the free runs at its start and its end and the
+ * longest free run inside it */
+typedef struct{
+    uint32_t rs_free;
+    uint32_t rs_head;
+    uint32_t rs_tail;
+    uint32_t rs_max;
+}bm_run_sum_t;
+
+
+typedef struct{
+    unsigned char *bs_map;        /* the map, not owned by the summary */
+    uint64_t bs_total_bits;
+
+    uint64_t *bs_words;           /* a bit per word, 1 if it has free bits */
+    uint64_t bs_words_num;
+
+    int bs_levels_num;
+    bm_run_sum_t *bs_levels[BMS_MAX_LEVELS];
+    uint64_t bs_entries[BMS_MAX_LEVELS];  /* entries in each level */
+    uint64_t bs_span[BMS_MAX_LEVELS];     /* bits covered by an entry */
+}bm_summary_t;
+
+
+/* create the summary of the map bm, with total_bits bits, and build it.
+ * The map should stay in memory while the summary is in use */
+bm_summary_t *bm_summary_alloc( unsigned char *bm, uint64_t total_bits);
+void bm_summary_free( bm_summary_t *s);
+
+/* build everything again from the map */
+void bm_summary_rebuild( bm_summary_t *s);
+
+/* the num_bits bits starting in bit_address were changed in the map
+ * outside of the summary calls, update their summary */
+void bm_summary_update( bm_summary_t *s,
+                        uint64_t bit_address,
+                        uint64_t num_bits);
+
+/* bm_set_bit() and bm_set_extent() on the summarized map, the summary is
+ * updated. Same return values */
+int bm_summary_set_bit( bm_summary_t *s,
+                        uint64_t bit_address,
+                        int clear_or_set);
+int bm_summary_set_extent( bm_summary_t *s,
+                           uint64_t bit_address,
+                           uint64_t num_bits_to_set,
+                           int clear_or_set);
+
+/* same than bm_find() in the summarized map, the first gap of gap_size
+ * clear bits between start and start + count. Only the groups which may
+ * have the gap, by their counters, are read from the map.
+ * Return 0 and set found_address if found, -1 otherwise */
+int bm_summary_find( bm_summary_t *s,
+                     uint64_t start,
+                     uint64_t count,
+                     uint64_t gap_size,
+                     uint64_t *found_address);
+
+/* the same from the end, the last gap of gap_size clear bits between start
+ * and start + count, the one with the highest address */
+int bm_summary_find_last( bm_summary_t *s,
+                          uint64_t start,
+                          uint64_t count,
+                          uint64_t gap_size,
+                          uint64_t *found_address);
+
+/* number of clear bits in the map */
+uint64_t bm_summary_free_bits( bm_summary_t *s);
+
+/* longest run of clear bits in the map */
+uint64_t bm_summary_max_gap( bm_summary_t *s);
+
+
+#endif
+
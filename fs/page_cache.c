@@ -1,104 +1,291 @@
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
 #include <time.h>
 #include <stdint.h>
 #include <sys/time.h>
 #include "trace.h"
 #include "page_cache.h"
-#include "eio.h"
+#include "bdev.h"
+#include "ioq.h"
 #include "kfs_mem.h"
 
 
 
+/* look for a cached element mapping addr, no matter its size. 
+ * pc_lock is assumed to be held, shared or exclusive */
+static pgcache_element_t *pgcache_find( pgcache_t *pgcache, uint64_t addr){
+    cache_t *cache = (cache_t *) pgcache;
+    pgcache_element_t *el;
+    int i;
+
+    for( i = 0; i < cache->ca_elements_capacity; i++){
+        el = (pgcache_element_t *) cache->ca_elements_ptr[i];
+        if( el == NULL){
+            continue;
+        }
+        if( el->pe_el.ce_id == addr){
+            return( el);
+        }
+    }
+    return( NULL);
+}
+
+
+
+/* init the page cache part of a fresh cache element, the element lock
+ * should be ready before anybody could evict it */
+static int pgcache_element_init( pgcache_element_t *el){
+    if( pthread_rwlock_init( &el->pe_rwlock, NULL) != 0){
+        TRACE_ERR("rwlock init has failed");
+        return( -1);
+    }
+    el->pe_flags |= PGCACHE_EL_RWLOCK;
+    return( 0);
+}
+
+
+
+/* a prefetched page has been referenced or evicted, release its place in 
+ * the prefetch budget */
+static void pgcache_prefetch_unref( pgcache_element_t *el){
+    pgcache_t *pgcache = (pgcache_t *) el->pe_el.ce_owner_cache;
+
+    if( (el->pe_flags & PGCACHE_EL_PREFETCHED) == 0){
+        return;
+    }
+
+    pthread_mutex_lock( &pgcache->pc_prefetch_mutex);
+    if( (el->pe_flags & PGCACHE_EL_PREFETCHED) != 0){
+        el->pe_flags &= ~PGCACHE_EL_PREFETCHED;
+        if( pgcache->pc_prefetch_cached > 0){
+            pgcache->pc_prefetch_cached--;
+        }
+    }
+    pthread_mutex_unlock( &pgcache->pc_prefetch_mutex);
+}
+
+
+/* the blocks from addr on are being mapped or evicted. A prefetch read of
+ * any of them, queued or in flight, could be older than the data going to
+ * the device, so the request is marked to drop its blocks instead of
+ * caching them */
+static void pgcache_prefetch_invalidate( pgcache_t *pgcache, uint64_t addr,
+                                         int numblocks){
+    pgcache_prefetch_t *pf;
+    int i;
+
+    pthread_mutex_lock( &pgcache->pc_prefetch_mutex);
+    for( i = 0; i < pgcache->pc_prefetch_num; i++){
+        pf = &pgcache->pc_prefetch_queue[( pgcache->pc_prefetch_head + i) %
+                                         PGCACHE_PREFETCH_QUEUE_LEN];
+        if( pf->pf_addr < addr + (uint64_t) numblocks &&
+            addr < pf->pf_addr + (uint64_t) pf->pf_num_blocks){
+            pf->pf_flags |= PGCACHE_PF_STALE;
+        }
+    }
+    pthread_mutex_unlock( &pgcache->pc_prefetch_mutex);
+}
+
+
 void *pgcache_on_evict( void *arg){
     pgcache_element_t *pgcache_el = ( pgcache_element_t *) arg;
+
+    if( (pgcache_el->pe_flags & PGCACHE_EL_RWLOCK) != 0){
+        /* the cache and element mutexes are held here, waiting for the
+         * readers and writers could deadlock with one of them marking
+         * the element dirty or mapping another page. It stays */
+        if( pthread_rwlock_trywrlock( &pgcache_el->pe_rwlock) != 0){
+            return( CACHE_CB_BUSY);
+        }
+        pthread_rwlock_unlock( &pgcache_el->pe_rwlock);
+        pthread_rwlock_destroy( &pgcache_el->pe_rwlock);
+        pgcache_el->pe_flags &= ~PGCACHE_EL_RWLOCK;
+    }
+
+    pgcache_prefetch_unref( pgcache_el);
+
     if( pgcache_el->pe_mem_ptr != NULL){
+        pgcache_prefetch_invalidate( 
+                          (pgcache_t *) pgcache_el->pe_el.ce_owner_cache,
+                          pgcache_el->pe_block_addr, 
+                          pgcache_el->pe_num_blocks);
         free( pgcache_el->pe_mem_ptr);
     }
     return( NULL);
 }
 
-void *pgcache_on_flush( void *arg){
-    pgcache_element_t *pgcache_el = ( pgcache_element_t *) arg;
+
+/* write the element blocks to the device, the caller holds the element 
+ * lock, shared or exclusive. prio is the IO queue priority */
+static int pgcache_element_write_out( pgcache_element_t *pgcache_el, 
+                                      int prio){
     pgcache_t *pgcache; 
+    int rc;
 
     pgcache = (pgcache_t *) pgcache_el->pe_el.ce_owner_cache;
 
-    int rc = extent_write( pgcache->pc_fd, 
-                           pgcache_el->pe_mem_ptr, 
-                           pgcache_el->pe_block_addr, 
-                           pgcache_el->pe_num_blocks);
+    rc = ioq_write( pgcache->pc_ioq, 
+                    pgcache_el->pe_mem_ptr, 
+                    pgcache_el->pe_block_addr, 
+                    pgcache_el->pe_num_blocks,
+                    prio);
 
     if( rc != 0){
         TRACE_ERR("extent write error");
     } 
+    return( rc);
+}
+
+
+/* the flusher only needs a consistent snapshot of the blocks, so it takes
+ * the element lock shared and readers can keep going meanwhile */
+void *pgcache_on_flush( void *arg){
+    pgcache_element_t *pgcache_el = ( pgcache_element_t *) arg;
+
+    /* same as the eviction, a writer keeps it dirty for the next loop */
+    if( (pgcache_el->pe_flags & PGCACHE_EL_RWLOCK) == 0){
+        pgcache_element_write_out( pgcache_el, IOQ_PRIO_WRITEBACK);
+        return( NULL);
+    }
+
+    if( pthread_rwlock_tryrdlock( &pgcache_el->pe_rwlock) != 0){
+        return( CACHE_CB_BUSY);
+    }
+    pgcache_element_write_out( pgcache_el, IOQ_PRIO_WRITEBACK);
+    pgcache_element_unlock( pgcache_el);
     return( NULL);
 }
 
 
 
+int pgcache_element_read_lock( pgcache_element_t *el){
+    if( pthread_rwlock_rdlock( &el->pe_rwlock) != 0){
+        TRACE_ERR("could not take the element read lock");
+        return( -1);
+    }
+    return( 0);
+}
+
+int pgcache_element_write_lock( pgcache_element_t *el){
+    if( pthread_rwlock_wrlock( &el->pe_rwlock) != 0){
+        TRACE_ERR("could not take the element write lock");
+        return( -1);
+    }
+    return( 0);
+}
+
+int pgcache_element_unlock( pgcache_element_t *el){
+    if( pthread_rwlock_unlock( &el->pe_rwlock) != 0){
+        TRACE_ERR("could not release the element lock");
+        return( -1);
+    }
+    return( 0);
+}
+
+
+
+/* add the blocks after the cached ones to an element. The caller holds
+ * the element lock exclusive and not pc_lock, so the other maps and the
+ * lookups go on during the read. The cached blocks stay as they are,
+ * dirty or not, only the new ones are read. pc_lock is taken to publish
+ * the new size. The element lock is released */
+static int pgcache_element_grow( pgcache_t *pgcache, pgcache_element_t *el,
+                                 int numblocks){
+    uint64_t len = KFS_BLOCKS_TO_BYTES( el->pe_num_blocks);
+    char *p;
+    int rc = -1;
+
+    p = malloc( KFS_BLOCKS_TO_BYTES( numblocks));
+    if( p == NULL){
+        TRACE_ERR("malloc error");
+        goto exit0;
+    }
+    memcpy( p, el->pe_mem_ptr, len);
+
+    rc = ioq_read( pgcache->pc_ioq, p + len, 
+                   el->pe_block_addr + el->pe_num_blocks,
+                   numblocks - el->pe_num_blocks, IOQ_PRIO_META);
+    if( rc != 0){
+        TRACE_ERR("extent read error");
+        free( p);
+        goto exit0;
+    }
+
+    pthread_rwlock_wrlock( &pgcache->pc_lock);
+    free( el->pe_mem_ptr);
+    el->pe_mem_ptr = p;
+    el->pe_num_blocks = numblocks;
+    pgcache_prefetch_invalidate( pgcache, el->pe_block_addr, numblocks);
+    pthread_rwlock_unlock( &pgcache->pc_lock);
+
+exit0:
+    pgcache_element_unlock( el);
+    return( rc);
+}
+
+
 
 pgcache_element_t *pgcache_element_map( pgcache_t *pgcache, 
                                         uint64_t addr, 
                                         int numblocks){
-    int i, rc;
+    int rc, tries;
     pgcache_element_t *el;
-    cache_element_t *cel;
-    cache_t *cache = (cache_t *) pgcache;
     void *p;
     
     TRACE("start");
 
+    /* the common case, the page is cached already with the size we need.
+     * Lookups run in parallel under the shared lock */
+    pthread_rwlock_rdlock( &pgcache->pc_lock);
+    el = pgcache_find( pgcache, addr);
+    if( el != NULL && numblocks <= el->pe_num_blocks){
+        CACHE_EL_ADD_COUNT( el);
+        pgcache_prefetch_unref( el);
+        pthread_rwlock_unlock( &pgcache->pc_lock);
+        TRACE("end");
+        return( el);
+    }
+    pthread_rwlock_unlock( &pgcache->pc_lock);
+
+    /* we need to change the cache, look again because the page may 
+     * have been mapped while the lock was released */
+    for( tries = 0; ; tries++){
+        pthread_rwlock_wrlock( &pgcache->pc_lock);
+        el = pgcache_find( pgcache, addr);
+        if( el == NULL){
+            break;
+        }
 
-    /* loop in the cache, look if the elements is there already */
-    pthread_mutex_lock( &pgcache->pc_mutex);
-    for( i = 0; i < cache->ca_elements_capacity; i++){
-        cel = cache->ca_elements_ptr[i];
-
-        if( cel == NULL){
-            continue;
+        CACHE_EL_ADD_COUNT( el);
+        pgcache_prefetch_unref( el);
+        if( numblocks <= el->pe_num_blocks){ /* page already mapped, 
+                                              * with the size we need, 
+                                              * just return. */
+            goto exit0;
         }
-        if( cel->ce_id == addr){ /* element exist */
-            CACHE_EL_ADD_COUNT( cel);
-            el = (pgcache_element_t *) cel;
-            if( numblocks <= el->pe_num_blocks){ /* page already mapped, 
-                                                  * with the size we need, 
-                                                  * just return. */
-                goto exit0;
-            }else{ /* same address, but requires more blocks. So we will
-                      lock, flush, realloc, re-read and unlock. */
-                pthread_mutex_lock( &cel->ce_mutex); /* lock element */
-                if( (cel->ce_flags & CACHE_EL_DIRTY) != 0){
-                    pgcache_on_flush( cel); /* flush if needed */
-                }
-
-                /* realloc */ 
-                el->pe_mem_ptr = realloc( el->pe_mem_ptr, 
-                                          numblocks * KFS_BLOCKSIZE);
-
-                if( el->pe_mem_ptr == NULL){
-                    TRACE_ERR("malloc error");
-                    el = NULL;
-                    goto exit0;
-                }
-
-                rc = extent_read( pgcache->pc_fd, 
-                                  el->pe_mem_ptr, 
-                                  addr, 
-                                  numblocks);
-                if( rc != 0){
-                    TRACE_ERR("extent read error");
-                    free( el->pe_mem_ptr);
-                    el = NULL;
-                    goto exit0;
-                }
-                el->pe_num_blocks = numblocks;
-                pthread_mutex_unlock( &cel->ce_mutex); /* unlock element */
-                goto exit0;
+
+        /* same address, but requires more blocks. The element lock keeps
+         * it from being evicted once pc_lock is released for the read */
+        if( pthread_rwlock_trywrlock( &el->pe_rwlock) == 0){
+            pthread_rwlock_unlock( &pgcache->pc_lock);
+            if( pgcache_element_grow( pgcache, el, numblocks) != 0){
+                el = NULL;
             }
-            break;
+            TRACE("end");
+            return( el);
+        }
+
+        pthread_rwlock_unlock( &pgcache->pc_lock);
+        if( tries == PGCACHE_BUSY_TRIES){
+            TRACE_ERR("element busy, addr=%lu", addr);
+            errno = EBUSY;
+            return( NULL);
         }
+        sched_yield();
     }
 
     /* if we are here, the required page is not cached. Lets fix that. */
@@ -110,7 +297,13 @@ pgcache_element_t *pgcache_element_map( pgcache_t *pgcache,
     }
     
     el = ( pgcache_element_t *) p;
-    el->pe_mem_ptr = malloc( numblocks * KFS_BLOCKSIZE);
+    if( pgcache_element_init( el) != 0){
+        cache_element_mark_eviction( CACHE_EL( el));
+        el = NULL;
+        goto exit0;
+    }
+
+    el->pe_mem_ptr = malloc( KFS_BLOCKS_TO_BYTES( numblocks));
     if( el->pe_mem_ptr == NULL){
         TRACE_ERR("malloc error");
         cache_element_mark_eviction( CACHE_EL( el));
@@ -119,7 +312,8 @@ pgcache_element_t *pgcache_element_map( pgcache_t *pgcache,
     }
 
 
-    rc = extent_read( pgcache->pc_fd, el->pe_mem_ptr, addr, numblocks);
+    rc = ioq_read( pgcache->pc_ioq, el->pe_mem_ptr, addr, numblocks,
+                   IOQ_PRIO_META);
     if( rc != 0){
         TRACE_ERR("extent read error");
         free( el->pe_mem_ptr);
@@ -132,9 +326,10 @@ pgcache_element_t *pgcache_element_map( pgcache_t *pgcache,
     el->pe_block_addr = addr;
     el->pe_num_blocks = numblocks;
     el->pe_el.ce_id = (uint64_t) addr;
+    pgcache_prefetch_invalidate( pgcache, addr, numblocks);
  
 exit0:
-    pthread_mutex_unlock( &pgcache->pc_mutex);
+    pthread_rwlock_unlock( &pgcache->pc_lock);
     
     TRACE("end");
     return( el);
@@ -145,32 +340,22 @@ exit0:
 pgcache_element_t *pgcache_element_map_zero( pgcache_t *pgcache, 
                                              uint64_t addr, 
                                              int numblocks){
-    int i;
     pgcache_element_t *el;
-    cache_element_t *cel;
-    cache_t *cache = (cache_t *) pgcache;
     void *p;
     
     TRACE("start");
 
 
-    /* loop in the cache, look if the elements is there already */
-    pthread_mutex_lock( &pgcache->pc_mutex);
-    for( i = 0; i < cache->ca_elements_capacity; i++){
-        cel = cache->ca_elements_ptr[i];
-
-        if( cel == NULL){
-            continue;
-        }
-        if( cel->ce_id == addr){ /* element exist, not good to map zeroes
-                                  * blocks into an existing cache element
-                                  */
-            CACHE_EL_ADD_COUNT( cel);
-            TRACE("page cached already, addr=0x%lx,%lu", addr, addr);
-            el = NULL;
-            goto exit0;
-            break;
-        }
+    /* look if the element is there already */
+    pthread_rwlock_wrlock( &pgcache->pc_lock);
+    el = pgcache_find( pgcache, addr);
+    if( el != NULL){ /* element exist, not good to map zeroes
+                      * blocks into an existing cache element
+                      */
+        CACHE_EL_ADD_COUNT( el);
+        TRACE("page cached already, addr=0x%lx,%lu", addr, addr);
+        el = NULL;
+        goto exit0;
     }
 
     /* map cache element */
@@ -182,20 +367,28 @@ pgcache_element_t *pgcache_element_map_zero( pgcache_t *pgcache,
     }
     
     el = ( pgcache_element_t *) p;
-    el->pe_mem_ptr = malloc( numblocks * KFS_BLOCKSIZE);
+    if( pgcache_element_init( el) != 0){
+        cache_element_mark_eviction( CACHE_EL( el));
+        el = NULL;
+        goto exit0;
+    }
+
+    el->pe_mem_ptr = malloc( KFS_BLOCKS_TO_BYTES( numblocks));
     if( el->pe_mem_ptr == NULL){
         TRACE_ERR("malloc error");
+        cache_element_mark_eviction( CACHE_EL( el));
         el = NULL;
         goto exit0;
     }
 
-    memset( el->pe_mem_ptr, 0,  numblocks * KFS_BLOCKSIZE);
+    memset( el->pe_mem_ptr, 0,  KFS_BLOCKS_TO_BYTES( numblocks));
     el->pe_block_addr = addr;
     el->pe_num_blocks = numblocks;
     el->pe_el.ce_id = (uint64_t) addr;
+    pgcache_prefetch_invalidate( pgcache, addr, numblocks);
  
 exit0:
-    pthread_mutex_unlock( &pgcache->pc_mutex);
+    pthread_rwlock_unlock( &pgcache->pc_lock);
     
     TRACE("end");
     return( el);
@@ -203,7 +396,191 @@ exit0:
 
 
 
-pgcache_t *pgcache_alloc( int fd, int elements_capacity){
+/* place the blocks read by the prefetch worker into the cache. Only free
+ * cache elements are used and never more than pc_prefetch_max pages not
+ * referenced yet, otherwise the read is just dropped. It is dropped too
+ * if the request went stale during the read, pf is its queue entry */
+static void pgcache_prefetch_insert( pgcache_t *pgcache, 
+                                     pgcache_prefetch_t *pf,
+                                     void *mem){
+    cache_t *cache = (cache_t *) pgcache;
+    pgcache_element_t *el;
+    int budget;
+
+    pthread_rwlock_wrlock( &pgcache->pc_lock);
+
+    pthread_mutex_lock( &pgcache->pc_prefetch_mutex);
+    budget = ( pgcache->pc_prefetch_cached < pgcache->pc_prefetch_max &&
+               (pf->pf_flags & PGCACHE_PF_STALE) == 0);
+    pthread_mutex_unlock( &pgcache->pc_prefetch_mutex);
+
+    if( budget == 0 || 
+        cache->ca_elements_in_use >= cache->ca_elements_capacity ||
+        pgcache_find( pgcache, pf->pf_addr) != NULL){
+        free( mem);
+        goto exit0;
+    }
+
+    el = (pgcache_element_t *) cache_element_map( cache, 
+                                                  sizeof( pgcache_element_t));
+    if( el == NULL){
+        free( mem);
+        goto exit0;
+    }
+
+    if( pgcache_element_init( el) != 0){
+        free( mem);
+        cache_element_mark_eviction( CACHE_EL( el));
+        goto exit0;
+    }
+
+    el->pe_mem_ptr = mem;
+    el->pe_block_addr = pf->pf_addr;
+    el->pe_num_blocks = pf->pf_num_blocks;
+
+    /* an overlapping element may have been evicted meanwhile, the cache
+     * thread does it without pc_lock */
+    pthread_mutex_lock( &pgcache->pc_prefetch_mutex);
+    if( pf->pf_flags & PGCACHE_PF_STALE){
+        pthread_mutex_unlock( &pgcache->pc_prefetch_mutex);
+        cache_element_mark_eviction( CACHE_EL( el));
+        goto exit0;
+    }
+    el->pe_flags |= PGCACHE_EL_PREFETCHED;
+    el->pe_el.ce_id = pf->pf_addr;
+    pgcache->pc_prefetch_cached++;
+    pthread_mutex_unlock( &pgcache->pc_prefetch_mutex);
+
+exit0:
+    pthread_rwlock_unlock( &pgcache->pc_lock);
+}
+
+
+
+/* prefetch worker. Takes the request at the queue head, reads it without
+ * holding any cache lock, and removes it from the queue once it is done,
+ * so pgcache_prefetch() can see the requests in flight. */
+static void *pgcache_prefetch_thread( void *arg){
+    pgcache_t *pgcache = (pgcache_t *) arg;
+    pgcache_prefetch_t pf;
+    void *mem;
+    int rc;
+
+    pthread_mutex_lock( &pgcache->pc_prefetch_mutex);
+    while( (pgcache->pc_prefetch_flags & PGCACHE_PREFETCH_EXIT) == 0){
+        if( pgcache->pc_prefetch_num == 0){
+            pthread_cond_wait( &pgcache->pc_prefetch_cond, 
+                               &pgcache->pc_prefetch_mutex);
+            continue;
+        }
+
+        pf = pgcache->pc_prefetch_queue[pgcache->pc_prefetch_head];
+        pthread_mutex_unlock( &pgcache->pc_prefetch_mutex);
+
+        mem = malloc( KFS_BLOCKS_TO_BYTES( pf.pf_num_blocks));
+        if( mem == NULL){
+            TRACE_ERR("malloc error");
+        }else{
+            rc = ioq_read( pgcache->pc_ioq, mem, 
+                           pf.pf_addr, pf.pf_num_blocks, IOQ_PRIO_PREFETCH);
+            if( rc != 0){
+                TRACE_ERR("prefetch read error, addr=%lu", pf.pf_addr);
+                free( mem);
+            }else{
+                pgcache_prefetch_insert( pgcache, 
+                    &pgcache->pc_prefetch_queue[pgcache->pc_prefetch_head],
+                    mem);
+            }
+        }
+
+        pthread_mutex_lock( &pgcache->pc_prefetch_mutex);
+        pgcache->pc_prefetch_head = ( pgcache->pc_prefetch_head + 1) % 
+                                    PGCACHE_PREFETCH_QUEUE_LEN;
+        pgcache->pc_prefetch_num--;
+    }
+    pthread_mutex_unlock( &pgcache->pc_prefetch_mutex);
+
+    pthread_exit( NULL);
+}
+
+
+
+/* stop the prefetch worker, pending requests are dropped */
+static void pgcache_prefetch_stop( pgcache_t *pgcache){
+    if( (pgcache->pc_prefetch_flags & PGCACHE_PREFETCH_ACTIVE) == 0){
+        return;
+    }
+
+    pthread_mutex_lock( &pgcache->pc_prefetch_mutex);
+    pgcache->pc_prefetch_flags |= PGCACHE_PREFETCH_EXIT;
+    pthread_cond_signal( &pgcache->pc_prefetch_cond);
+    pthread_mutex_unlock( &pgcache->pc_prefetch_mutex);
+
+    pthread_join( pgcache->pc_prefetch_thread, NULL);
+    pgcache->pc_prefetch_flags = 0;
+    pgcache->pc_prefetch_num = 0;
+}
+
+
+
+int pgcache_prefetch( pgcache_t *pgcache, uint64_t addr, int numblocks){
+    pgcache_element_t *el;
+    pgcache_prefetch_t *pf;
+    int i, sub, rc = 0;
+
+    if( numblocks <= 0 || numblocks > PGCACHE_PREFETCH_MAX_BLOCKS){
+        TRACE_ERR("invalid number of blocks to prefetch, %d", numblocks);
+        return( -1);
+    }
+
+    if( (pgcache->pc_prefetch_flags & PGCACHE_PREFETCH_ACTIVE) == 0){
+        TRACE_ERR("prefetch worker is not running");
+        return( -1);
+    }
+
+    /* already cached, nothing to do */
+    pthread_rwlock_rdlock( &pgcache->pc_lock);
+    el = pgcache_find( pgcache, addr);
+    if( el != NULL && el->pe_num_blocks >= numblocks){
+        pthread_rwlock_unlock( &pgcache->pc_lock);
+        return( 0);
+    }
+    pthread_rwlock_unlock( &pgcache->pc_lock);
+
+    pthread_mutex_lock( &pgcache->pc_prefetch_mutex);
+
+    /* queued or in flight already */
+    for( i = 0; i < pgcache->pc_prefetch_num; i++){
+        sub = ( pgcache->pc_prefetch_head + i) % PGCACHE_PREFETCH_QUEUE_LEN;
+        pf = &pgcache->pc_prefetch_queue[sub];
+        if( pf->pf_addr == addr && pf->pf_num_blocks >= numblocks &&
+            (pf->pf_flags & PGCACHE_PF_STALE) == 0){
+            goto exit0;
+        }
+    }
+
+    if( pgcache->pc_prefetch_num == PGCACHE_PREFETCH_QUEUE_LEN){
+        rc = 1;
+        goto exit0;
+    }
+
+    sub = ( pgcache->pc_prefetch_head + pgcache->pc_prefetch_num) % 
+          PGCACHE_PREFETCH_QUEUE_LEN;
+    pf = &pgcache->pc_prefetch_queue[sub];
+    pf->pf_addr = addr;
+    pf->pf_num_blocks = numblocks;
+    pf->pf_flags = 0;
+    pgcache->pc_prefetch_num++;
+    pthread_cond_signal( &pgcache->pc_prefetch_cond);
+
+exit0:
+    pthread_mutex_unlock( &pgcache->pc_prefetch_mutex);
+    return( rc);
+}
+
+
+
+pgcache_t *pgcache_alloc( bdev_t *bdev, int elements_capacity){
     pgcache_t *pgcache;
     int rc;
 
@@ -228,14 +605,37 @@ pgcache_t *pgcache_alloc( int fd, int elements_capacity){
     }
 
 
-    if( pthread_mutex_init( &pgcache->pc_mutex, NULL) != 0) { 
-        TRACE_ERR("mutex init has failed");
+    pgcache->pc_ioq = ioq_alloc( bdev);
+    if( pgcache->pc_ioq == NULL){
+        TRACE_ERR("IO queue init has failed"); 
+        free( pgcache);
+        pgcache = NULL;
+        goto exit0;
+    }
+
+    if( pthread_rwlock_init( &pgcache->pc_lock, NULL) != 0) { 
+        TRACE_ERR("rwlock init has failed");
+        ioq_destroy( pgcache->pc_ioq);
+        free( pgcache);
+        pgcache = NULL;
+        goto exit0;
+    }
+
+    if( pthread_mutex_init( &pgcache->pc_prefetch_mutex, NULL) != 0 ||
+        pthread_cond_init( &pgcache->pc_prefetch_cond, NULL) != 0){ 
+        TRACE_ERR("prefetch mutex init has failed");
+        pthread_rwlock_destroy( &pgcache->pc_lock);
+        ioq_destroy( pgcache->pc_ioq);
         free( pgcache);
         pgcache = NULL;
         goto exit0;
     }
 
-    pgcache->pc_fd = fd;
+    pgcache->pc_bdev = bdev;
+    pgcache->pc_prefetch_max = elements_capacity / PGCACHE_PREFETCH_RATIO;
+    if( pgcache->pc_prefetch_max == 0){
+        pgcache->pc_prefetch_max = 1;
+    }
 
 exit0:
     TRACE("end");
@@ -247,8 +647,14 @@ exit0:
 
 int pgcache_destroy( pgcache_t *pgcache){
     TRACE("start");
-    pthread_mutex_destroy( &pgcache->pc_mutex);
+    pgcache_prefetch_stop( pgcache);
     cache_disable( &pgcache->pc_cache);
+
+    /* after cache_disable(), the last dirty pages go through the queue */
+    ioq_destroy( pgcache->pc_ioq);
+    pthread_rwlock_destroy( &pgcache->pc_lock);
+    pthread_cond_destroy( &pgcache->pc_prefetch_cond);
+    pthread_mutex_destroy( &pgcache->pc_prefetch_mutex);
     free( pgcache);
     TRACE("end");
 
@@ -258,6 +664,13 @@ int pgcache_destroy( pgcache_t *pgcache){
 /* locking call, alloc a cache, start it, and wait for it to be running. */
 int pgcache_enable_sync( pgcache_t *pgcache){
     int rc = 0; 
+
+    rc = ioq_start( pgcache->pc_ioq);
+    if( rc != 0){
+        TRACE_ERR("Issues in ioq_start()");
+        goto exit1;
+    }
+
     rc = cache_enable( CACHE(pgcache) );
     if( rc != 0){
         TRACE_ERR("Issues in cache_enable()");
@@ -269,7 +682,18 @@ int pgcache_enable_sync( pgcache_t *pgcache){
                                PGCACHE_DEFAULT_TIMEOUT);
     if( rc != 0){
         TRACE_ERR("timeout waiting for CACHE_ACTIVE flag");
+        goto exit1;
+    }
+
+    rc = pthread_create( &pgcache->pc_prefetch_thread,
+                         NULL,
+                         pgcache_prefetch_thread,
+                         pgcache);
+    if( rc != 0){
+        TRACE_ERR("pthread_create() failed for prefetch worker");
+        goto exit1;
     }
+    pgcache->pc_prefetch_flags |= PGCACHE_PREFETCH_ACTIVE;
 
 exit1:
     return( rc);
@@ -282,7 +706,7 @@ pgcache_element_t *pgcache_element_map_sync( pgcache_t *pgcache,
     pgcache_element_t *el;
     int rc = 0;
 
-    el = pgcache_element_map( pgcache, 0, 1);
+    el = pgcache_element_map( pgcache, addr, numblocks);
     if( el == NULL){
         TRACE_ERR("Issues in pgcache_element_map()");
         goto exit1;
@@ -5,32 +5,91 @@
 #include <stdint.h>
 #include "trace.h"
 #include "cache.h"
+#include "ioq.h"
+#include "bdev.h"
 
 
 #define PGCACHE_DEFAULT_TIMEOUT          10 /* timeout in seconds */
+#define PGCACHE_BUSY_TRIES               100 /* tries for the lock of an
+                                                element to grow */
+
+/* prefetch limits. The queue holds the pending and in flight requests, a 
+ * request bigger than PGCACHE_PREFETCH_MAX_BLOCKS is refused, and no more 
+ * than 1/PGCACHE_PREFETCH_RATIO of the cache capacity can be held by 
+ * prefetched pages not referenced yet. */
+#define PGCACHE_PREFETCH_QUEUE_LEN       64
+#define PGCACHE_PREFETCH_MAX_BLOCKS      64
+#define PGCACHE_PREFETCH_RATIO           4
 
 typedef struct{
     cache_element_t pe_el;
     void *pe_mem_ptr;   /* ptr to memory */
     uint64_t pe_block_addr;           /* block mapped */
     int pe_num_blocks; /* num of blocks */
+
+#define PGCACHE_EL_PREFETCHED            0x0001 /* mapped by the prefetch 
+                                                   worker, nobody has 
+                                                   referenced it yet */
+#define PGCACHE_EL_RWLOCK                0x0002 /* pe_rwlock is ready */
+    uint32_t pe_flags;
+
+    /* shared/exclusive access to the mapped blocks. Readers and the 
+     * flusher take it shared, only mutators take it exclusive */
+    pthread_rwlock_t pe_rwlock;
 }pgcache_element_t;
 
 
+/* a prefetch request, stays in the queue until the read is done */
 typedef struct{
-    cache_t pc_cache;
-    int pc_fd;
+    uint64_t pf_addr;
+    int pf_num_blocks;
+
+#define PGCACHE_PF_STALE                 0x0001 /* some of the blocks were
+                                                   mapped or evicted after
+                                                   the request, the read may
+                                                   be older than the device,
+                                                   it is dropped */
+    uint32_t pf_flags;
+}pgcache_prefetch_t;
 
-    /* mutex for this cache */
-    pthread_mutex_t pc_mutex;
+
+typedef struct{
+    cache_t pc_cache;
+    bdev_t *pc_bdev;   /* not owned, the caller closes it */
+
+    /* all the device IO goes through this queue, so cache misses are
+     * served before the flusher and prefetch traffic */
+    ioq_t *pc_ioq;
+
+    /* lock for this cache, lookups take it shared and map takes it
+     * exclusive, so a page is not mapped twice. The cache thread flushes
+     * and evicts without it, it only tries the element lock and leaves
+     * the busy elements for later */
+    pthread_rwlock_t pc_lock;
+
+    /* prefetch queue and worker thread */
+    pgcache_prefetch_t pc_prefetch_queue[PGCACHE_PREFETCH_QUEUE_LEN];
+    int pc_prefetch_head;
+    int pc_prefetch_num;
+    uint32_t pc_prefetch_cached; /* prefetched pages not referenced yet */
+    uint32_t pc_prefetch_max;    /* upper limit for pc_prefetch_cached */
+
+#define PGCACHE_PREFETCH_ACTIVE          0x0001 /* worker is running */
+#define PGCACHE_PREFETCH_EXIT            0x0002 /* worker should finish */
+    uint32_t pc_prefetch_flags;
+    pthread_mutex_t pc_prefetch_mutex;
+    pthread_cond_t pc_prefetch_cond;
+    pthread_t pc_prefetch_thread;
 }pgcache_t;
 
 
-/* create and init a page cache_t structure */
-pgcache_t *pgcache_alloc( int fd, int elements_capacity);
+/* create and init a page cache_t structure over the bdev backend */
+pgcache_t *pgcache_alloc( bdev_t *bdev, int elements_capacity);
 int pgcache_destroy( pgcache_t *pgcache);
 
-/* map a number of blocks from the device into memory */
+/* map a number of blocks from the device into memory. A page cached with
+ * fewer blocks grows, if its element stays locked by somebody else, NULL
+ * is returned with errno EBUSY */
 pgcache_element_t *pgcache_element_map( pgcache_t *cache, 
                                         uint64_t addr, 
                                         int numblocks );
@@ -54,6 +113,21 @@ pgcache_element_t *pgcache_element_map_sync( pgcache_t *cache,
 /* pgcache element sync */
 int pgcache_element_sync( pgcache_element_t *el);
 
+/* hint the page cache that numblocks blocks starting in addr will be 
+ * needed soon. The read is queued for the prefetch worker and this call 
+ * never blocks on IO. Prefetched pages only take free cache elements, so
+ * pinned or referenced pages are never evicted because of a prefetch.
+ * Return 0 if the range was queued, is already cached or is in flight, 
+ * 1 if the request was dropped because the queue is full, -1 on error. */
+int pgcache_prefetch( pgcache_t *pgcache, uint64_t addr, int numblocks);
+
+/* shared/exclusive access to the blocks mapped by a cache element. Never
+ * wait for CACHE_EL_CLEAN holding the write lock, the flusher needs the 
+ * read lock to write the blocks out */
+int pgcache_element_read_lock( pgcache_element_t *el);
+int pgcache_element_write_lock( pgcache_element_t *el);
+int pgcache_element_unlock( pgcache_element_t *el);
+
 #define PGCACHE_EL_MARK_DIRTY(x)    cache_element_mark_dirty( \
                                              CACHE_EL(x));
  
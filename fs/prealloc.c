@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trace.h"
+#include "prealloc.h"
+
+
+
+void prealloc_init( prealloc_t *pa, agmap_t *am, uint64_t max_len){
+    memset( (void *) pa, 0, sizeof( prealloc_t));
+    pa->pa_map = am;
+    pa->pa_max_len = max_len;
+}
+
+
+
+/* take a new tail after the last extent, as big as the object up to
+ * PREALLOC_MAX_BITS. Nothing happens if the bits after it are in use */
+static void pa_tail_grow( prealloc_t *pa){
+    uint64_t used, spec;
+
+    spec = max( min( pa->pa_size, (uint64_t) PREALLOC_MAX_BITS),
+                (uint64_t) PREALLOC_MIN_BITS);
+
+    used = pa->pa_len + pa->pa_tail;
+    if( pa->pa_max_len != 0){
+        if( used >= pa->pa_max_len){
+            return;
+        }
+        spec = min( spec, pa->pa_max_len - used);
+    }
+
+    if( agmap_grow( pa->pa_map, pa->pa_addr, used, spec, 0) == 0){
+        pa->pa_tail += spec;
+    }
+}
+
+
+
+int prealloc_get( prealloc_t *pa, uint64_t goal, uint64_t len, int reserved,
+                  uint64_t *addr){
+    uint64_t t, need;
+    int rc;
+
+    *addr = 0;
+    if( len == 0){
+        return( -1);
+    }
+
+    /* the tail first, then the extent grows in place for the rest */
+    if( pa->pa_len > 0 &&
+        ( pa->pa_max_len == 0 || pa->pa_len + len <= pa->pa_max_len)){
+        t = min( len, pa->pa_tail);
+        need = len - t;
+        if( need == 0 ||
+            agmap_grow( pa->pa_map, pa->pa_addr, pa->pa_len + pa->pa_tail,
+                        need, reserved) == 0){
+
+            /* the tail was taken already, the reservation is not needed */
+            if( reserved && t > 0){
+                agmap_unreserve( pa->pa_map, t);
+            }
+
+            *addr = pa->pa_addr + pa->pa_len;
+            pa->pa_len += len;
+            pa->pa_tail -= t;
+            pa->pa_size += len;
+            goto exit0;
+        }
+    }
+
+    /* a new extent, as close as possible to the last one */
+    if( prealloc_trim( pa) != 0){
+        return( -1);
+    }
+
+    if( goal == FALLOC_NO_GOAL && pa->pa_len > 0){
+        goal = pa->pa_addr + pa->pa_len;
+    }
+
+    rc = reserved ?
+         agmap_get_reserved( pa->pa_map, AG_ANY_GROUP, goal, len, addr) :
+         agmap_get( pa->pa_map, AG_ANY_GROUP, goal, len, addr);
+    if( rc != 0){
+        return( -1);
+    }
+
+    pa->pa_addr = *addr;
+    pa->pa_len = len;
+    pa->pa_size += len;
+
+exit0:
+    if( pa->pa_tail == 0){
+        pa_tail_grow( pa);
+    }
+    return( 0);
+}
+
+
+
+int prealloc_trim( prealloc_t *pa){
+    if( pa->pa_tail == 0){
+        return( 0);
+    }
+
+    if( agmap_put( pa->pa_map, pa->pa_addr + pa->pa_len, pa->pa_tail) != 0){
+        TRACE_ERR("Could not free the tail, addr=%lu, len=%lu",
+                  pa->pa_addr + pa->pa_len, pa->pa_tail);
+        return( -1);
+    }
+
+    pa->pa_tail = 0;
+    return( 0);
+}
+
@@ -0,0 +1,48 @@
+#ifndef _PREALLOC_H_
+#define _PREALLOC_H_
+
+#include <stdint.h>
+#include "agroup.h"
+
+
+/* speculative preallocation for growing objects, like the data of a file
+ * or an edges list. Every time an object needs more bits a tail is taken
+ * too after them, proportional to the object size, so the next requests
+ * are served from the tail or by growing the same extent in place while
+ * the bits after it are free. Steady appends stay in a single extent
+ * without moving data around.
+ *
+ * The tail is in use in the map, prealloc_trim() gives it back when the
+ * object is closed or evicted. */
+#define PREALLOC_MIN_BITS                8
+#define PREALLOC_MAX_BITS                2048
+
+typedef struct{
+    agmap_t *pa_map;              /* not owned */
+    uint64_t pa_max_len;          /* longest extent, 0 for any */
+
+    uint64_t pa_addr;             /* last extent of the object */
+    uint64_t pa_len;              /* bits of it in use, 0 if there is none */
+    uint64_t pa_tail;             /* bits after them, taken but not used */
+    uint64_t pa_size;             /* bits given to the object */
+}prealloc_t;
+
+
+/* the object has no bits yet, its extents are taken from am, and never
+ * longer than max_len bits if it is not 0 */
+void prealloc_init( prealloc_t *pa, agmap_t *am, uint64_t max_len);
+
+/* len bits more for the object, from the tail, growing the last extent in
+ * place, or in a new extent near goal, FALLOC_NO_GOAL for the best fit.
+ * With reserved the len bits come from a reservation, see agmap_reserve(),
+ * the tail never does. Return 0 and set *addr, the bits follow the last
+ * ones when *addr is the end of the previous request, or -1 */
+int prealloc_get( prealloc_t *pa, uint64_t goal, uint64_t len, int reserved,
+                  uint64_t *addr);
+
+/* give back the tail not used */
+int prealloc_trim( prealloc_t *pa);
+
+
+#endif
+
@@ -1,8 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "kfs_disk.h"
+#include "eio.h"
 
 int main(){
+    uint32_t bs;
+
     printf("kfs_extent_header_t=%ld\n", sizeof( kfs_extent_header_t));
     printf("kfs_extent_t=%ld\n", sizeof( kfs_extent_t));
     printf("kfs_slot_t=%ld\n", sizeof( kfs_slot_t));
@@ -14,13 +17,16 @@ int main(){
     printf("kfs_si_table_t=%ld\n", sizeof( kfs_si_table_t));
     printf("kfs_blockmap_t=%ld\n", sizeof( kfs_blockmap_t));
     printf("kfs_superblock_t=%ld\n", sizeof( kfs_superblock_t));
-    printf("Blocksize=%d\n", KFS_BLOCKSIZE);
-    printf("SlotPerBlock=%ld, remaining=%ld\n", 
-            KFS_BLOCKSIZE/sizeof( kfs_slot_t),
-            KFS_BLOCKSIZE%sizeof( kfs_slot_t));
-     printf("SinodePerBlock=%ld, remaining=%ld\n", 
-            KFS_BLOCKSIZE/sizeof( kfs_sinode_t),
-            KFS_BLOCKSIZE%sizeof( kfs_sinode_t));
+    for( bs = KFS_BLOCKSIZE_MIN; bs <= KFS_BLOCKSIZE_MAX; bs <<= 1){
+        kfs_set_blocksize( bs);
+        printf("Blocksize=%d\n", KFS_BLOCKSIZE);
+        printf("SlotPerBlock=%ld, remaining=%ld\n", 
+                KFS_BLOCKSIZE/sizeof( kfs_slot_t),
+                KFS_BLOCKSIZE%sizeof( kfs_slot_t));
+         printf("SinodePerBlock=%ld, remaining=%ld\n", 
+                KFS_BLOCKSIZE/sizeof( kfs_sinode_t),
+                KFS_BLOCKSIZE%sizeof( kfs_sinode_t));
+    }
     return(0);
 }
 
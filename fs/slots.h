@@ -2,6 +2,7 @@
 #define _SLOTS_H_
 
 #include "kfs_super.h"
+#include "dict_codec.h"
 
 
 
@@ -23,12 +24,21 @@ int slot_set_owner( slot_t *s,
                     uint64_t inode, 
                     uint16_t edge, 
                     uint16_t flags);
-int slot_set_dict( slot_t *s, dict_t d); /* set new key-values to slot */
+int slot_set_dict( slot_t *s, dict_t *d); /* set new key-values to slot */
 int slot_dump( slot_t *slot); /* dump slot */
 int slot_destroy( slot_t *slot);
 int slot_write( slot_t *slot); /* flush the slot to disk */
 int slot_close( slot_t *slot); /* close slot */
 int slot_evict( uint64_t slot_id); /* evict a slot from storage*/
+
+/* decode len bytes of records into d, a new dict, inline for a few records
+ * or in an arena. They are compact records if flags, the slot flags, have
+ * SLOT_COMPACT, with the shared keys of keys, or kfs_slot_data_t records.
+ * Reads which do not keep the dict should use a dict_view_t over the page
+ * instead, see dict_view.h */
+int kfs_slot_dict_load( unsigned char *p, uint32_t len, uint16_t flags,
+                        dict_keys_t *keys, dict_t *d);
+
 /**************************************************************************
  * KEY-VALUES SLOTS BEHAVIOR
  * If only read key values and ownership is required, the peek functions are 
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "map.h"
+#include "agroup.h"
+
+#define TEST_MAP_BITS                    ( 1 << 20)
+#define TEST_GROUP_BITS                  ( 1 << 16)
+#define TEST_THREADS                     4
+#define TEST_ALLOCS                      4000
+
+
+typedef struct{
+    agmap_t *am;
+    int flags;
+    uint64_t addr[TEST_ALLOCS];
+    uint64_t len[TEST_ALLOCS];
+    int n;
+    int own_group;                /* allocations in the thread group */
+}test_thread_t;
+
+
+static unsigned char map[TEST_MAP_BITS / 8];
+
+
+void *test_thread( void *arg){
+    test_thread_t *t = (test_thread_t *) arg;
+    int i, group = agmap_thread_group( t->am);
+
+    for( i = 0; i < TEST_ALLOCS; i++){
+        t->len[t->n] = ( t->flags & AGMAP_EXTENTS) ? 1 + rand() % 16 : 1;
+        if( agmap_get( t->am, AG_ANY_GROUP, FALLOC_NO_GOAL, t->len[t->n],
+                       &t->addr[t->n]) != 0){
+            continue;
+        }
+
+        if( agmap_group( t->am, t->addr[t->n]) == group){
+            t->own_group++;
+        }
+        t->n++;
+    }
+
+    return( NULL);
+}
+
+
+int test_groups( uint32_t flags){
+    test_thread_t *t;
+    pthread_t th[TEST_THREADS];
+    agmap_t *am;
+    uint64_t used = 0, count, goal, near[3];
+    int i, j, rc = 0;
+
+    memset( map, 0, sizeof( map));
+    am = agmap_alloc( map, TEST_MAP_BITS, TEST_GROUP_BITS, flags);
+    t = calloc( TEST_THREADS, sizeof( test_thread_t));
+    if( am == NULL || t == NULL || am->am_groups_num != 16){
+        printf("Allocation groups not built\n");
+        return( -1);
+    }
+
+    for( i = 0; i < TEST_THREADS; i++){
+        t[i].am = am;
+        t[i].flags = flags;
+        pthread_create( &th[i], NULL, test_thread, &t[i]);
+    }
+
+    for( i = 0; i < TEST_THREADS; i++){
+        pthread_join( th[i], NULL);
+        if( t[i].n != TEST_ALLOCS || t[i].own_group != TEST_ALLOCS){
+            printf("Thread %d, %d allocations, %d in its group\n", i,
+                   t[i].n, t[i].own_group);
+            rc = -1;
+        }
+
+        for( j = 0; j < t[i].n; j++){
+            used += t[i].len[j];
+        }
+    }
+
+    /* no extent was given twice, the map has the bits of all of them */
+    for( i = 0, count = 0; i < TEST_MAP_BITS; i++){
+        count += bm_get_bit( map, TEST_MAP_BITS, i);
+    }
+    if( count != used || agmap_free_bits( am) != TEST_MAP_BITS - used){
+        printf("Used bits do not match, map=%lu, expected=%lu\n", count,
+               used);
+        rc = -1;
+    }
+
+    /* with a goal, in the group of the goal and outward from it */
+    goal = 10 * TEST_GROUP_BITS + 5;
+    for( i = 0; i < 3; i++){
+        if( agmap_get( am, AG_ANY_GROUP, goal, 1, &near[i]) != 0){
+            near[i] = 0;
+        }
+    }
+    if( near[0] != goal || near[1] != goal + 1 || near[2] != goal - 1){
+        printf("Goal not used, got %lu %lu %lu\n", near[0], near[1],
+               near[2]);
+        rc = -1;
+    }
+    for( i = 0; i < 3; i++){
+        agmap_put( am, near[i], 1);
+    }
+
+    /* extents never span groups */
+    if( agmap_put( am, TEST_GROUP_BITS - 1, 2) == 0){
+        printf("Free across groups did not fail\n");
+        rc = -1;
+    }
+
+    for( i = 0; i < TEST_THREADS; i++){
+        for( j = 0; j < t[i].n; j++){
+            if( agmap_put( am, t[i].addr[j], t[i].len[j]) != 0){
+                rc = -1;
+            }
+        }
+    }
+
+    if( agmap_free_bits( am) != TEST_MAP_BITS){
+        printf("Not everything freed\n");
+        rc = -1;
+    }
+
+    agmap_free( am);
+    free( t);
+    return( rc);
+}
+
+
+int main(){
+    int rc;
+
+    rc = test_groups( 0);
+    printf("allocation groups, bits: %s\n", rc == 0 ? "PASSED" : "FAILED");
+
+    rc |= test_groups( AGMAP_EXTENTS);
+    printf("allocation groups, extents: %s\n",
+           rc == 0 ? "PASSED" : "FAILED");
+
+    return( rc);
+}
+
@@ -197,7 +197,6 @@ int main( int argc, char **argv){
     cache_element_mark_dirty( el5);
     rc = cache_destroy( cache);
 
-    cache_dump( cache);
     return( rc);
 }
 
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "map.h"
+#include "agroup.h"
+#include "page_cache.h"
+#include "dalloc.h"
+
+#define TEST_MAP_BITS                    4096
+#define TEST_GROUP_BITS                  1024
+#define TEST_OBJECTS                     2
+#define TEST_APPENDS                     200
+#define TEST_APPEND_LEN                  300
+#define TEST_STEADY_BLOCKS               100
+
+
+static unsigned char map[TEST_MAP_BITS / 8];
+
+
+/* the data is in the page cache at the extents */
+int check_data( pgcache_t *pgcache, kfs_extent_t *ex, int n,
+                unsigned char *data, uint64_t len){
+    pgcache_element_t *el;
+    uint64_t done = 0, bytes;
+    int i;
+
+    for( i = 0; i < n; i++){
+        el = pgcache_element_map( pgcache, ex[i].ee_block_addr,
+                                  ex[i].ee_block_size);
+        bytes = min( KFS_BLOCKS_TO_BYTES( ex[i].ee_block_size), len - done);
+        if( el == NULL || memcmp( el->pe_mem_ptr, data + done, bytes) != 0){
+            printf("Data does not match in extent %d\n", i);
+            return( -1);
+        }
+        done += bytes;
+    }
+
+    return( done == len ? 0 : -1);
+}
+
+
+int main(){
+    static unsigned char data[TEST_OBJECTS][TEST_APPENDS * TEST_APPEND_LEN +
+                                            TEST_APPEND_LEN];
+    dalloc_t da[TEST_OBJECTS];
+    pgcache_element_t *el;
+    kfs_extent_t ex[TEST_OBJECTS][4];
+    int n[TEST_OBJECTS];
+    bdev_t *bdev;
+    pgcache_t *pgcache;
+    agmap_t *am;
+    uint64_t blocks, addr, len = TEST_APPENDS * TEST_APPEND_LEN;
+    int i, j, rc = 0;
+
+    bdev = bdev_open_ram( NULL, KFS_BLOCKS_TO_BYTES( TEST_MAP_BITS), 0);
+    pgcache = ( bdev != NULL) ? pgcache_alloc( bdev, 32) : NULL;
+    if( pgcache == NULL || pgcache_enable_sync( pgcache) != 0){
+        printf("Page cache not ready\n");
+        return( -1);
+    }
+
+    memset( map, 0, sizeof( map));
+    am = agmap_alloc( map, TEST_MAP_BITS, TEST_GROUP_BITS, AGMAP_EXTENTS);
+    if( am == NULL){
+        printf("Allocation groups not built\n");
+        return( -1);
+    }
+
+    /* small appends to both objects in turn, nothing allocated yet. Each
+     * object has its own goal, like the block of its sinode */
+    for( i = 0; i < TEST_OBJECTS; i++){
+        dalloc_init( &da[i], am, pgcache, i * TEST_GROUP_BITS);
+        for( j = 0; j < (int) sizeof( data[i]); j++){
+            data[i][j] = (unsigned char) rand();
+        }
+    }
+
+    for( j = 0; j < TEST_APPENDS; j++){
+        for( i = 0; i < TEST_OBJECTS; i++){
+            if( dalloc_write( &da[i], j * TEST_APPEND_LEN,
+                              data[i] + j * TEST_APPEND_LEN,
+                              TEST_APPEND_LEN) != 0){
+                printf("Append %d to object %d failed\n", j, i);
+                rc = -1;
+            }
+        }
+    }
+
+    blocks = KFS_BYTES_TO_BLOCKS( len + KFS_BLOCKSIZE - 1);
+    if( agmap_free_bits( am) != TEST_MAP_BITS ||
+        am->am_avail != TEST_MAP_BITS - TEST_OBJECTS * blocks){
+        printf("Blocks not reserved, avail=%lu\n", am->am_avail);
+        rc = -1;
+    }
+
+    /* out of the dirty range, the caller should flush first */
+    if( dalloc_write( &da[0], len + 1, data[0], 1) != 1){
+        printf("Write out of range accepted\n");
+        rc = -1;
+    }
+
+    /* the reserved blocks can not be taken by anybody else */
+    if( agmap_get( am, AG_ANY_GROUP, FALLOC_NO_GOAL,
+                   TEST_MAP_BITS - TEST_OBJECTS * blocks + 1, &addr) == 0 ||
+        agmap_reserve( am, TEST_MAP_BITS) == 0){
+        printf("Reserved blocks were taken\n");
+        rc = -1;
+    }
+
+    /* a single extent per object, with its data */
+    for( i = 0; i < TEST_OBJECTS; i++){
+        n[i] = dalloc_flush( &da[i], ex[i], 4);
+        if( n[i] != 1 || ex[i][0].ee_block_size != blocks ||
+            ex[i][0].ee_block_addr != i * TEST_GROUP_BITS ||
+            ex[i][0].ee_log_addr != 0){
+            printf("Object %d flushed in %d extents\n", i, n[i]);
+            rc = -1;
+            continue;
+        }
+        rc |= check_data( pgcache, ex[i], n[i], data[i], len);
+    }
+
+    /* the tails taken after the extents are in use too */
+    if( agmap_free_bits( am) != TEST_MAP_BITS - TEST_OBJECTS * blocks -
+                                da[0].da_prealloc.pa_tail -
+                                da[1].da_prealloc.pa_tail ||
+        da[0].da_prealloc.pa_tail == 0 ||
+        am->am_avail != agmap_free_bits( am) || da[0].da_reserved != 0){
+        printf("Reservation not consumed, avail=%lu\n", am->am_avail);
+        rc = -1;
+    }
+
+    /* an append at the end of the data goes on in the partial last block,
+     * the flush rewrites it in place */
+    if( dalloc_write( &da[0], len, data[0] + len, 10) != 0 ||
+        dalloc_flush( &da[0], ex[0] + 1, 3) != 1 ||
+        ex[0][1].ee_log_addr != blocks - 1 ||
+        ex[0][1].ee_block_size != 1 ||
+        ex[0][1].ee_block_addr != ex[0][0].ee_block_addr + blocks - 1 ||
+        check_data( pgcache, ex[0], 1, data[0], len + 10) != 0){
+        printf("Append after the flush not placed in the last block\n");
+        rc = -1;
+    }
+
+    /* the next range starts after the flushed blocks, close to them */
+    if( dalloc_write( &da[0], KFS_BLOCKS_TO_BYTES( blocks), data[0], 10) != 0
+        || dalloc_flush( &da[0], ex[0] + 1, 3) != 1 ||
+        ex[0][1].ee_log_addr != blocks ||
+        ex[0][1].ee_block_addr != ex[0][0].ee_block_addr + blocks){
+        printf("Second range not placed after the first one\n");
+        rc = -1;
+    }
+
+    /* a range dropped gives its reservation and its tail back */
+    dalloc_write( &da[1], KFS_BLOCKS_TO_BYTES( blocks), data[1], len);
+    dalloc_destroy( &da[1]);
+    if( am->am_avail != agmap_free_bits( am) ||
+        agmap_free_bits( am) != TEST_MAP_BITS - 2 * blocks - 1 -
+                                da[0].da_prealloc.pa_tail){
+        printf("Reservation not given back\n");
+        rc = -1;
+    }
+    dalloc_destroy( &da[0]);
+
+    /* steady appends flushed one block at a time grow a single extent */
+    dalloc_init( &da[0], am, pgcache, 2 * TEST_GROUP_BITS);
+    for( j = 0; j < TEST_STEADY_BLOCKS; j++){
+        if( dalloc_write( &da[0], KFS_BLOCKS_TO_BYTES( j), data[0],
+                          KFS_BLOCKSIZE) != 0 ||
+            dalloc_flush( &da[0], ex[0], 4) != 1 ||
+            ex[0][0].ee_block_addr != 2 * TEST_GROUP_BITS + j){
+            printf("Append %d not placed in place\n", j);
+            rc = -1;
+            break;
+        }
+    }
+
+    dalloc_destroy( &da[0]);
+    if( agmap_free_bits( am) != TEST_MAP_BITS - 2 * blocks - 1 -
+                                TEST_STEADY_BLOCKS ||
+        am->am_avail != agmap_free_bits( am)){
+        printf("Tail not trimmed, free=%lu\n", agmap_free_bits( am));
+        rc = -1;
+    }
+
+    /* small appends flushed one by one fill the blocks in a single
+     * extent, no block is taken per flush. The partial block is written
+     * again thru the element holding it */
+    dalloc_init( &da[0], am, pgcache, 3 * TEST_GROUP_BITS);
+    for( j = 0; j < TEST_APPENDS; j++){
+        n[0] = dalloc_write( &da[0], j * TEST_APPEND_LEN,
+                             data[0] + j * TEST_APPEND_LEN, TEST_APPEND_LEN);
+        if( n[0] != 0 || dalloc_flush( &da[0], ex[0], 4) != 1 ||
+            ex[0][0].ee_block_addr != 3 * TEST_GROUP_BITS +
+                              KFS_BYTES_TO_BLOCKS( j * TEST_APPEND_LEN)){
+            printf("Small append %d not placed in place\n", j);
+            rc = -1;
+            break;
+        }
+
+        el = pgcache_element_map( pgcache, da[0].da_el_addr, 
+                                  da[0].da_el_blocks);
+        if( ( da[0].da_flags & DALLOC_PARTIAL) && ( el == NULL ||
+            memcmp( (unsigned char *) el->pe_mem_ptr + KFS_BLOCKS_TO_BYTES(
+                        da[0].da_block_addr - da[0].da_el_addr),
+                    data[0] + da[0].da_offset, da[0].da_len) != 0)){
+            printf("Small append %d not in the page cache\n", j);
+            rc = -1;
+            break;
+        }
+    }
+
+    dalloc_destroy( &da[0]);
+    if( agmap_free_bits( am) != TEST_MAP_BITS - 3 * blocks - 1 -
+                                TEST_STEADY_BLOCKS){
+        printf("Small appends took %lu blocks\n", TEST_MAP_BITS - 
+               agmap_free_bits( am) - 2 * blocks - 1 - TEST_STEADY_BLOCKS);
+        rc = -1;
+    }
+
+    agmap_free( am);
+    pgcache_destroy( pgcache);
+    bdev_close( bdev);
+
+    printf("delayed allocation: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
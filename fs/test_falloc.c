@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "map.h"
+#include "map_summary.h"
+#include "falloc.h"
+
+#define TEST_MAP_BITS                    65536
+#define TEST_EXTENTS                     2000
+
+
+typedef struct{
+    uint64_t addr;
+    uint64_t len;
+}test_extent_t;
+
+
+/* the index should match the map, same free bits and every free extent
+ * clear in the map with used bits around */
+int check_index( falloc_t *fa){
+    bm_summary_t *bms = fa->fa_map;
+    avl_node_t *n;
+    free_extent_t *fe, key;
+    uint64_t count, free = 0;
+
+    n = avl_first( &fa->fa_by_addr);
+    while( n != NULL){
+        fe = avl_entry( n, free_extent_t, fe_by_addr);
+        bm_count( bms->bs_map, bms->bs_total_bits, fe->fe_addr, fe->fe_len,
+                  CLEARBIT, &count);
+        if( count != fe->fe_len ||
+            ( fe->fe_addr > 0 &&
+              bm_get_bit( bms->bs_map, bms->bs_total_bits,
+                          fe->fe_addr - 1) != 1)){
+            printf("Bad extent [%lu, %lu]\n", fe->fe_addr, fe->fe_len);
+            return( -1);
+        }
+        free += fe->fe_len;
+
+        key.fe_addr = fe->fe_addr + 1;
+        n = avl_ceil( &fa->fa_by_addr, &key.fe_by_addr);
+    }
+
+    if( free != fa->fa_free || free != bm_summary_free_bits( bms)){
+        printf("Free bits do not match, index=%lu, map=%lu\n",
+               fa->fa_free, bm_summary_free_bits( bms));
+        return( -1);
+    }
+
+    return( 0);
+}
+
+
+int main(){
+    static unsigned char map[TEST_MAP_BITS / 8];
+    test_extent_t ex[TEST_EXTENTS];
+    bm_summary_t *bms;
+    falloc_t *fa;
+    uint64_t addr, count;
+    int i, n = 0, rc = 0;
+
+    /* some blocks in use at the start, like the tables */
+    memset( map, 0, sizeof( map));
+    bm_set_extent( map, TEST_MAP_BITS, 0, 100, SETBIT);
+    bm_set_extent( map, TEST_MAP_BITS, 1000, 24, SETBIT);
+
+    bms = bm_summary_alloc( map, TEST_MAP_BITS);
+    fa = falloc_alloc( bms);
+    if( fa == NULL || falloc_extents( fa) != 2 ||
+        fa->fa_free != TEST_MAP_BITS - 124){
+        printf("Index build failed\n");
+        return( -1);
+    }
+
+    /* best fit takes the smallest hole, between the used extents */
+    if( falloc_get( fa, FALLOC_NO_GOAL, 900, &addr) != 0 || addr != 100){
+        printf("Best fit failed, addr=%lu\n", addr);
+        rc = -1;
+    }
+
+    /* the goal is free */
+    if( falloc_get( fa, 5000, 10, &addr) != 0 || addr != 5000){
+        printf("Goal allocation failed, addr=%lu\n", addr);
+        rc = -1;
+    }
+
+    /* the goal is used, next free extent after it */
+    if( falloc_get( fa, 5005, 10, &addr) != 0 || addr != 5010){
+        printf("Near goal allocation failed, addr=%lu\n", addr);
+        rc = -1;
+    }
+
+    /* closer room before the goal, at the end of that extent */
+    if( falloc_get( fa, 5005, 3, &addr) != 0 || addr != 4997){
+        printf("Outward goal allocation failed, addr=%lu\n", addr);
+        rc = -1;
+    }
+    falloc_put( fa, 4997, 3);
+
+    /* free in the middle, then both sides, everything coalesces */
+    falloc_put( fa, 5000, 10);
+    falloc_put( fa, 5010, 10);
+    falloc_put( fa, 100, 900);
+    if( falloc_extents( fa) != 2 || falloc_max_extent( fa) !=
+        TEST_MAP_BITS - 1024){
+        printf("Coalesce failed, %lu extents\n", falloc_extents( fa));
+        rc = -1;
+    }
+
+    /* already free */
+    if( falloc_put( fa, 2000, 1) == 0){
+        printf("Double free not detected\n");
+        rc = -1;
+    }
+
+    /* random allocations and frees */
+    srand( 38);
+    for( i = 0; i < 20000; i++){
+        if( n < TEST_EXTENTS && ( n == 0 || rand() % 3 != 0)){
+            ex[n].len = 1 + rand() % 64;
+            if( falloc_get( fa, ( rand() % 2) ? FALLOC_NO_GOAL :
+                                rand() % TEST_MAP_BITS,
+                            ex[n].len, &ex[n].addr) == 0){
+                bm_count( map, TEST_MAP_BITS, ex[n].addr, ex[n].len, SETBIT,
+                          &count);
+                if( count != ex[n].len){
+                    printf("Extent not set in the map\n");
+                    rc = -1;
+                }
+                n++;
+            }
+        }else{
+            int k = rand() % n;
+
+            if( falloc_put( fa, ex[k].addr, ex[k].len) != 0){
+                printf("Free failed [%lu, %lu]\n", ex[k].addr, ex[k].len);
+                rc = -1;
+            }
+            ex[k] = ex[--n];
+        }
+    }
+
+    rc |= check_index( fa);
+
+    /* the index built again from the map is the same */
+    falloc_free( fa);
+    bm_summary_rebuild( bms);
+    fa = falloc_alloc( bms);
+    rc |= check_index( fa);
+
+    while( n > 0){
+        n--;
+        falloc_put( fa, ex[n].addr, ex[n].len);
+    }
+    if( falloc_extents( fa) != 2){
+        printf("Not everything coalesced, %lu extents\n",
+               falloc_extents( fa));
+        rc = -1;
+    }
+
+    falloc_free( fa);
+    bm_summary_free( bms);
+
+    printf("free extents allocator: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
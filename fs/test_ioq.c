@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include "kfs_mem.h"
+#include "bdev.h"
+#include "ioq.h"
+
+#define TEST_BLOCKS                      48
+
+
+/* scattered extents in one call, out of order and some of them adjacent.
+ * Block i holds 'a' + i % 26 when this runs */
+int test_vec( bdev_t *bdev){
+    bdev_vec_t vec[4];
+    uint64_t addrs[4] = { 20, 4, 6, 40};
+    int blocks[4] = { 3, 2, 1, 2};
+    char *buf;
+    int i, j, rc = 0;
+
+    buf = malloc( 8 * KFS_BLOCKSIZE);
+    if( buf == NULL){
+        perror( "malloc");
+        return( -1);
+    }
+
+    for( i = 0, j = 0; i < 4; j += blocks[i++]){
+        vec[i].bv_block_addr = addrs[i];
+        vec[i].bv_num_blocks = blocks[i];
+        vec[i].bv_buf = buf + j * KFS_BLOCKSIZE;
+    }
+
+    memset( buf, 0, 8 * KFS_BLOCKSIZE);
+    if( bdev_read_vec( bdev, vec, 4) != 0){
+        printf("Vector read failed\n");
+        rc = -1;
+    }
+
+    for( i = 0; i < 4; i++){
+        for( j = 0; j < blocks[i]; j++){
+            if( vec[i].bv_buf[j * KFS_BLOCKSIZE] !=
+                'a' + ( addrs[i] + j) % 26){
+                printf("Vector block %lu mismatch\n", addrs[i] + j);
+                rc = -1;
+            }
+        }
+    }
+
+    /* write them back shifted by one letter and read them again */
+    for( i = 0; i < 8 * KFS_BLOCKSIZE; i++){
+        buf[i]++;
+    }
+    if( bdev_write_vec( bdev, vec, 4) != 0 ||
+        bdev_read( bdev, buf, 4, 3) != 0 ||
+        buf[0] != 'a' + 5 || buf[2 * KFS_BLOCKSIZE] != 'a' + 7 ||
+        bdev_read( bdev, buf, 40, 1) != 0 || buf[0] != 'a' + 15){
+        printf("Vector write failed\n");
+        rc = -1;
+    }
+
+    free( buf);
+    return( rc);
+}
+
+
+/* write blocks thru the queue in reverse order, read them back and check */
+int test_backend( bdev_t *bdev){
+    ioq_request_t reqs[TEST_BLOCKS];
+    ioq_t *ioq;
+    char *buf, *p;
+    int i, rc = 0;
+
+    buf = malloc( TEST_BLOCKS * KFS_BLOCKSIZE);
+    if( buf == NULL){
+        perror( "malloc");
+        return( -1);
+    }
+
+    ioq = ioq_alloc( bdev);
+    if( ioq == NULL || ioq_start( ioq) != 0){
+        printf("Could not start the IO queue\n");
+        return( -1);
+    }
+
+    /* queue the writes in reverse order and with mixed priorities, the
+     * dispatcher should sort and merge them */
+    for( i = TEST_BLOCKS - 1; i >= 0; i--){
+        p = buf + i * KFS_BLOCKSIZE;
+        memset( p, 'a' + (i % 26), KFS_BLOCKSIZE);
+        memset( &reqs[i], 0, sizeof( ioq_request_t));
+        reqs[i].iq_block_addr = i;
+        reqs[i].iq_num_blocks = 1;
+        reqs[i].iq_buf = p;
+        reqs[i].iq_op = IOQ_OP_WRITE;
+        reqs[i].iq_prio = i % IOQ_PRIO_NUM;
+        if( ioq_submit( ioq, &reqs[i]) != 0){
+            printf("Submit failed, block %d\n", i);
+            rc = -1;
+        }
+    }
+
+    for( i = 0; i < TEST_BLOCKS; i++){
+        if( ioq_wait( ioq, &reqs[i]) != 0){
+            printf("Write failed, block %d\n", i);
+            rc = -1;
+        }
+    }
+
+    /* read everything back with a single synchronous request */
+    memset( buf, 0, TEST_BLOCKS * KFS_BLOCKSIZE);
+    if( ioq_read( ioq, buf, 0, TEST_BLOCKS, IOQ_PRIO_META) != 0){
+        printf("Read failed\n");
+        rc = -1;
+    }
+
+    for( i = 0; i < TEST_BLOCKS; i++){
+        p = buf + i * KFS_BLOCKSIZE;
+        if( p[0] != 'a' + (i % 26) || p[KFS_BLOCKSIZE - 1] != p[0]){
+            printf("Block %d mismatch\n", i);
+            rc = -1;
+        }
+    }
+
+    rc |= test_vec( bdev);
+
+    /* reading past the end of file should fail */
+    if( ioq_read( ioq, buf, TEST_BLOCKS, 1, IOQ_PRIO_PREFETCH) == 0){
+        printf("Read past the end did not fail\n");
+        rc = -1;
+    }
+
+    ioq_destroy( ioq);
+    free( buf);
+    return( rc);
+}
+
+
+int main( int argc, char **argv){
+    bdev_t *bdev, *devs[3];
+    char *filename = "/tmp/test_ioq.img";
+    uint64_t addr;
+    int i, fd, rc;
+
+    if( argc > 1){
+        filename = argv[1];
+    }
+
+    fd = open( filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if( fd < 0){
+        perror( "open");
+        return( -1);
+    }
+    close( fd);
+
+    bdev = bdev_open( filename, BDEV_FILE);
+    if( bdev == NULL){
+        return( -1);
+    }
+    rc = test_backend( bdev);
+    printf("file backend: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    bdev_close( bdev);
+    unlink( filename);
+
+    bdev = bdev_open_ram( NULL, TEST_BLOCKS * KFS_BLOCKSIZE, 100);
+    if( bdev == NULL){
+        return( -1);
+    }
+    rc |= test_backend( bdev);
+    printf("ram backend: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    bdev_close( bdev);
+
+    /* three slow ram devices striped in chunks of 4 blocks, the requests
+     * are split between them */
+    for( i = 0; i < 3; i++){
+        devs[i] = bdev_open_ram( NULL, TEST_BLOCKS / 3 * KFS_BLOCKSIZE, 100);
+        if( devs[i] == NULL){
+            return( -1);
+        }
+    }
+    bdev = bdev_stripe( devs, 3, 4);
+    if( bdev == NULL){
+        return( -1);
+    }
+    rc |= test_backend( bdev);
+
+    /* block 13 is in the fourth stripe, back in the first device */
+    bdev_stripe_map( bdev, 13, &i, &addr);
+    if( i != 0 || addr != 5){
+        printf("Wrong stripe map, dev=%d, addr=%lu\n", i, addr);
+        rc = -1;
+    }
+    printf("stripe backend: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    bdev_close( bdev);
+
+    /* same with the biggest block size */
+    kfs_set_blocksize( KFS_BLOCKSIZE_MAX);
+    bdev = bdev_open_ram( NULL, TEST_BLOCKS * KFS_BLOCKSIZE, 0);
+    if( bdev == NULL){
+        return( -1);
+    }
+    rc |= test_backend( bdev);
+    printf("ram backend, %u bytes blocks: %s\n", KFS_BLOCKSIZE, 
+           rc == 0 ? "PASSED" : "FAILED");
+    bdev_close( bdev);
+
+    return( rc);
+}
+
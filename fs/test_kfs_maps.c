@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "kfs.h"
+#include "bdev.h"
+#include "page_cache.h"
+
+#define TEST_FILE                        "/tmp/test_kfs_maps.img"
+#define TEST_STRIPE_FILES                "/tmp/test_kfs_maps.s1," \
+                                         "/tmp/test_kfs_maps.s2"
+#define TEST_CACHE_PAGES                 6 /* superblock, 3 maps, 2 more */
+#define TEST_PAGES                       40
+#define TEST_BLOCKS                      10
+
+
+/* blocks in use in the block map, from its bits */
+uint64_t blocks_in_use( sb_t *sb){
+    agmap_t *am = (agmap_t *) sb->sb_blockmap.cache;
+
+    return( am->am_total_bits - agmap_free_bits( am));
+}
+
+
+/* mount with a page cache smaller than the pages mapped after, the maps
+ * and the superblock should stay in memory, and their changes should be
+ * found after a new mount */
+int test_maps( kfs_config_t *config){
+    pgcache_t *pgcache;
+    sb_t *sb = kfs_get_sb();
+    table_t *maps[3] = { &sb->sb_blockmap, &sb->sb_si_table,
+                         &sb->sb_slot_table};
+    uint64_t addr, id, in_use;
+    int i, rc = 0;
+
+    if( kfs_mount( config) != 0){
+        printf("Mount failed\n");
+        return( -1);
+    }
+
+    pgcache = (pgcache_t *) sb->sb_page_cache;
+    in_use = blocks_in_use( sb);
+    for( i = 0; i < TEST_PAGES; i++){
+        if( pgcache_element_map( pgcache, 1000 + i, 1) == NULL){
+            printf("Could not map page %d\n", i);
+            rc = -1;
+        }
+    }
+
+    for( i = 0; i < 3; i++){
+        if( cache_lookup( CACHE( pgcache),
+                          maps[i]->bitmap_extent.ex_block_addr) !=
+            CACHE_EL( maps[i]->map_page)){
+            printf("Map %d evicted\n", i);
+            rc = -1;
+        }
+    }
+
+    if( cache_lookup( CACHE( pgcache), 0) !=
+        CACHE_EL( sb->sb_superblock_page) ||
+        kfs_blocks_alloc( FALLOC_NO_GOAL, TEST_BLOCKS, &addr) != 0 ||
+        kfs_sinode_id_alloc( FALLOC_NO_GOAL, &id) != 0 ||
+        blocks_in_use( sb) != in_use + TEST_BLOCKS){
+        printf("Maps not usable after the evictions\n");
+        rc = -1;
+    }
+
+    if( kfs_umount() != 0 || kfs_mount( config) != 0){
+        printf("Remount failed\n");
+        return( -1);
+    }
+
+    if( blocks_in_use( sb) != in_use + TEST_BLOCKS ||
+        sb->sb_blockmap.in_use != in_use + TEST_BLOCKS){
+        printf("Block map not written out, %lu blocks in use\n",
+               blocks_in_use( sb));
+        rc = -1;
+    }
+
+    kfs_umount();
+    return( rc);
+}
+
+
+void test_unlink(){
+    unlink( TEST_FILE);
+    unlink( "/tmp/test_kfs_maps.s1");
+    unlink( "/tmp/test_kfs_maps.s2");
+}
+
+
+int main(){
+    kfs_config_t config;
+    int rc = 0;
+
+    test_unlink();
+    memset( &config, 0, sizeof( kfs_config_t));
+    strcpy( config.kfs_file, TEST_FILE);
+    config.cache_page_len = TEST_CACHE_PAGES;
+    config.bdev_backend = BDEV_FILE;
+
+    if( system( "./kfs_mkfs kfs -f " TEST_FILE " -d 50M > /dev/null") != 0){
+        printf("Could not create the volume\n");
+        return( -1);
+    }
+    rc = test_maps( &config);
+    test_unlink();
+    printf("kfs maps pinned: %s\n", rc == 0 ? "PASSED" : "FAILED");
+
+    /* the tables and maps spread over the three devices, the volume is
+     * only found thru the stripe */
+    if( system( "./kfs_mkfs kfs -f " TEST_FILE " -d 60M -t "
+                TEST_STRIPE_FILES " -u 16 > /dev/null") != 0){
+        printf("Could not create the striped volume\n");
+        return( -1);
+    }
+    strcpy( config.kfs_stripe_files, TEST_STRIPE_FILES);
+    if( test_maps( &config) != 0){
+        rc = -1;
+        printf("kfs maps pinned, striped: FAILED\n");
+    }else{
+        printf("kfs maps pinned, striped: PASSED\n");
+    }
+    test_unlink();
+
+    return( rc);
+}
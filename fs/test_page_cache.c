@@ -3,10 +3,13 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include "dumphex.h"
+#include "kfs_mem.h"
 #include "page_cache.h"
 
 int cache_dump( cache_t *cache){
@@ -32,9 +35,195 @@ int cache_dump( cache_t *cache){
 }
 
 
+/* the LRU page is write locked by this thread. Mapping another page has
+ * to evict a different one instead of waiting for that lock, and marking
+ * it dirty under the lock leaves the flush for later */
+int test_busy(){
+    pgcache_t *pgcache;
+    bdev_t *bdev;
+    pgcache_element_t *el, *el2;
+    int rc = 0;
+
+    bdev = bdev_open_ram( NULL, KFS_BLOCKS_TO_BYTES( 16), 0);
+    pgcache = ( bdev != NULL) ? pgcache_alloc( bdev, 2) : NULL;
+    if( pgcache == NULL || pgcache_enable_sync( pgcache) != 0){
+        printf("Page cache not ready\n");
+        return( -1);
+    }
+
+    el = pgcache_element_map( pgcache, 0, 1);
+    el2 = pgcache_element_map( pgcache, 1, 1);
+    pgcache_element_map( pgcache, 1, 1);
+    pgcache_element_map( pgcache, 1, 1);
+    if( el == NULL || el2 == NULL){
+        printf("Could not map the pages\n");
+        return( -1);
+    }
+
+    pgcache_element_write_lock( el);
+    strcpy( (char *) el->pe_mem_ptr, "busy");
+    PGCACHE_EL_MARK_DIRTY( el);
+    if( pgcache_element_map( pgcache, 2, 1) == NULL ||
+        cache_lookup( CACHE( pgcache), 0) != CACHE_EL( el) ||
+        cache_lookup( CACHE( pgcache), 1) != NULL){
+        printf("Locked page evicted\n");
+        rc = -1;
+    }
+    pgcache_element_unlock( el);
+
+    if( cache_element_wait_for_flags( CACHE_EL( el), CACHE_EL_CLEAN,
+                                      10) != 0){
+        printf("Page not flushed after the unlock\n");
+        rc = -1;
+    }
+
+    pgcache_destroy( pgcache);
+    bdev_close( bdev);
+    printf("page cache busy elements: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
+
+typedef struct{
+    pgcache_t *pgcache;
+    pgcache_element_t *el;
+    int err;
+}test_grow_t;
+
+
+void *test_grow_thread( void *arg){
+    test_grow_t *t = (test_grow_t *) arg;
+
+    errno = 0;
+    t->el = pgcache_element_map( t->pgcache, 0, 4);
+    t->err = errno;
+    return( NULL);
+}
+
+
+/* a page growing while its lock is held by a thread mapping another page
+ * should not block that thread, and once free the page grows keeping its
+ * cached blocks */
+int test_grow(){
+    pgcache_t *pgcache;
+    bdev_t *bdev;
+    pgcache_element_t *el;
+    test_grow_t t;
+    pthread_t thread;
+    char *buf;
+    int rc = 0;
+
+    bdev = bdev_open_ram( NULL, KFS_BLOCKS_TO_BYTES( 16), 0);
+    buf = malloc( KFS_BLOCKS_TO_BYTES( 4));
+    pgcache = ( bdev != NULL) ? pgcache_alloc( bdev, 8) : NULL;
+    if( buf == NULL || pgcache == NULL || 
+        pgcache_enable_sync( pgcache) != 0){
+        printf("Page cache not ready\n");
+        return( -1);
+    }
+
+    memset( buf, 'd', KFS_BLOCKS_TO_BYTES( 4));
+    bdev_write( bdev, buf, 0, 4);
+    el = pgcache_element_map( pgcache, 0, 1);
+    if( el == NULL){
+        printf("Could not map the page\n");
+        return( -1);
+    }
+
+    pgcache_element_write_lock( el);
+    strcpy( (char *) el->pe_mem_ptr, "cached");
+    pgcache_element_unlock( el);
+
+    t.pgcache = pgcache;
+    pgcache_element_read_lock( el);
+    if( pthread_create( &thread, NULL, test_grow_thread, &t) != 0){
+        printf("Could not start the thread\n");
+        return( -1);
+    }
+    usleep( 10000);
+    if( pgcache_element_map( pgcache, 8, 1) == NULL){
+        printf("Could not map another page\n");
+        rc = -1;
+    }
+    pthread_join( thread, NULL);
+    pgcache_element_unlock( el);
+
+    if( t.el != NULL || t.err != EBUSY){
+        printf("Locked page grown\n");
+        rc = -1;
+    }
+
+    el = pgcache_element_map( pgcache, 0, 4);
+    if( el == NULL || el->pe_num_blocks != 4 ||
+        strcmp( (char *) el->pe_mem_ptr, "cached") != 0 ||
+        memcmp( (char *) el->pe_mem_ptr + KFS_BLOCKSIZE, buf,
+                KFS_BLOCKS_TO_BYTES( 3)) != 0){
+        printf("Page not grown\n");
+        rc = -1;
+    }
+
+    pgcache_destroy( pgcache);
+    bdev_close( bdev);
+    free( buf);
+    printf("page cache grow: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
+
+/* a page mapped and evicted while the prefetch worker reads it, the read
+ * may be older than what the page wrote, it should not be cached */
+int test_prefetch_stale(){
+    pgcache_t *pgcache;
+    bdev_t *bdev;
+    pgcache_element_t *el;
+    int i, rc = 0, pending = 1;
+
+    bdev = bdev_open_ram( NULL, KFS_BLOCKS_TO_BYTES( 16), 300000);
+    pgcache = ( bdev != NULL) ? pgcache_alloc( bdev, 8) : NULL;
+    if( pgcache == NULL || pgcache_enable_sync( pgcache) != 0){
+        printf("Page cache not ready\n");
+        return( -1);
+    }
+
+    if( pgcache_prefetch( pgcache, 5, 1) != 0){
+        printf("Prefetch not queued\n");
+        return( -1);
+    }
+    usleep( 20000);
+
+    el = pgcache_element_map_zero( pgcache, 5, 1);
+    if( el == NULL){
+        printf("Could not map the page\n");
+        return( -1);
+    }
+    cache_element_mark_eviction( CACHE_EL( el));
+    for( i = 0; i < 100 && cache_lookup( CACHE( pgcache), 5) != NULL; i++){
+        usleep( 10000);
+    }
+
+    for( i = 0; i < 100 && pending; i++){
+        usleep( 10000);
+        pthread_mutex_lock( &pgcache->pc_prefetch_mutex);
+        pending = pgcache->pc_prefetch_num;
+        pthread_mutex_unlock( &pgcache->pc_prefetch_mutex);
+    }
+
+    if( pending || cache_lookup( CACHE( pgcache), 5) != NULL){
+        printf("Stale prefetch cached\n");
+        rc = -1;
+    }
+
+    pgcache_destroy( pgcache);
+    bdev_close( bdev);
+    printf("page cache stale prefetch: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
+
 int main( int argc, char **argv){
     pgcache_t *pgcache;
-    int rc, fd;
+    int rc, i;
+    bdev_t *bdev;
     char *filename;
     pgcache_element_t *el, *el2;
     char s1[] = "1 anita lava la tina";
@@ -50,16 +239,16 @@ int main( int argc, char **argv){
 
     printf("argc=%d, argv=['%s', '%s' ]\n", argc, argv[0], argv[1]);
     filename = argv[1];
-    fd = open( filename, O_RDWR );
-    if( fd < 0){
+    bdev = bdev_open( filename, BDEV_FILE);
+    if( bdev == NULL){
         TRACE_ERR( "Could not open file '%s'\n", filename);
         return( -1);
     }
        
-    pgcache = pgcache_alloc( fd, 32);
+    pgcache = pgcache_alloc( bdev, 32);
     if( pgcache == NULL){
         TRACE_ERR("Issues in pgcache_alloc()");
-        close( fd);
+        bdev_close( bdev);
         return( -1);
     }
         
@@ -68,7 +257,7 @@ int main( int argc, char **argv){
     if( rc != 0){
         TRACE_ERR("Issues in pgcache_enable_sync()");
         pgcache_destroy( pgcache);
-        close( fd);
+        bdev_close( bdev);
         return( -1);
     }
         
@@ -79,7 +268,7 @@ int main( int argc, char **argv){
     if( el == NULL){
         TRACE_ERR("Issues in pgcache_element_map_sync()");
         pgcache_destroy( pgcache);
-        close( fd);
+        bdev_close( bdev);
         return( -1);
     }
 
@@ -96,7 +285,7 @@ int main( int argc, char **argv){
     el2 = pgcache_element_map( pgcache, 10, 2);
     if( el == NULL){
         TRACE_ERR("Issues in pgcache_element_map()");
-        close( fd);
+        bdev_close( bdev);
         return( -1);
     }
 
@@ -110,7 +299,9 @@ int main( int argc, char **argv){
         return( -1);
     }
 
+    pgcache_element_write_lock( el);
     strcpy( (char *) el->pe_mem_ptr, s2);
+    pgcache_element_unlock( el);
     PGCACHE_EL_MARK_DIRTY( el);
 
     strcpy( (char *) el2->pe_mem_ptr, s3);
@@ -135,9 +326,31 @@ int main( int argc, char **argv){
     }
 
 
-    rc = cache_destroy( CACHE(pgcache));
-    close( fd);
+    /* prefetch a range, it should show up in the cache shortly */
+    rc = pgcache_prefetch( pgcache, 20, 2);
+    if( rc != 0){
+        TRACE_ERR("Issues in pgcache_prefetch()");
+        return( -1);
+    }
+
+    for( i = 0; i < 50; i++){
+        if( cache_lookup( CACHE( pgcache), 20) != NULL){
+            break;
+        }
+        usleep( 100000);
+    }
+    if( i == 50){
+        TRACE_ERR("prefetched page was not cached");
+        return( -1);
+    }
+    cache_dump( CACHE( pgcache));
+
+    rc = pgcache_destroy( pgcache);
+    bdev_close( bdev);
 
+    rc |= test_busy();
+    rc |= test_grow();
+    rc |= test_prefetch_stale();
     return( rc);
 }
 
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include "kfs_mem.h"
+#include "kfs_disk.h"
+#include "bdev.h"
+#include "kfs_table.h"
+
+#define TEST_TABLE_ADDR                  2
+#define TEST_TABLE_BLOCKS                10
+
+
+/* the first slot id found in a table block */
+uint64_t first_slot( char *p, uint64_t idx){
+    kfs_slot_t *slot = (kfs_slot_t *) p;
+
+    if( idx == 0){
+        slot = (kfs_slot_t *) ( p + sizeof( kfs_extent_header_t));
+    }
+    return( slot->slot_id);
+}
+
+
+int main( int argc, char **argv){
+    char *filename = "/tmp/test_table.img";
+    table_t t;
+    bdev_t *bdev;
+    char *p;
+    uint64_t i;
+    int fd, rc = 0;
+
+    if( argc > 1){
+        filename = argv[1];
+    }
+
+    /* a sparse file, like kfs_mkfs leaves it */
+    fd = open( filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if( fd < 0 || 
+        ftruncate( fd, KFS_BLOCKS_TO_BYTES( TEST_TABLE_ADDR + 
+                                            TEST_TABLE_BLOCKS)) != 0){
+        perror( "open");
+        return( -1);
+    }
+    close( fd);
+
+    bdev = bdev_open( filename, BDEV_FILE);
+    if( bdev == NULL){
+        return( -1);
+    }
+
+    p = malloc( KFS_BLOCKSIZE);
+    if( p == NULL){
+        perror( "malloc");
+        return( -1);
+    }
+
+    memset( (void *) &t, 0, sizeof( table_t));
+    t.table_extent.ex_block_addr = TEST_TABLE_ADDR;
+    t.table_extent.ex_block_size = TEST_TABLE_BLOCKS;
+    t.capacity = TEST_TABLE_BLOCKS * KFS_SLOTS_PER_BLOCK;
+
+    /* only the first block goes to disk */
+    kfs_table_block_init( p, KFS_SLOTS_TABLE_MAGIC, 0, t.capacity);
+    if( kfs_table_block_write( bdev, &t, KFS_SLOTS_TABLE_MAGIC, 0, p) != 0 ||
+        t.hwm != 1){
+        printf("First block write failed\n");
+        rc = -1;
+    }
+
+    /* past the mark, built in memory */
+    memset( p, 0xff, KFS_BLOCKSIZE);
+    if( kfs_table_block_read( bdev, &t, KFS_SLOTS_TABLE_MAGIC, 5, p) != 0 ||
+        first_slot( p, 5) != 5 * KFS_SLOTS_PER_BLOCK){
+        printf("Default block 5 is wrong\n");
+        rc = -1;
+    }
+
+    /* writing block 3 initializes 1 and 2 on disk */
+    kfs_table_block_read( bdev, &t, KFS_SLOTS_TABLE_MAGIC, 3, p);
+    ((kfs_slot_t *) p)->slot_flags = 0x55;
+    if( kfs_table_block_write( bdev, &t, KFS_SLOTS_TABLE_MAGIC, 3, p) != 0 ||
+        t.hwm != 4){
+        printf("Block 3 write failed, hwm=%lu\n", t.hwm);
+        rc = -1;
+    }
+
+    for( i = 0; i < 4; i++){
+        memset( p, 0xff, KFS_BLOCKSIZE);
+        if( bdev_read( bdev, p, TEST_TABLE_ADDR + i, 1) != 0 ||
+            first_slot( p, i) != i * KFS_SLOTS_PER_BLOCK){
+            printf("Block %lu not initialized on disk\n", i);
+            rc = -1;
+        }
+    }
+
+    if( ((kfs_slot_t *) p)->slot_flags != 0x55){
+        printf("Block 3 contents lost\n");
+        rc = -1;
+    }
+
+    /* out of the table */
+    if( kfs_table_block_read( bdev, &t, KFS_SLOTS_TABLE_MAGIC, 
+                              TEST_TABLE_BLOCKS, p) == 0){
+        printf("Read out of the table did not fail\n");
+        rc = -1;
+    }
+
+    free( p);
+    bdev_close( bdev);
+    unlink( filename);
+
+    printf("lazy tables: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
@@ -1,5 +1,550 @@
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "kfs.h"
 #include "dict.h"
+#include "dict_view.h"
+#include "dict_codec.h"
+#include "slots.h"
+
+
+#define TEST_INDEX_KEYS                            1000
+
+/* many keys with the same first characters, with the hash index */
+int test_index(){
+    dict_t d;
+    dict_entry_t *e;
+    char key[DICT_KEY_LEN];
+    int i, sub, rc = 0;
+
+    dict_init( &d);
+    for( i = 0; i < TEST_INDEX_KEYS; i++){
+        snprintf( key, sizeof( key), "annotation_%04d", i);
+        dict_add_entry( &d, key, dict_value_new( DICT_INT, &i, 0));
+    }
+
+    if( d.index == NULL){
+        printf("No index built\n");
+        rc = -1;
+    }
+
+    /* every other key, the first ones and the last one */
+    for( i = 0; i < TEST_INDEX_KEYS; i += 2){
+        snprintf( key, sizeof( key), "annotation_%04d", i);
+        if( dict_remove_entry( &d, key) != 0){
+            rc = -1;
+        }
+    }
+    dict_remove_entry( &d, "annotation_0001");
+    dict_remove_entry( &d, "annotation_0999");
+
+    for( i = 0; i < TEST_INDEX_KEYS; i++){
+        snprintf( key, sizeof( key), "annotation_%04d", i);
+        e = dict_search_entry( &d, key, &sub);
+        if( ( i % 2 == 0 || i == 1 || i == 999) != ( e == NULL) ||
+            ( e != NULL && e->value.value.i != i)){
+            printf("Search of %s failed\n", key);
+            rc = -1;
+        }
+    }
+
+    /* the entries left are still in insertion order */
+    for( i = 0, sub = -1; i < d.used_elems; i++){
+        if( d.dict[i].value.data_type == DICT_DELETED){
+            continue;
+        }
+        if( d.dict[i].value.value.i <= sub){
+            printf("Insertion order lost\n");
+            rc = -1;
+        }
+        sub = d.dict[i].value.value.i;
+    }
+
+    if( dict_num_entries( &d) != TEST_INDEX_KEYS / 2 - 2){
+        printf("%u entries left\n", dict_num_entries( &d));
+        rc = -1;
+    }
+
+    dict_clean( &d);
+    printf("dict hash index: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
+
+/* the entries of a sorted dict are in order */
+int check_sorted( dict_t *d){
+    int i;
+
+    for( i = 1; i < d->used_elems; i++){
+        if( d->dict[i - 1].hash_key > d->dict[i].hash_key ||
+            ( d->dict[i - 1].hash_key == d->dict[i].hash_key &&
+              strncmp( d->dict[i - 1].key, d->dict[i].key,
+                       DICT_KEY_LEN) > 0)){
+            printf("Not sorted at %d\n", i);
+            return( -1);
+        }
+    }
+
+    return( 0);
+}
+
+
+/* dates of three years in random order, walked by range and prefix */
+int test_sorted(){
+    dict_t d, d2;
+    dict_iter_t it;
+    dict_entry_t *e;
+    char key[DICT_KEY_LEN];
+    int i, n, sub, rc = 0;
+
+    dict_init_sorted( &d);
+    dict_init_sorted( &d2);
+    for( i = 0; i < 36; i++){
+        n = ( i * 7) % 36;
+        snprintf( key, sizeof( key), "date_%d-%02d", 2023 + n / 12,
+                  n % 12 + 1);
+        dict_add_entry( ( n % 2) ? &d : &d2, key,
+                        dict_value_new( DICT_INT, &n, 0));
+    }
+    dict_add_entry( &d, "name", dict_value_new( DICT_INT, &i, 0));
+    dict_add_entry( &d2, "date", dict_value_new( DICT_INT, &i, 0));
+
+    /* the same key in both, the one merged stays */
+    n = -1;
+    dict_add_entry( &d2, "date_2024-02", dict_value_new( DICT_INT, &n, 0));
+    dict_remove_entry( &d2, "date_2024-01");
+
+    if( dict_merge( &d, &d2) != 0 || dict_num_entries( &d2) != 0 ||
+        dict_num_entries( &d) != 37 || check_sorted( &d) != 0){
+        printf("Merge failed, %u entries\n", dict_num_entries( &d));
+        rc = -1;
+    }
+
+    e = dict_search_entry( &d, "date_2024-02", &sub);
+    if( e == NULL || e->value.value.i != -1 ||
+        dict_search_entry( &d, "date_2024-01", &sub) != NULL){
+        printf("Search in sorted dict failed\n");
+        rc = -1;
+    }
+
+    /* a year */
+    dict_range( &d, &it, "date_2024", "date_2025");
+    for( n = 0; ( e = dict_iter_next( &it)) != NULL; n++){
+        if( strncmp( e->key, "date_2024-", 10) != 0){
+            printf("%s out of range\n", e->key);
+            rc = -1;
+        }
+    }
+    if( n != 11){
+        printf("Range with %d keys\n", n);
+        rc = -1;
+    }
+
+    /* a quarter */
+    dict_prefix( &d, &it, "date_2025-0");
+    for( n = 0; ( e = dict_iter_next( &it)) != NULL; n++){
+        if( strncmp( e->key, "date_2025-0", 11) != 0){
+            rc = -1;
+        }
+    }
+    if( n != 9){
+        printf("Prefix with %d keys\n", n);
+        rc = -1;
+    }
+
+    dict_clean( &d);
+    printf("dict sorted: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
+
+/* string and blob values in an arena, a single chunk for all of them */
+int test_arena(){
+    dict_t d, d2;
+    dict_entry_t *e;
+    char key[DICT_KEY_LEN], s[32];
+    int i, sub, rc = 0;
+
+    if( dict_init_arena( &d, 16384, 0) != 0){
+        printf("dict arena: FAILED\n");
+        return( -1);
+    }
+
+    for( i = 0; i < 50; i++){
+        snprintf( key, sizeof( key), "name_%02d", i);
+        snprintf( s, sizeof( s), "value of %d", i);
+        if( i % 2){
+            rc |= dict_add_value( &d, key, DICT_STRING, s, 0);
+        }else{
+            rc |= dict_add_entry( &d, key, dict_value_new( DICT_STRING, s, 0));
+        }
+    }
+    rc |= dict_add_value( &d, "blob", DICT_BLOB, s, sizeof( s));
+
+    /* the heap copies of the update and the removal go away */
+    rc |= dict_update_entry( &d, "name_07",
+                             dict_value_new( DICT_STRING, "seven", 0));
+    rc |= dict_remove_entry( &d, "name_08");
+
+    for( i = 0; i < 50; i++){
+        snprintf( key, sizeof( key), "name_%02d", i);
+        snprintf( s, sizeof( s), "value of %d", i);
+        e = dict_search_entry( &d, key, &sub);
+        if( ( i == 8) != ( e == NULL) ||
+            ( e != NULL && strcmp( e->value.value.s,
+                                   i == 7 ? "seven" : s) != 0)){
+            printf("Search of %s failed\n", key);
+            rc = -1;
+        }
+    }
+
+    if( d.arena->ar_chunks_num != 1){
+        printf("%d chunks in the arena\n", d.arena->ar_chunks_num);
+        rc = -1;
+    }
+
+    /* a heap dict merged into a sorted arena dict and back */
+    dict_init_sorted( &d2);
+    dict_add_entry( &d2, "heap", dict_value_new( DICT_STRING, "from heap", 0));
+    dict_clean( &d);
+    rc |= dict_init_arena( &d, 0, DICT_SORTED);
+    dict_add_value( &d, "arena", DICT_STRING, "from arena", 0);
+    rc |= dict_merge( &d, &d2);
+    rc |= dict_merge( &d2, &d);
+    e = dict_search_entry( &d2, "arena", &sub);
+    if( e == NULL || strcmp( e->value.value.s, "from arena") != 0 ||
+        dict_search_entry( &d2, "heap", &sub) == NULL){
+        printf("Merge of arena dicts failed\n");
+        rc = -1;
+    }
+
+    dict_clean( &d2);
+    printf("dict arena: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
+
+/* a few keys inline in the dict_t, then out of it */
+int test_inline(){
+    dict_t d, d2;
+    dict_entry_t *e;
+    char key[DICT_KEY_LEN];
+    int i, sub, rc = 0;
+
+    dict_init( &d);
+    for( i = 0; i < DICT_INLINE_ELEMS; i++){
+        snprintf( key, sizeof( key), "k%d", i);
+        rc |= dict_add_value( &d, key, DICT_STRING, "short", 0);
+    }
+
+    e = dict_search_entry( &d, "k3", &sub);
+    if( d.dict != d.inline_dict || e == NULL ||
+        e->value.value.s < d.inline_str ||
+        e->value.value.s >= d.inline_str + DICT_INLINE_STRLEN ||
+        strcmp( e->value.value.s, "short") != 0){
+        printf("Entries not inline\n");
+        rc = -1;
+    }
+
+    /* the strings inline follow the dict_t */
+    dict_move( &d2, &d);
+    e = dict_search_entry( &d2, "k1", &sub);
+    if( d2.dict != d2.inline_dict || e == NULL ||
+        e->value.value.s < d2.inline_str ||
+        e->value.value.s >= d2.inline_str + DICT_INLINE_STRLEN ||
+        dict_num_entries( &d) != 0){
+        printf("Move failed\n");
+        rc = -1;
+    }
+
+    /* out of inline_str and out of the inline entries */
+    for( ; i < 3 * DICT_INLINE_ELEMS; i++){
+        snprintf( key, sizeof( key), "k%d", i);
+        rc |= dict_add_value( &d2, key, DICT_STRING,
+                              "a string a bit longer than the others", 0);
+    }
+    rc |= dict_update_entry( &d2, "k0", dict_value_new( DICT_STRING, "new", 0));
+    rc |= dict_remove_entry( &d2, "k1");
+
+    e = dict_search_entry( &d2, "k0", &sub);
+    if( d2.dict == d2.inline_dict || e == NULL ||
+        strcmp( e->value.value.s, "new") != 0 ||
+        dict_search_entry( &d2, "k2", &sub) == NULL ||
+        dict_search_entry( &d2, "k11", &sub) == NULL ||
+        dict_num_entries( &d2) != 3 * DICT_INLINE_ELEMS - 1){
+        printf("Growth out of the inline entries failed\n");
+        rc = -1;
+    }
+
+    dict_clean( &d2);
+    printf("dict inline: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
+
+/* append a record to buf, return its length */
+int view_put( unsigned char *buf, char *key, int type, void *data, int len){
+    kfs_slot_data_t *r = ( kfs_slot_data_t *) buf;
+
+    r->hash_k = dict_view_hash( key);
+    r->key_len = strlen( key);
+    r->value_type = type;
+    r->value_len = len;
+    r->rec_len = ( sizeof( kfs_slot_data_t) + r->key_len + 1 + len + 3) &
+                 ~3;
+    strcpy( r->kv_data, key);
+    memcpy( r->kv_data + r->key_len + 1, data, len);
+    return( r->rec_len);
+}
+
+
+/* records in a buffer, found and walked in place */
+int test_view(){
+    unsigned char buf[512];
+    dict_view_t v;
+    dict_view_iter_t it;
+    dict_view_entry_t e;
+    value_t value;
+    uint64_t ui = 1ULL << 40;
+    uint32_t len = 0;
+    int i, n, rc = 0;
+
+    memset( buf, 0, sizeof( buf));
+    for( i = 0; i < 10; i++){
+        char key[DICT_KEY_LEN];
+
+        snprintf( key, sizeof( key), "key_%d", i);
+        len += view_put( buf + len, key, DICT_INT, &i, sizeof( i));
+    }
+    len += view_put( buf + len, "size", DICT_UINT, &ui, sizeof( ui));
+    len += view_put( buf + len, "name", DICT_STRING, "kanek", 5);
+
+    /* the free space after the records ends the view */
+    dict_view_init( &v, buf, sizeof( buf));
+    if( dict_view_find( &v, "key_7", &e) != 0 ||
+        dict_view_value( &e, &value) != 0 || value.value.i != 7 ||
+        ( unsigned char *) e.ve_key < buf ||
+        ( unsigned char *) e.ve_key >= buf + len){
+        printf("Find of key_7 failed\n");
+        rc = -1;
+    }
+
+    if( dict_view_find( &v, "size", &e) != 0 ||
+        dict_view_value( &e, &value) != 0 || value.value.ui != ui ||
+        dict_view_find( &v, "name", &e) != 0 ||
+        dict_view_value( &e, &value) != 0 || value.data_len != 5 ||
+        strncmp( value.value.s, "kanek", 5) != 0 ||
+        dict_view_find( &v, "key_10", &e) != 1){
+        printf("Find failed\n");
+        rc = -1;
+    }
+
+    dict_view_iter_init( &v, &it);
+    for( n = 0; dict_view_next( &it, &e) == 1; n++);
+    if( n != 12){
+        printf("%d records walked\n", n);
+        rc = -1;
+    }
+
+    /* a record longer than the buffer */
+    (( kfs_slot_data_t *) ( buf + len))->rec_len = 600;
+    if( dict_view_find( &v, "nothing", &e) != -1){
+        printf("Broken record not found\n");
+        rc = -1;
+    }
+
+    printf("dict view: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
+
+/* a dict encoded in compact records, smaller than kfs_slot_data_t ones
+ * and read back by a view */
+int test_compact(){
+    unsigned char buf[512], old[512];
+    char *shared[] = { "owner", "mtime", "mime_type"};
+    dict_keys_t keys = { shared, 3};
+    dict_t d;
+    dict_view_t v;
+    dict_view_iter_t it;
+    dict_view_entry_t e;
+    value_t value;
+    uint64_t ui = 1700000000;
+    double f = 0.5;
+    char c = 1;
+    int i = -3, n, len, old_len = 0, rc = 0;
+
+    dict_init( &d);
+    dict_add_value( &d, "owner", DICT_INT, &i, 0);
+    dict_add_value( &d, "mtime", DICT_UINT, &ui, 0);
+    dict_add_value( &d, "mime_type", DICT_STRING, "text/plain", 0);
+    dict_add_value( &d, "ratio", DICT_FLOAT, &f, 0);
+    dict_add_value( &d, "hidden", DICT_BOOLEAN, &c, 0);
+    dict_add_value( &d, "title", DICT_STRING, "kanek", 0);
+
+    memset( buf, 0, sizeof( buf));
+    len = dict_encode_compact( &d, &keys, buf, sizeof( buf));
+    old_len += view_put( old + old_len, "owner", DICT_INT, &i, sizeof( i));
+    old_len += view_put( old + old_len, "mtime", DICT_UINT, &ui, sizeof( ui));
+    old_len += view_put( old + old_len, "mime_type", DICT_STRING,
+                         "text/plain", 10);
+    old_len += view_put( old + old_len, "ratio", DICT_FLOAT, &f, sizeof( f));
+    old_len += view_put( old + old_len, "hidden", DICT_BOOLEAN, &c, 1);
+    old_len += view_put( old + old_len, "title", DICT_STRING, "kanek", 5);
+    if( len <= 0 || len * 2 > old_len){
+        printf("Compact records of %d bytes, %d before\n", len, old_len);
+        rc = -1;
+    }
+
+    if( dict_encode_compact( &d, &keys, buf, len - 1) != -1){
+        printf("Encoded out of the buffer\n");
+        rc = -1;
+    }
+    memset( buf + len, 0, sizeof( buf) - len);
+
+    dict_view_init_compact( &v, buf, sizeof( buf), &keys);
+    if( dict_view_find( &v, "owner", &e) != 0 ||
+        dict_view_value( &e, &value) != 0 || value.value.i != -3 ||
+        dict_view_find( &v, "mtime", &e) != 0 ||
+        dict_view_value( &e, &value) != 0 || value.value.ui != ui ||
+        dict_view_find( &v, "ratio", &e) != 0 ||
+        dict_view_value( &e, &value) != 0 || value.value.f != f ||
+        dict_view_find( &v, "hidden", &e) != 0 ||
+        dict_view_value( &e, &value) != 0 || value.value.b != 1 ||
+        dict_view_find( &v, "title", &e) != 0 || e.ve_len != 5 ||
+        memcmp( e.ve_data, "kanek", 5) != 0 ||
+        dict_view_find( &v, "mime", &e) != 1){
+        printf("Find in compact records failed\n");
+        rc = -1;
+    }
+
+    dict_view_iter_init( &v, &it);
+    for( n = 0; dict_view_next( &it, &e) == 1; n++);
+    if( n != 6){
+        printf("%d compact records walked\n", n);
+        rc = -1;
+    }
+
+    /* the shared keys are needed to read them */
+    dict_view_init_compact( &v, buf, sizeof( buf), NULL);
+    if( dict_view_find( &v, "title", &e) != -1){
+        printf("Interned key read without the keys\n");
+        rc = -1;
+    }
+
+    /* a shared key with no room for its terminator is not taken */
+    shared[0] = "owner_of_the_object_with_32_char";
+    dict_view_init_compact( &v, buf, sizeof( buf), &keys);
+    if( dict_view_find( &v, "title", &e) != -1){
+        printf("Interned key of %d bytes read\n", DICT_KEY_LEN);
+        rc = -1;
+    }
+
+    dict_clean( &d);
+    printf("dict compact: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
+
+/* check the n keys of a dict loaded from slot records */
+int check_slot_dict( dict_t *d, int n, uint64_t ui){
+    dict_entry_t *e;
+    char key[DICT_KEY_LEN];
+    int i, sub;
+
+    if( dict_num_entries( d) != n + 2 ||
+        ( n + 2 <= DICT_INLINE_ELEMS) != ( d->dict == d->inline_dict) ||
+        ( n + 2 <= DICT_INLINE_ELEMS) != ( d->arena == NULL)){
+        printf("%u entries loaded, %d records\n", dict_num_entries( d), n + 2);
+        return( -1);
+    }
+
+    for( i = 0; i < n; i++){
+        snprintf( key, sizeof( key), "key_%d", i);
+        e = dict_search_entry( d, key, &sub);
+        if( e == NULL || e->value.data_type != DICT_INT ||
+            e->value.value.i != i){
+            printf("Load of %s failed\n", key);
+            return( -1);
+        }
+    }
+
+    e = dict_search_entry( d, "size", &sub);
+    if( e == NULL || e->value.value.ui != ui){
+        printf("Load of size failed\n");
+        return( -1);
+    }
+    e = dict_search_entry( d, "name", &sub);
+    if( e == NULL || e->value.data_type != DICT_STRING ||
+        strcmp( e->value.value.s, "kanek") != 0){
+        printf("Load of name failed\n");
+        return( -1);
+    }
+    return( 0);
+}
+
+
+/* slot records of both formats loaded into a dict, inline for a few
+ * records and in an arena for more */
+int test_slot_load(){
+    unsigned char buf[512];
+    char *shared[] = { "size", "name"};
+    dict_keys_t keys = { shared, 2};
+    dict_t d;
+    slot_t *slot;
+    uint64_t ui = 1ULL << 40;
+    uint32_t len;
+    int i, n, rc = 0;
+
+    for( n = 1; n <= 10; n += 9){
+        memset( buf, 0, sizeof( buf));
+        len = 0;
+        for( i = 0; i < n; i++){
+            char key[DICT_KEY_LEN];
+
+            snprintf( key, sizeof( key), "key_%d", i);
+            len += view_put( buf + len, key, DICT_INT, &i, sizeof( i));
+        }
+        len += view_put( buf + len, "size", DICT_UINT, &ui, sizeof( ui));
+        len += view_put( buf + len, "name", DICT_STRING, "kanek", 5);
+
+        if( kfs_slot_dict_load( buf, sizeof( buf), 0, NULL, &d) != 0 ||
+            check_slot_dict( &d, n, ui) != 0){
+            printf("Load of %d records failed\n", n + 2);
+            rc = -1;
+            continue;
+        }
+
+        /* the same dict back in compact records */
+        memset( buf, 0, sizeof( buf));
+        len = dict_encode_compact( &d, &keys, buf, sizeof( buf));
+        dict_clean( &d);
+
+        slot = calloc( 1, sizeof( slot_t));
+        slot->slot_flags = SLOT_COMPACT;
+        if( len <= 0 ||
+            kfs_slot_dict_load( buf, len, slot->slot_flags, &keys,
+                                &slot->slot_d) != 0 ||
+            check_slot_dict( &slot->slot_d, n, ui) != 0){
+            printf("Load of %d compact records failed\n", n + 2);
+            rc = -1;
+            free( slot);
+            continue;
+        }
+        rc |= slot_destroy( slot);
+    }
+
+    /* a broken record does not leave a dict behind */
+    len = view_put( buf, "key", DICT_INT, &i, sizeof( i));
+    (( kfs_slot_data_t *) buf)->rec_len = 600;
+    if( kfs_slot_dict_load( buf, sizeof( buf), 0, NULL, &d) != -1){
+        printf("Broken records loaded\n");
+        rc = -1;
+    }
+
+    printf("dict slot load: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
 
 
 int main(){
@@ -10,7 +555,7 @@ int main(){
     char c;
     char s[45];
 
-    d = dict_new();
+    dict_init( &d);
     dict_display( &d);
 
     i = -1;
@@ -54,6 +599,8 @@ int main(){
 
     dict_clean( &d);
     dict_display( &d);
-    return 0;
+
+    return( test_index() | test_sorted() | test_arena() | test_view() |
+            test_inline() | test_compact() | test_slot_load());
 }
 
@@ -5,6 +5,71 @@
 #include "dumphex.h"
 #include "gc.h"
 
+/* nodes of every class and a big one, freed, reused and released */
+int test_gc(){
+    gc_list_t gcl;
+    char *p[GC_CLASSES + 1], *q, *r;
+    int i, rc = 0;
+
+    gc_list_init( &gcl);
+    for( i = 0; i <= GC_CLASSES; i++){
+        p[i] = gc_malloc( &gcl, ( GC_MIN_CLASS_SIZE << i) - 1);
+        memset( p[i], 'a' + i, ( GC_MIN_CLASS_SIZE << i) - 1);
+    }
+
+    /* the last one is bigger than the classes */
+    if( gcl.large != 1 || gcl.arena == NULL ||
+        gcl.arena->ar_chunks_num != 1){
+        printf("Nodes out of their classes\n");
+        rc = -1;
+    }
+
+    /* a freed node is given again for its class */
+    q = p[2];
+    gc_free( &gcl, p[2]);
+    p[2] = gc_malloc( &gcl, GC_MIN_CLASS_SIZE * 3);
+    if( p[2] != q){
+        printf("Node of the class not reused\n");
+        rc = -1;
+    }
+
+    q = gc_strdup( &gcl, "hola");
+    r = gc_strncat( &gcl, q, " anita lava la tina");
+    if( strcmp( r, "hola anita lava la tina") != 0){
+        printf("gc_strncat failed, '%s'\n", r);
+        rc = -1;
+    }
+
+    q = gc_calloc( &gcl, 4, sizeof( int));
+    if( (( int *) q)[3] != 0){
+        printf("gc_calloc not clean\n");
+        rc = -1;
+    }
+
+    /* the marked nodes go away */
+    gc_mark( q);
+    gc_mark( p[GC_CLASSES]);
+    gc_sweep( &gcl);
+    if( gcl.large != 0 ||
+        gc_list_total_mem( &gcl) != strlen( r) + 1 +
+                                    ( GC_MIN_CLASS_SIZE * 3) +
+                                    ( GC_MIN_CLASS_SIZE << 1) - 1 +
+                                    ( GC_MIN_CLASS_SIZE << 0) - 1 +
+                                    ( GC_MIN_CLASS_SIZE << 3) - 1 +
+                                    ( GC_MIN_CLASS_SIZE << 4) - 1 +
+                                    ( GC_MIN_CLASS_SIZE << 5) - 1 +
+                                    ( GC_MIN_CLASS_SIZE << 6) - 1 +
+                                    ( GC_MIN_CLASS_SIZE << 7) - 1){
+        printf("Sweep failed, %lu bytes left\n", gc_list_total_mem( &gcl));
+        rc = -1;
+    }
+
+    gc_list_destroy( &gcl);
+    printf("gc: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
+
 int main(){
     gc_list_t gcl;
     char *p, *q;
@@ -24,15 +89,15 @@ int main(){
 
     printf("total=%ld\n", gc_list_total_mem( &gcl));
     gc_dump_list( &gcl);
-    gc_free( p);
+    gc_free( &gcl, p);
 
     gc_dump_list( &gcl);
-    gc_free( q);
+    gc_free( &gcl, q);
 
     gc_dump_list( &gcl);
     gc_list_destroy( &gcl);
 
-    return 0;
+    return test_gc();
 }
 
 
@@ -5,12 +5,107 @@
 #include "hash.h"
 
 
+/* the lookup table against the ranges, the batches against one by one */
+int test_hash(){
+    char buf[41], *words[41];
+    const void *in[41];
+    size_t len[41];
+    uint64_t h64[41], w64[41];
+    uint32_t h32[41];
+    int c, i, rc = 0;
+    char s[2];
+
+    s[1] = 0;
+    for( c = 1; c < 256; c++){
+        s[0] = ( char) c;
+        if( hash_b79( s) != ( uint64_t) ascii_2_mx79( c) * 79ULL * 79 * 79 *
+                              79 * 79 * 79 * 79 * 79 * 79){
+            printf("b79 code of 0x%02x is wrong\n", c);
+            rc = -1;
+        }
+    }
+
+    /* every length up to two stripes and a bit */
+    for( i = 0; i <= 40; i++){
+        buf[i] = 'a' + i % 26;
+    }
+    buf[40] = 0;
+    for( i = 0; i <= 40; i++){
+        in[i] = buf;
+        len[i] = i;
+        words[i] = buf + 40 - i;
+    }
+
+    xxh64_batch( in, len, 7, h64, 41);
+    xxh32_batch( in, len, 7, h32, 41);
+    hash_b79_batch( words, w64, 41);
+    for( i = 0; i <= 40; i++){
+        if( h64[i] != xxh64( buf, i, 7) || h32[i] != xxh32( buf, i, 7) ||
+            w64[i] != hash_b79( words[i])){
+            printf("Batch hash of %d bytes is wrong\n", i);
+            rc = -1;
+        }
+    }
+
+    printf("hash: %s\n", rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
+
+/* many inputs of mixed lengths, so the multi-lane path, taken when the
+ * CPU has AVX2, gets lanes of different lengths and leftovers. Every hash
+ * is checked against the scalar one */
+int test_hash_lanes(){
+    char buf[300], *words[199];
+    const void *in[199];
+    size_t len[199];
+    uint64_t h64[199], w64[199], seed;
+    uint32_t h32[199];
+    int i, n, rc = 0;
+
+    for( i = 0; i < 299; i++){
+        buf[i] = ( char) ( 1 + ( i * 37) % 255);
+    }
+    buf[299] = 0;
+
+    for( n = 1; n < 199; n += 13){
+        seed = ( uint64_t) n * 0x9e3779b97f4a7c15ULL;
+        for( i = 0; i < n; i++){
+            len[i] = ( i * 7 + n) % ( ( i % 5) ? 33 : 80);
+            in[i] = buf + i;
+            words[i] = buf + 299 - ( i * 3 + n) % 14;
+        }
+
+        xxh64_batch( in, len, seed, h64, n);
+        xxh32_batch( in, len, ( uint32_t) seed, h32, n);
+        hash_b79_batch( words, w64, n);
+        for( i = 0; i < n; i++){
+            if( h64[i] != xxh64( in[i], len[i], seed) ||
+                h32[i] != xxh32( in[i], len[i], ( uint32_t) seed) ||
+                w64[i] != hash_b79( words[i])){
+                printf("Hash %d of %d, %lu bytes, is wrong\n", i, n, 
+                       len[i]);
+                rc = -1;
+            }
+        }
+    }
+
+    printf("hash lanes, %s: %s\n", hash_batch_avx2() ? "avx2" : "scalar",
+           rc == 0 ? "PASSED" : "FAILED");
+    return( rc);
+}
+
+
 int main(){
     char s[1024];
     char *r;
     uint64_t h1, h2;
     uint32_t h3;
 
+    if( test_hash() != 0 || test_hash_lanes() != 0){
+        return( 1);
+    }
+
     do{
         memset( s, 0, 1020);
         r = fgets( s, 1020, stdin);
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "map.h"
+#include "map_summary.h"
 
 
 char *tests[]={
@@ -28,6 +29,8 @@ char *tests[]={
     "GrowExtent in Bitmap #2", 
     "GetBits in byte #1",
     "GetBits in Bitmap #1",
+    "FindGap and CountBits in big Bitmap #1",
+    "FindGap with Summary in big Bitmap #1",
 };
 
 
@@ -1249,6 +1252,130 @@ int main(){
     test_id++;
 
 
+    /*********************************************************************
+     * TEST #22
+     * Find gap and count bits in a big bitmap. It is mostly used, so the
+     * searches go over many full words, 256 bits at a time with AVX2
+     */
+    static unsigned char m_22[4096];
+    int e_22[16] = {  0, 1000,  0, 20000,  0, 30001,  0, 30001,
+                     -1,    0,  0, 20003,  0,   100,  0,  1000 };
+    int r_22[16];
+
+    if( verbose_mode == 1){
+        printf("Test #%d: %s\n", test_id, tests[test_id]);
+    }
+
+    memset( m_22, 0xff, sizeof( m_22));
+    bm_set_extent( m_22, 32768, 1000, 3, 0);
+    bm_set_extent( m_22, 32768, 20000, 10, 0);
+    bm_set_extent( m_22, 32768, 30001, 100, 0);
+
+    r_22[0] = bm_find( m_22, 32768, 0, 32768, 3, &addr[0]);
+    r_22[2] = bm_find( m_22, 32768, 0, 32768, 10, &addr[1]);
+    r_22[4] = bm_find( m_22, 32768, 0, 32768, 11, &addr[2]);
+    r_22[6] = bm_find( m_22, 32768, 7, 32000, 100, &addr[3]);
+    r_22[8] = bm_find( m_22, 32768, 0, 32768, 101, &addr[4]);
+    r_22[10] = bm_find( m_22, 32768, 20003, 64, 5, &addr[5]);
+    r_22[12] = bm_count( m_22, 32768, 30001, 200, 0, &count_result[0]);
+    r_22[14] = bm_count( m_22, 32768, 0, 2000, 1, &count_result[1]);
+
+    for( i = 0; i < 6; i++){
+        r_22[2*i+1] = (int) addr[i];
+    }
+    r_22[13] = (int) count_result[0];
+    r_22[15] = (int) count_result[1];
+
+    show_test_results( test_id, r_22, e_22, 16, 4);
+    test_id++;
+
+    /******************************************************************
+     * TEST #23
+     * Find gaps with the summary of a big bitmap, and compare with
+     * bm_find(). The map is randomly filled, then extents are set and
+     * cleared thru the summary to check it is kept updated.
+     */
+    static unsigned char m_23[262144];
+    uint64_t total_23 = sizeof( m_23) * 8, s23, c23, g23, a23, b23;
+    bm_summary_t *bms;
+    int e_23[6] = { 0, 0, 0, 1, 1, 0 };
+    int r_23[6] = { 0, 0, 0, 0, 0, 0 };
+    int rc_a, rc_b;
+
+    if( verbose_mode == 1){
+        printf("Test #%d: %s\n", test_id, tests[test_id]);
+    }
+
+    srand( 23);
+    memset( m_23, 0xff, sizeof( m_23));
+    for( i = 0; i < 3000; i++){
+        bm_set_extent( m_23, total_23, rand() % ( total_23 - 300), 
+                       1 + rand() % 256, 0);
+    }
+
+    bms = bm_summary_alloc( m_23, total_23);
+    for( i = 0; i < 20000; i++){
+        s23 = rand() % total_23;
+        c23 = 1 + rand() % ( total_23 - s23);
+        g23 = 1 + rand() % 300;
+        if( g23 > c23){
+            g23 = c23;
+        }
+
+        rc_a = bm_find( m_23, total_23, s23, c23, g23, &a23);
+        rc_b = bm_summary_find( bms, s23, c23, g23, &b23);
+        if( rc_a != rc_b || a23 != b23){
+            r_23[0]++;
+        }
+
+        /* the last gap, checked by brute force in short ranges */
+        if( i % 10 == 0){
+            c23 = min( c23, (uint64_t) 5000);
+            rc_a = -1;
+            a23 = 0;
+            for( b23 = s23 + c23 - g23 + 1; b23-- > s23; ){
+                bm_count( m_23, total_23, b23, g23, 0, &count_result[0]);
+                if( count_result[0] == g23){
+                    rc_a = 0;
+                    a23 = b23;
+                    break;
+                }
+            }
+
+            rc_b = bm_summary_find_last( bms, s23, c23, g23, &b23);
+            if( rc_a != rc_b || a23 != b23){
+                r_23[0]++;
+            }
+        }
+
+        /* take the gap found, and free something else */
+        if( i % 4 == 0 && rc_b == 0){
+            bm_summary_set_extent( bms, b23, g23, 1);
+            bm_summary_set_extent( bms, rand() % ( total_23 - 300), 
+                                   1 + rand() % 256, 0);
+        }
+    }
+
+    /* the counters should be the same than a full rebuild */
+    a23 = bm_summary_free_bits( bms);
+    b23 = bm_summary_max_gap( bms);
+    bm_summary_rebuild( bms);
+    r_23[1] = ( a23 != bm_summary_free_bits( bms));
+    r_23[2] = ( b23 != bm_summary_max_gap( bms));
+
+    /* fill everything, then a single free bit at the end */
+    bm_summary_set_extent( bms, 0, total_23, 1);
+    r_23[3] = ( bm_summary_find( bms, 0, total_23, 1, &a23) != 0);
+    bm_summary_set_bit( bms, total_23 - 1, 0);
+    r_23[4] = ( bm_summary_free_bits( bms) == 1);
+    r_23[5] = bm_summary_find( bms, 0, total_23, 1, &a23) + 
+              ( a23 != total_23 - 1);
+    bm_summary_free( bms);
+
+    show_test_results( test_id, r_23, e_23, 6, 4);
+    test_id++;
+
+
     /******************************************************************
      * GLOBAL RESULTS 
      */
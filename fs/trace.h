@@ -52,12 +52,14 @@ typedef struct{
                                           ##__VA_ARGS__); 
                                           
 
-#define TRACE( file, class, level, str, fmt, ...)   {                        \
-                                 if((level >= global_trace.level) &&         \
-                                    ( (class & global_trace.class) != 0)){   \
-                                        TRACE_STR( str, fmt, ##__VA_ARGS__); \
-			                            trace(file, fmt, ##__VA_ARGS__);     \
-                                    } \
+/* debug traces, only built with DEBUG */
+#ifdef DEBUG
+#define TRACE(fmt,...)           do{                                        \
+                                     TRACE_DBG( fmt, ##__VA_ARGS__);        \
+                                 }while( 0)
+#else
+#define TRACE(fmt,...)           do{ }while( 0)
+#endif
 
 int trace( FILE *file, char *string);
 #endif